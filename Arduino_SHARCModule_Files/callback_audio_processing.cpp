@@ -7,7 +7,15 @@
 
 #include <audio_processing/audio_effects_selector.h>
 #include <math.h>
-#include "midi_setup.h"
+#include <builtins.h>
+#include "drum_engine.h"
+#include "drum_midi_queue.h"
+#include "drum_sample_cache.h"
+#include "drum_profile.h"
+#include "drum_admission.h"
+#include "drum_shared_data.h"
+#include "drum_patch_snapshot.h"
+#include "drum_capture.h"
 
 // Define your audio system parameters in this file
 #include "common/audio_system_config.h"
@@ -193,39 +201,78 @@
  */
 
 
-struct Drums {
-	float tau;
-	float tauf;
-	float A;
-	float r; //end time
-	float TimePeak;
-	float t_r;
-	float A_t;
-	float I_t;
-	float fc;
-	float fm;
-	float I_0;
-	float DrumSynth;
-	float counter;
-	float dither;
-	float freqShift;
-}Kickdrum,SubKick,Snaredrum,Midtom,SubTom,Hightom,Hihat;
-
 //Global var
-Keyboard keys[5];	//an arr of 6, can synthesize up to 6 notes
-//var from midi messages
-float tempAudio;	//sum synthesized sound
-float tempAudio2;	//sum synthesized sound
-float tempAudio3;	//sum synthesized sound
-float tempAudio4;	//sum synthesized sound
-float tempAudio5;	//sum synthesized sound
+//MIDI events from midi_rx_callback_sharc1(), stamped with the sample clock at arrival
+DrumMidiQueue midiQueue;
+DrumMidiClock midiClock;
+
+//all of the drum synthesis lives in the hardware-independent engine (drum_engine.cpp); its voices
+//and models are read every sample, and at under 30 KB (drum_render --footprint) they stay in L1
+//next to the sine table
+#pragma section("seg_l1_block1")
+DrumEngine drumEngine;
+
+//knob and button targets worked out by the background loop and handed to the callback at a
+//block boundary, and the panic button's requests (drum_patch_snapshot.h)
+DrumPatchSnapshots drumPatchSnapshots;
+
+//cycles of every callback, per drum and per voice, published in DRUM_SHARED_DATA->profile[0]
+//(drum_profile.h) for the background loop, core 2 or the ARM
+#define DRUM_CYCLES_PER_BLOCK	((uint32_t)(DRUM_CORE_CLOCK_HZ*AUDIO_BLOCK_SIZE/AUDIO_SAMPLE_RATE))
+
+DrumSharedData *drumShared;
+DrumProfiler drumProfiler;
+
+//the background loop's latest consistent copy of the statistics, e.g. for the debugger
+DrumProfileStats drumProfileSnapshot;
+
+//keep the callback within its budget under heavy rolls, with the costs the profiler measures
+//(drum_admission.h)
+DrumAdmission drumAdmission;
+
+//mix pre-rendered one-shots instead of synthesizing every voice (drum_sample_cache.h)
+#define DRUM_USE_SAMPLE_CACHE	1
+
+//two sets of one-shots are ~850 KB, too big for L2, so they live in external memory
+#if DRUM_USE_SAMPLE_CACHE
+#pragma section("seg_sdram")
+DrumSampleCache drumCache;
+#endif
+
+//what was played and what came out (drum_capture.h): the MIDI interrupt and the callback add to
+//the capture, the background loop drains it into the dump, ~2 MB in external memory
+DrumCapture drumCapture;
+#pragma section("seg_sdram")
+DrumCaptureDump drumCaptureDump;
+
+#if AUDIO_BLOCK_SIZE > DRUM_CAPTURE_BLOCK_SIZE
+#error "a capture record holds DRUM_CAPTURE_BLOCK_SIZE samples: raise it to AUDIO_BLOCK_SIZE"
+#endif
+
+//ring the toms on their modal resonators (drum_modal.h) instead of their FM operators.  Off: the
+//fits only reach 9.5 to 13 dB SNR against the recordings, and a reduced floor tom 3.8 dB against
+//its full modes (drum_render --modalfit, --modal)
+#define DRUM_MODAL_TOMS			0
 
 
-// button default
+//core 1 renders every voice, also with USE_BOTH_CORES_TO_PROCESS_AUDIO: splitting them with core 2
+//(drum_dual_core.h) needs a core 2 callback, and the core 2 project is not part of this tree.  The
+//split is modelled on the host by drum_render --dual
+
+
+// button default; only the background loop reads and writes them, the callback gets them in a
+// DrumPatchSnapshot
 int type = 0;
 int type2 = 0;
 int type3 = 0;
 
+//the knobs and buttons as they are now
+static DrumControls drum_controls_now(void) {
+
+	DrumControls c = { multicore_data->audioproj_fin_pot_hadc0, multicore_data->audioproj_fin_pot_hadc1,
+			multicore_data->audioproj_fin_pot_hadc2, type, type2, type3, drumEngine.oversampling };
+	return c;
+}
 
 
 
@@ -239,19 +286,38 @@ void processaudio_setup(void) {
 	// *******************************************************************************
 
 	//initialize the synth
-	int i = 0;
-	for(i=0; i<=5; i++){
-		keys[i].reset();
+	midiQueue.reset();
+	midiClock.setup(AUDIO_SAMPLE_RATE);
+	drumCapture.reset();
+
+	drumEngine.setup(AUDIO_SAMPLE_RATE);
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		drumEngine.modal[d] = DRUM_MODAL_TOMS && drumPatches[d].modal >= 0;
 	}
 
-	//counter for keeping tract of time t
-	Kickdrum.counter = 0;
-	SubKick.counter = 0;
-	Snaredrum.counter = 0;
-	Midtom.counter = 0;
-	SubTom.counter = 0;
-	Hightom.counter = 0;
+	//the targets for the knobs and buttons as they are at power up; the first callback picks them up
+	drumPatchSnapshots.setup();
+	drumPatchSnapshots.publish(drumEngine, drum_controls_now());
+
+	drumShared = DRUM_SHARED_DATA;
+	drumProfiler.setup(&drumShared->profile[0], DRUM_CYCLES_PER_BLOCK);
+	drumEngine.profiler = &drumProfiler;
+	drumAdmission.setup(DRUM_CYCLES_PER_BLOCK, AUDIO_BLOCK_SIZE, AUDIO_SAMPLE_RATE);
+	drumEngine.admission = &drumAdmission;
+
+#if DRUM_USE_SAMPLE_CACHE
+	//render the first set of one-shots before the audio starts; falls back to synthesis if they do not fit
+	drumCache.setup(AUDIO_SAMPLE_RATE);
+	drumCache.setControls(multicore_data->audioproj_fin_pot_hadc0, multicore_data->audioproj_fin_pot_hadc1,
+			multicore_data->audioproj_fin_pot_hadc2, type, type2, type3);
+	drumCache.renderAll();
+	if(drumCache.enabled){
+		drumEngine.cache = &drumCache;
+	}
+#endif
 
+	//the dump says how the engine is set up, for the replay
+	drum_capture_dump_setup(drumCaptureDump, drumEngine, AUDIO_BLOCK_SIZE);
 }
 
 /*
@@ -297,364 +363,43 @@ void processaudio_callback(void) {
 
 	}*/
 
-	//knob to control fundamental frequencies for the drums
-	Kickdrum.freqShift = multicore_data->audioproj_fin_pot_hadc0+1;
-	Snaredrum.freqShift = multicore_data->audioproj_fin_pot_hadc1+1;
-	Midtom.freqShift = multicore_data->audioproj_fin_pot_hadc2+1;
-	Hightom.freqShift = multicore_data->audioproj_fin_pot_hadc2+1;
-
+	drumProfiler.beginCallback();
+	drumAdmission.measure(drumShared->profile[0], drumEngine);
 
+	//this block's capture record, which the engine renders into; NULL if the background loop has
+	//fallen behind
+	DrumCaptureBlock *capture = drumCapture.claimBlock();
 
-	// Otherwise, perform our C-based block processing here!
-	for (int i = 0; i < AUDIO_BLOCK_SIZE; i++) {
-
-		// *******************************************************************************
-		// Replace the pass-through code below with your custom audio processing code here
-		// *******************************************************************************
-
-		// Default: Pass audio just from 1/8" (or 1/4" on Audio Project Fin) inputs to outputs
-		tempAudio = 0;	//reset loop
-		tempAudio2 = 0;
-		tempAudio3 = 0;
-		tempAudio4 = 0;
-		tempAudio5 = 0;
-
-		for(int j=0; j<=5; j++){
-
-			//Kickdrum
-			if(keys[j].midiNote == 60){
-
-				//Kick Fundamental
-				Kickdrum.A = 0.999;
-				Kickdrum.r = 0.3;
-				Kickdrum.t_r = Kickdrum.counter/AUDIO_SAMPLE_RATE;
-				Kickdrum.TimePeak = 0.005;
-				Kickdrum.tau = 0.065;
-
-				//Get time envelope A_t
-				//Attack
-				if (Kickdrum.t_r <= Kickdrum.TimePeak){
-					Kickdrum.A_t = 199.826*Kickdrum.t_r;
-				}
-
-				//Decay
-				if ((Kickdrum.t_r > Kickdrum.TimePeak) && (Kickdrum.t_r <= Kickdrum.r)){
-					Kickdrum.A_t = Kickdrum.A*exp(-(Kickdrum.t_r-Kickdrum.TimePeak)/Kickdrum.tau);
-				}
-
-				//End of decay
-				if (Kickdrum.t_r > Kickdrum.r){
-					Kickdrum.A_t = 0;
-				}
-
-				//Get frequency envelope I_t
-				Kickdrum.I_t = -(1/70)*Kickdrum.t_r + 1;
-				Kickdrum.fc = 70*Kickdrum.freqShift;
-				Kickdrum.fm = 30*Kickdrum.freqShift;
-				Kickdrum.I_0 = 1.15+type3*2;
-
-				//FM synthesis sound
-				Kickdrum.DrumSynth = Kickdrum.A_t*sin(2*PI*Kickdrum.fc*Kickdrum.t_r + Kickdrum.I_0*Kickdrum.I_t*sin(2*PI*Kickdrum.fm*Kickdrum.t_r));
-
-				//Kick Percussion
-				SubKick.r = 0.03;
-				SubKick.t_r = SubKick.counter/AUDIO_SAMPLE_RATE;
-				SubKick.A_t = -(1/SubKick.r)*SubKick.t_r + 1;
-				SubKick.I_t = SubKick.A_t;
-				SubKick.fc = 200;
-				SubKick.fm = 350;
-				SubKick.I_0 = 5;
-
-				//FM synthesize the percussive sound; the percussive is shorter than the kick drum fundamental sound itself
-				if(Kickdrum.t_r <= SubKick.r){
-					SubKick.DrumSynth = SubKick.A_t*sin(2*PI*SubKick.fc*SubKick.t_r + SubKick.I_0*SubKick.I_t*sin(2*PI*SubKick.fm*SubKick.t_r));
-				}
-
-				else{
-					SubKick.DrumSynth = 0;
-				}
-
-				//keep looping over the counter as long as t < time length of the drum sound
-				if((Kickdrum.counter)<=14400){
-					tempAudio = 0.001*SubKick.DrumSynth+Kickdrum.DrumSynth;
-					Kickdrum.counter++; //increment time
-					SubKick.counter++;
-				}
-
-				//if hits the end of the time decay of the drum sound, check if user is still pressing on the key
-				//mute and reset if the key is released
-				if(Kickdrum.counter == 14401 && keys[j].playing == false){
-					tempAudio = 0;
-					keys[j].reset();
-				}
-
-				//keep looping if the user keep pressing on the key
-				if(Kickdrum.counter == 14401 && keys[j].playing == true){
-					Kickdrum.counter = 0;
-					Kickdrum.t_r = 0;
-					SubKick.counter = 0;
-					SubKick.t_r = 0;
-				}
-
-			}
-
-			//Snaredrum
-			if(keys[j].midiNote == 61){
-
-				//Snare Fundamental
-				Snaredrum.A = 0.999;
-				Snaredrum.r = 0.25;
-				Snaredrum.t_r = Snaredrum.counter/AUDIO_SAMPLE_RATE;
-				Snaredrum.TimePeak = 0.00152;
-				Snaredrum.tau = 0.04;
-
-				//Get time envelope A_t
-				if (Snaredrum.t_r <= Snaredrum.TimePeak){
-					Snaredrum.A_t = 657.237*Snaredrum.t_r;
-				}
-
-				if ((Snaredrum.t_r > Snaredrum.TimePeak) && (Snaredrum.t_r <= Snaredrum.r)){
-					Snaredrum.A_t = Snaredrum.A*exp(-(Snaredrum.t_r-Snaredrum.TimePeak)/Snaredrum.tau);
-				}
-
-				if (Snaredrum.t_r > Snaredrum.r){
-					Snaredrum.A_t = 0;
-				}
-
-				//Get frequency envelope I_t
-				Snaredrum.tauf = 0.03;
-				Snaredrum.I_t = exp(-Snaredrum.t_r/Snaredrum.tauf);
-				Snaredrum.fc = 80*Snaredrum.freqShift;
-				Snaredrum.fm = 85*Snaredrum.freqShift;
-				Snaredrum.I_0 = 1+type2*2;
-
-				//FM synthesis sound
-				Snaredrum.DrumSynth = Snaredrum.A_t*sin(2*PI*Snaredrum.fc*Snaredrum.t_r + Snaredrum.I_0*Snaredrum.I_t*sin(2*PI*Snaredrum.fm*Snaredrum.t_r));
-
-				//Snare sound made out of white noise
-				Snaredrum.dither = Snaredrum.A_t*(rand()%2-1)*0.035;
-
-				if((Snaredrum.counter)<=12000){
-					tempAudio2 = Snaredrum.DrumSynth+Snaredrum.dither;
-					Snaredrum.counter++;	//increment time
-				}
-
-				//time check
-				if(Snaredrum.counter == 12001 && keys[j].playing == false){
-					tempAudio2 = 0;
-					keys[j].reset();
-				}
-
-				if(Snaredrum.counter == 12001 && keys[j].playing == true){
-					Snaredrum.counter = 0;
-					Snaredrum.t_r = 0;
-				}
-
-			}
-
-			//Midtom
-			if(keys[j].midiNote == 62){
-
-				//Tom Fundamental
-				Midtom.A = 0.999;
-				Midtom.r = 0.4;
-				Midtom.t_r = Midtom.counter/AUDIO_SAMPLE_RATE;
-				Midtom.TimePeak = 0.00642;
-				Midtom.tau = 0.1;
-
-				//Get time envelope A_t
-				if (Midtom.t_r <= Midtom.TimePeak){
-					Midtom.A_t = 155.607*Midtom.t_r;
-				}
-
-				if ((Midtom.t_r > Midtom.TimePeak) && (Midtom.t_r <= Midtom.r)){
-					Midtom.A_t = Midtom.A*exp(-(Midtom.t_r-Midtom.TimePeak)/Midtom.tau);
-				}
-
-				if (Midtom.t_r > Midtom.r){
-					Midtom.A_t = 0;
-				}
-
-				//Get frequency envelope I_t
-				Midtom.tauf = 70;
-				Midtom.I_t = 18500*pow((Midtom.t_r+0.01),2)*exp(-Midtom.tauf*(Midtom.t_r+0.01));
-				Midtom.fc = 110*Midtom.freqShift;
-				Midtom.fm = 113*Midtom.freqShift;
-				Midtom.I_0 = 1.5+type*2;
-
-				//FM synthesis sound
-				Midtom.DrumSynth = Midtom.A_t*sin(2*PI*Midtom.fc*Midtom.t_r + Midtom.I_0*Midtom.I_t*sin(2*PI*Midtom.fm*Midtom.t_r));
-
-				//Tom Percussion
-				SubTom.r = 0.03;
-				SubTom.t_r = SubTom.counter/AUDIO_SAMPLE_RATE;
-				SubTom.A_t = -(1/SubTom.r)*SubTom.t_r + 1;
-				SubTom.I_t = SubTom.A_t;
-				SubTom.fc = 200;
-				SubTom.fm = 350;
-				SubTom.I_0 = 5;
-
-				if(Midtom.t_r <= SubTom.r){
-					SubTom.DrumSynth = SubTom.A_t*sin(2*PI*SubTom.fc*SubTom.t_r + SubTom.I_0*SubTom.I_t*sin(2*PI*SubTom.fm*SubTom.t_r));
-				}
-
-				else{
-					SubTom.DrumSynth = 0;
-				}
-
-				if((Midtom.counter)<=19200){
-					tempAudio3 = 0.005*SubTom.DrumSynth+Midtom.DrumSynth;
-					Midtom.counter++; //increment time
-					SubTom.counter++;
-				}
-
-
-				if(Midtom.counter == 19201 && keys[j].playing == false){
-					tempAudio3 = 0;
-					keys[j].reset();
-				}
-
-				if(Midtom.counter == 19201 && keys[j].playing == true){
-					Midtom.counter = 0;
-					Midtom.t_r = 0;
-					SubTom.counter = 0;
-					SubTom.t_r = 0;
-				}
-			}
-
-			//Hightom
-			if(keys[j].midiNote == 63){
-
-				//Hightom Fundamental
-				Hightom.A = 0.999;
-				Hightom.r = 0.4;
-				Hightom.t_r = Hightom.counter/AUDIO_SAMPLE_RATE;
-				Hightom.TimePeak = 0.0144;
-				Hightom.tau = 0.1;
-
-				//Get time envelope A_t
-				if (Hightom.t_r <= Hightom.TimePeak){
-					Hightom.A_t = 69.375*Hightom.t_r;
-				}
-
-				if ((Hightom.t_r > Hightom.TimePeak) && (Hightom.t_r <= Hightom.r)){
-					Hightom.A_t = Hightom.A*exp(-(Hightom.t_r-Hightom.TimePeak)/Hightom.tau);
-				}
-
-				if (Hightom.t_r > Hightom.r){
-					Hightom.A_t = 0;
-				}
-
-				//Get frequency envelope I_t
-				Hightom.tauf = 100;
-				Hightom.I_t = 18500*pow((Hightom.t_r+0.01),2)*exp(-Hightom.tauf*(Hightom.t_r+0.01));
-				Hightom.fc = 200*Hightom.freqShift;
-				Hightom.fm = 400*Hightom.freqShift;
-				Hightom.I_0 = 1.5+type*2;
-
-				//FM synthesis sound
-				Hightom.DrumSynth = Hightom.A_t*sin(2*PI*Hightom.fc*Hightom.t_r + Hightom.I_0*Hightom.I_t*sin(2*PI*Hightom.fm*Hightom.t_r));
-
-				//Tom Percussion
-				SubTom.r = 0.03;
-				SubTom.t_r = SubTom.counter/AUDIO_SAMPLE_RATE;
-				SubTom.A_t = -(1/SubTom.r)*SubTom.t_r + 1;
-				SubTom.I_t = SubTom.A_t;
-				SubTom.fc = 200;
-				SubTom.fm = 350;
-				SubTom.I_0 = 5;
-
-				if(Hightom.t_r <= SubTom.r){
-					SubTom.DrumSynth = SubTom.A_t*sin(2*PI*SubTom.fc*SubTom.t_r + SubTom.I_0*SubTom.I_t*sin(2*PI*SubTom.fm*SubTom.t_r));
-				}
-
-				else{
-					SubTom.DrumSynth = 0;
-				}
-
-				//time check
-				if((Hightom.counter)<=19200){
-					tempAudio4 = 0.005*SubTom.DrumSynth+Hightom.DrumSynth;
-					Hightom.counter++; //increment time
-					SubTom.counter++;
-				}
-
-
-				if(Hightom.counter == 19201 && keys[j].playing == false){
-					tempAudio4 = 0;
-					keys[j].reset();
-				}
-
-				if(Hightom.counter == 19201 && keys[j].playing == true){
-					Hightom.counter = 0;
-					Hightom.t_r = 0;
-					SubTom.counter = 0;
-					SubTom.t_r = 0;
-				}
-			}
-
-			//Hihat
-			if(keys[j].midiNote == 64){
-
-				//Hihat Fundamental Tone
-				Hihat.A = 1;
-				Hihat.r = 0.3;
-				Hihat.t_r = Hihat.counter/AUDIO_SAMPLE_RATE;
-				Hihat.TimePeak = 0.00122;
-				Hihat.tau = 0.045;
-
-				//Get time envelope A_t
-				if (Hihat.t_r <= Hihat.TimePeak){
-					Hihat.A_t = 819.672*Hihat.t_r;
-				}
-
-				if ((Hihat.t_r > Hihat.TimePeak) && (Hihat.t_r <= Hihat.r)){
-					Hihat.A_t = Hihat.A*exp(-(Hihat.t_r-Hihat.TimePeak)/Hihat.tau);
-				}
-
-				if (Hihat.t_r > Hihat.r){
-					Hihat.A_t = 0;
-				}
-
-				//Get frequency envelope I_t
-				Hihat.I_t = exp(-Hihat.t_r/0.2);
-				Hihat.fc = 350;
-				Hihat.fm = 2*Hihat.fc;
-				Hihat.I_0 = 20;
-
-				//FM synthesis sound
-				Hihat.DrumSynth = Hihat.A_t*sin(2*PI*Hihat.fc*Hihat.t_r + Hihat.I_0*Hihat.I_t*sin(2*PI*Hihat.fm*Hihat.t_r));
-
-				//Hihat sound from white noise
-				Hihat.dither = Hihat.A_t*(rand()%2-1)*0.2;
-
-				if((Hihat.counter)<=14400){
-					tempAudio5 = 0.15*Hihat.DrumSynth+Hihat.dither;
-					Hihat.counter++;	//increment time
-				}
-
-
-				if(Hihat.counter == 14401 && keys[j].playing == false){
-					tempAudio5 = 0;
-					keys[j].reset();
-				}
-
-				if(Hihat.counter == 14401 && keys[j].playing == true){
-					Hihat.counter = 0;
-					Hihat.t_r = 0;
-				}
-
-			}
-
-			//add up all sounds
-			audiochannel_0_left_out[i] = 2*tempAudio + 2*tempAudio2 + tempAudio3 + tempAudio4 + tempAudio5;
-			audiochannel_0_right_out[i] = 2*tempAudio + 2*tempAudio2 + tempAudio3 + tempAudio4 + tempAudio5;
+	//knobs to control the fundamental frequencies and buttons for the modulation index of the drums:
+	//the targets the background loop last published, the same for the whole block
+	drumEngine.snapshot = drumPatchSnapshots.acquire();
 
+	//start a new period of the sample clock; the events that arrived during the previous one are
+	//played at the same offset inside this block, one block of fixed latency and no jitter
+	uint32_t window = midiClock.periodStart();
+	midiClock.startPeriod(window + AUDIO_BLOCK_SIZE, emuclk());
 
+	//the panic button: All Sound Off at the start of the block
+	bool panic = drumPatchSnapshots.takePanic();
+	if(panic){
+		DrumMidiEvent panicEvent = { window, MIDI_CONTROL_CHANGE, MIDI_ALL_SOUND_OFF, 0 };
+		drumEngine.applyEvent(panicEvent);
+	}
+	if(capture != 0){
+		drum_capture_block_begin(*capture, drumEngine, panic);
+	}
 
-		}
+	//the output is sent from the capture record
+	float *drumOut = capture != 0 ? capture->audio : audiochannel_0_left_out;
+	drumEngine.renderQueued(midiQueue, window, drumOut, AUDIO_BLOCK_SIZE);
+	if(capture != 0){
+		drum_capture_block_end(*capture, drumEngine, window);
+	}
 
+	for (int i = 0; i < AUDIO_BLOCK_SIZE; i++) {
 
+		audiochannel_0_left_out[i] = drumOut[i];
+		audiochannel_0_right_out[i] = drumOut[i];
 
 		/* Below are some additional examples of how to receive audio from the various input buffers
 
@@ -722,6 +467,12 @@ void processaudio_callback(void) {
 #endif
 	}
 
+	//the record goes to the background loop with the cycles the callback took
+	uint32_t cycles = drumProfiler.endCallback();
+	if(capture != 0){
+		capture->cycles = cycles;
+		drumCapture.commitBlock();
+	}
 }
 
 #if (USE_BOTH_CORES_TO_PROCESS_AUDIO)
@@ -825,15 +576,26 @@ void processaudio_background_loop(void) {
 	if(multicore_data->audioproj_fin_sw_4_core1_pressed==true){
 		multicore_data->audioproj_fin_sw_4_core1_pressed = false;
 
-		for(int i=0; i<=5; i++){
-			keys[i].reset();
-			tempAudio = 0;
-			tempAudio2 = 0;
-			tempAudio3 = 0;
-			tempAudio4 = 0;
-			tempAudio5 = 0;
-		}
+		//silence every voice; the callback does it at its next block
+		drumPatchSnapshots.requestPanic();
 	}
+
+	//new targets when a knob or button moved, published at a block boundary; retried on the next
+	//pass if the callback has not picked up the last ones yet
+	drumPatchSnapshots.publish(drumEngine, drum_controls_now());
+
+	//a consistent copy of the callback statistics; the callback never waits for it
+	drum_profile_read(&drumShared->profile[0], drumProfileSnapshot);
+
+	//what the MIDI interrupt and the callback captured since the last pass, into the dump
+	drumCapture.drain(drumCaptureDump);
+
+#if DRUM_USE_SAMPLE_CACHE
+	//re-render the one-shots a slice per pass when a knob or button moved; published at a block boundary
+	drumCache.setControls(multicore_data->audioproj_fin_pot_hadc0, multicore_data->audioproj_fin_pot_hadc1,
+			multicore_data->audioproj_fin_pot_hadc2, type, type2, type3);
+	drumCache.renderStep(DRUM_CACHE_STEP);
+#endif
 }
 
 /*
@@ -841,4 +603,7 @@ void processaudio_background_loop(void) {
  * to complete (essentially exceeding the available computational resources of this core).
  */
 void processaudio_mips_overflow(void) {
+
+	//count it, and note when it happened and how many voices were sounding, in the statistics
+	drumProfiler.mipsOverflow(midiClock.periodStart(), drumEngine.pool.numActive);
 }
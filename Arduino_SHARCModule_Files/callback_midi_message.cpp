@@ -6,7 +6,11 @@
  */
 #include <stdint.h>
 #include <math.h>
+#include <builtins.h>
 #include "midi_setup.h"
+#include "drum_midi_queue.h"
+#include "drum_capture.h"
+#include "midi_parser.h"
 
 // Define your audio system parameters in this file
 #include "common/audio_system_config.h"
@@ -34,10 +38,20 @@ BM_UART midi_uart_sharc1;
  * @return true if successful
  */
 
-extern Keyboard keys[6];	//global var
+//events for the audio callback, and the sample clock to stamp them with
+extern DrumMidiQueue midiQueue;
+extern DrumMidiClock midiClock;
+
+//and what it queued, for the capture the background loop drains (drum_capture.h)
+extern DrumCapture drumCapture;
+
+//running status and partial messages carry over from one interrupt to the next
+static MidiParser midiParser;
 
 bool midi_setup_sharc1(void) {
 
+	midiParser.reset();
+
 	//tells SAM to look for MIDI sig
     if (uart_initialize(&midi_uart_sharc1, UART_BAUD_RATE_MIDI, UART_SERIAL_8N1, UART_AUDIOPROJ_DEVICE_MIDI)
         != UART_SUCCESS) {
@@ -55,100 +69,25 @@ bool midi_setup_sharc1(void) {
  */
 void midi_rx_callback_sharc1(void) {
 
-    uint8_t val;	//input byte for the midi
-
-    static uint32_t midi_state = 0;
-    static bool midi_note_start = false;
-    static bool midi_note_stop = false;
-    static uint32_t midi_note = 0;
-    static uint32_t midi_vol = 0;
+    uint8_t val = 0;	//input byte for the midi
+    DrumMidiEvent event;
 
-    // Keep reading bytes from MIDI FIFO until we have processed all of them
+    // Keep reading bytes from MIDI FIFO until we have processed all of them; the parser keeps its
+    // state between interrupts, so a message may be split across them
     while (uart_available(&midi_uart_sharc1)) {
 
-        // Replace the uart_read_byte() / uart_write_byte() functions below with any custom code
-        // This code just passes the received MIDI byte back to MIDI out
-
         // Read the new byte
         uart_read_byte(&midi_uart_sharc1, &val);	//read func
 
-        if(midi_state == 0){
-        	if(val == 0x80){
-        		midi_note_stop = true;
-        	}
-
-        	if(val == 0x90){
-        		midi_note_start = true;
+        //queue complete note on/offs (any channel) for the audio callback, stamped with the sample clock
+        if(midiParser.feed(val, event) && midi_is_note(event)){
+        	event.time = midiClock.now(emuclk());
+        	//counts an overflow if the callback has fallen behind
+        	if(midiQueue.push(event)){
+        		drumCapture.addEvent(event);
         	}
-
-        	midi_state = 1;	//tells SAM to look for the next byte
-        	return;	//return back to the start of While loop and test the 2nd byte; FIFO sequential for memory
         }
 
-        if(midi_state == 1){
-        	midi_note = val;
-        	midi_state = 2;
-        	return;
-        }
-
-        if(midi_state == 2){
-        	midi_vol = val;
-            midi_state = 0;	//have received all 3 bytes
-
-            //generate or stop sig output
-                  if(midi_note_start == true){
-                  	//variable to check if a note is found or not
-                  	bool found = false;
-                  	//variable to count through voices of filter object
-                  	int idx = 0;
-                  	do{
-                  		//if the voice is not currently playing
-                  		if(!keys[idx].playing){
-                  			keys[idx].playing = true;
-                  			//assign note value to voice, convert to freq value
-                  			keys[idx].midiNote = midi_note;
-                  			found = true;	//We've found this note
-                  		}
-
-                  		idx++; //update to the next potential note
-
-                  	}while(!found && idx<5);
-
-                  		midi_note_start = false;
-
-                  	return;
-                  }
-
-                  if(midi_note_stop){
-                	  bool found = false;
-                	  int idx = 0;
-
-                	  do{
-                		  //if the voice is not currently playing
-                		  if(keys[idx].playing && keys[idx].midiNote == midi_note){
-
-                			  keys[idx].playing = false;
-                			  found = true;	//We've found this note
-                		  }
-
-                		  idx++; //update to the next potential note
-                	  }while(!found && idx <5);
-
-                	  midi_note_stop = false;
-
-                	  return;
-                  }
-
-
-
-            return;	//back to the start of while loop; end of the testing for the 3rd byte
-        }
-
-
-
-
-
-
         // Write that byte back to MIDI TX
         //uart_write_byte(&midi_uart_sharc1, val);	//write func; we only need to read for this lab
     }
@@ -0,0 +1,118 @@
+/*
+ * drum_admission.cpp
+ *
+ * Room for a new voice within the CPU budget.  See drum_admission.h.
+ */
+
+#include <math.h>
+#include "drum_engine.h"
+#include "drum_admission.h"
+
+//predicted cycles per block of the voices of part newPart with a new voice of the drum
+float DrumEngine::admissionLoad(int drum, int newPart) {
+
+	DrumAdmission &adm = *admission;
+
+	float load = adm.cost(drum, false);
+	for(int a=0; a<pool.numActive; a++){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if((int)(v.serial % (unsigned)numParts) == newPart){
+			load += adm.cost(v.drum, v.reduced);
+		}
+	}
+	return load;
+}
+
+//true if the new voice of the drum fits, after reducing tails and stealing quiet voices if it
+//has to; false if the hit has to be refused.  The voices to reduce and steal are picked with the
+//same sums that decide the refusal, and only touched once the hit is admitted, so a refused hit
+//leaves every voice as it was
+bool DrumEngine::admitVoice(int drum) {
+
+	DrumAdmission &adm = *admission;
+
+	//the part the new voice will play on, and what its voices cost with the new one
+	int newPart = (int)(nextSerial % (unsigned)numParts);
+	float limit = adm.target();
+	float load = admissionLoad(drum, newPart);
+	if(load <= limit){
+		return true;
+	}
+
+	//per slot of the pool: picked to reduce, to steal
+	bool reduce[DRUM_MAX_VOICES] = { false };
+	bool steal[DRUM_MAX_VOICES] = { false };
+
+	//1. tails to reduced quality, oldest first
+	while(load > limit){
+		DrumVoice *oldest = 0;
+		for(int a=0; a<pool.numActive; a++){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			if((int)(v.serial % (unsigned)numParts) != newPart || v.reduced || reduce[pool.active[a]]
+					|| v.counter < tailStart[v.drum]){
+				continue;
+			}
+			if(oldest == 0 || nextSerial - v.serial > nextSerial - oldest->serial){
+				oldest = &v;
+			}
+		}
+		if(oldest == 0){
+			break;
+		}
+		reduce[oldest - pool.voices] = true;
+		load -= adm.cost(oldest->drum, false) - adm.cost(oldest->drum, true);
+	}
+
+	//2. the quietest voices, the oldest of equally quiet ones; the level comes from the counter,
+	//since a core only advances the envelopes of the voices it plays, worked out once per voice
+	float level[DRUM_MAX_VOICES];
+	if(load > limit){
+		for(int a=0; a<pool.numActive; a++){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			level[pool.active[a]] = fabsf(model[v.drum].amp.valueAt(v.counter));
+		}
+	}
+	while(load > limit){
+		DrumVoice *quietest = 0;
+		float quietestLevel = 0;
+		for(int a=0; a<pool.numActive; a++){
+			int slot = pool.active[a];
+			DrumVoice &v = pool.voices[slot];
+			if((int)(v.serial % (unsigned)numParts) != newPart || v.counter < adm.minAge || steal[slot]){
+				continue;
+			}
+			if(quietest == 0 || level[slot] < quietestLevel || (level[slot] == quietestLevel &&
+					nextSerial - v.serial > nextSerial - quietest->serial)){
+				quietest = &v;
+				quietestLevel = level[slot];
+			}
+		}
+		if(quietest == 0){
+			break;
+		}
+		int slot = (int)(quietest - pool.voices);
+		steal[slot] = true;
+		load -= adm.cost(quietest->drum, quietest->reduced || reduce[slot]);
+	}
+
+	//3. refuse the hit if even stealing every voice that may be stolen does not make room
+	if(load > limit){
+		adm.refused++;
+		return false;
+	}
+
+	for(int a=pool.numActive-1; a>=0; a--){
+		int slot = pool.active[a];
+		DrumVoice &v = pool.voices[slot];
+		if(steal[slot]){
+			pool.release(v);
+			adm.stolen++;
+		}
+		else if(reduce[slot]){
+			v.reduced = true;
+			syncOversampling(v);
+			adm.reduced++;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,143 @@
+/*
+ * drum_admission.h
+ *
+ * CPU budget aware voice admission.
+ *
+ * With a DrumAdmission attached, DrumEngine::noteOn() first predicts what the block will cost
+ * with the new voice: the cycles spent outside the voices plus, for every sounding voice, its
+ * drum's cost per voice and sample times the block size.  The costs are the DrumProfiler's
+ * measurements (drum_profile.h), taken in with measure() at the start of every callback.  Until
+ * anything has been measured a full pool is assumed to fit, and a drum that has not played yet
+ * is taken to cost as much as the dearest one that has.  The averages lean on long tails, while
+ * a roll is mostly fresh attacks, so measure() also compares each callback with what the costs
+ * predicted for the voices it played and scales the costs by the (averaged) ratio.  When the prediction is over the
+ * target (the budget less DRUM_ADMISSION_HEADROOM), the engine makes room, least audible first:
+ *
+ *   1. voices in their tail (past the attack and the sub operator) drop to reduced quality,
+ *      oldest first: the sines come from the nearest table entry instead of interpolating
+ *      (drum_sine_coarse(), within 3.1e-3) and the sub operator stays off;
+ *   2. the quietest voices older than DRUM_ADMISSION_MIN_AGE are stolen, as many as it takes;
+ *   3. if even that would not be enough, the hit is refused and nothing is reduced or stolen.
+ *
+ * With the voices split between cores (numParts > 1) only the voices of the part the new voice
+ * would play on count, so each core is kept within its own budget.  The decisions depend on
+ * nothing but the pool and the costs, so both cores make the same ones as long as core 2 uses
+ * core 1's costs, which drum_dual_core.h forwards with every block.
+ */
+
+#ifndef DRUM_ADMISSION_H_
+#define DRUM_ADMISSION_H_
+
+#include <stdint.h>
+#include "drum_engine.h"
+#include "drum_profile.h"
+
+//share of the budget kept free for what the prediction misses (stage changes, interrupts)
+#ifndef DRUM_ADMISSION_HEADROOM
+#define DRUM_ADMISSION_HEADROOM		0.2f
+#endif
+
+//voices younger than this (seconds) are never stolen, so a hit always gets its attack
+#define DRUM_ADMISSION_MIN_AGE		0.02f
+
+//cost of a reduced quality voice relative to a full one; `drum_render --admission` measures it
+#define DRUM_ADMISSION_REDUCED_COST	0.7f
+
+//callbacks the profiler averages over before its costs are used
+#define DRUM_ADMISSION_WARMUP		64
+
+//the correction of the costs follows roughly the last 1/DRUM_ADMISSION_CORRECTION callbacks
+//with voices, and stays within DRUM_ADMISSION_MAX_CORRECTION either way
+#define DRUM_ADMISSION_CORRECTION		(1.0f/16)
+#define DRUM_ADMISSION_MAX_CORRECTION	2.0f
+
+class DrumAdmission {
+
+	public:
+		float budget;			//cycles per block
+		int blockSize;
+		int minAge;				//DRUM_ADMISSION_MIN_AGE in samples
+
+		//cycles per sample of one full quality voice of each drum (corrected), and per block
+		//outside the voices
+		float voiceCost[DRUM_NUM_TYPES];
+		float overhead;
+
+		//measured over predicted cycles of the voices
+		float correction;
+
+		//what it had to do since setup()
+		volatile uint32_t reduced, stolen, refused;
+
+		void setup(float budgetCycles, int blockSize, float sampleRate) {
+
+			budget = budgetCycles;
+			this->blockSize = blockSize;
+			minAge = (int)(DRUM_ADMISSION_MIN_AGE*sampleRate);
+			overhead = 0;
+			correction = 1;
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				voiceCost[d] = target()/((float)DRUM_MAX_VOICES*blockSize);
+			}
+			reduced = 0;
+			stolen = 0;
+			refused = 0;
+		}
+
+		//take the costs the profiler measured, once it has averaged over enough callbacks; called
+		//at the start of a callback, before any event, so the engine's voices are the ones the
+		//last callback played
+		void measure(const DrumProfileStats &stats, const DrumEngine &engine) {
+
+			if(stats.callbacks < DRUM_ADMISSION_WARMUP){
+				return;
+			}
+
+			//what the last callback's voices took against what the costs put them at
+			float predicted = 0;
+			for(int a=0; a<engine.pool.numActive; a++){
+				const DrumVoice &v = engine.pool.voices[engine.pool.active[a]];
+				if(engine.owns(v)){
+					predicted += cost(v.drum, v.reduced);
+				}
+			}
+			float voices = (float)stats.last - stats.otherAverage;
+			if(predicted > 0 && stats.last <= 2*stats.budget){
+				float ratio = correction*voices/predicted;
+				if(ratio > DRUM_ADMISSION_MAX_CORRECTION){
+					ratio = DRUM_ADMISSION_MAX_CORRECTION;
+				}
+				if(ratio < 1/DRUM_ADMISSION_MAX_CORRECTION){
+					ratio = 1/DRUM_ADMISSION_MAX_CORRECTION;
+				}
+				correction += (ratio - correction)*DRUM_ADMISSION_CORRECTION;
+			}
+			float dearest = 0;
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				if(stats.drumVoiceSample[d] > dearest){
+					dearest = stats.drumVoiceSample[d];
+				}
+			}
+			if(dearest == 0){
+				return;
+			}
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				voiceCost[d] = correction*(stats.drumVoiceSample[d] > 0 ? stats.drumVoiceSample[d] : dearest);
+			}
+			overhead = stats.otherAverage;
+		}
+
+		//cycles per block the voices may take
+		inline float target() {
+
+			return budget*(1 - DRUM_ADMISSION_HEADROOM) - overhead;
+		}
+
+		//cycles per block of a voice
+		inline float cost(int drum, bool reducedQuality) {
+
+			return voiceCost[drum]*blockSize*(reducedQuality ? DRUM_ADMISSION_REDUCED_COST : 1.0f);
+		}
+};
+
+#endif /* DRUM_ADMISSION_H_ */
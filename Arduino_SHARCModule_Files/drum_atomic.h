@@ -0,0 +1,26 @@
+/*
+ * drum_atomic.h
+ *
+ * Memory ordering for data handed between the background loop (or the MIDI interrupt) and the
+ * audio callback.
+ *
+ * The writer fills in the data, calls DRUM_RELEASE_BARRIER() and then publishes it with a
+ * single aligned word store (a pointer or an index).  The reader loads that word, calls
+ * DRUM_ACQUIRE_BARRIER() and then reads the data.  Aligned 32 bit loads and stores are atomic
+ * on the SHARC and on x86/ARM hosts, so the barriers only have to stop the compiler (and a
+ * weakly ordered host CPU) from moving the data accesses across the publishing store.
+ */
+
+#ifndef DRUM_ATOMIC_H_
+#define DRUM_ATOMIC_H_
+
+#if defined(__GNUC__)
+#define DRUM_RELEASE_BARRIER()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define DRUM_ACQUIRE_BARRIER()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+//the SHARC core runs in order, so keeping the compiler from reordering is enough
+#define DRUM_RELEASE_BARRIER()	asm volatile("" : : : "memory")
+#define DRUM_ACQUIRE_BARRIER()	asm volatile("" : : : "memory")
+#endif
+
+#endif /* DRUM_ATOMIC_H_ */
@@ -0,0 +1,70 @@
+/*
+ * drum_capture.cpp
+ *
+ * Draining the capture rings into the dump.  See drum_capture.h.
+ */
+
+#include "drum_capture.h"
+
+void drum_capture_dump_setup(DrumCaptureDump &dump, const DrumEngine &engine, int blockSize) {
+
+	DrumCaptureHeader &h = dump.header;
+	h.magic = DRUM_CAPTURE_MAGIC;
+	h.version = DRUM_CAPTURE_VERSION;
+	h.headerBytes = sizeof(DrumCaptureHeader);
+	h.blockBytes = sizeof(DrumCaptureBlock);
+	h.eventBytes = sizeof(DrumCaptureEvent);
+	h.maxBlocks = DRUM_CAPTURE_DUMP_BLOCKS;
+	h.maxEvents = DRUM_CAPTURE_DUMP_EVENTS;
+
+	h.blockSize = blockSize;
+	h.sampleRate = engine.sampleRate;
+	h.loopOrder = engine.loopOrder;
+	h.smoothControls = engine.smoothControls;
+	h.oversampling = engine.oversampling;
+	h.numParts = engine.numParts;
+	h.part = engine.part;
+	h.modal = 0;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(engine.modal[d]){
+			h.modal |= 1u << d;
+		}
+	}
+	h.admissionBudget = engine.admission != 0 ? engine.admission->budget : 0;
+
+	h.blocks = 0;
+	h.events = 0;
+	h.blocksLost = 0;
+	h.eventsLost = 0;
+}
+
+int DrumCapture::drain(DrumCaptureDump &dump) {
+
+	DrumCaptureHeader &h = dump.header;
+
+	DrumMidiEvent event;
+	while(events.peek(event)){
+		DrumCaptureEvent &e = dump.events[h.events % DRUM_CAPTURE_DUMP_EVENTS];
+		e.time = event.time;
+		e.message = event.status | (uint32_t)event.data1 << 8 | (uint32_t)event.data2 << 16;
+		events.pop();
+		DRUM_RELEASE_BARRIER();
+		h.events = h.events + 1;
+	}
+	h.eventsLost = events.overflows;
+
+	//each record is copied out before its slot goes back to the callback
+	int moved = 0;
+	uint32_t t = tail;
+	while(t != head){
+		DRUM_ACQUIRE_BARRIER();
+		dump.blocks[h.blocks % DRUM_CAPTURE_DUMP_BLOCKS] = blocks[t & (DRUM_CAPTURE_RING_BLOCKS - 1)];
+		DRUM_RELEASE_BARRIER();
+		t++;
+		tail = t;
+		h.blocks = h.blocks + 1;
+		moved++;
+	}
+	h.blocksLost = blocksLost;
+	return moved;
+}
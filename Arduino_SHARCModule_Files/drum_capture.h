@@ -0,0 +1,193 @@
+/*
+ * drum_capture.h
+ *
+ * Always-on capture of what was played and what came out: the MIDI events and every block the
+ * audio callback rendered, with the cycles it took.
+ *
+ * Two rings, single producer / single consumer like DrumMidiQueue.  midi_rx_callback_sharc1()
+ * adds every event it queued for the callback with addEvent().  processaudio_callback() claims
+ * the next block record with claimBlock() before it renders, renders straight into the record's
+ * audio and sends the output from there, so the audio path copies nothing for the capture; it
+ * fills in the rest of the record around the render (drum_capture_block_begin() and _end()) and
+ * commits it with the cycles the callback took.  When the background loop has fallen behind, a
+ * full ring costs the producer a compare and a count and the block renders into the output as
+ * without a capture.  `drum_render --capture` measures what the capture adds to the interrupt,
+ * the callback and the background loop.
+ *
+ * processaudio_background_loop() moves both rings into a DrumCaptureDump with drain(): the last
+ * DRUM_CAPTURE_DUMP_BLOCKS blocks and DRUM_CAPTURE_DUMP_EVENTS events, the oldest overwritten
+ * first.  The dump is 32-bit words only, laid out as its header says, so its memory saved as it
+ * is (from the debugger, or copied out by the ARM) is a file `drum_render --replay` reads.  A
+ * reader running alongside the drain notes the counts in the header before and after it copies,
+ * and drops what the drain may have overwritten in between.
+ *
+ * A record holds everything the output depends on besides the events: the knobs, buttons and
+ * admission costs of the block (a DrumCoreBlock, as core 2 gets them), the controls of the cached
+ * one-shots it mixed, the panic, and the serial the next voice gets.  A replay starts at a block
+ * that began with no voice sounding and reproduces every block from there bit for bit on the
+ * same build of the engine; on the host, a dump from the SHARC replays with the same hits,
+ * controls and decisions, and samples within the two compilers' rounding.
+ */
+
+#ifndef DRUM_CAPTURE_H_
+#define DRUM_CAPTURE_H_
+
+#include <stdint.h>
+#include "drum_atomic.h"
+#include "drum_midi_queue.h"
+#include "drum_engine.h"
+#include "drum_sample_cache.h"
+#include "drum_dual_core.h"
+
+//samples a block record holds, at least AUDIO_BLOCK_SIZE
+#ifndef DRUM_CAPTURE_BLOCK_SIZE
+#define DRUM_CAPTURE_BLOCK_SIZE		32
+#endif
+
+//block records between the callback and the background loop; a power of two
+#ifndef DRUM_CAPTURE_RING_BLOCKS
+#define DRUM_CAPTURE_RING_BLOCKS	32
+#endif
+
+//history the dump keeps: 5.5 s of 32 sample blocks at 48 kHz, ~1.9 MB
+#ifndef DRUM_CAPTURE_DUMP_BLOCKS
+#define DRUM_CAPTURE_DUMP_BLOCKS	8192
+#endif
+#ifndef DRUM_CAPTURE_DUMP_EVENTS
+#define DRUM_CAPTURE_DUMP_EVENTS	4096
+#endif
+
+#define DRUM_CAPTURE_MAGIC			0x50414344	//"DCAP"
+#define DRUM_CAPTURE_VERSION		1
+
+//DrumCaptureBlock::flags
+#define DRUM_CAPTURE_IDLE			1	//no voice sounding when the block's events started
+#define DRUM_CAPTURE_PANIC			2	//All Sound Off at the block start
+#define DRUM_CAPTURE_CACHED			4	//mixed from the one-shots rendered for `cache`
+
+struct DrumCaptureBlock {
+	uint32_t sequence;			//callbacks since reset(); a gap is a lost record
+	uint32_t flags;
+	uint32_t nextSerial;		//serial of the next voice when the block's events started
+	uint32_t eventsLost;		//events lost to a full ring before the block
+	uint32_t cycles;			//the callback's, as drum_profile.h counts them
+	DrumCoreBlock controls;		//window, knobs, buttons and admission costs
+	DrumCacheControls cache;
+	float audio[DRUM_CAPTURE_BLOCK_SIZE];	//what the engine rendered
+};
+
+struct DrumCaptureEvent {
+	uint32_t time;				//sample clock at arrival
+	uint32_t message;			//status | data1 << 8 | data2 << 16
+};
+
+struct DrumCaptureHeader {
+	uint32_t magic;
+	uint32_t version;
+
+	//layout: the header, maxBlocks block records of blockBytes, then maxEvents events of eventBytes
+	uint32_t headerBytes, blockBytes, eventBytes;
+	uint32_t maxBlocks, maxEvents;
+
+	//the engine's setup
+	uint32_t blockSize;
+	float sampleRate;
+	int32_t loopOrder, smoothControls, oversampling;
+	int32_t numParts, part;
+	uint32_t modal;				//bit d for the drums on modal resonators
+	float admissionBudget;		//cycles per block, 0 without admission
+
+	//written by drain(): block n and event n are at n % maxBlocks and n % maxEvents while they are
+	//among the last maxBlocks and maxEvents
+	volatile uint32_t blocks, events;
+
+	//callbacks whose record was lost, and events lost, to a full ring
+	volatile uint32_t blocksLost, eventsLost;
+};
+
+struct DrumCaptureDump {
+	DrumCaptureHeader header;
+	DrumCaptureBlock blocks[DRUM_CAPTURE_DUMP_BLOCKS];
+	DrumCaptureEvent events[DRUM_CAPTURE_DUMP_EVENTS];
+};
+
+class DrumCapture {
+
+	public:
+		//events the interrupt queued for the callback, in arrival order; its overflows are the
+		//events lost
+		DrumMidiQueue events;
+
+		//callbacks whose record was lost because the ring was full
+		volatile uint32_t blocksLost;
+
+		void reset() {
+
+			events.reset();
+			blocksLost = 0;
+			head = 0;
+			tail = 0;
+			sequence = 0;
+		}
+
+		//MIDI interrupt: an event it queued for the callback
+		inline void addEvent(const DrumMidiEvent &event) {
+
+			events.push(event);
+		}
+
+		//audio callback, once per block before it renders: the block's record, NULL (and the block
+		//counted lost) if the background loop has fallen behind
+		inline DrumCaptureBlock *claimBlock() {
+
+			uint32_t h = head;
+			uint32_t s = sequence++;
+			if(h - tail >= DRUM_CAPTURE_RING_BLOCKS){
+				blocksLost++;
+				return 0;
+			}
+			DrumCaptureBlock *block = &blocks[h & (DRUM_CAPTURE_RING_BLOCKS - 1)];
+			block->sequence = s;
+			block->eventsLost = events.overflows;
+			return block;
+		}
+
+		//audio callback: the claimed record is complete
+		inline void commitBlock() {
+
+			DRUM_RELEASE_BARRIER();
+			head = head + 1;
+		}
+
+		//background loop: move the waiting events and records into the dump; returns the records moved
+		int drain(DrumCaptureDump &dump);
+
+	private:
+		DrumCaptureBlock blocks[DRUM_CAPTURE_RING_BLOCKS];
+		volatile uint32_t head;		//next record the callback claims
+		volatile uint32_t tail;		//next record the background loop drains
+		uint32_t sequence;
+};
+
+//start an empty dump of the engine, set up as it will play; blockSize at most DRUM_CAPTURE_BLOCK_SIZE
+void drum_capture_dump_setup(DrumCaptureDump &dump, const DrumEngine &engine, int blockSize);
+
+//audio callback, after the panic and before the block's events
+static inline void drum_capture_block_begin(DrumCaptureBlock &block, const DrumEngine &engine, bool panic) {
+
+	block.flags = (panic ? DRUM_CAPTURE_PANIC : 0) | (engine.pool.numActive == 0 ? DRUM_CAPTURE_IDLE : 0);
+	block.nextSerial = engine.nextVoiceSerial();
+}
+
+//audio callback, after the block is rendered
+static inline void drum_capture_block_end(DrumCaptureBlock &block, const DrumEngine &engine, uint32_t window) {
+
+	block.controls = drum_core_block_make(engine, window);
+	const DrumOneShots *shots = engine.cache != 0 ? engine.cache->acquired() : 0;
+	if(shots != 0){
+		block.flags |= DRUM_CAPTURE_CACHED;
+		block.cache = shots->controls;
+	}
+}
+
+#endif /* DRUM_CAPTURE_H_ */
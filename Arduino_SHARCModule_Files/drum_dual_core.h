@@ -0,0 +1,198 @@
+/*
+ * drum_dual_core.h
+ *
+ * Splitting the drum voices between SHARC core 1 and core 2, as drum_render --dual models it with
+ * two threads.  The firmware does not split them: that needs the core 2 callback below, and the
+ * core 2 project is not part of this tree, so core 1 renders every voice.
+ *
+ * Both cores run a DrumEngine with numParts = 2; voices alternate between them by trigger
+ * serial.  Core 1 owns the MIDI queue: it renders its share with renderQueued(), which forwards
+ * every event it applied, stamped with the sample it was applied at, into the DrumCoreLink in
+ * shared memory, and then adds a DrumCoreBlock with the window and the knob and button values
+ * of the block.  Core 2 replays each block with drum_core2_render(): the same events on the same
+ * samples with the same controls, so its voice pool stays identical to core 1's, while it
+ * renders the other share.
+ *
+ * Core 2's stem reaches core 1 through audiochannel_from_sharc_core2_* a fixed number of blocks
+ * later, so core 1 holds its own stem back as long in a DrumStemDelay and adds the two in
+ * processaudio_output_routing(), into the buffers it sends to the codec.
+ *
+ * On the board, core 1 would set up its engine with numParts = 2, part = 0 and reset a
+ * DrumCoreLink added to DrumSharedData (drum_shared_data.h); the core 2 project's processaudio_setup() would set up
+ * its engine with numParts = 2, part = 1 and the same modal[] as core 1, and its
+ * processaudio_callback() call drum_core2_render() into audiochannel_0_left_out/right_out.
+ */
+
+#ifndef DRUM_DUAL_CORE_H_
+#define DRUM_DUAL_CORE_H_
+
+#include <stdint.h>
+#include "drum_atomic.h"
+#include "drum_midi_queue.h"
+#include "drum_engine.h"
+#include "drum_admission.h"
+
+//block headers the link holds; a power of two
+#define DRUM_CORE_LINK_BLOCKS		8
+
+//longest delay DrumStemDelay can apply, in samples; a power of two
+#define DRUM_STEM_DELAY_SIZE		1024
+
+//what core 2 needs to replay one of core 1's blocks, besides its events
+struct DrumCoreBlock {
+	uint32_t window;		//sample clock at the start of the block
+	float pot0, pot1, pot2;
+	int type, type2, type3;
+
+	//core 1's admission costs (drum_admission.h), so both cores admit the same voices
+	float voiceCost[DRUM_NUM_TYPES];
+	float overhead;
+};
+
+//core 1 to core 2, both sides single producer / single consumer like DrumMidiQueue
+class DrumCoreLink {
+
+	public:
+		//events core 1 applied, stamped with the sample they were applied at
+		DrumMidiQueue events;
+
+		//blocks core 1 could not hand over because core 2 had fallen behind
+		volatile uint32_t overflows;
+
+		//callbacks on core 2 that found no block to render
+		volatile uint32_t underruns;
+
+		//window of the last block core 2 rendered
+		volatile uint32_t core2Window;
+
+		void reset() {
+
+			events.reset();
+			head = 0;
+			tail = 0;
+			overflows = 0;
+			underruns = 0;
+			core2Window = 0;
+		}
+
+		//core 1, after the block's events are in `events`
+		inline bool pushBlock(const DrumCoreBlock &block) {
+
+			uint32_t h = head;
+			if(h - tail >= DRUM_CORE_LINK_BLOCKS){
+				overflows++;
+				return false;
+			}
+			blocks[h & (DRUM_CORE_LINK_BLOCKS - 1)] = block;
+			DRUM_RELEASE_BARRIER();
+			head = h + 1;
+			return true;
+		}
+
+		//core 2: the oldest block, false if there is none
+		inline bool peekBlock(DrumCoreBlock &block) {
+
+			uint32_t t = tail;
+			if(head == t){
+				return false;
+			}
+			DRUM_ACQUIRE_BARRIER();
+			block = blocks[t & (DRUM_CORE_LINK_BLOCKS - 1)];
+			return true;
+		}
+
+		inline void popBlock() {
+
+			DRUM_RELEASE_BARRIER();
+			tail = tail + 1;
+		}
+
+	private:
+		DrumCoreBlock blocks[DRUM_CORE_LINK_BLOCKS];
+		volatile uint32_t head;
+		volatile uint32_t tail;
+};
+
+//core 1: the header of the block it just rendered
+static inline DrumCoreBlock drum_core_block_make(const DrumEngine &engine, uint32_t window) {
+
+	DrumCoreBlock block;
+	block.window = window;
+	block.pot0 = engine.pot0;
+	block.pot1 = engine.pot1;
+	block.pot2 = engine.pot2;
+	block.type = engine.type;
+	block.type2 = engine.type2;
+	block.type3 = engine.type3;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		block.voiceCost[d] = engine.admission != 0 ? engine.admission->voiceCost[d] : 0;
+	}
+	block.overhead = engine.admission != 0 ? engine.admission->overhead : 0;
+	return block;
+}
+
+static inline void drum_core_block_controls(DrumEngine &engine, const DrumCoreBlock &block) {
+
+	engine.pot0 = block.pot0;
+	engine.pot1 = block.pot1;
+	engine.pot2 = block.pot2;
+	engine.type = block.type;
+	engine.type2 = block.type2;
+	engine.type3 = block.type3;
+	if(engine.admission != 0){
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			engine.admission->voiceCost[d] = block.voiceCost[d];
+		}
+		engine.admission->overhead = block.overhead;
+	}
+}
+
+//core 2: render the oldest block core 1 handed over into out[]; silence and an underrun if there is none
+static inline bool drum_core2_render(DrumEngine &engine, DrumCoreLink &link, float *out, int numSamples) {
+
+	DrumCoreBlock block;
+	if(!link.peekBlock(block)){
+		for(int i=0; i<numSamples; i++){
+			out[i] = 0;
+		}
+		link.underruns++;
+		return false;
+	}
+	drum_core_block_controls(engine, block);
+	engine.renderQueued(link.events, block.window, out, numSamples);
+	link.core2Window = block.window;
+	link.popBlock();
+	return true;
+}
+
+//fixed delay for core 1's stem
+class DrumStemDelay {
+
+	public:
+		void setup(int delaySamples) {
+
+			delay = delaySamples < DRUM_STEM_DELAY_SIZE ? delaySamples : DRUM_STEM_DELAY_SIZE - 1;
+			pos = 0;
+			for(int i=0; i<DRUM_STEM_DELAY_SIZE; i++){
+				buffer[i] = 0;
+			}
+		}
+
+		//out[] gets in[] from delaySamples ago; in and out may be the same buffer
+		void process(const float *in, float *out, int numSamples) {
+
+			for(int i=0; i<numSamples; i++){
+				float x = in[i];
+				buffer[pos] = x;
+				out[i] = buffer[(pos - delay) & (DRUM_STEM_DELAY_SIZE - 1)];
+				pos = (pos + 1) & (DRUM_STEM_DELAY_SIZE - 1);
+			}
+		}
+
+	private:
+		float buffer[DRUM_STEM_DELAY_SIZE];
+		int delay;
+		int pos;
+};
+
+#endif /* DRUM_DUAL_CORE_H_ */
@@ -0,0 +1,909 @@
+/*
+ * drum_engine.cpp
+ *
+ * Hardware-independent FM drum synthesis engine.  See drum_engine.h.
+ */
+
+#include <math.h>
+#include "drum_engine.h"
+#include "drum_fm.h"
+#include "drum_sample_cache.h"
+#include "drum_profile.h"
+#include "drum_admission.h"
+
+int drum_type_from_note(int midiNote) {
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].note == midiNote){
+			return d;
+		}
+	}
+	return -1;
+}
+
+void DrumEngine::setup(float sampleRate) {
+
+	this->sampleRate = sampleRate;
+
+	pot0 = 0;
+	pot1 = 0;
+	pot2 = 0;
+
+	type = 0;
+	type2 = 0;
+	type3 = 0;
+
+	loopOrder = DRUM_VOICE_OUTER;
+	smoothControls = true;
+	oversampling = DRUM_OVERSAMPLE_AUTO;
+	snapshot = 0;
+	cache = 0;
+	numParts = 1;
+	part = 0;
+	profiler = 0;
+	admission = 0;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		modal[d] = false;
+	}
+
+	drum_fm_init();
+
+	//everything that only depends on the sample rate is computed once here; the knob and button
+	//dependent parts in workOutTargets()
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const DrumPatch &patch = drumPatches[d];
+		DrumModel &m = model[d];
+
+		//the drum plays until r, the sample at r included
+		drumLength[d] = (int)floor(patch.r*sampleRate + 1e-3) + 1;
+
+		m.amp.setupAttackDecay(sampleRate, patch.slope, patch.timePeak, patch.A, patch.tau, patch.r);
+		if(patch.stack >= 0){
+			m.stack.setup(drumStackPatches[patch.stack], sampleRate, patch.r);
+		}
+		else if(patch.indexKind == DRUM_LANE_INDEX_EXP){
+			m.index.setupExpDecay(sampleRate, patch.indexTau);
+		}
+		else if(patch.indexKind == DRUM_LANE_INDEX_GAMMA){
+			m.gammaIndex.setup(sampleRate, patch.gammaC, patch.gammaT0, patch.indexTau);
+		}
+
+		//the gamma index peaks at t + t0 = 2/k, or straight away if t0 is already past that
+		m.indexPeak = 1;
+		if(patch.stack < 0 && patch.indexKind == DRUM_LANE_INDEX_GAMMA){
+			float u = 2/patch.indexTau > patch.gammaT0 ? 2/patch.indexTau : patch.gammaT0;
+			m.indexPeak = patch.gammaC*u*u*expf(-patch.indexTau*u);
+		}
+
+		//the percussive sub operator only sounds for the first subR seconds of the drum
+		m.subLength = 0;
+		if(patch.hasSub){
+			m.subAmp.setupRampDown(sampleRate, 1, patch.subR);
+			m.subOp.setFrequencies(patch.subFc, patch.subFm, sampleRate);
+			m.subLength = (int)floor(patch.subR*sampleRate + 1e-3);
+		}
+
+		//the tail starts after the attack, and after the sub operator for the drums that have one
+		tailStart[d] = m.amp.stages[0].length;
+		if(patch.hasSub && tailStart[d] < m.subLength + 1){
+			tailStart[d] = m.subLength + 1;
+		}
+
+		noiseFilter[d].setup(patch.hasNoise ? patch.noiseColor : DRUM_NOISE_WHITE, sampleRate);
+		silentLength[d] = findSilentLength(d);
+
+		//the modal toms go quiet where their modes together do
+		modalSilentLength[d] = silentLength[d];
+		if(patch.modal >= 0){
+			m.modal.setup(drumModalPatches[patch.modal], sampleRate, patch.synthGain);
+			modalSilentLength[d] = m.modal.silentAfter(DRUM_SILENT_LEVEL, drumLength[d]);
+		}
+
+		//no knob is ever at -1: the first updateControls() takes every target
+		m.op.carrierInc = 0;
+		m.op.modInc = 0;
+		m.I_0 = 0;
+		m.freqShift = -1;
+		m.ramping = false;
+		m.oversample = false;
+	}
+
+	//no button is ever at -1 either: the first updateControls() works out its own targets
+	own.controls.type = -1;
+	applied = 0;
+
+	noteDelay = 0;
+	controlRamp = false;
+	reset();
+	updateControls(false);
+}
+
+//where the drum goes quiet for good: past the sub operator, every term of its mix below its share
+//of DRUM_SILENT_LEVEL.  A two operator drum is at most (synthGain + noiseGain*noise peak)*A_t;
+//a stack drum is at most the sum of its carriers' levels and its noise operator's
+int DrumEngine::findSilentLength(int drum) const {
+
+	const DrumPatch &patch = drumPatches[drum];
+	const DrumModel &m = model[drum];
+	int length = drumLength[drum];
+	int silent = patch.hasSub ? m.subLength + 1 : 0;
+
+	if(patch.stack < 0){
+		float weight = patch.synthGain + (patch.hasNoise ? patch.noiseGain*noiseFilter[drum].peak : 0);
+		int n = m.amp.silentAfter(DRUM_SILENT_LEVEL/weight, length);
+		return n > silent ? n : silent;
+	}
+
+	const DrumStackPatch &stack = drumStackPatches[patch.stack];
+	int numTerms = patch.hasNoise ? 1 : 0;
+	for(int k=0; k<stack.numOps; k++){
+		if(stack.op[k].gain != 0){
+			numTerms++;
+		}
+	}
+	float share = DRUM_SILENT_LEVEL/numTerms;
+	for(int k=0; k<stack.numOps; k++){
+		float weight = patch.synthGain*fabsf(stack.op[k].gain);
+		int n = weight != 0 ? m.stack.level[k].silentAfter(share/weight, length) : 0;
+		if(n > silent){
+			silent = n;
+		}
+	}
+	if(patch.hasNoise){
+		int n = m.stack.level[stack.noiseOp].silentAfter(share/(patch.noiseGain*noiseFilter[drum].peak), length);
+		if(n > silent){
+			silent = n;
+		}
+	}
+	return silent;
+}
+
+void DrumEngine::reset() {
+
+	pool.reset();
+	nextSerial = 0;
+}
+
+void DrumEngine::noteOn(int midiNote) {
+
+	int drum = drum_type_from_note(midiNote);
+	if(drum < 0){
+		return;
+	}
+	if(admission != 0 && !admitVoice(drum)){
+		return;
+	}
+
+	DrumVoice *voice = pool.allocate();
+
+	//all voices busy: restart the oldest one for the new hit
+	if(voice == 0){
+		voice = &pool.voices[pool.active[0]];
+		for(int a=1; a<pool.numActive; a++){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			if(nextSerial - v.serial > nextSerial - voice->serial){
+				voice = &v;
+			}
+		}
+	}
+
+	voice->drum = drum;
+	voice->note = midiNote;
+	voice->held = true;
+	voice->serial = nextSerial++;
+	voice->noise.seed(voice->serial);
+	startVoice(*voice);
+	voice->delay = noteDelay;
+}
+
+void DrumEngine::noteOff(int midiNote) {
+
+	DrumVoice *oldest = 0;
+	for(int a=0; a<pool.numActive; a++){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if(v.held && v.note == midiNote && (oldest == 0 || nextSerial - v.serial > nextSerial - oldest->serial)){
+			oldest = &v;
+		}
+	}
+	if(oldest != 0){
+		oldest->held = false;
+	}
+}
+
+void DrumEngine::applyEvent(const DrumMidiEvent &event) {
+
+	int type = event.status & 0xf0;
+	if(type == MIDI_NOTE_ON && event.data2 > 0){
+		noteOn(event.data1);
+	}
+	else if(type == MIDI_NOTE_ON || type == MIDI_NOTE_OFF){
+		noteOff(event.data1);
+	}
+	else if(type == MIDI_CONTROL_CHANGE && event.data1 == MIDI_ALL_SOUND_OFF){
+		reset();
+	}
+}
+
+//restart the voice at t = 0 on its drum's envelopes and operators; only the ones the drum uses
+//are started, the others may never have been set
+void DrumEngine::startVoice(DrumVoice &voice) {
+
+	const DrumPatch &patch = drumPatches[voice.drum];
+	const DrumModel &m = model[voice.drum];
+
+	voice.counter = 0;
+	voice.reduced = false;
+	voice.oversampled = false;
+	voice.modal = modal[voice.drum] && patch.modal >= 0;
+
+	if(voice.modal){
+		voice.bank.start(m.modal);
+		return;
+	}
+	if(patch.stack >= 0){
+		voice.stack.start(m.stack, true);
+		return;
+	}
+
+	DrumFmVoice &fm = voice.fm;
+	fm.amp.start(m.amp);
+	fm.op = m.op;
+	fm.op.start();
+	if(patch.indexKind == DRUM_LANE_INDEX_EXP){
+		fm.index.start(m.index);
+	}
+	else if(patch.indexKind == DRUM_LANE_INDEX_GAMMA){
+		fm.gammaIndex.start(m.gammaIndex);
+	}
+	if(patch.hasSub){
+		fm.subAmp.start(m.subAmp);
+		fm.subOp = m.subOp;
+		fm.subOp.start();
+	}
+	syncOversampling(voice);
+}
+
+//the operators of the drum that run at twice the rate, from its targets; true if any changed
+bool DrumEngine::takeOversampling(int drum, const DrumPatchTargets &t) {
+
+	const DrumPatch &patch = drumPatches[drum];
+	DrumModel &m = model[drum];
+
+	if(patch.stack >= 0){
+		bool changed = false;
+		for(int k=0; k<m.stack.numOps; k++){
+			changed = changed || m.stack.oversample[k] != t.oversample[k];
+			m.stack.oversample[k] = t.oversample[k];
+		}
+		return changed;
+	}
+	bool changed = m.oversample != t.oversample[0];
+	m.oversample = t.oversample[0];
+	return changed;
+}
+
+//switch the voice's operators over to twice the rate or back, following its model; a voice at
+//reduced quality stays at the sample rate, and the modal resonators always do
+void DrumEngine::syncOversampling(DrumVoice &voice) {
+
+	const DrumPatch &patch = drumPatches[voice.drum];
+	const DrumModel &m = model[voice.drum];
+
+	if(voice.modal){
+		return;
+	}
+	if(patch.stack >= 0){
+		voice.stack.setOversampling(m.stack, !voice.reduced);
+		return;
+	}
+	bool on = m.oversample && !voice.reduced;
+	if(on == voice.oversampled){
+		return;
+	}
+	if(on){
+		//the decimator is filled at the index the voice is at
+		float I_t = m.I_0;
+		if(patch.indexKind == DRUM_LANE_INDEX_EXP){
+			I_t *= voice.fm.index.value;
+		}
+		else if(patch.indexKind == DRUM_LANE_INDEX_GAMMA){
+			I_t *= voice.fm.gammaIndex.square*voice.fm.gammaIndex.decay;
+		}
+		voice.fm.op.startOversampling(I_t, voice.fm.halfband);
+	}
+	else{
+		voice.fm.op.stopOversampling();
+	}
+	voice.oversampled = on;
+}
+
+void DrumEngine::workOutTargets(const DrumControls &c, DrumPatchSnapshot &s) const {
+
+	const float pots[] = { c.pot0, c.pot1, c.pot2 };
+	const int buttons[] = { c.type, c.type2, c.type3 };
+
+	s.controls = c;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const DrumPatch &patch = drumPatches[d];
+		const DrumModel &m = model[d];
+		DrumPatchTargets &t = s.drum[d];
+
+		//knob to control the fundamental frequencies, modulation index from the tone buttons
+		t.freqShift = patch.knob != DRUM_KNOB_NONE ? pots[patch.knob] + 1 : 1;
+		t.I_0 = patch.index0;
+		if(patch.button != DRUM_BUTTON_NONE){
+			t.I_0 += patch.indexStep*buttons[patch.button];
+		}
+
+		//the phase increments, and the operators that fold back too much at them
+		if(patch.stack >= 0){
+			const DrumStackPatch &stack = drumStackPatches[patch.stack];
+			for(int k=0; k<m.stack.numOps; k++){
+				t.inc[k] = drum_phase_increment(stack.op[k].freq*t.freqShift, sampleRate);
+			}
+			m.stack.findOversampling(stack, t.freqShift, sampleRate, c.oversampling, t.oversample);
+		}
+		else{
+			t.inc[0] = drum_phase_increment(patch.fc*t.freqShift, sampleRate);
+			t.inc[1] = drum_phase_increment(patch.fm*t.freqShift, sampleRate);
+			float folded = drum_fm_folded(patch.fc*t.freqShift, patch.fm*t.freqShift, t.I_0*m.indexPeak, sampleRate);
+			t.oversample[0] = c.oversampling == DRUM_OVERSAMPLE_ALL ||
+					(c.oversampling == DRUM_OVERSAMPLE_AUTO && folded > DRUM_OVERSAMPLE_MIN_FOLDED);
+		}
+
+		//the modal resonators retuned
+		if(patch.modal >= 0){
+			m.modal.findPoles(drumModalPatches[patch.modal], t.freqShift, sampleRate, t.poleRe, t.poleIm);
+		}
+	}
+}
+
+//control rate, once per block: the targets of the snapshot, or of pot0..type3, for the drums
+//whose targets moved since the last block, ramped to over the block if `ramp`, set straight away
+//otherwise.  The same snapshot as last block costs a comparison.  Returns true if any drum ramps
+bool DrumEngine::updateControls(bool ramp) {
+
+	const DrumPatchSnapshot *s = snapshot;
+	if(s != 0){
+		pot0 = s->controls.pot0;
+		pot1 = s->controls.pot1;
+		pot2 = s->controls.pot2;
+		type = s->controls.type;
+		type2 = s->controls.type2;
+		type3 = s->controls.type3;
+	}
+	else{
+		DrumControls c = { pot0, pot1, pot2, type, type2, type3, oversampling };
+		if(c.differs(own.controls)){
+			workOutTargets(c, own);
+			applied = 0;
+		}
+		s = &own;
+	}
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		model[d].ramping = false;
+	}
+	if(s == applied){
+		return false;
+	}
+	applied = s;
+
+	bool changed = false, any = false;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const DrumPatch &patch = drumPatches[d];
+		DrumModel &m = model[d];
+		const DrumPatchTargets &t = s->drum[d];
+
+		//a new oversampling mode alone only changes which operators oversample
+		if(t.freqShift == m.freqShift && t.I_0 == m.I_0To){
+			changed = takeOversampling(d, t) || changed;
+			continue;
+		}
+
+		//the ramp starts from where the last one ended, the current increments go to the targets
+		int numIncs = patch.stack >= 0 ? m.stack.numOps : 2;
+		if(patch.stack >= 0){
+			for(int k=0; k<numIncs; k++){
+				m.incFrom[k] = m.stack.inc[k];
+				m.stack.inc[k] = t.inc[k];
+			}
+		}
+		else{
+			m.incFrom[0] = m.op.carrierInc;
+			m.incFrom[1] = m.op.modInc;
+			m.op.carrierInc = t.inc[0];
+			m.op.modInc = t.inc[1];
+		}
+		for(int k=0; k<numIncs; k++){
+			m.incTo[k] = t.inc[k];
+		}
+		if(patch.modal >= 0){
+			for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+				m.poleReFrom[k] = m.modal.poleRe[k];
+				m.poleImFrom[k] = m.modal.poleIm[k];
+				m.modal.poleRe[k] = m.poleReTo[k] = t.poleRe[k];
+				m.modal.poleIm[k] = m.poleImTo[k] = t.poleIm[k];
+			}
+		}
+		m.I_0From = m.I_0;
+		m.I_0To = t.I_0;
+
+		//setup() has no ramp to start from
+		m.ramping = ramp && m.freqShift >= 0;
+		m.freqShift = t.freqShift;
+		if(!m.ramping){
+			m.I_0 = t.I_0;
+		}
+		takeOversampling(d, t);
+		changed = true;
+		any = any || m.ramping;
+	}
+
+	//the sounding voices pick up the new phase increments (the stack and modal voices read them from
+	//their model) and oversampling
+	if(changed){
+		for(int a=0; a<pool.numActive; a++){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			if(drumPatches[v.drum].stack < 0 && !v.modal){
+				v.fm.op.carrierInc = model[v.drum].op.carrierInc;
+				v.fm.op.modInc = model[v.drum].op.modInc;
+			}
+			syncOversampling(v);
+		}
+	}
+	return any;
+}
+
+//the coefficients of the ramping drums `frac` of the way along their ramp, landing exactly on
+//the targets at 1
+void DrumEngine::applyControls(float frac) {
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		DrumModel &m = model[d];
+		if(!m.ramping){
+			continue;
+		}
+
+		bool stack = drumPatches[d].stack >= 0;
+		int numIncs = stack ? m.stack.numOps : 2;
+		for(int k=0; k<numIncs; k++){
+			uint32_t inc = m.incTo[k];
+			if(frac < 1){
+				inc = m.incFrom[k] + (uint32_t)(int32_t)(frac*(float)(int32_t)(m.incTo[k] - m.incFrom[k]));
+			}
+			if(stack){
+				m.stack.inc[k] = inc;
+			}
+			else if(k == 0){
+				m.op.carrierInc = inc;
+			}
+			else{
+				m.op.modInc = inc;
+			}
+		}
+		m.I_0 = frac < 1 ? m.I_0From + frac*(m.I_0To - m.I_0From) : m.I_0To;
+
+		if(drumPatches[d].modal >= 0){
+			for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+				m.modal.poleRe[k] = frac < 1 ? m.poleReFrom[k] + frac*(m.poleReTo[k] - m.poleReFrom[k]) : m.poleReTo[k];
+				m.modal.poleIm[k] = frac < 1 ? m.poleImFrom[k] + frac*(m.poleImTo[k] - m.poleImFrom[k]) : m.poleImTo[k];
+			}
+		}
+	}
+
+	for(int a=0; a<pool.numActive; a++){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if(model[v.drum].ramping && drumPatches[v.drum].stack < 0 && !v.modal){
+			v.fm.op.carrierInc = model[v.drum].op.carrierInc;
+			v.fm.op.modInc = model[v.drum].op.modInc;
+		}
+	}
+}
+
+void DrumEngine::render(float *out, int numSamples) {
+
+	renderSpan(out, numSamples, 0, numSamples);
+}
+
+//samples blockPos..blockPos + numSamples of a block of blockLength; the controls are taken at the
+//block start, and a ramp runs over the whole block however renderQueued() splits it
+void DrumEngine::renderSpan(float *out, int numSamples, int blockPos, int blockLength) {
+
+	const DrumOneShots *shots = cache != 0 ? cache->acquire() : 0;
+	skipOtherVoices(shots != 0 ? shots->length : drumLength, numSamples);
+
+	//nothing sounding: silence, without going through the renderers; the knobs are followed
+	//without a ramp, there is nothing to hear it on, and a ramp the block started lands on its
+	//targets
+	if(pool.numActive == 0){
+		if(blockPos == 0){
+			updateControls(false);
+		}
+		else if(controlRamp){
+			applyControls(1);
+		}
+		controlRamp = false;
+		for(int i=0; i<numSamples; i++){
+			out[i] = 0;
+		}
+		return;
+	}
+	if(blockPos == 0){
+		controlRamp = updateControls(smoothControls);
+	}
+
+	//nothing moved (the usual case), or no smoothing: the span in one go; otherwise a knob or
+	//button moved: ramp to it in steps of DRUM_CONTROL_PERIOD samples from the block start,
+	//landing on the targets with the block's last one
+	if(!controlRamp){
+		renderBlock(shots, out, numSamples);
+	}
+	else{
+		int end = blockPos + numSamples;
+		for(int pos=blockPos; pos<end; ){
+			int stepEnd = (pos/DRUM_CONTROL_PERIOD + 1)*DRUM_CONTROL_PERIOD;
+			if(stepEnd > blockLength){
+				stepEnd = blockLength;
+			}
+			int n = (stepEnd < end ? stepEnd : end) - pos;
+			applyControls((float)stepEnd/blockLength);
+			renderBlock(shots, &out[pos - blockPos], n);
+			pos += n;
+		}
+	}
+
+	retireSilentVoices();
+}
+
+void DrumEngine::renderBlock(const DrumOneShots *shots, float *out, int numSamples) {
+
+	if(shots != 0){
+		renderCached(*shots, out, numSamples);
+	}
+	else if(loopOrder == DRUM_SAMPLE_OUTER){
+		renderSampleOuter(out, numSamples);
+	}
+	else{
+		renderVoiceOuter(out, numSamples);
+	}
+}
+
+void DrumEngine::renderQueued(DrumMidiQueue &queue, uint32_t windowStart, float *out, int numSamples,
+		DrumMidiQueue *forward) {
+
+	//a hit starts its voice `offset - pos` samples into the next render, so it sounds from its exact
+	//sample; the render only stops at the events that need the voices as they are at their offset
+	int pos = 0;
+	DrumMidiEvent event;
+	while(queue.peek(event)){
+		int32_t offset = (int32_t)(event.time - windowStart);
+		if(offset >= numSamples){
+			break;
+		}
+		if(offset < pos){
+			offset = pos;
+		}
+		if(offset > pos && waitsForVoices(event, offset - pos)){
+			renderSpan(&out[pos], offset - pos, pos, numSamples);
+			pos = offset;
+		}
+		noteDelay = offset - pos;
+		applyEvent(event);
+		noteDelay = 0;
+		queue.pop();
+		if(forward != 0){
+			event.time = windowStart + offset;
+			forward->push(event);
+		}
+	}
+	if(pos < numSamples){
+		renderSpan(&out[pos], numSamples - pos, pos, numSamples);
+	}
+}
+
+//true if the event, `samples` into the next render, has to wait for the voices to be rendered up
+//to it: All Sound Off; a hit that takes a sounding voice, or that the admission makes room for;
+//the release of a held voice that reaches the end of its drum before it, and loops only if held
+bool DrumEngine::waitsForVoices(const DrumMidiEvent &event, int samples) {
+
+	int type = event.status & 0xf0;
+	if(type == MIDI_NOTE_ON && event.data2 > 0){
+		int drum = drum_type_from_note(event.data1);
+		if(drum < 0){
+			return false;
+		}
+		if(pool.numActive == DRUM_MAX_VOICES){
+			return true;
+		}
+		return admission != 0 && admissionLoad(drum, (int)(nextSerial % (unsigned)numParts)) > admission->target();
+	}
+	if(type == MIDI_NOTE_ON || type == MIDI_NOTE_OFF){
+		for(int a=0; a<pool.numActive; a++){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			if(v.held && v.note == event.data1 && v.delay + drumLength[v.drum] - v.counter <= samples){
+				return true;
+			}
+		}
+		return false;
+	}
+	return type == MIDI_CONTROL_CHANGE && event.data1 == MIDI_ALL_SOUND_OFF;
+}
+
+//advance the voices another engine renders by numSamples, ending and looping them on the same
+//sample as their owner does, so the pools of all the parts stay the same
+void DrumEngine::skipOtherVoices(const int *length, int numSamples) {
+
+	if(numParts == 1){
+		return;
+	}
+	for(int a=pool.numActive-1; a>=0; a--){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if(owns(v)){
+			continue;
+		}
+		//held voices loop, the others end; a hit on a delay starts within the samples or after them
+		int skip = v.delay < numSamples ? v.delay : numSamples;
+		v.delay -= skip;
+		int counter = v.counter + numSamples - skip;
+		if(counter >= length[v.drum] && !v.held){
+			pool.release(v);
+			continue;
+		}
+		v.counter = counter % length[v.drum];
+	}
+}
+
+//end the unheld voices that have gone quiet; every part of a split engine sees the same counters,
+//so their pools stay the same
+void DrumEngine::retireSilentVoices() {
+
+	for(int a=pool.numActive-1; a>=0; a--){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		int silent = v.modal ? modalSilentLength[v.drum] : silentLength[v.drum];
+		if(!v.held && v.counter >= silent){
+			pool.release(v);
+		}
+	}
+}
+
+void DrumEngine::renderSampleOuter(float *out, int numSamples) {
+
+	for (int i = 0; i < numSamples; i++) {
+
+		float mix = 0;
+
+		//walk the active list backwards so a voice that ends can be swapped out in place
+		for(int a=pool.numActive-1; a>=0; a--){
+			DrumVoice &v = pool.voices[pool.active[a]];
+			if(!owns(v)){
+				continue;
+			}
+			if(v.delay > 0){
+				v.delay--;
+				continue;
+			}
+
+			mix += renderVoice(v);
+
+			//end of the drum sound: loop if the key is still held, otherwise free the voice
+			if(++v.counter == drumLength[v.drum]){
+				if(v.held){
+					startVoice(v);
+				}
+				else{
+					pool.release(v);
+				}
+			}
+		}
+
+		out[i] = mix;
+	}
+}
+
+//one sample of a voice, already weighted for the mix
+float DrumEngine::renderVoice(DrumVoice &v) {
+
+	float noiseWeight;
+	float y = renderVoiceTone(v, noiseWeight);
+
+	//noise of the snare and hihat, drawn every sample so the voice-outer render gets the same sequence
+	if(drumPatches[v.drum].hasNoise){
+		y += noiseWeight*v.noise.next(noiseFilter[v.drum]);
+	}
+	return y;
+}
+
+//one sample of a voice of drum MODEL without its noise term, and the weight of the noise; the
+//patch is a constant here, so its weights fold and the parts it does not use drop out
+template<int MODEL>
+static float render_tone(const DrumModel &m, DrumVoice &v, float &noiseWeight) {
+
+	constexpr const DrumPatch &patch = drumPatches[MODEL];
+
+	//the operator stacks weigh their noise with the level of one of their operators
+	if(patch.stack >= 0){
+		float noiseLevel;
+		float y = drum_stack_sample(m.stack, v.stack, v.reduced, patch.synthGain, noiseLevel);
+		noiseWeight = patch.noiseGain*noiseLevel;
+		return y;
+	}
+
+	//Get time envelope A_t: attack, decay, end of decay
+	DrumFmVoice &fm = v.fm;
+	float A_t = fm.amp.next(m.amp);
+
+	//Get frequency envelope I_t
+	float I_t = m.I_0;
+	if(patch.indexKind == DRUM_LANE_INDEX_EXP){
+		I_t *= fm.index.next(m.index);
+	}
+	else if(patch.indexKind == DRUM_LANE_INDEX_GAMMA){
+		I_t *= fm.gammaIndex.next(m.gammaIndex);
+	}
+
+	//FM synthesis sound
+	float y;
+	if(v.reduced){
+		y = fm.op.nextCoarse(I_t);
+	}
+	else if(v.oversampled){
+		y = fm.op.nextOversampled(I_t, fm.halfband);
+	}
+	else{
+		y = fm.op.next(I_t);
+	}
+	y = patch.synthGain*(A_t*y);
+
+	//FM synthesize the percussive sound; it is shorter than the drum's fundamental sound itself
+	if(patch.hasSub && v.counter <= m.subLength && !v.reduced){
+		float subA_t = fm.subAmp.next(m.subAmp);
+		y += patch.subGain*(subA_t*fm.subOp.next(patch.subIndex0*subA_t));
+	}
+
+	noiseWeight = patch.noiseGain*A_t;
+	return y;
+}
+
+typedef float (*DrumToneRenderer)(const DrumModel &m, DrumVoice &v, float &noiseWeight);
+
+//render_tone() of every drum, in DrumType order
+static const DrumToneRenderer toneRenderers[] = {
+	render_tone<DRUM_KICK>,
+	render_tone<DRUM_SNARE>,
+	render_tone<DRUM_MIDTOM>,
+	render_tone<DRUM_HIGHTOM>,
+	render_tone<DRUM_HIHAT>,
+	render_tone<DRUM_FLOORTOM>,
+	render_tone<DRUM_RIDE>,
+	render_tone<DRUM_CRASH>
+};
+
+static_assert(sizeof(toneRenderers)/sizeof(toneRenderers[0]) == DRUM_NUM_TYPES, "one renderer per DrumType");
+
+//one sample of a voice without its noise term, and the weight of the noise
+float DrumEngine::renderVoiceTone(DrumVoice &v, float &noiseWeight) {
+
+	//the modal toms have no noise
+	if(v.modal){
+		float y = 0;
+		drum_modal_render(model[v.drum].modal, v.bank, v.reduced, &y, 1);
+		noiseWeight = 0;
+		return y;
+	}
+	return toneRenderers[v.drum](model[v.drum], v, noiseWeight);
+}
+
+void DrumEngine::startOneShot(DrumVoice &voice, int drum) {
+
+	updateControls(false);
+
+	voice.drum = drum;
+	voice.note = 0;
+	voice.held = false;
+	voice.serial = 0;
+	voice.noise.seed(0);
+	startVoice(voice);
+	voice.delay = 0;
+}
+
+void DrumEngine::renderOneShot(DrumVoice &voice, float *tone, float *noiseWeight, int numSamples) {
+
+	for(int i=0; i<numSamples; i++){
+		float w;
+		tone[i] = renderVoiceTone(voice, w);
+		if(noiseWeight != 0){
+			noiseWeight[i] = w;
+		}
+		voice.counter++;
+	}
+}
+
+//mix the sounding voices from the cached one-shots, a voice at a time
+void DrumEngine::renderCached(const DrumOneShots &shots, float *out, int numSamples) {
+
+	for(int i=0; i<numSamples; i++){
+		out[i] = 0;
+	}
+
+	//one clock read per voice: each voice's cycles run from the end of the one before
+	uint32_t t = profiler != 0 ? profiler->now() : 0;
+
+	for(int a=pool.numActive-1; a>=0; a--){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if(!owns(v)){
+			continue;
+		}
+		int length = shots.length[v.drum];
+		int drum = v.drum;
+		int slot = (int)(&v - pool.voices);
+
+		//a hit on a delay starts that far into the samples
+		int start = v.delay < numSamples ? v.delay : numSamples;
+		v.delay -= start;
+
+		//drums the cache does not hold, and the modal toms, are synthesized
+		if(shots.tone[drum] == 0 || v.modal){
+			DrumVoice *finished;
+			int numFinished = 0;
+			int n = v.modal ? renderModalVoice(v, &out[start], numSamples - start, &finished, numFinished)
+					: renderStackVoice(v, &out[start], numSamples - start, &finished, numFinished);
+			if(numFinished != 0){
+				pool.release(v);
+			}
+			if(profiler != 0){
+				uint32_t t1 = profiler->now();
+				profiler->addDrum(drum, t1 - t, n);
+				profiler->addVoice(slot, drum, t1 - t);
+				t = t1;
+			}
+			continue;
+		}
+
+		int pos = start;
+		while(pos < numSamples){
+			int n = length - v.counter;
+			if(n > numSamples - pos){
+				n = numSamples - pos;
+			}
+
+			const float *tone = &shots.tone[v.drum][v.counter];
+			const float *noise = shots.noise[v.drum];
+			if(noise != 0){
+				noise += v.counter;
+				float samples[DRUM_LANE_CHUNK];
+				for(int c=0; c<n; c+=DRUM_LANE_CHUNK){
+					int m = n - c < DRUM_LANE_CHUNK ? n - c : DRUM_LANE_CHUNK;
+					v.noise.fill(noiseFilter[v.drum], samples, m);
+					for(int i=0; i<m; i++){
+						out[pos + c + i] += tone[c + i] + noise[c + i]*samples[i];
+					}
+				}
+			}
+			else{
+				for(int i=0; i<n; i++){
+					out[pos + i] += tone[i];
+				}
+			}
+			pos += n;
+			v.counter += n;
+
+			//end of the drum sound: loop if the key is still held, otherwise free the voice
+			if(v.counter == length){
+				if(v.held){
+					startVoice(v);
+				}
+				else{
+					pool.release(v);
+					break;
+				}
+			}
+		}
+
+		if(profiler != 0){
+			uint32_t t1 = profiler->now();
+			profiler->addDrum(drum, t1 - t, pos - start);
+			profiler->addVoice(slot, drum, t1 - t);
+			t = t1;
+		}
+	}
+}
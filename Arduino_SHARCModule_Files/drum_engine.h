@@ -0,0 +1,296 @@
+/*
+ * drum_engine.h
+ *
+ * Hardware-independent FM drum synthesis engine.
+ *
+ * All of the drum synthesis (Kick, Snare, Midtom, Hightom, Hihat, Floor tom, Ride, Crash) lives
+ * here so that it can be compiled both into the SHARC audio callback and into the host render /
+ * benchmark tools in Host_DrumSynth_Tools.  Nothing in this file depends on the SHARC audio framework: the
+ * caller passes in the sample rate, the knob values, the note events and an output buffer.
+ * The drums themselves are the constant patches of drum_patches.h; the engine turns each into a
+ * DrumModel at the sample rate, and renders it with code specialized for that patch; the floor
+ * tom, ride and crash are operator stacks (drum_fm_stack.h), rendered a voice at a time.  The
+ * toms can ring on modal resonators (drum_modal.h) instead of their operators, chosen per drum
+ * with modal[]; those voices are rendered a voice at a time too.
+ * Note events either come straight through noteOn()/noteOff() at block boundaries, or
+ * timestamped through a DrumMidiQueue (drum_midi_queue.h) with renderQueued(), which starts
+ * each hit at its exact sample: the new voice waits out its offset into the block (its delay)
+ * while the others render, so the block is still rendered in one go.
+ *
+ * Every hit plays on its own voice from a DrumVoicePool (drum_voice_pool.h).  A voice loops
+ * its drum for as long as its key is held and is returned to the pool when the drum ends
+ * after the key has been released, or earlier, at a block boundary, once the rest of the drum
+ * stays below DRUM_SILENT_LEVEL (silentLength[]).  Only the voices on the pool's active list
+ * cost anything, and a block with none of them is just zero-filled.
+ *
+ * render() runs voice-outer by default: the voices of each drum are packed into the lanes of
+ * a DrumLanes (drum_lanes.h) and rendered a whole block at a time.  The original sample-outer
+ * order (every voice for one sample, then the next sample) is kept as DRUM_SAMPLE_OUTER for
+ * comparison; `drum_render --loops` benchmarks the two.
+ *
+ * The knobs and tone buttons are read at control rate: once per block render() takes the
+ * coefficients that depend on them (phase increments, I_0, oversampling, the modal poles) from a
+ * DrumPatchSnapshot (drum_patch_snapshot.h), the one the background loop worked out if the caller
+ * sets `snapshot`, otherwise its own, worked out again whenever pot0..2, type..type3 or
+ * oversampling move.  Only the drums whose targets moved are touched, and a change is ramped in
+ * linearly over the block, DRUM_CONTROL_PERIOD samples at a time, instead of stepping to it at the
+ * block start (zipper noise on a pot sweep).  The audio rate loops only ever read the coefficients.
+ *
+ * Operators that fold back past Nyquist at the current knobs and buttons run at twice the sample
+ * rate (drum_fm.h, drum_fm_stack.h): the main operator of a two operator drum, a whole
+ * modulation chain of a stack drum.  The sub operators never get near Nyquist.  Which ones is
+ * worked out with the other control rate coefficients, and the sounding voices follow.
+ *
+ * With numParts > 1 the voices are split between engines on different cores (drum_dual_core.h):
+ * every engine gets the same note events, so their pools stay identical, but each renders only
+ * its own share of the voices and just keeps time for the rest.
+ *
+ * With a DrumSampleCache attached (drum_sample_cache.h) render() mixes pre-rendered one-shots
+ * instead of synthesizing, and only the noise (drum_noise.h) and the stack drums are generated.
+ *
+ * With a DrumProfiler attached (drum_profile.h) the cycles spent on each drum and each voice
+ * are added to the callback's statistics.  With a DrumAdmission attached (drum_admission.h)
+ * noteOn() keeps the predicted cost of the block within the budget, by rendering tails at
+ * reduced quality, stealing quiet voices or, as a last resort, refusing the hit.
+ */
+
+#ifndef DRUM_ENGINE_H_
+#define DRUM_ENGINE_H_
+
+#include "drum_envelope.h"
+#include "drum_fm.h"
+#include "drum_voice_pool.h"
+#include "drum_lanes.h"
+#include "drum_midi_queue.h"
+#include "drum_patches.h"
+#include "drum_patch_snapshot.h"
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+//samples between the steps of a control ramp
+#define DRUM_CONTROL_PERIOD		8
+
+//level below which a drum counts as silent: -100 dBFS, under the noise floor of the codec
+#define DRUM_SILENT_LEVEL		1e-5f
+
+//order of the loops in DrumEngine::render()
+enum DrumLoopOrder {
+	DRUM_VOICE_OUTER = 0,	//each drum's voices in SIMD lanes, a block at a time
+	DRUM_SAMPLE_OUTER		//every voice one sample at a time
+};
+
+class DrumSampleCache;
+struct DrumOneShots;
+class DrumProfiler;
+class DrumAdmission;
+
+//a drum's patch at the sample rate: envelopes and operators copied into a voice when it is
+//triggered (only the ones the patch uses are set up), and its modulation index, which with the
+//carrier and modulator frequencies follows the knobs and buttons at control rate
+struct DrumModel {
+	Envelope amp;				//A_t
+	Envelope index;				//I_t, DRUM_LANE_INDEX_EXP
+	GammaEnvelope gammaIndex;	//I_t, DRUM_LANE_INDEX_GAMMA
+	FmOperator op;
+	Envelope subAmp;
+	FmOperator subOp;
+	float I_0;
+	float indexPeak;			//peak of I_t/I_0 over the drum
+	bool oversample;			//op at twice the rate
+	int subLength;				//last sample of the sub operator
+	DrumStackModel stack;		//operators of the stack drums, instead of op, index and sub
+	DrumModalModel modal;		//resonators of the toms that have them
+
+	//control inputs the targets were worked out for
+	float freqShift;
+	float I_0To;
+
+	//this block's control ramp: the phase increments (carrier and modulator, or the stack's
+	//operators) and I_0 go from *From to *To
+	bool ramping;
+	uint32_t incFrom[DRUM_STACK_MAX_OPS];
+	uint32_t incTo[DRUM_STACK_MAX_OPS];
+	float I_0From;
+
+	//and the poles of the modal resonators
+	float poleReFrom[DRUM_MODAL_MAX_MODES], poleImFrom[DRUM_MODAL_MAX_MODES];
+	float poleReTo[DRUM_MODAL_MAX_MODES], poleImTo[DRUM_MODAL_MAX_MODES];
+};
+
+class DrumEngine {
+
+	public:
+		//drumPatches[] at the sample rate
+		DrumModel model[DRUM_NUM_TYPES];
+
+		//colour of each drum's noise; white for the drums without noise
+		DrumNoiseFilter noiseFilter[DRUM_NUM_TYPES];
+
+		//samples each drum plays for
+		int drumLength[DRUM_NUM_TYPES];
+
+		//first sample of each drum's tail: past its attack and its sub operator
+		int tailStart[DRUM_NUM_TYPES];
+
+		//samples after which each drum stays below DRUM_SILENT_LEVEL, at most drumLength; an
+		//unheld voice ends there.  modalSilentLength for the voices on modal resonators
+		int silentLength[DRUM_NUM_TYPES];
+		int modalSilentLength[DRUM_NUM_TYPES];
+
+		float sampleRate;
+
+		//knob values (0..1) controlling the fundamental frequencies
+		float pot0, pot1, pot2;
+
+		//tone buttons, each cycles between 0 and 3
+		int type, type2, type3;
+
+		DrumVoicePool pool;
+
+		//DrumLoopOrder, DRUM_VOICE_OUTER after setup()
+		int loopOrder;
+
+		//ramp knob and button changes in over the block (true after setup()), false to step to them
+		//at the block start
+		bool smoothControls;
+
+		//DrumOversampling: which operators run at twice the rate, DRUM_OVERSAMPLE_AUTO after setup();
+		//a change is picked up with the knobs.  Voices at reduced quality never oversample
+		int oversampling;
+
+		//per drum, true to ring its new voices on the modal resonators of drum_modal.h instead of its
+		//operators, for the drums with a modal patch (the toms); false for all after setup().  Voices
+		//already sounding keep theirs
+		bool modal[DRUM_NUM_TYPES];
+
+		//knob and button targets to follow, set by the caller before each block, e.g. from
+		//DrumPatchSnapshots::acquire(); NULL (the default) to work them out from pot0..2, type..type3
+		//and oversampling.  render() copies the snapshot's knobs and buttons into pot0..type3
+		const DrumPatchSnapshot *snapshot;
+
+		//one-shots to mix instead of synthesizing, NULL (the default) to synthesize
+		DrumSampleCache *cache;
+
+		//voice partition: this engine renders the voices with serial % numParts == part (1 and 0
+		//after setup(): all of them)
+		int numParts, part;
+
+		//cycle accounting per drum and voice (drum_profile.h), NULL (the default) for none; only the
+		//voice-outer and cached renders are broken down, the sample-outer one counts as a whole
+		DrumProfiler *profiler;
+
+		//CPU budget aware admission of new voices (drum_admission.h), NULL (the default) to admit
+		//every hit
+		DrumAdmission *admission;
+
+		void setup(float sampleRate);
+
+		//silence every voice
+		void reset();
+
+		//start a new voice for the drum mapped to the note; steals the oldest voice if all are busy
+		void noteOn(int midiNote);
+
+		//release the oldest held voice of the note; it plays to the end of its drum and stops
+		void noteOff(int midiNote);
+
+		//note on (velocity > 0) or note off (note off, or note on with velocity 0) on any channel;
+		//All Sound Off (the panic button) silences every voice
+		void applyEvent(const DrumMidiEvent &event);
+
+		//synthesize numSamples samples of the drum mix into out[]
+		void render(float *out, int numSamples);
+
+		//render a block, applying each queued event at its offset from windowStart; events at or
+		//past windowStart + numSamples stay in the queue, late ones are applied at the block start.
+		//A hit that finds a free voice within the budget starts on a delay and the block is
+		//rendered once; only the events that act on sounding voices (All Sound Off, a hit that
+		//steals or degrades voices, the release of a voice that would loop before it) split the
+		//render at their offset.  Every applied event is also pushed to `forward` (if not NULL),
+		//stamped with the sample it was applied at, so another engine can replay the block exactly
+		void renderQueued(DrumMidiQueue &queue, uint32_t windowStart, float *out, int numSamples,
+				DrumMidiQueue *forward = 0);
+
+		//every drum's targets for the controls c; reads only what setup() wrote, so the background
+		//loop may call it on the engine the callback is rendering with
+		void workOutTargets(const DrumControls &c, DrumPatchSnapshot &s) const;
+
+		//true if this engine renders the voice
+		inline bool owns(const DrumVoice &voice) const {
+
+			return numParts == 1 || (int)(voice.serial % (unsigned)numParts) == part;
+		}
+
+		//serial the next voice gets; a replay of a capture (drum_capture.h) starts from the one the
+		//capture recorded
+		inline unsigned nextVoiceSerial() const {
+
+			return nextSerial;
+		}
+
+		inline void setNextVoiceSerial(unsigned serial) {
+
+			nextSerial = serial;
+		}
+
+		//one-shot of a drum for DrumSampleCache: start it on a voice that is not in the pool, then
+		//pull it in pieces.  tone[] gets the hit without its noise, noiseWeight[] (if not NULL)
+		//the weight of the noise, which the caller multiplies with its own noise
+		void startOneShot(DrumVoice &voice, int drum);
+		void renderOneShot(DrumVoice &voice, float *tone, float *noiseWeight, int numSamples);
+
+	private:
+		unsigned nextSerial;
+
+		//delay of the voices noteOn() starts, set by renderQueued()
+		int noteDelay;
+
+		//the controls ramp over the block renderSpan() is in
+		bool controlRamp;
+
+		//the voice-outer render's lanes, kept here rather than on the callback's stack
+		DrumLanes lanes;
+
+		//the targets for pot0..type3 when no snapshot is set, and the snapshot the models follow
+		DrumPatchSnapshot own;
+		const DrumPatchSnapshot *applied;
+
+		bool updateControls(bool ramp);
+		bool takeOversampling(int drum, const DrumPatchTargets &t);
+		void syncOversampling(DrumVoice &voice);
+		void applyControls(float frac);
+		void renderSpan(float *out, int numSamples, int blockPos, int blockLength);
+		void renderBlock(const DrumOneShots *shots, float *out, int numSamples);
+		bool admitVoice(int drum);
+		float admissionLoad(int drum, int newPart);
+		bool waitsForVoices(const DrumMidiEvent &event, int samples);
+		void startVoice(DrumVoice &voice);
+		void skipOtherVoices(const int *length, int numSamples);
+		void retireSilentVoices();
+		int findSilentLength(int drum) const;
+
+		void renderSampleOuter(float *out, int numSamples);
+		float renderVoice(DrumVoice &voice);
+		float renderVoiceTone(DrumVoice &voice, float &noiseWeight);
+
+		void renderCached(const DrumOneShots &shots, float *out, int numSamples);
+
+		//voice-outer render, drum_lanes.cpp
+		void renderVoiceOuter(float *out, int numSamples);
+		void renderGroup(DrumVoice **voices, int count, float *out, int numSamples, DrumVoice **finished,
+				int &numFinished, uint32_t &t);
+		void laneParams(int drum, DrumLaneParams &p);
+		void renderLanes(DrumLanes &lanes, const DrumLaneParams &p, float *out, int numSamples,
+				DrumVoice **finished, int &numFinished);
+		int renderStackVoice(DrumVoice &v, float *out, int numSamples, DrumVoice **finished,
+				int &numFinished);
+		int renderModalVoice(DrumVoice &v, float *out, int numSamples, DrumVoice **finished,
+				int &numFinished);
+};
+
+//map a MIDI note to the drum it triggers, -1 if the note is not mapped
+int drum_type_from_note(int midiNote);
+
+#endif /* DRUM_ENGINE_H_ */
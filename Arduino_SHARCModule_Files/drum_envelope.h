@@ -0,0 +1,376 @@
+/*
+ * drum_envelope.h
+ *
+ * Incremental envelope generators for the drum engine.
+ *
+ * The closed-form envelopes used by the drums (the attack ramp A_t = slope*t, the exponential
+ * decay A*exp(-(t-TimePeak)/tau), the index envelopes exp(-t/tauf) and the gamma shaped tom
+ * index 18500*(t+0.01)^2*exp(-tauf*(t+0.01))) are all advanced here with multiply-add
+ * recurrences.  Every coefficient is computed once in setup(), so no exp() or pow() is left
+ * in the per-sample path.
+ *
+ * Error bound: the recurrences run in single precision, so each step adds at most about one
+ * ulp of relative error.  Left alone that would grow with the length of a stage, which at 96 kHz
+ * runs to a million samples for the ride, so a stage is cut into segments of ENV_SEGMENT
+ * samples and each segment starts again from the closed form.  The closed form's mul^n is kept
+ * as a running product of segmentMul, one rounding per segment instead of one per sample, so
+ * no pow() is left on the audio path either; valueAt() gets it by squaring (env_pow()).  The
+ * error then stays below 3e-4 relative at any sample rate; `drum_render --envelope` measures
+ * the actual error against the closed forms.
+ *
+ * An Envelope or GammaEnvelope holds both its coefficients and its running state.  The voices
+ * keep only the running state, an EnvelopeState or GammaState, and read the coefficients from
+ * the envelope of their drum's model, so a voice does not carry a copy of the stage table.
+ */
+
+#ifndef DRUM_ENVELOPE_H_
+#define DRUM_ENVELOPE_H_
+
+#include <math.h>
+
+#define ENV_MAX_STAGES	3
+#define ENV_FOREVER		0x7fffffff
+
+//samples a recurrence runs before it is put back on the closed form
+#define ENV_SEGMENT		4096
+
+//one stage of an envelope: y starts at `start` and then y[n+1] = y[n]*mul + add for `length` samples
+struct EnvStage {
+	float start;
+	float mul;
+	float add;
+	int length;
+	float segmentMul;	//mul^ENV_SEGMENT, rounded once
+};
+
+//x^n for n >= 0 by squaring, a multiply or two per bit of n; about n ulp of relative error
+static inline float env_pow(float x, int n) {
+
+	float y = 1;
+	while(n > 0){
+		if(n & 1){
+			y *= x;
+		}
+		x *= x;
+		n >>= 1;
+	}
+	return y;
+}
+
+//start of stage s's first segment: value, samples in the segment, samples of the stage after it
+//and mul^(samples since the stage start)
+static inline void env_first_segment(const EnvStage &s, float &value, int &remaining, int &left, float &power) {
+
+	value = s.start;
+	remaining = s.length < ENV_SEGMENT ? s.length : ENV_SEGMENT;
+	left = s.length - remaining;
+	power = 1;
+}
+
+//start of the segment after the one that just ended, left > 0 samples before the end of stage s
+static inline void env_next_segment(const EnvStage &s, float &value, int &remaining, int &left, float &power) {
+
+	int n = s.length - left;
+	if(s.mul == 1){
+		value = s.start + s.add*(float)n;
+	}
+	else{
+		power *= s.segmentMul;
+		value = s.start*power + s.add*(1 - power)/(1 - s.mul);
+	}
+	remaining = left < ENV_SEGMENT ? left : ENV_SEGMENT;
+	left -= remaining;
+}
+
+class Envelope {
+
+	public:
+		EnvStage stages[ENV_MAX_STAGES];
+		int numStages;
+
+		float value;
+		float mul;
+		float add;
+		int remaining;		//samples to the end of the segment
+		int left;			//samples of the stage after the segment
+		float power;		//mul^(samples since the stage start) at the segment start
+		int stage;
+
+		//attack ramp A_t = slope*t up to TimePeak, then A*exp(-(t-TimePeak)/tau) until r, then 0
+		void setupAttackDecay(float sampleRate, float slope, float timePeak, float A, float tau, float r) {
+
+			//the closed form uses t <= TimePeak / t <= r, so the boundary sample belongs to the earlier stage
+			int lastAttack = (int)floor(timePeak*sampleRate + 1e-3);
+			int lastDecay = (int)floor(r*sampleRate + 1e-3);
+			int firstDecay = lastAttack + 1;
+
+			stages[0].start = 0;
+			stages[0].mul = 1;
+			stages[0].add = slope/sampleRate;
+			stages[0].length = lastAttack + 1;
+			stages[0].segmentMul = 1;
+
+			stages[1].start = A*exp(-(firstDecay/(double)sampleRate - timePeak)/tau);
+			stages[1].mul = exp(-1.0/(tau*(double)sampleRate));
+			stages[1].add = 0;
+			stages[1].length = lastDecay - lastAttack;
+			stages[1].segmentMul = exp(-ENV_SEGMENT/(tau*(double)sampleRate));
+
+			setupSilence(2);
+			numStages = 3;
+			start();
+		}
+
+		//from*exp(-t/tau) for as long as the drum lasts
+		void setupExpDecay(float sampleRate, float tau, float from = 1) {
+
+			stages[0].start = from;
+			stages[0].mul = exp(-1.0/(tau*(double)sampleRate));
+			stages[0].add = 0;
+			stages[0].length = ENV_FOREVER;
+			stages[0].segmentMul = exp(-ENV_SEGMENT/(tau*(double)sampleRate));
+			numStages = 1;
+			start();
+		}
+
+		//linear ramp from `from` to 0 over r seconds (A_t = -(1/r)*t + 1), then 0
+		void setupRampDown(float sampleRate, float from, float r) {
+
+			setupLine(sampleRate, from, r, r);
+		}
+
+		//from*(1 - t/zeroTime), which carries on past 0 until r, then 0
+		void setupLine(float sampleRate, float from, float zeroTime, float r) {
+
+			stages[0].start = from;
+			stages[0].mul = 1;
+			stages[0].add = -from/(zeroTime*sampleRate);
+			stages[0].length = (int)floor(r*sampleRate + 1e-3) + 1;
+			stages[0].segmentMul = 1;
+
+			setupSilence(1);
+			numStages = 2;
+			start();
+		}
+
+		//restart from the first stage (note on)
+		inline void start() {
+
+			stage = 0;
+			enterStage();
+		}
+
+		//current value, then advance one sample
+		inline float next() {
+
+			float y = value;
+			value = value*mul + add;
+			if(--remaining == 0){
+				nextSegment();
+			}
+			return y;
+		}
+
+		//move on to the next segment, or stage; for renderers that advance value/remaining themselves
+		inline void nextSegment() {
+
+			if(left > 0){
+				env_next_segment(stages[stage], value, remaining, left, power);
+				return;
+			}
+			stage++;
+			enterStage();
+		}
+
+		//the value n samples after start(), in closed form; for decisions that must not depend on
+		//whether this core advanced the envelope (drum_admission.cpp).  mul^n is made of whole
+		//segments and the rest, which keeps it within the same 3e-4 without a pow()
+		float valueAt(int n) const {
+
+			int s = 0;
+			while(s < numStages - 1 && n >= stages[s].length){
+				n -= stages[s].length;
+				s++;
+			}
+			const EnvStage &st = stages[s];
+			if(st.mul == 1){
+				return st.start + st.add*n;
+			}
+			float m = env_pow(st.segmentMul, n/ENV_SEGMENT)*env_pow(st.mul, n % ENV_SEGMENT);
+			return st.start*m + st.add*(1 - m)/(1 - st.mul);
+		}
+
+		//samples from start() after which |value| stays at or below x, looking no further than
+		//limit samples; for ending voices that have gone quiet (DrumEngine::silentLength)
+		int silentAfter(float x, int limit) const {
+
+			int begin = 0;
+			int last = -1;
+			for(int s=0; s<numStages && begin<limit; s++){
+				const EnvStage &st = stages[s];
+				int length = st.length < limit - begin ? st.length : limit - begin;
+
+				//last sample of the stage above x: a line is above x at its end or until it enters
+				//[-x, x], a decay until it falls below x
+				int n = -1;
+				if(st.mul == 1){
+					if(fabsf(st.start + st.add*(length - 1)) > x){
+						n = length - 1;
+					}
+					else if(st.add > 0 && st.start < -x){
+						n = (int)ceil((-x - st.start)/st.add) - 1;
+					}
+					else if(st.add < 0 && st.start > x){
+						n = (int)ceil((x - st.start)/st.add) - 1;
+					}
+				}
+				else if(fabsf(st.start) > x){
+					n = st.mul > 0 && st.mul < 1 ? (int)ceil(log(x/fabsf(st.start))/log(st.mul)) - 1 : length - 1;
+				}
+				if(n >= 0){
+					last = begin + (n < length - 1 ? n : length - 1);
+				}
+				begin += length;
+			}
+			return last + 1;
+		}
+
+	private:
+		void setupSilence(int s) {
+
+			stages[s].start = 0;
+			stages[s].mul = 0;
+			stages[s].add = 0;
+			stages[s].length = ENV_FOREVER;
+			stages[s].segmentMul = 0;
+		}
+
+		inline void enterStage() {
+
+			if(stage >= numStages){
+				stage = numStages - 1;
+			}
+			mul = stages[stage].mul;
+			add = stages[stage].add;
+			env_first_segment(stages[stage], value, remaining, left, power);
+		}
+};
+
+//the running part of an Envelope, advanced through the stage table of the Envelope it follows
+struct EnvelopeState {
+	float value;
+	float mul;
+	float add;
+	int remaining;		//samples to the end of the segment
+	int left;			//samples of the stage after the segment
+	float power;		//mul^(samples since the stage start) at the segment start
+	int stage;
+
+	//restart from the first stage of e (note on)
+	inline void start(const Envelope &e) {
+
+		stage = 0;
+		enterStage(e);
+	}
+
+	//current value, then advance one sample
+	inline float next(const Envelope &e) {
+
+		float y = value;
+		value = value*mul + add;
+		if(--remaining == 0){
+			nextSegment(e);
+		}
+		return y;
+	}
+
+	//move on to the next segment, or stage, of e; for renderers that advance value/remaining
+	//themselves
+	inline void nextSegment(const Envelope &e) {
+
+		if(left > 0){
+			env_next_segment(e.stages[stage], value, remaining, left, power);
+			return;
+		}
+		stage++;
+		enterStage(e);
+	}
+
+	inline void enterStage(const Envelope &e) {
+
+		if(stage >= e.numStages){
+			stage = e.numStages - 1;
+		}
+		const EnvStage &s = e.stages[stage];
+		mul = s.mul;
+		add = s.add;
+		env_first_segment(s, value, remaining, left, power);
+	}
+};
+
+//gamma shaped envelope C*(t+t0)^2*exp(-k*(t+t0)), used for the tom index envelopes
+class GammaEnvelope {
+
+	public:
+		//(t+t0)^2 is advanced with second order differences, C*exp(-k*(t+t0)) with a multiply
+		float square;
+		float squareStep;
+		float squareStep2;
+		float decay;
+		float decayMul;
+
+		float startSquare, startSquareStep, startDecay;
+
+		void setup(float sampleRate, float C, float t0, float k) {
+
+			double dt = 1.0/sampleRate;
+
+			startSquare = t0*t0;
+			startSquareStep = 2*t0*dt + dt*dt;
+			squareStep2 = 2*dt*dt;
+			startDecay = C*exp(-k*t0);
+			decayMul = exp(-k*dt);
+			start();
+		}
+
+		inline void start() {
+
+			square = startSquare;
+			squareStep = startSquareStep;
+			decay = startDecay;
+		}
+
+		inline float next() {
+
+			float y = square*decay;
+			square += squareStep;
+			squareStep += squareStep2;
+			decay *= decayMul;
+			return y;
+		}
+};
+
+//the running part of a GammaEnvelope
+struct GammaState {
+	float square;
+	float squareStep;
+	float decay;
+
+	inline void start(const GammaEnvelope &g) {
+
+		square = g.startSquare;
+		squareStep = g.startSquareStep;
+		decay = g.startDecay;
+	}
+
+	inline float next(const GammaEnvelope &g) {
+
+		float y = square*decay;
+		square += squareStep;
+		squareStep += g.squareStep2;
+		decay *= g.decayMul;
+		return y;
+	}
+};
+
+#endif /* DRUM_ENVELOPE_H_ */
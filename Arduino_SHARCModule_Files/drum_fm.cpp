@@ -0,0 +1,72 @@
+/*
+ * drum_fm.cpp
+ *
+ * Sine table for the FM operators, and what an operator folds back.  See drum_fm.h.
+ */
+
+#include <math.h>
+#include "drum_fm.h"
+
+//every operator reads this table on every sample, so keep it in L1 on the SHARC
+#if defined(__ADSP21000__)
+#pragma section("seg_l1_block1")
+#endif
+float drum_sine_table[DRUM_SINE_TABLE_SIZE + 1];
+
+void drum_fm_init(void) {
+
+	for(int i=0; i<=DRUM_SINE_TABLE_SIZE; i++){
+		drum_sine_table[i] = (float)sin(6.283185307179586*i/DRUM_SINE_TABLE_SIZE);
+	}
+}
+
+//sidebands drum_fm_folded() sums, each way; J_n(index) is below 1e-7 past about
+//n = index + 4*index^(1/3) + 8, which DRUM_FM_FOLDED_ORDERS covers for indexes up to 40
+#define DRUM_FM_FOLDED_ORDERS	80
+
+float drum_fm_folded(float fc, float fm, float index, float sampleRate) {
+
+	float nyquist = sampleRate/2;
+	if(index <= 0){
+		return fabsf(fc) > nyquist ? 1.0f : 0.0f;
+	}
+
+	//J_0..J_N by Miller's backward recurrence, J_(n-1) = 2n/index*J_n - J_(n+1), from an arbitrary
+	//start far enough up, scaled back whenever it grows large and normalised by
+	//J_0 + 2*(J_2 + J_4 + ...) = 1 at the end
+	int N = (int)(1.5f*index) + 24;
+	if(N > DRUM_FM_FOLDED_ORDERS){
+		N = DRUM_FM_FOLDED_ORDERS;
+	}
+	float J[DRUM_FM_FOLDED_ORDERS + 2];
+	J[N + 1] = 0;
+	J[N] = 1e-20f;
+	for(int n=N; n>0; n--){
+		J[n - 1] = 2*n/index*J[n] - J[n + 1];
+		if(fabsf(J[n - 1]) > 1e10f){
+			for(int k=n-1; k<=N; k++){
+				J[k] *= 1e-10f;
+			}
+		}
+	}
+	float norm = J[0];
+	for(int n=2; n<=N; n+=2){
+		norm += 2*J[n];
+	}
+
+	//J_(-n)^2 = J_n^2; a sideband past Nyquist lands at its distance to the nearest multiple of the
+	//rate
+	float folded = 0;
+	for(int n=-N; n<=N; n++){
+		float f = fabsf(fc + n*fm);
+		if(f <= nyquist){
+			continue;
+		}
+		f -= sampleRate*(float)(int)(f/sampleRate + 0.5f);
+		if(fabsf(f) < sampleRate/3){
+			float j = J[n < 0 ? -n : n]/norm;
+			folded += j*j;
+		}
+	}
+	return folded;
+}
@@ -0,0 +1,238 @@
+/*
+ * drum_fm.h
+ *
+ * Phase-accumulator FM operator with a table-based sine.
+ *
+ * Each operator computes sin(2*PI*fc*t + I*sin(2*PI*fm*t)) without libm.  The carrier and
+ * modulator phases are 32 bit accumulators that wrap once per cycle, so the phase never loses
+ * precision on held notes, and the per-sample increments are computed from fc/fm only when
+ * the frequencies change (once per block).  The sine comes from a linearly interpolated table
+ * that is kept in L1 on the SHARC.
+ *
+ * With DRUM_SINE_TABLE_BITS = 10 the table sine is within 5e-6 of sin() everywhere, which puts
+ * THD+N of a pure table tone around -109 dB; `drum_render --fm` measures it.
+ *
+ * An operator that folds more of its power back past Nyquist than the decimator would get wrong
+ * can run at twice the sample rate: it is evaluated on every sample and half way to the next one,
+ * and the pairs go through a polyphase half-band decimator.  Its phases then run
+ * DRUM_HALFBAND_DELAY samples ahead, so the decimated output lines up with the plain one and an
+ * operator can go over to oversampling and back between blocks.  `drum_render --oversample` measures the aliasing it takes away and what it costs.
+ */
+
+#ifndef DRUM_FM_H_
+#define DRUM_FM_H_
+
+#include <stdint.h>
+
+#define DRUM_SINE_TABLE_BITS	10
+#define DRUM_SINE_TABLE_SIZE	(1 << DRUM_SINE_TABLE_BITS)
+
+//one full cycle of sine plus a guard point so the interpolation never has to wrap
+extern float drum_sine_table[DRUM_SINE_TABLE_SIZE + 1];
+
+//fill drum_sine_table; safe to call more than once
+void drum_fm_init(void);
+
+//phase units: 2^32 per cycle.  Modulation is added in 2^24 per cycle and shifted up, which
+//keeps the float to int conversion in range for indexes up to 128 cycles (~800 radians)
+#define DRUM_PHASE_PER_CYCLE	4294967296.0
+#define DRUM_MOD_PER_RADIAN		(16777216.0f/6.28318530717958647f)
+
+//sine of a 32 bit phase
+static inline float drum_sine(uint32_t phase) {
+
+	uint32_t idx = phase >> (32 - DRUM_SINE_TABLE_BITS);
+	float frac = (float)(phase & ((1u << (32 - DRUM_SINE_TABLE_BITS)) - 1))
+			* (1.0f/(float)(1u << (32 - DRUM_SINE_TABLE_BITS)));
+	float a = drum_sine_table[idx];
+	return a + frac*(drum_sine_table[idx + 1] - a);
+}
+
+//sine of a 32 bit phase from the nearest table entry, without the interpolation: within 3.1e-3
+//of sin(), for voices rendered at reduced quality (drum_admission.h)
+static inline float drum_sine_coarse(uint32_t phase) {
+
+	return drum_sine_table[(phase + (1u << (31 - DRUM_SINE_TABLE_BITS))) >> (32 - DRUM_SINE_TABLE_BITS)];
+}
+
+//phase increment per sample for a frequency in Hz
+static inline uint32_t drum_phase_increment(float freq, float sampleRate) {
+
+	double cycles = (double)freq/sampleRate;
+	cycles -= (double)(int64_t)cycles;
+	if(cycles < 0){
+		cycles += 1;
+	}
+	return (uint32_t)(cycles*DRUM_PHASE_PER_CYCLE);
+}
+
+//which operators run at twice the sample rate
+enum DrumOversampling {
+	DRUM_OVERSAMPLE_AUTO = 0,	//the ones that fold back more than DRUM_OVERSAMPLE_MIN_FOLDED (drum_fm_folded())
+	DRUM_OVERSAMPLE_OFF,
+	DRUM_OVERSAMPLE_ALL			//all that can, for measurements
+};
+
+//highest frequency at which an operator at fc, modulated with `index` radians by a signal that
+//reaches up to fm, has sidebands within 60 dB of its peak: J_n(index) stays above 1e-3 up to
+//about n = index + 2.2*index^(1/3) + 1, which 1.25*index + 4 bounds from above
+static inline float drum_fm_bandwidth(float fc, float fm, float index) {
+
+	return index > 0 ? fc + (1.25f*index + 4)*fm : fc;
+}
+
+//share of the power of sin(2*pi*fc*t + index*sin(2*pi*fm*t)) in the sidebands past Nyquist that
+//fold back below a third of the sample rate, where the decimator is flat: the sum of
+//J_n(index)^2 over those n.  What folds back above the third the decimator could not take away
+//either.  Control rate only, without libm (drum_fm.cpp)
+float drum_fm_folded(float fc, float fm, float index, float sampleRate);
+
+//half-band decimator from twice the rate: 31 taps, of which the odd ones (DRUM_HALFBAND_TAPS
+//distinct values, mirrored) and the centre (0.5) are not 0.  Equiripple, flat within 3.2e-5
+//(-90 dB) up to a third of the sample rate; what would fold back below that third, from two
+//thirds up, as far down
+#define DRUM_HALFBAND_TAPS		8
+
+//samples the decimator's output lags its input by, DRUM_HALFBAND_TAPS - 1/2
+#define DRUM_HALFBAND_DELAY		7.5f
+
+static constexpr float drumHalfband[DRUM_HALFBAND_TAPS] = {
+	0.3136962272f, -0.09295499802f, 0.04385563483f, -0.02154594324f,
+	0.009878026152f, -0.003933063503f, 0.001239541961f, -0.0002511453659f
+};
+
+//folded power, of the operator's, past which DRUM_OVERSAMPLE_AUTO runs an operator at twice the
+//rate: 12 dB over the decimator's own error (its ripple, squared), so what the decimator takes
+//away always outweighs what it adds
+#define DRUM_OVERSAMPLE_MIN_FOLDED	(16*3.2e-5f*3.2e-5f)
+
+//phase an oversampled operator runs ahead by, DRUM_HALFBAND_DELAY samples of the increment
+static inline uint32_t drum_halfband_lead(uint32_t inc) {
+
+	return (DRUM_HALFBAND_TAPS - 1)*inc + (inc >> 1);
+}
+
+//push a pair of samples at twice the rate, on the sample and half way to the next, into the
+//decimator history even[k*stride] (2*DRUM_HALFBAND_TAPS on-sample inputs, oldest first) and
+//odd[k*stride] (DRUM_HALFBAND_TAPS half-sample inputs), and return the output.  Polyphase: the
+//on-sample inputs meet the odd taps, the half-sample ones only the centre, DRUM_HALFBAND_TAPS
+//pairs later.  The stride lets the lanes keep their histories side by side
+static inline float drum_halfband(float *even, float *odd, int stride, float onSample, float halfSample) {
+
+	const int K = DRUM_HALFBAND_TAPS;
+	for(int k=0; k<2*K-1; k++){
+		even[k*stride] = even[(k + 1)*stride];
+	}
+	even[(2*K - 1)*stride] = onSample;
+
+	float y = 0.5f*odd[0];
+	for(int k=0; k<K; k++){
+		y += drumHalfband[k]*(even[(K - 1 - k)*stride] + even[(K + k)*stride]);
+	}
+
+	for(int k=0; k<K-1; k++){
+		odd[k*stride] = odd[(k + 1)*stride];
+	}
+	odd[(K - 1)*stride] = halfSample;
+	return y;
+}
+
+//the decimator of one operator
+struct DrumHalfband {
+	float even[2*DRUM_HALFBAND_TAPS];
+	float odd[DRUM_HALFBAND_TAPS];
+
+	void reset() {
+
+		for(int k=0; k<2*DRUM_HALFBAND_TAPS; k++){
+			even[k] = 0;
+		}
+		for(int k=0; k<DRUM_HALFBAND_TAPS; k++){
+			odd[k] = 0;
+		}
+	}
+};
+
+//sin(carrier + index*sin(modulator)) at a pair of phases
+static inline float drum_fm_sample(uint32_t carrierPhase, uint32_t modPhase, float index) {
+
+	float mod = index*drum_sine(modPhase);
+	return drum_sine(carrierPhase + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8));
+}
+
+class FmOperator {
+
+	public:
+		uint32_t carrierPhase;
+		uint32_t modPhase;
+		uint32_t carrierInc;
+		uint32_t modInc;
+
+		//set the carrier and modulator frequencies; the phases carry on where they are
+		void setFrequencies(float fc, float fm, float sampleRate) {
+
+			carrierInc = drum_phase_increment(fc, sampleRate);
+			modInc = drum_phase_increment(fm, sampleRate);
+		}
+
+		//back to t = 0 (note on)
+		inline void start() {
+
+			carrierPhase = 0;
+			modPhase = 0;
+		}
+
+		//sin(carrier + index*sin(modulator)), index in radians, then advance one sample
+		inline float next(float index) {
+
+			float y = drum_fm_sample(carrierPhase, modPhase, index);
+
+			carrierPhase += carrierInc;
+			modPhase += modInc;
+			return y;
+		}
+
+		//next() at twice the rate through the decimator h, after startOversampling()
+		inline float nextOversampled(float index, DrumHalfband &h) {
+
+			float y = drum_fm_sample(carrierPhase, modPhase, index);
+			float yHalf = drum_fm_sample(carrierPhase + (carrierInc >> 1), modPhase + (modInc >> 1), index);
+
+			carrierPhase += carrierInc;
+			modPhase += modInc;
+			return drum_halfband(h.even, h.odd, 1, y, yHalf);
+		}
+
+		//go over to nextOversampled(): the phases move DRUM_HALFBAND_DELAY samples ahead, and the
+		//decimator is filled with the pairs on the way there, at the current index
+		void startOversampling(float index, DrumHalfband &h) {
+
+			h.reset();
+			carrierPhase -= drum_halfband_lead(carrierInc);
+			modPhase -= drum_halfband_lead(modInc);
+			for(int p=0; p<2*DRUM_HALFBAND_TAPS-1; p++){
+				nextOversampled(index, h);
+			}
+		}
+
+		//back to next()
+		void stopOversampling() {
+
+			carrierPhase -= drum_halfband_lead(carrierInc);
+			modPhase -= drum_halfband_lead(modInc);
+		}
+
+		//next() with drum_sine_coarse()
+		inline float nextCoarse(float index) {
+
+			float mod = index*drum_sine_coarse(modPhase);
+			uint32_t phase = carrierPhase + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8);
+			float y = drum_sine_coarse(phase);
+
+			carrierPhase += carrierInc;
+			modPhase += modInc;
+			return y;
+		}
+};
+
+#endif /* DRUM_FM_H_ */
@@ -0,0 +1,246 @@
+/*
+ * drum_fm_stack.cpp
+ *
+ * N-operator FM voices.  See drum_fm_stack.h.
+ */
+
+#include "drum_fm_stack.h"
+#include "drum_lanes.h"
+
+void DrumStackModel::setup(const DrumStackPatch &patch, float sampleRate, float drumR) {
+
+	numOps = patch.numOps;
+	noiseOp = patch.noiseOp;
+
+	//a layer ends wherever the depth in the routing changes; operators of the same depth next
+	//to each other never modulate one another
+	int depth[DRUM_STACK_MAX_OPS];
+	int numDecimators = 0;
+	numLayers = 0;
+	for(int k=0; k<numOps; k++){
+		const DrumStackOp &op = patch.op[k];
+		src[k] = op.src >= 0 ? op.src : DRUM_STACK_MAX_OPS;
+		depth[k] = op.src >= 0 ? depth[op.src] + 1 : 0;
+		chain[k] = op.src >= 0 ? chain[op.src] : k;
+		oversample[k] = false;
+		if(k > 0 && depth[k] != depth[k - 1]){
+			layerEnd[numLayers++] = k;
+		}
+		gain[k] = op.gain;
+		inc[k] = 0;
+		decimator[k] = op.gain != 0 && numDecimators < DRUM_STACK_DECIMATORS ? numDecimators++ : -1;
+
+		float r = op.r > 0 ? op.r : drumR;
+		switch(op.shape){
+			case DRUM_STACK_ATTACK_DECAY:
+				level[k].setupAttackDecay(sampleRate, op.level/op.time, op.time, op.level, op.tau, r);
+				break;
+			case DRUM_STACK_LINE:
+				level[k].setupLine(sampleRate, op.level, op.time, r);
+				break;
+			default:
+				level[k].setupExpDecay(sampleRate, op.tau, op.level);
+				break;
+		}
+	}
+	layerEnd[numLayers++] = numOps;
+}
+
+void DrumStackModel::setFrequencies(const DrumStackPatch &patch, float freqShift, float sampleRate) {
+
+	for(int k=0; k<numOps; k++){
+		inc[k] = drum_phase_increment(patch.op[k].freq*freqShift, sampleRate);
+	}
+}
+
+void DrumStackModel::findOversampling(const DrumStackPatch &patch, float freqShift, float sampleRate, int mode,
+		bool *result) const {
+
+	//a modulated operator's sidebands are spaced by its modulator's frequency, or by as far as the
+	//modulator reaches if it is modulated itself, and counted at the modulator's peak level.  A
+	//chain goes to twice the rate when any of its operators folds back too much; a chain with a
+	//carrier left without a decimator cannot
+	bool over[DRUM_STACK_MAX_OPS] = { false };
+	bool blocked[DRUM_STACK_MAX_OPS] = { false };
+	float bandwidth[DRUM_STACK_MAX_OPS];
+	for(int k=0; k<numOps; k++){
+		const DrumStackOp &op = patch.op[k];
+		float freq = op.freq*freqShift;
+		float folded = freq > sampleRate/2 ? 1.0f : 0.0f;
+		bandwidth[k] = freq;
+		if(op.src >= 0){
+			const DrumStackOp &mod = patch.op[op.src];
+			float spacing = mod.src >= 0 ? bandwidth[op.src] : mod.freq*freqShift;
+			bandwidth[k] = drum_fm_bandwidth(freq, bandwidth[op.src], mod.level);
+			folded = drum_fm_folded(freq, spacing, mod.level, sampleRate);
+		}
+		if(folded > DRUM_OVERSAMPLE_MIN_FOLDED){
+			over[chain[k]] = true;
+		}
+		if(gain[k] != 0 && decimator[k] < 0){
+			blocked[chain[k]] = true;
+		}
+	}
+	for(int k=0; k<numOps; k++){
+		result[k] = !blocked[chain[k]] &&
+				(mode == DRUM_OVERSAMPLE_ALL || (mode == DRUM_OVERSAMPLE_AUTO && over[chain[k]]));
+	}
+}
+
+void DrumStackVoice::setOversampling(const DrumStackModel &m, bool oversample) {
+
+	bool starting[DRUM_STACK_MAX_OPS];
+	bool anyStarting = false;
+	numOversampled = 0;
+	numDecimated = 0;
+	for(int k=0; k<m.numOps; k++){
+		bool on = oversample && m.oversample[k];
+		starting[k] = on && !oversampled[k];
+		anyStarting = anyStarting || starting[k];
+		if(on != oversampled[k]){
+			phase[k] -= drum_halfband_lead(m.inc[k]);
+			oversampled[k] = on;
+		}
+		if(on){
+			oversampledOps[numOversampled++] = k;
+			if(m.gain[k] != 0){
+				decimatedOps[numDecimated++] = k;
+			}
+		}
+		int d = m.decimator[k];
+		if(starting[k] && d >= 0){
+			for(int t=0; t<2*DRUM_HALFBAND_TAPS; t++){
+				halfbandEven[t][d] = 0;
+			}
+			for(int t=0; t<DRUM_HALFBAND_TAPS; t++){
+				halfbandOdd[t][d] = 0;
+			}
+		}
+	}
+	if(!anyStarting){
+		return;
+	}
+
+	//the chains that start, from DRUM_HALFBAND_DELAY samples back to as far ahead; a whole chain
+	//starts at once, so the sources of an operator that starts start too
+	for(int p=0; p<2*DRUM_HALFBAND_TAPS-1; p++){
+		float y[DRUM_STACK_MAX_OPS + 1], yHalf[DRUM_STACK_MAX_OPS + 1];
+		y[DRUM_STACK_MAX_OPS] = 0;
+		yHalf[DRUM_STACK_MAX_OPS] = 0;
+		for(int k=0; k<m.numOps; k++){
+			if(!starting[k]){
+				y[k] = 0;
+				yHalf[k] = 0;
+				continue;
+			}
+			float mod = y[m.src[k]], modHalf = yHalf[m.src[k]];
+			float x = drum_sine(phase[k] + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8));
+			float xHalf = drum_sine(phase[k] + (m.inc[k] >> 1) + ((uint32_t)(int32_t)(modHalf*DRUM_MOD_PER_RADIAN) << 8));
+			y[k] = value[k]*x;
+			yHalf[k] = value[k]*xHalf;
+			int d = m.decimator[k];
+			if(d >= 0){
+				drum_halfband(&halfbandEven[0][d], &halfbandOdd[0][d], DRUM_STACK_DECIMATORS, x, xHalf);
+			}
+			phase[k] += m.inc[k];
+		}
+	}
+}
+
+template<bool COARSE>
+static inline float stack_sine(uint32_t phase) {
+
+	return COARSE ? drum_sine_coarse(phase) : drum_sine(phase);
+}
+
+//OVERSAMPLED: the voice has operators at twice the rate, which are also evaluated half way to the
+//next sample, and its carriers among them are decimated
+template<bool COARSE, bool OVERSAMPLED>
+static void render_stack(const DrumStackModel &m, DrumStackVoice &s, float synthGain, float noiseGain,
+		const float *noise, float *out, int n) {
+
+	for(int i=0; i<n; i++){
+		//this sample's operator outputs, and a 0 for the unmodulated ones to read
+		float y[DRUM_STACK_MAX_OPS + 1];
+		y[DRUM_STACK_MAX_OPS] = 0;
+		float noiseLevel = s.value[m.noiseOp];
+
+		//the oversampled operators half way to the next sample, before their state moves on; their
+		//levels and sines on the sample, for the decimated ones
+		float yHalf[DRUM_STACK_MAX_OPS + 1], xHalf[DRUM_STACK_MAX_OPS];
+		float level[DRUM_STACK_MAX_OPS], x[DRUM_STACK_MAX_OPS];
+		if(OVERSAMPLED){
+			yHalf[DRUM_STACK_MAX_OPS] = 0;
+			for(int j=0; j<s.numOversampled; j++){
+				int k = s.oversampledOps[j];
+				float mod = yHalf[m.src[k]];
+				xHalf[k] = drum_sine(s.phase[k] + (m.inc[k] >> 1) + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8));
+				yHalf[k] = s.value[k]*xHalf[k];
+			}
+		}
+
+		int begin = 0;
+		for(int l=0; l<m.numLayers; l++){
+			int end = m.layerEnd[l];
+
+			DRUM_SIMD_FOR
+			for(int k=begin; k<end; k++){
+				float lev = s.value[k];
+				float mod = y[m.src[k]];
+				float sine = stack_sine<COARSE>(s.phase[k] + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8));
+				y[k] = lev*sine;
+				if(OVERSAMPLED){
+					level[k] = lev;
+					x[k] = sine;
+				}
+				s.value[k] = lev*s.mul[k] + s.add[k];
+				s.phase[k] += m.inc[k];
+			}
+			begin = end;
+		}
+
+		//the decimated carriers replace their outputs in the mix (their modulators are done with them)
+		if(OVERSAMPLED){
+			for(int j=0; j<s.numDecimated; j++){
+				int k = s.decimatedOps[j];
+				int d = m.decimator[k];
+				y[k] = level[k]*drum_halfband(&s.halfbandEven[0][d], &s.halfbandOdd[0][d], DRUM_STACK_DECIMATORS,
+						x[k], xHalf[k]);
+			}
+		}
+
+		float mix = 0;
+		for(int k=0; k<m.numOps; k++){
+			mix += m.gain[k]*y[k];
+		}
+		float v = synthGain*mix;
+		if(noise != 0){
+			v += noiseGain*noiseLevel*noise[i];
+		}
+		out[i] += v;
+	}
+}
+
+void drum_stack_render(const DrumStackModel &m, DrumStackVoice &s, bool coarse, float synthGain,
+		float noiseGain, const float *noise, float *out, int n) {
+
+	if(coarse){
+		render_stack<true, false>(m, s, synthGain, noiseGain, noise, out, n);
+	}
+	else if(s.numOversampled > 0){
+		render_stack<false, true>(m, s, synthGain, noiseGain, noise, out, n);
+	}
+	else{
+		render_stack<false, false>(m, s, synthGain, noiseGain, noise, out, n);
+	}
+}
+
+float drum_stack_sample(const DrumStackModel &m, DrumStackVoice &s, bool coarse, float synthGain,
+		float &noiseLevel) {
+
+	noiseLevel = s.value[m.noiseOp];
+	float y = 0;
+	drum_stack_render(m, s, coarse, synthGain, 0, 0, &y, 1);
+	s.advance(m, 1);
+	return y;
+}
@@ -0,0 +1,234 @@
+/*
+ * drum_fm_stack.h
+ *
+ * N-operator FM voices, for the drums that need more than a carrier and a modulator: the
+ * floor tom (three summed FM layers in DrumMachine_FloorTom.m), the ride (DrumMachine_Ride.m)
+ * and the crash.
+ *
+ * A DrumStackPatch lists up to DRUM_STACK_MAX_OPS operators.  Each one is a table sine with its
+ * own level envelope, y = level(t)*sin(2*pi*f*t + y_src), where y_src is the output of the
+ * operator that modulates it (none for the unmodulated ones).  The level of a modulator is its
+ * FM index in radians, the level of a carrier its amplitude, and every operator has a weight in
+ * the mix, 0 for pure modulators.  Operators are listed by layer: first the ones nothing
+ * modulates, then the ones they modulate, and so on, so an operator's source always comes
+ * earlier in the list.
+ *
+ * The operators of a layer do not depend on each other, so they are rendered side by side: the
+ * state of a voice is one array per field, indexed by operator, and the loop over a layer's
+ * operators vectorizes like the voice lanes of drum_lanes.h do.  Level envelope stage changes
+ * are handled between segments, as in the lanes.  A voice costs about one table sine and four
+ * multiply-adds per operator and sample; `drum_render --stack` measures the cost per operator.
+ *
+ * Oversampling (drum_fm.h) goes by modulation chain, an operator with everything that modulates it
+ * and everything it modulates: a chain runs at twice the rate once any of its operators folds back
+ * too much (drum_fm_folded()), and the outputs of its carriers go through a decimator each.  The other
+ * chains of the voice stay at the sample rate.
+ */
+
+#ifndef DRUM_FM_STACK_H_
+#define DRUM_FM_STACK_H_
+
+#include <stdint.h>
+#include "drum_envelope.h"
+#include "drum_fm.h"
+
+//operators a stack can have; 8 fills an AVX register
+#define DRUM_STACK_MAX_OPS		8
+
+//carriers of a voice that can be oversampled, each with a decimator; the chains of the carriers
+//past these stay at the sample rate
+#define DRUM_STACK_DECIMATORS	4
+
+//level envelope of an operator
+enum DrumStackShape {
+	DRUM_STACK_ATTACK_DECAY = 0,	//ramp up to `level` at `time`, then level*exp(-(t-time)/tau)
+	DRUM_STACK_LINE,				//level*(1 - t/time), carrying on past 0 until r
+	DRUM_STACK_EXP					//level*exp(-t/tau), for as long as the drum (r is not used)
+};
+
+struct DrumStackOp {
+	int src;		//operator that modulates this one, -1 for none
+	float freq;		//Hz, times (1 + knob) for the drums on a knob
+	float gain;		//weight in the mix, 0 for a modulator
+	int shape;		//DrumStackShape
+	float level;	//peak amplitude, or FM index in radians for a modulator
+	float time;		//ATTACK_DECAY: time of the peak; LINE: time the line crosses 0
+	float tau;		//ATTACK_DECAY, EXP: decay time constant
+	float r;		//silent after r seconds; 0 to last as long as the drum
+};
+
+struct DrumStackPatch {
+	int numOps;
+	DrumStackOp op[DRUM_STACK_MAX_OPS];
+	int noiseOp;	//operator whose level shapes the drum's noise
+};
+
+enum DrumStackType {
+	DRUM_STACK_FLOORTOM = 0,
+	DRUM_STACK_RIDE,
+	DRUM_STACK_CRASH,
+	DRUM_STACK_NUM_TYPES
+};
+
+static constexpr DrumStackPatch drumStackPatches[] = {
+	//Floor tom, DrumMachine_FloorTom.m: a 90 Hz ring and a 100 Hz stick, each with its own
+	//modulator, and a quiet 600 Hz tone over the first third
+	{ 5, {
+		//src  freq   gain   shape                     level   time      tau    r
+		{ -1,   50,   0,     DRUM_STACK_LINE,          2,      0.5f,     0,     0 },
+		{ -1,   80,   0,     DRUM_STACK_LINE,          5,      0.1f,     0,     0.1f },
+		{ -1,  600,   0.01f, DRUM_STACK_ATTACK_DECAY,  0.6f,   0.00469f, 0.15f, 0.55f/3 },
+		{  0,   90,   1,     DRUM_STACK_ATTACK_DECAY,  0.6f,   0.00469f, 0.15f, 0 },
+		{  1,  100,   1,     DRUM_STACK_LINE,          1,      0.1f,     0,     0.1f } },
+		3 },
+
+	//Ride, DrumMachine_Ride.m: a 790 Hz carrier under a decaying 1.2x modulator, over noise
+	{ 2, {
+		{ -1,  948,   0,     DRUM_STACK_EXP,           10,     0,        0.85f, 0 },
+		{  0,  790,   1,     DRUM_STACK_ATTACK_DECAY,  1,      0.0224f,  0.65f, 0 } },
+		1 },
+
+	//Crash: no recording or model; the ride's pair with two more at inharmonic ratios, faster
+	//index and amplitude decays for the higher ones, a quicker attack and brighter noise
+	{ 6, {
+		{ -1,  948,   0,     DRUM_STACK_EXP,           10,     0,        0.5f,  0 },
+		{ -1, 1711,   0,     DRUM_STACK_EXP,           8,      0,        0.4f,  0 },
+		{ -1, 2719,   0,     DRUM_STACK_EXP,           6,      0,        0.3f,  0 },
+		{  0,  790,   1,     DRUM_STACK_ATTACK_DECAY,  1,      0.002f,   0.8f,  0 },
+		{  1, 1163,   0.8f,  DRUM_STACK_ATTACK_DECAY,  1,      0.002f,   0.6f,  0 },
+		{  2, 1987,   0.6f,  DRUM_STACK_ATTACK_DECAY,  1,      0.002f,   0.45f, 0 } },
+		3 }
+};
+
+static_assert(sizeof(drumStackPatches)/sizeof(drumStackPatches[0]) == DRUM_STACK_NUM_TYPES,
+		"one patch per DrumStackType");
+
+//a stack patch at the sample rate
+struct DrumStackModel {
+	int numOps;
+	int numLayers;
+	int layerEnd[DRUM_STACK_MAX_OPS];	//operators [layerEnd[l-1], layerEnd[l]) make up layer l
+
+	//source of each operator's modulation as an index into the outputs of a sample, where
+	//DRUM_STACK_MAX_OPS always holds 0
+	int src[DRUM_STACK_MAX_OPS];
+	float gain[DRUM_STACK_MAX_OPS];
+	uint32_t inc[DRUM_STACK_MAX_OPS];	//this block's phase increments
+	Envelope level[DRUM_STACK_MAX_OPS];
+	int noiseOp;
+
+	//modulation chain of each operator, numbered by its first operator, and whether it runs at
+	//twice the rate
+	int chain[DRUM_STACK_MAX_OPS];
+	bool oversample[DRUM_STACK_MAX_OPS];
+
+	//decimator of the voice each operator in the mix goes through when oversampled, -1 for the
+	//modulators and the carriers past DRUM_STACK_DECIMATORS
+	int decimator[DRUM_STACK_MAX_OPS];
+
+	//drumR: end of the drum, which the operators with r = 0 last until
+	void setup(const DrumStackPatch &patch, float sampleRate, float drumR);
+
+	//phase increments with the frequencies times freqShift
+	void setFrequencies(const DrumStackPatch &patch, float freqShift, float sampleRate);
+
+	//the operators that run at twice the rate for the frequencies times freqShift and a
+	//DrumOversampling mode, into result[] (which the engine copies into oversample[])
+	void findOversampling(const DrumStackPatch &patch, float freqShift, float sampleRate, int mode,
+			bool *result) const;
+};
+
+//the operators of one voice
+struct DrumStackVoice {
+	uint32_t phase[DRUM_STACK_MAX_OPS];
+	float value[DRUM_STACK_MAX_OPS];
+	float mul[DRUM_STACK_MAX_OPS];
+	float add[DRUM_STACK_MAX_OPS];
+	int remaining[DRUM_STACK_MAX_OPS];		//samples to the end of the segment
+	int left[DRUM_STACK_MAX_OPS];			//samples of the stage after the segment
+	float power[DRUM_STACK_MAX_OPS];		//mul^(samples since the stage start) at the segment start
+	int stage[DRUM_STACK_MAX_OPS];
+
+	//operators running at twice the rate, in list order, and the ones among them in the mix, whose
+	//outputs are decimated; the decimator histories are [tap][DrumStackModel::decimator]
+	bool oversampled[DRUM_STACK_MAX_OPS];
+	int numOversampled;
+	int oversampledOps[DRUM_STACK_MAX_OPS];
+	int numDecimated;
+	int decimatedOps[DRUM_STACK_MAX_OPS];
+	float halfbandEven[2*DRUM_HALFBAND_TAPS][DRUM_STACK_DECIMATORS];
+	float halfbandOdd[DRUM_HALFBAND_TAPS][DRUM_STACK_DECIMATORS];
+
+	//back to t = 0 (note on), oversampling the operators the model does if `oversample`
+	void start(const DrumStackModel &m, bool oversample) {
+
+		for(int k=0; k<m.numOps; k++){
+			phase[k] = 0;
+			stage[k] = 0;
+			oversampled[k] = false;
+			enterStage(m, k);
+		}
+		numOversampled = 0;
+		numDecimated = 0;
+		setOversampling(m, oversample);
+	}
+
+	//follow the model's oversample[] (none of it if not `oversample`): the operators that go over
+	//to twice the rate move DRUM_HALFBAND_DELAY samples ahead, filling their decimators on the way at
+	//their current levels, the ones that go back move back
+	void setOversampling(const DrumStackModel &m, bool oversample);
+
+	//operator k's level envelope moves on to stage[k]
+	void enterStage(const DrumStackModel &m, int k) {
+
+		const Envelope &e = m.level[k];
+		if(stage[k] >= e.numStages){
+			stage[k] = e.numStages - 1;
+		}
+		const EnvStage &s = e.stages[stage[k]];
+		mul[k] = s.mul;
+		add[k] = s.add;
+		env_first_segment(s, value[k], remaining[k], left[k], power[k]);
+	}
+
+	//samples, up to n, before any operator's envelope reaches the end of a segment (drum_envelope.h)
+	inline int segment(const DrumStackModel &m, int n) const {
+
+		for(int k=0; k<m.numOps; k++){
+			if(remaining[k] < n){
+				n = remaining[k];
+			}
+		}
+		return n;
+	}
+
+	//count n samples off the segments and move on where one ends
+	inline void advance(const DrumStackModel &m, int n) {
+
+		for(int k=0; k<m.numOps; k++){
+			remaining[k] -= n;
+			if(remaining[k] == 0){
+				if(left[k] > 0){
+					env_next_segment(m.level[k].stages[stage[k]], value[k], remaining[k], left[k], power[k]);
+				}
+				else{
+					stage[k]++;
+					enterStage(m, k);
+				}
+			}
+		}
+	}
+};
+
+//render n samples of a voice, which must not cross the end of a segment (segment()), adding
+//synthGain*(the operator mix) + noiseGain*(the noise operator's level)*noise[i] into out[];
+//noise may be NULL for none.  Does not advance() the stages.
+void drum_stack_render(const DrumStackModel &m, DrumStackVoice &s, bool coarse, float synthGain,
+		float noiseGain, const float *noise, float *out, int n);
+
+//one sample of a voice without its noise term, and the level of its noise operator; advances
+//the stages
+float drum_stack_sample(const DrumStackModel &m, DrumStackVoice &s, bool coarse, float synthGain,
+		float &noiseLevel);
+
+#endif /* DRUM_FM_STACK_H_ */
@@ -0,0 +1,499 @@
+/*
+ * drum_lanes.cpp
+ *
+ * Voice-outer, block-at-a-time render of the DrumEngine.  See drum_lanes.h.
+ *
+ * Each block is cut into segments that end where any lane changes envelope stage, leaves the
+ * sub operator window or reaches the end of its drum.  Inside a segment every lane does the
+ * same multiply-adds, so the segment loops carry no per-sample branches; the stage changes
+ * are done on the DrumVoice between segments.
+ *
+ * The stack drums (drum_fm_stack.h) already run their operators side by side within a voice, so
+ * their voices are rendered one after the other, in segments that end where any operator
+ * changes stage.  So are the toms on modal resonators (drum_modal.h), whose modes run side by
+ * side within a voice the same way.
+ */
+
+#include "drum_engine.h"
+#include "drum_lanes.h"
+#include "drum_profile.h"
+
+template<bool COARSE>
+static inline float lane_sine(uint32_t phase) {
+
+	return COARSE ? drum_sine_coarse(phase) : drum_sine(phase);
+}
+
+//one segment of n samples of drum MODEL for the first WIDTH lanes, added into out[]; the index
+//envelope, the noise term and the mix weights come from the constant patch.  OVERSAMPLED runs the
+//operator at twice the rate, through each lane's decimator
+template<int MODEL, bool SUB, bool COARSE, bool OVERSAMPLED, int WIDTH>
+static void render_segment(DrumLanes &L, const DrumLaneParams &p, float *out, int n) {
+
+	constexpr const DrumPatch &patch = drumPatches[MODEL];
+	const int INDEX = patch.indexKind;
+	const bool NOISE = patch.hasNoise;
+
+	for(int i=0; i<n; i++){
+		float laneOut[WIDTH];
+
+		DRUM_SIMD_FOR
+		for(int l=0; l<WIDTH; l++){
+			float A_t = L.ampValue[l];
+			L.ampValue[l] = A_t*L.ampMul[l] + L.ampAdd[l];
+
+			float I_t;
+			if(INDEX == DRUM_LANE_INDEX_CONST){
+				I_t = p.index0;
+			}
+			else if(INDEX == DRUM_LANE_INDEX_EXP){
+				I_t = p.index0*L.indexValue[l];
+				L.indexValue[l] *= p.indexMul;
+			}
+			else{
+				I_t = p.index0*(L.square[l]*L.decay[l]);
+				L.square[l] += L.squareStep[l];
+				L.squareStep[l] += p.squareStep2;
+				L.decay[l] *= p.decayMul;
+			}
+
+			float mod = I_t*lane_sine<COARSE>(L.modPhase[l]);
+			float y = lane_sine<COARSE>(L.carrierPhase[l] + ((uint32_t)(int32_t)(mod*DRUM_MOD_PER_RADIAN) << 8));
+			if(OVERSAMPLED){
+				float yHalf = drum_fm_sample(L.carrierPhase[l] + (p.carrierInc >> 1), L.modPhase[l] + (p.modInc >> 1), I_t);
+				y = drum_halfband(&L.halfbandEven[0][l], &L.halfbandOdd[0][l], DRUM_LANES, y, yHalf);
+			}
+			L.carrierPhase[l] += p.carrierInc;
+			L.modPhase[l] += p.modInc;
+
+			float v = patch.synthGain*(A_t*y);
+
+			if(SUB){
+				float subA_t = L.subValue[l];
+				L.subValue[l] = subA_t + L.subStep[l];
+				float subMod = patch.subIndex0*subA_t*drum_sine(L.subModPhase[l]);
+				float subY = drum_sine(L.subCarrierPhase[l] + ((uint32_t)(int32_t)(subMod*DRUM_MOD_PER_RADIAN) << 8));
+				L.subCarrierPhase[l] += p.subCarrierInc;
+				L.subModPhase[l] += p.subModInc;
+				v += patch.subGain*L.subGate[l]*(subA_t*subY);
+			}
+
+			if(NOISE){
+				v += patch.noiseGain*(A_t*L.noise[i][l]);
+			}
+
+			laneOut[l] = v;
+		}
+
+		float mix = 0;
+		for(int l=0; l<WIDTH; l++){
+			mix += laneOut[l];
+		}
+		out[i] += mix;
+	}
+}
+
+//step every lane's noise generator n samples; unused lanes make noise too, at zero amplitude
+static void fill_noise(DrumLanes &L, const DrumNoiseFilter &f, int width, int n) {
+
+	if(f.color == DRUM_NOISE_WHITE){
+		for(int i=0; i<n; i++){
+			DRUM_SIMD_FOR
+			for(int l=0; l<width; l++){
+				uint32_t s = drum_xorshift(L.noiseState[l]);
+				L.noiseState[l] = s;
+				L.noise[i][l] = f.gain*drum_noise_sample(s);
+			}
+		}
+		return;
+	}
+
+	for(int i=0; i<n; i++){
+		DRUM_SIMD_FOR
+		for(int l=0; l<width; l++){
+			uint32_t s = drum_xorshift(L.noiseState[l]);
+			L.noiseState[l] = s;
+			float x = drum_noise_sample(s);
+			float y = f.gain*x + f.feedback*L.noiseZ[l];
+			L.noiseZ[l] = x + f.recursive*(y - x);
+			L.noise[i][l] = y;
+		}
+	}
+}
+
+//a lone voice in lane 0 is rendered one lane wide instead of paying for DRUM_LANES
+template<int MODEL, bool SUB, bool COARSE, bool OVERSAMPLED>
+static void render_segment_width(DrumLanes &L, const DrumLaneParams &p, bool single, float *out, int n) {
+
+	if(single){
+		render_segment<MODEL, SUB, COARSE, OVERSAMPLED, 1>(L, p, out, n);
+	}
+	else{
+		render_segment<MODEL, SUB, COARSE, OVERSAMPLED, DRUM_LANES>(L, p, out, n);
+	}
+}
+
+//full quality lanes, at the sample rate or oversampled
+template<int MODEL, bool SUB>
+static void render_segment_full(DrumLanes &L, const DrumLaneParams &p, bool single, float *out, int n) {
+
+	if(p.oversample){
+		render_segment_width<MODEL, SUB, false, true>(L, p, single, out, n);
+	}
+	else{
+		render_segment_width<MODEL, SUB, false, false>(L, p, single, out, n);
+	}
+}
+
+//reduced quality lanes never run the sub operator or oversample, and drums without a sub operator
+//never instantiate it
+template<int MODEL>
+static void render_segment_model(DrumLanes &L, const DrumLaneParams &p, bool anyGate, bool single, float *out, int n) {
+
+	if(p.coarse){
+		render_segment_width<MODEL, false, true, false>(L, p, single, out, n);
+	}
+	else if(drumPatches[MODEL].hasSub && anyGate){
+		render_segment_full<MODEL, drumPatches[MODEL].hasSub>(L, p, single, out, n);
+	}
+	else{
+		render_segment_full<MODEL, false>(L, p, single, out, n);
+	}
+}
+
+typedef void (*DrumSegmentRenderer)(DrumLanes &L, const DrumLaneParams &p, bool anyGate, bool single,
+		float *out, int n);
+
+//render_segment_model() of every drum, in DrumType order
+static const DrumSegmentRenderer segmentRenderers[] = {
+	render_segment_model<DRUM_KICK>,
+	render_segment_model<DRUM_SNARE>,
+	render_segment_model<DRUM_MIDTOM>,
+	render_segment_model<DRUM_HIGHTOM>,
+	render_segment_model<DRUM_HIHAT>,
+	0,	//stack drums: renderStackVoice()
+	0,
+	0
+};
+
+static_assert(sizeof(segmentRenderers)/sizeof(segmentRenderers[0]) == DRUM_NUM_TYPES, "one renderer per DrumType");
+
+//coefficients the voices of a drum share this block; the rest of the patch is compiled into
+//its render_segment()
+void DrumEngine::laneParams(int drum, DrumLaneParams &p) {
+
+	const DrumPatch &patch = drumPatches[drum];
+	const DrumModel &m = model[drum];
+
+	p.drum = drum;
+	p.hasSub = patch.hasSub;
+	p.hasNoise = patch.hasNoise;
+	p.coarse = false;
+	p.oversample = m.oversample;
+	p.length = drumLength[drum];
+	p.subLength = m.subLength;
+
+	p.carrierInc = m.op.carrierInc;
+	p.modInc = m.op.modInc;
+	p.subCarrierInc = patch.hasSub ? m.subOp.carrierInc : 0;
+	p.subModInc = patch.hasSub ? m.subOp.modInc : 0;
+	p.index0 = m.I_0;
+	p.indexMul = patch.indexKind == DRUM_LANE_INDEX_EXP ? m.index.stages[0].mul : 1;
+	p.squareStep2 = patch.indexKind == DRUM_LANE_INDEX_GAMMA ? m.gammaIndex.squareStep2 : 0;
+	p.decayMul = patch.indexKind == DRUM_LANE_INDEX_GAMMA ? m.gammaIndex.decayMul : 1;
+
+	p.noiseFilter = noiseFilter[drum];
+}
+
+//render a block of lanes into out[]; voices that end unheld are added to finished[]
+void DrumEngine::renderLanes(DrumLanes &L, const DrumLaneParams &p, float *out, int numSamples,
+		DrumVoice **finished, int &numFinished) {
+
+	const DrumModel &m = model[p.drum];
+	int pos = 0;
+	while(pos < numSamples){
+
+		//the segment ends at the first stage change of any lane
+		int n = numSamples - pos;
+		if(n > DRUM_LANE_CHUNK){
+			n = DRUM_LANE_CHUNK;
+		}
+		int numLive = 0;
+		bool anyGate = false;
+		for(int l=0; l<DRUM_LANES; l++){
+			if(L.voice[l] == 0){
+				continue;
+			}
+			numLive++;
+			if(L.ampRemaining[l] < n){
+				n = L.ampRemaining[l];
+			}
+			if(p.length - L.counter[l] < n){
+				n = p.length - L.counter[l];
+			}
+			bool gate = p.hasSub && L.counter[l] <= p.subLength;
+			L.subGate[l] = gate ? 1.0f : 0.0f;
+			L.subStep[l] = gate ? L.voice[l]->fm.subAmp.add : 0.0f;
+			if(gate){
+				anyGate = true;
+				if(p.subLength + 1 - L.counter[l] < n){
+					n = p.subLength + 1 - L.counter[l];
+				}
+				if(L.subRemaining[l] < n){
+					n = L.subRemaining[l];
+				}
+			}
+		}
+		if(numLive == 0){
+			return;
+		}
+
+		bool single = numLive == 1 && L.voice[0] != 0;
+		if(p.hasNoise){
+			fill_noise(L, p.noiseFilter, single ? 1 : DRUM_LANES, n);
+		}
+
+		segmentRenderers[p.drum](L, p, anyGate, single, &out[pos], n);
+		pos += n;
+
+		//stage changes and the end of the drum, on the voice itself
+		for(int l=0; l<DRUM_LANES; l++){
+			DrumVoice *v = L.voice[l];
+			if(v == 0){
+				continue;
+			}
+			L.counter[l] += n;
+			L.ampRemaining[l] -= n;
+			if(L.subGate[l] != 0){
+				L.subRemaining[l] -= n;
+			}
+
+			bool ampDone = L.ampRemaining[l] == 0;
+			bool subDone = L.subGate[l] != 0 && L.subRemaining[l] == 0;
+			if(!ampDone && !subDone && L.counter[l] != p.length){
+				continue;
+			}
+
+			L.store(l);
+			if(L.counter[l] == p.length){
+				//end of the drum sound: loop if the key is still held, otherwise free the voice
+				if(v->held){
+					startVoice(*v);
+				}
+				else{
+					finished[numFinished++] = v;
+					L.clear(l);
+					continue;
+				}
+			}
+			else{
+				if(ampDone){
+					v->fm.amp.nextSegment(m.amp);
+				}
+				if(subDone){
+					v->fm.subAmp.nextSegment(m.subAmp);
+				}
+			}
+			L.load(l, v);
+		}
+	}
+}
+
+//render a block of a stack drum's voice into out[]; adds it to finished[] if it ends unheld, and
+//returns the samples it rendered
+int DrumEngine::renderStackVoice(DrumVoice &v, float *out, int numSamples, DrumVoice **finished,
+		int &numFinished) {
+
+	const DrumPatch &patch = drumPatches[v.drum];
+	const DrumStackModel &m = model[v.drum].stack;
+	int length = drumLength[v.drum];
+	float noise[DRUM_LANE_CHUNK];
+
+	int pos = 0;
+	while(pos < numSamples){
+		int n = numSamples - pos;
+		if(n > DRUM_LANE_CHUNK){
+			n = DRUM_LANE_CHUNK;
+		}
+		if(length - v.counter < n){
+			n = length - v.counter;
+		}
+		n = v.stack.segment(m, n);
+
+		if(patch.hasNoise){
+			v.noise.fill(noiseFilter[v.drum], noise, n);
+		}
+		drum_stack_render(m, v.stack, v.reduced, patch.synthGain, patch.noiseGain,
+				patch.hasNoise ? noise : 0, &out[pos], n);
+		v.stack.advance(m, n);
+		pos += n;
+
+		//end of the drum sound: loop if the key is still held, otherwise free the voice
+		v.counter += n;
+		if(v.counter == length){
+			if(v.held){
+				startVoice(v);
+			}
+			else{
+				finished[numFinished++] = &v;
+				break;
+			}
+		}
+	}
+	return pos;
+}
+
+//render a block of a modal tom's voice into out[]; adds it to finished[] if it ends unheld, and
+//returns the samples it rendered
+int DrumEngine::renderModalVoice(DrumVoice &v, float *out, int numSamples, DrumVoice **finished,
+		int &numFinished) {
+
+	const DrumModalModel &m = model[v.drum].modal;
+	int length = drumLength[v.drum];
+
+	int pos = 0;
+	while(pos < numSamples){
+		int n = numSamples - pos;
+		if(length - v.counter < n){
+			n = length - v.counter;
+		}
+		drum_modal_render(m, v.bank, v.reduced, &out[pos], n);
+		pos += n;
+
+		//end of the drum sound: loop if the key is still held, otherwise free the voice
+		v.counter += n;
+		if(v.counter == length){
+			if(v.held){
+				startVoice(v);
+			}
+			else{
+				finished[numFinished++] = &v;
+				break;
+			}
+		}
+	}
+	return pos;
+}
+
+//render voices of one drum into out[]: the stack drums and the modal toms a voice at a time, the
+//others DRUM_LANES at a time, all at full or all at reduced quality.  t is the clock at the end of
+//what was rendered before, each voice's or group of lanes' cycles run from there
+void DrumEngine::renderGroup(DrumVoice **voices, int count, float *out, int numSamples, DrumVoice **finished,
+		int &numFinished, uint32_t &t) {
+
+	int d = voices[0]->drum;
+	if(voices[0]->modal || drumPatches[d].stack >= 0){
+		for(int g=0; g<count; g++){
+			DrumVoice &v = *voices[g];
+			int n = v.modal ? renderModalVoice(v, out, numSamples, finished, numFinished)
+					: renderStackVoice(v, out, numSamples, finished, numFinished);
+			if(profiler != 0){
+				uint32_t t1 = profiler->now();
+				profiler->addDrum(d, t1 - t, n);
+				profiler->addVoice((int)(&v - pool.voices), d, t1 - t);
+				t = t1;
+			}
+		}
+		return;
+	}
+
+	DrumLaneParams params;
+	laneParams(d, params);
+	if(voices[0]->reduced){
+		params.coarse = true;
+		params.hasSub = false;
+		params.oversample = false;
+	}
+	lanes.oversample = params.oversample;
+
+	for(int g=0; g<count; g+=DRUM_LANES){
+		for(int l=0; l<DRUM_LANES; l++){
+			if(g + l < count){
+				lanes.load(l, voices[g + l]);
+			}
+			else{
+				lanes.clear(l);
+			}
+		}
+
+		renderLanes(lanes, params, out, numSamples, finished, numFinished);
+
+		for(int l=0; l<DRUM_LANES; l++){
+			if(lanes.voice[l] != 0){
+				lanes.store(l);
+			}
+		}
+
+		//the lanes of a group share its cost
+		if(profiler != 0){
+			int n = count - g < DRUM_LANES ? count - g : DRUM_LANES;
+			uint32_t t1 = profiler->now();
+			profiler->addDrum(d, t1 - t, n*numSamples);
+			for(int l=0; l<n; l++){
+				profiler->addVoice((int)(voices[g + l] - pool.voices), d, (t1 - t)/n);
+			}
+			t = t1;
+		}
+	}
+}
+
+void DrumEngine::renderVoiceOuter(float *out, int numSamples) {
+
+	for(int i=0; i<numSamples; i++){
+		out[i] = 0;
+	}
+
+	//group the sounding voices by drum, and the full quality ones apart from the reduced ones; the
+	//modal toms on their own.  A hit on a delay renders on its own from where it starts, or not at
+	//all if that is past the block
+	DrumVoice *group[2*DRUM_NUM_TYPES][DRUM_MAX_VOICES];
+	int groupSize[2*DRUM_NUM_TYPES] = { 0 };
+	DrumVoice *modalVoices[DRUM_MAX_VOICES];
+	int numModal = 0;
+	DrumVoice *delayed[DRUM_MAX_VOICES];
+	int numDelayed = 0;
+	for(int a=0; a<pool.numActive; a++){
+		DrumVoice &v = pool.voices[pool.active[a]];
+		if(!owns(v)){
+			continue;
+		}
+		if(v.delay >= numSamples){
+			v.delay -= numSamples;
+			continue;
+		}
+		if(v.delay > 0){
+			delayed[numDelayed++] = &v;
+			continue;
+		}
+		if(v.modal){
+			modalVoices[numModal++] = &v;
+			continue;
+		}
+		int k = 2*v.drum + (v.reduced ? 1 : 0);
+		group[k][groupSize[k]++] = &v;
+	}
+
+	DrumVoice *finished[DRUM_MAX_VOICES];
+	int numFinished = 0;
+
+	//one clock read per group of lanes: each group's cycles run from the end of the one before
+	uint32_t t = profiler != 0 ? profiler->now() : 0;
+
+	for(int k=0; k<2*DRUM_NUM_TYPES; k++){
+		if(groupSize[k] != 0){
+			renderGroup(group[k], groupSize[k], out, numSamples, finished, numFinished, t);
+		}
+	}
+	for(int g=0; g<numModal; g++){
+		renderGroup(&modalVoices[g], 1, out, numSamples, finished, numFinished, t);
+	}
+	for(int g=0; g<numDelayed; g++){
+		int start = delayed[g]->delay;
+		delayed[g]->delay = 0;
+		renderGroup(&delayed[g], 1, &out[start], numSamples - start, finished, numFinished, t);
+	}
+
+	for(int f=0; f<numFinished; f++){
+		pool.release(*finished[f]);
+	}
+}
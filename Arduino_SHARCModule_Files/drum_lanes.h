@@ -0,0 +1,208 @@
+/*
+ * drum_lanes.h
+ *
+ * Structure-of-arrays state for rendering several voices of the same drum side by side.
+ *
+ * In the voice-outer render the voices of one drum are loaded into the lanes of a DrumLanes
+ * (every field is an array indexed by lane), rendered for a whole block, and stored back into
+ * their DrumVoice.  Voices of the same drum share every coefficient except their own state, so
+ * the per-sample loop over the lanes is straight-line code the compiler turns into SIMD: SSE or
+ * AVX on the host, the PEx/PEy SIMD mode on the SHARC.  Envelope stage changes and the end of
+ * the drum are handled between segments of the block, never inside the lane loop.
+ */
+
+#ifndef DRUM_LANES_H_
+#define DRUM_LANES_H_
+
+#include <stdint.h>
+#include "drum_voice_pool.h"
+
+//voices rendered together; 8 fills an AVX register, 4 an SSE register or two SHARC SIMD pairs
+#ifndef DRUM_LANES
+#if defined(__AVX__)
+#define DRUM_LANES			8
+#else
+#define DRUM_LANES			4
+#endif
+#endif
+
+//longest run of samples rendered between two checks for stage changes
+#define DRUM_LANE_CHUNK		32
+
+//marks the per-sample lane loops for the vectorizer
+#if defined(__ADSP21000__)
+#define DRUM_SIMD_FOR		_Pragma("SIMD_for")
+#elif defined(__GNUC__)
+#define DRUM_SIMD_FOR		_Pragma("GCC ivdep")
+#else
+#define DRUM_SIMD_FOR
+#endif
+
+#if defined(__GNUC__)
+#define DRUM_LANE_ALIGN		__attribute__((aligned(32)))
+#else
+#define DRUM_LANE_ALIGN
+#endif
+
+//how a drum's FM index moves over time
+enum DrumLaneIndex {
+	DRUM_LANE_INDEX_CONST = 0,	//I_0
+	DRUM_LANE_INDEX_EXP,		//I_0*exp(-t/tauf), Envelope
+	DRUM_LANE_INDEX_GAMMA		//I_0*C*(t+t0)^2*exp(-k*(t+t0)), GammaEnvelope
+};
+
+//everything the lanes of one drum share during a block, besides its constant patch
+//(drum_patches.h)
+struct DrumLaneParams {
+	int drum;			//DrumType
+	bool hasSub;		//percussive sub operator (kick, toms)
+	bool hasNoise;		//noise term (snare, hihat)
+	bool coarse;		//reduced quality voices: drum_sine_coarse(), no sub operator
+	bool oversample;	//the operator at twice the rate, through the lanes' decimators
+	int length;			//samples the drum plays for
+	int subLength;		//last sample of the sub operator
+
+	uint32_t carrierInc, modInc;
+	uint32_t subCarrierInc, subModInc;
+	float index0;		//I_0
+	float indexMul;		//exp index decay per sample
+	float squareStep2;	//gamma index second difference
+	float decayMul;		//gamma index decay per sample
+
+	DrumNoiseFilter noiseFilter;
+};
+
+struct DrumLanes {
+	DrumVoice *voice[DRUM_LANES];		//NULL for an unused lane, which renders silence
+
+	//the DrumLaneParams::oversample the lanes render with; load() and store() move the
+	//decimator histories only then
+	bool oversample;
+
+	int counter[DRUM_LANES] DRUM_LANE_ALIGN;
+
+	float ampValue[DRUM_LANES] DRUM_LANE_ALIGN;
+	float ampMul[DRUM_LANES] DRUM_LANE_ALIGN;
+	float ampAdd[DRUM_LANES] DRUM_LANE_ALIGN;
+	int ampRemaining[DRUM_LANES] DRUM_LANE_ALIGN;
+
+	float indexValue[DRUM_LANES] DRUM_LANE_ALIGN;
+	float square[DRUM_LANES] DRUM_LANE_ALIGN;
+	float squareStep[DRUM_LANES] DRUM_LANE_ALIGN;
+	float decay[DRUM_LANES] DRUM_LANE_ALIGN;
+
+	uint32_t carrierPhase[DRUM_LANES] DRUM_LANE_ALIGN;
+	uint32_t modPhase[DRUM_LANES] DRUM_LANE_ALIGN;
+
+	//decimator histories of the oversampled operators, [tap][lane]
+	float halfbandEven[2*DRUM_HALFBAND_TAPS][DRUM_LANES] DRUM_LANE_ALIGN;
+	float halfbandOdd[DRUM_HALFBAND_TAPS][DRUM_LANES] DRUM_LANE_ALIGN;
+
+	//the sub operator only advances while its gate is 1 (within the first subLength samples)
+	float subValue[DRUM_LANES] DRUM_LANE_ALIGN;
+	float subStep[DRUM_LANES] DRUM_LANE_ALIGN;		//subAmp.add while gated, else 0
+	float subGate[DRUM_LANES] DRUM_LANE_ALIGN;
+	int subRemaining[DRUM_LANES] DRUM_LANE_ALIGN;
+	uint32_t subCarrierPhase[DRUM_LANES] DRUM_LANE_ALIGN;
+	uint32_t subModPhase[DRUM_LANES] DRUM_LANE_ALIGN;
+
+	//noise generators, and the noise for the current segment, [sample][lane]
+	uint32_t noiseState[DRUM_LANES] DRUM_LANE_ALIGN;
+	float noiseZ[DRUM_LANES] DRUM_LANE_ALIGN;
+	float noise[DRUM_LANE_CHUNK][DRUM_LANES] DRUM_LANE_ALIGN;
+
+	//copy a voice's state into lane l
+	void load(int l, DrumVoice *v) {
+
+		voice[l] = v;
+		counter[l] = v->counter;
+		ampValue[l] = v->fm.amp.value;
+		ampMul[l] = v->fm.amp.mul;
+		ampAdd[l] = v->fm.amp.add;
+		ampRemaining[l] = v->fm.amp.remaining;
+		indexValue[l] = v->fm.index.value;
+		square[l] = v->fm.gammaIndex.square;
+		squareStep[l] = v->fm.gammaIndex.squareStep;
+		decay[l] = v->fm.gammaIndex.decay;
+		carrierPhase[l] = v->fm.op.carrierPhase;
+		modPhase[l] = v->fm.op.modPhase;
+		if(oversample){
+			for(int k=0; k<2*DRUM_HALFBAND_TAPS; k++){
+				halfbandEven[k][l] = v->fm.halfband.even[k];
+			}
+			for(int k=0; k<DRUM_HALFBAND_TAPS; k++){
+				halfbandOdd[k][l] = v->fm.halfband.odd[k];
+			}
+		}
+		subValue[l] = v->fm.subAmp.value;
+		subStep[l] = 0;
+		subGate[l] = 0;
+		subRemaining[l] = v->fm.subAmp.remaining;
+		subCarrierPhase[l] = v->fm.subOp.carrierPhase;
+		subModPhase[l] = v->fm.subOp.modPhase;
+		noiseState[l] = v->noise.state;
+		noiseZ[l] = v->noise.z;
+	}
+
+	//write lane l back into its voice
+	void store(int l) {
+
+		DrumVoice *v = voice[l];
+		v->counter = counter[l];
+		v->fm.amp.value = ampValue[l];
+		v->fm.amp.remaining = ampRemaining[l];
+		v->fm.index.value = indexValue[l];
+		v->fm.gammaIndex.square = square[l];
+		v->fm.gammaIndex.squareStep = squareStep[l];
+		v->fm.gammaIndex.decay = decay[l];
+		v->fm.op.carrierPhase = carrierPhase[l];
+		v->fm.op.modPhase = modPhase[l];
+		if(oversample){
+			for(int k=0; k<2*DRUM_HALFBAND_TAPS; k++){
+				v->fm.halfband.even[k] = halfbandEven[k][l];
+			}
+			for(int k=0; k<DRUM_HALFBAND_TAPS; k++){
+				v->fm.halfband.odd[k] = halfbandOdd[k][l];
+			}
+		}
+		v->fm.subAmp.value = subValue[l];
+		v->fm.subAmp.remaining = subRemaining[l];
+		v->fm.subOp.carrierPhase = subCarrierPhase[l];
+		v->fm.subOp.modPhase = subModPhase[l];
+		v->noise.state = noiseState[l];
+		v->noise.z = noiseZ[l];
+	}
+
+	//unused lane: zero amplitude forever, so its noise is never heard
+	void clear(int l) {
+
+		voice[l] = 0;
+		counter[l] = 0;
+		ampValue[l] = 0;
+		ampMul[l] = 0;
+		ampAdd[l] = 0;
+		ampRemaining[l] = 0;
+		indexValue[l] = 0;
+		square[l] = 0;
+		squareStep[l] = 0;
+		decay[l] = 0;
+		carrierPhase[l] = 0;
+		modPhase[l] = 0;
+		for(int k=0; k<2*DRUM_HALFBAND_TAPS; k++){
+			halfbandEven[k][l] = 0;
+		}
+		for(int k=0; k<DRUM_HALFBAND_TAPS; k++){
+			halfbandOdd[k][l] = 0;
+		}
+		subValue[l] = 0;
+		subStep[l] = 0;
+		subGate[l] = 0;
+		subRemaining[l] = 0;
+		subCarrierPhase[l] = 0;
+		subModPhase[l] = 0;
+		noiseState[l] = 1;
+		noiseZ[l] = 0;
+	}
+};
+
+#endif /* DRUM_LANES_H_ */
@@ -0,0 +1,164 @@
+/*
+ * drum_midi_queue.h
+ *
+ * Lock-free, timestamped MIDI event queue from the UART interrupt to the audio callback.
+ *
+ * midi_rx_callback_sharc1() is the only producer and processaudio_callback() the only consumer,
+ * so a ring with a head index written only by the producer and a tail index written only by the
+ * consumer needs no locks: each side publishes its index with one aligned store after a
+ * barrier (drum_atomic.h).
+ *
+ * Every event carries the sample-clock position at which it arrived.  DrumMidiClock gives the
+ * interrupt that position: the start of the current audio period plus the core cycles elapsed
+ * since the callback began it.  The callback renders the events that arrived during the
+ * previous period at the same offset inside the current block, so every hit lands exactly one
+ * block after it was played, whatever AUDIO_BLOCK_SIZE is, instead of on the next block
+ * boundary.
+ */
+
+#ifndef DRUM_MIDI_QUEUE_H_
+#define DRUM_MIDI_QUEUE_H_
+
+#include <stdint.h>
+#include "drum_atomic.h"
+
+//events the queue holds; a power of two
+#ifndef DRUM_MIDI_QUEUE_SIZE
+#define DRUM_MIDI_QUEUE_SIZE	256
+#endif
+
+//SHARC core clock the cycle counter runs at
+#ifndef DRUM_CORE_CLOCK_HZ
+#define DRUM_CORE_CLOCK_HZ		450000000.0
+#endif
+
+//MIDI status nibbles the engine acts on
+#define MIDI_NOTE_OFF			0x80
+#define MIDI_NOTE_ON			0x90
+#define MIDI_CONTROL_CHANGE		0xb0
+
+//channel mode message (a control change) that silences everything at once
+#define MIDI_ALL_SOUND_OFF		120
+
+struct DrumMidiEvent {
+	uint32_t time;		//sample clock at arrival
+	uint8_t status;		//status byte including the channel
+	uint8_t data1;		//note
+	uint8_t data2;		//velocity
+};
+
+class DrumMidiQueue {
+
+	public:
+		//events dropped because the queue was full
+		volatile uint32_t overflows;
+
+		//most events that were waiting at once
+		volatile uint32_t maxDepth;
+
+		void reset() {
+
+			head = 0;
+			tail = 0;
+			overflows = 0;
+			maxDepth = 0;
+		}
+
+		//producer: false (and an overflow counted) if the queue is full
+		inline bool push(const DrumMidiEvent &event) {
+
+			uint32_t h = head;
+			uint32_t depth = h - tail;
+			if(depth >= DRUM_MIDI_QUEUE_SIZE){
+				overflows++;
+				return false;
+			}
+			events[h & (DRUM_MIDI_QUEUE_SIZE - 1)] = event;
+			DRUM_RELEASE_BARRIER();
+			head = h + 1;
+
+			if(depth + 1 > maxDepth){
+				maxDepth = depth + 1;
+			}
+			return true;
+		}
+
+		//consumer: the oldest event without removing it, false if the queue is empty
+		inline bool peek(DrumMidiEvent &event) {
+
+			uint32_t t = tail;
+			if(head == t){
+				return false;
+			}
+			DRUM_ACQUIRE_BARRIER();
+			event = events[t & (DRUM_MIDI_QUEUE_SIZE - 1)];
+			return true;
+		}
+
+		//consumer: drop the event peek() returned
+		inline void pop() {
+
+			DRUM_RELEASE_BARRIER();
+			tail = tail + 1;
+		}
+
+		//events waiting; either side may call it
+		inline uint32_t depth() {
+
+			return head - tail;
+		}
+
+	private:
+		DrumMidiEvent events[DRUM_MIDI_QUEUE_SIZE];
+		volatile uint32_t head;		//next slot the producer writes
+		volatile uint32_t tail;		//next slot the consumer reads
+};
+
+//sample clock for timestamping in the MIDI interrupt
+class DrumMidiClock {
+
+	public:
+		void setup(float sampleRate) {
+
+			samplesPerCycle = sampleRate/DRUM_CORE_CLOCK_HZ;
+			current = 0;
+			periods[0].sample = 0;
+			periods[0].cycles = 0;
+		}
+
+		//audio callback: a new period starts at sample clock `sample`, cycle counter `cycles`
+		inline void startPeriod(uint32_t sample, uint32_t cycles) {
+
+			//write the slot the interrupt is not reading, then switch to it with one store
+			int next = current ^ 1;
+			periods[next].sample = sample;
+			periods[next].cycles = cycles;
+			DRUM_RELEASE_BARRIER();
+			current = next;
+		}
+
+		//sample clock at which the current period started
+		inline uint32_t periodStart() {
+
+			return periods[current].sample;
+		}
+
+		//MIDI interrupt: sample clock now (nearest sample), from the cycle counter
+		inline uint32_t now(uint32_t cycles) {
+
+			const Period &p = periods[current];
+			DRUM_ACQUIRE_BARRIER();
+			return p.sample + (uint32_t)((float)(cycles - p.cycles)*samplesPerCycle + 0.5f);
+		}
+
+	private:
+		struct Period {
+			uint32_t sample;
+			uint32_t cycles;
+		};
+		Period periods[2];
+		volatile int current;
+		float samplesPerCycle;
+};
+
+#endif /* DRUM_MIDI_QUEUE_H_ */
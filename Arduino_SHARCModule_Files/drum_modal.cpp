@@ -0,0 +1,136 @@
+/*
+ * drum_modal.cpp
+ *
+ * Modal resonator toms.  See drum_modal.h.
+ */
+
+#include <math.h>
+#include "drum_modal.h"
+#include "drum_lanes.h"
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+void DrumModalModel::setup(const DrumModalPatch &patch, float sampleRate, float synthGain) {
+
+	numModes = patch.numModes;
+	for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+		startRe[k] = 0;
+		startIm[k] = 0;
+	}
+	for(int k=0; k<numModes; k++){
+		const DrumModalMode &mode = patch.mode[k];
+		startRe[k] = (float)(synthGain*mode.amp*cos(mode.phase));
+		startIm[k] = (float)(synthGain*mode.amp*sin(mode.phase));
+	}
+
+	//the knobs move the poles from the first block on; their radii, the decays, stay these
+	findPoles(patch, 1, sampleRate, poleRe, poleIm);
+
+	//the ramp reaches 1 on the sample at `attack`
+	rampLength = (int)floor(patch.attack*sampleRate + 1e-3);
+	rampStep = rampLength > 0 ? 1.0f/rampLength : 0;
+}
+
+void DrumModalModel::findPoles(const DrumModalPatch &patch, float freqShift, float sampleRate, float *re,
+		float *im) const {
+
+	for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+		re[k] = 0;
+		im[k] = 0;
+	}
+	for(int k=0; k<numModes; k++){
+		const DrumModalMode &mode = patch.mode[k];
+		double freq = (double)mode.freq*freqShift;
+		if(freq >= sampleRate/2){
+			continue;
+		}
+		double radius = exp(-1/(mode.tau*(double)sampleRate));
+		double w = 2*PI*freq/sampleRate;
+		re[k] = (float)(radius*cos(w));
+		im[k] = (float)(radius*sin(w));
+	}
+}
+
+int DrumModalModel::silentAfter(float level, int limit) const {
+
+	//the modes together are at most sum_k |start_k|*|pole_k|^n, which only falls: the first n
+	//below level, by bisection
+	float mag[DRUM_MODAL_MAX_MODES], logRadius[DRUM_MODAL_MAX_MODES];
+	for(int k=0; k<numModes; k++){
+		mag[k] = sqrtf(startRe[k]*startRe[k] + startIm[k]*startIm[k]);
+		logRadius[k] = 0.5f*logf(poleRe[k]*poleRe[k] + poleIm[k]*poleIm[k] + 1e-30f);
+	}
+	int lo = 0, hi = limit;
+	while(lo < hi){
+		int n = (lo + hi)/2;
+		float bound = 0;
+		for(int k=0; k<numModes; k++){
+			bound += mag[k]*expf(logRadius[k]*n);
+		}
+		if(bound < level){
+			hi = n;
+		}
+		else{
+			lo = n + 1;
+		}
+	}
+	return lo;
+}
+
+//WIDTH modes for n samples, times the attack ramp if RAMP
+template<int WIDTH, bool RAMP>
+static void render_modes(const DrumModalModel &m, DrumModalVoice &s, float *out, int n) {
+
+	float ramp = s.ramp;
+	for(int i=0; i<n; i++){
+		float y[WIDTH];
+
+		DRUM_SIMD_FOR
+		for(int k=0; k<WIDTH; k++){
+			float re = s.re[k], im = s.im[k];
+			y[k] = im;
+			s.re[k] = re*m.poleRe[k] - im*m.poleIm[k];
+			s.im[k] = re*m.poleIm[k] + im*m.poleRe[k];
+		}
+
+		float mix = 0;
+		for(int k=0; k<WIDTH; k++){
+			mix += y[k];
+		}
+		if(RAMP){
+			mix *= ramp;
+			ramp += m.rampStep;
+		}
+		out[i] += mix;
+	}
+	s.ramp = ramp;
+}
+
+template<int WIDTH>
+static void render_width(const DrumModalModel &m, DrumModalVoice &s, float *out, int n) {
+
+	//the attack, then the ring at full level
+	int a = s.rampLeft < n ? s.rampLeft : n;
+	if(a > 0){
+		render_modes<WIDTH, true>(m, s, out, a);
+		s.rampLeft -= a;
+		if(s.rampLeft == 0){
+			s.ramp = 1;
+		}
+	}
+	if(n > a){
+		render_modes<WIDTH, false>(m, s, &out[a], n - a);
+	}
+}
+
+void drum_modal_render(const DrumModalModel &m, DrumModalVoice &s, bool reduced, float *out, int n) {
+
+	if(reduced){
+		render_width<DRUM_MODAL_REDUCED_MODES>(m, s, out, n);
+	}
+	else{
+		render_width<DRUM_MODAL_MAX_MODES>(m, s, out, n);
+	}
+}
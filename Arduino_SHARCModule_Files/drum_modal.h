@@ -0,0 +1,152 @@
+/*
+ * drum_modal.h
+ *
+ * Modal synthesis of the toms: a bank of damped resonators per voice, which DrumEngine::modal
+ * selects per drum instead of its FM operators.
+ *
+ * A struck drum head rings in a handful of modes, each a sinusoid with its own frequency and
+ * decay time.  A DrumModalPatch lists up to DRUM_MODAL_MAX_MODES of them, strongest first, fitted
+ * to the drum's RD_T_*.wav recording by `drum_render --modalfit` as the ring after its peak,
+ *   y(t) = sum_k amp_k*exp(-t/tau_k)*sin(2*pi*freq_k*t + phase_k),
+ * and the attack is a linear ramp up to the recording's peak, like A_t of the FM drums.
+ *
+ * Every mode is a two-pole resonator in coupled form: its state (re, im) is turned by the pole
+ * exp(-1/(tau*fs))*exp(j*2*pi*freq/fs) every sample, four multiply-adds, and the drum is the sum
+ * of the im parts.  The stick is an impulse at the note on, which leaves each resonator at
+ * amp*exp(j*phase); nothing drives them after it.  Unlike a direct form biquad, the coupled form
+ * keeps a ringing mode's amplitude when the tom knob retunes it, and its coefficients are the pole
+ * itself, so a knob change is ramped in over the block like the phase increments of the FM drums.
+ * The poles are worked out with the other knob and button targets (drum_patch_snapshot.h); a mode
+ * the knob pushes past Nyquist is dropped.  The tone buttons do not act on the modal toms.
+ *
+ * The modes of a voice do not depend on each other, so they are updated side by side, one array
+ * per field, DRUM_MODAL_MAX_MODES wide with the unused ones at zero, and the loop over them
+ * vectorizes like the operators of a stack (drum_fm_stack.h).  A voice at reduced quality
+ * (drum_admission.h) rings on its DRUM_MODAL_REDUCED_MODES strongest modes only.
+ * `drum_render --modal` compares the cost and the spectral match with the FM toms.
+ */
+
+#ifndef DRUM_MODAL_H_
+#define DRUM_MODAL_H_
+
+//modes a drum can have; 8 fills an AVX register
+#define DRUM_MODAL_MAX_MODES		8
+
+//modes a voice at reduced quality keeps
+#define DRUM_MODAL_REDUCED_MODES	4
+
+struct DrumModalMode {
+	float freq;		//Hz, times (1 + knob)
+	float tau;		//decay time constant, seconds
+	float amp;		//amplitude extrapolated back to t = 0
+	float phase;	//radians at t = 0
+};
+
+struct DrumModalPatch {
+	float attack;	//end of the attack ramp, the recording's peak
+	int numModes;
+	DrumModalMode mode[DRUM_MODAL_MAX_MODES];
+};
+
+enum DrumModalType {
+	DRUM_MODAL_MIDTOM = 0,
+	DRUM_MODAL_HIGHTOM,
+	DRUM_MODAL_FLOORTOM,
+	DRUM_MODAL_NUM_TYPES
+};
+
+//fitted to the recordings by drum_render --modalfit
+static constexpr DrumModalPatch drumModalPatches[] = {
+	//midtom: fitted from RD_T_MT_3.wav, 8 modes, 10.3 dB SNR over 0.39 s of ring
+	{ 0.00641723f, 8, {
+		//freq       tau         amp          phase
+		{ 129.0455f,  0.0481492f, 2.03671f,    0.209665f },
+		{ 125.6623f,  0.103124f,  1.23406f,    -2.55657f },
+		{ 124.6673f,  0.233835f,  0.373557f,   0.65023f },
+		{ 134.7433f,  0.0124378f, 2.21189f,    3.08232f },
+		{ 706.4078f,  0.01f,      2.33767f,    -2.38917f },
+		{ 704.1003f,  0.0115563f, 1.88896f,    1.04598f },
+		{ 432.0562f,  0.01f,      0.585209f,   1.37811f },
+		{ 886.3469f,  0.01f,      0.484484f,   -1.96123f }
+	} },
+
+	//hightom: fitted from RD_T_HT_3.wav, 8 modes, 13.2 dB SNR over 0.39 s of ring
+	{ 0.0143991f, 8, {
+		//freq       tau         amp          phase
+		{ 165.5093f,  0.0639163f, 0.59512f,    -0.242624f },
+		{ 163.0014f,  0.241974f,  0.260111f,   2.74234f },
+		{ 172.7979f,  0.0432635f, 0.599799f,   -2.1249f },
+		{ 299.9307f,  0.0232189f, 0.531172f,   -0.222092f },
+		{ 426.9972f,  0.0269899f, 0.227736f,   1.48369f },
+		{ 293.511f,   0.0479893f, 0.115033f,   -3.014f },
+		{ 312.502f,   0.0377546f, 0.135109f,   -1.87256f },
+		{ 323.0487f,  0.01322f,   0.284074f,   0.479021f }
+	} },
+
+	//floortom: fitted from RD_T_FT_4.wav, 8 modes, 9.5 dB SNR over 0.55 s of ring
+	{ 0.00469388f, 8, {
+		//freq       tau         amp          phase
+		{ 123.6057f,  0.0422245f, 1.03869f,    0.51551f },
+		{ 118.6042f,  0.0860014f, 0.416275f,   -1.80661f },
+		{ 132.0756f,  0.0204351f, 0.781229f,   3.13892f },
+		{ 184.6892f,  0.01f,      0.975401f,   -1.23245f },
+		{ 217.8423f,  0.0293967f, 0.330222f,   0.181757f },
+		{ 114.8269f,  0.22375f,   0.0956491f,  -3.13102f },
+		{ 166.2609f,  0.0378223f, 0.20228f,    2.44878f },
+		{ 204.2586f,  0.0617915f, 0.123902f,   -0.849817f }
+	} }
+};
+
+static_assert(sizeof(drumModalPatches)/sizeof(drumModalPatches[0]) == DRUM_MODAL_NUM_TYPES,
+		"one patch per DrumModalType");
+
+//a modal patch at the sample rate
+struct DrumModalModel {
+	int numModes;
+
+	//the resonators after the stick, synthGain*amp*exp(j*phase); zero past numModes
+	float startRe[DRUM_MODAL_MAX_MODES];
+	float startIm[DRUM_MODAL_MAX_MODES];
+
+	//this block's poles
+	float poleRe[DRUM_MODAL_MAX_MODES];
+	float poleIm[DRUM_MODAL_MAX_MODES];
+
+	//attack ramp: rampLength samples from 0 up by rampStep
+	int rampLength;
+	float rampStep;
+
+	void setup(const DrumModalPatch &patch, float sampleRate, float synthGain);
+
+	//the poles with the frequencies times freqShift, into re[] and im[] (which the engine copies
+	//into poleRe[] and poleIm[])
+	void findPoles(const DrumModalPatch &patch, float freqShift, float sampleRate, float *re, float *im) const;
+
+	//samples after which the modes together stay below level, at most limit
+	int silentAfter(float level, int limit) const;
+};
+
+//the resonators of one voice
+struct DrumModalVoice {
+	float re[DRUM_MODAL_MAX_MODES];
+	float im[DRUM_MODAL_MAX_MODES];
+	float ramp;			//attack ramp value
+	int rampLeft;		//samples of the attack still to go
+
+	//back to t = 0 (note on): the stick
+	void start(const DrumModalModel &m) {
+
+		for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+			re[k] = m.startRe[k];
+			im[k] = m.startIm[k];
+		}
+		ramp = 0;
+		rampLeft = m.rampLength;
+	}
+};
+
+//render n samples of a voice, adding them into out[]; `reduced` rings the strongest
+//DRUM_MODAL_REDUCED_MODES only
+void drum_modal_render(const DrumModalModel &m, DrumModalVoice &s, bool reduced, float *out, int n);
+
+#endif /* DRUM_MODAL_H_ */
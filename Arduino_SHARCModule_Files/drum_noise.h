@@ -0,0 +1,160 @@
+/*
+ * drum_noise.h
+ *
+ * Noise for the snare and hihat.
+ *
+ * Each voice has its own xorshift32 generator, seeded from the voice's trigger serial, so the
+ * noise is reentrant, costs a few shifts and xors per sample, and a hit renders the same noise
+ * whichever loop order or cache path plays it.  The voice-outer render steps the generators of
+ * all lanes side by side, which vectorizes like the rest of the lane loop.
+ *
+ * The old rand()%2-1 only ever gave 0 or -1: a pulse train with a DC offset of -0.5 and an AC
+ * level of 0.5 RMS.  The samples here are uniform and zero mean, scaled to the same 0.5 RMS so
+ * the drums keep their balance.
+ *
+ * A one-state filter can colour the noise: DRUM_NOISE_DARK (one-pole lowpass) or
+ * DRUM_NOISE_BRIGHT (first difference), both normalized back to the white noise level.
+ *
+ * The colours are voiced at DRUM_NOISE_REFERENCE_RATE.  At other rates the filters are worked
+ * out to give the same spectrum in Hz, and the noise the same density: the same power spread
+ * over a wider band would be quieter in the audible part of it, so the level rises with the
+ * square root of the rate.
+ */
+
+#ifndef DRUM_NOISE_H_
+#define DRUM_NOISE_H_
+
+#include <stdint.h>
+#include <math.h>
+
+enum DrumNoiseColor {
+	DRUM_NOISE_WHITE = 0,
+	DRUM_NOISE_DARK,		//-6 dB/octave above about fs/9
+	DRUM_NOISE_BRIGHT		//+6 dB/octave, a null at DC
+};
+
+//colour of each drum's noise
+#ifndef DRUM_SNARE_NOISE_COLOR
+#define DRUM_SNARE_NOISE_COLOR	DRUM_NOISE_WHITE
+#endif
+#ifndef DRUM_HIHAT_NOISE_COLOR
+#define DRUM_HIHAT_NOISE_COLOR	DRUM_NOISE_WHITE
+#endif
+
+//int32 to uniform samples of 0.5 RMS: sqrt(3)/2 full scale
+#define DRUM_NOISE_SCALE		(0.8660254f/2147483648.0f)
+
+//largest white sample, and the rate the colours were voiced at
+#define DRUM_NOISE_WHITE_PEAK		0.8660254f
+#define DRUM_NOISE_REFERENCE_RATE	48000.0f
+
+static inline uint32_t drum_xorshift(uint32_t s) {
+
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+static inline float drum_noise_sample(uint32_t s) {
+
+	return (float)(int32_t)s*DRUM_NOISE_SCALE;
+}
+
+//a well mixed, nonzero generator state from any number (xorshift32 gets stuck at 0)
+static inline uint32_t drum_noise_seed(uint32_t n) {
+
+	n = (n ^ 0x9e3779b9u)*0x85ebca6bu;
+	n ^= n >> 13;
+	n *= 0xc2b2ae35u;
+	n ^= n >> 16;
+	return n != 0 ? n : 1;
+}
+
+//y = gain*x + feedback*z, then z = y (recursive = 1) or z = x (recursive = 0)
+struct DrumNoiseFilter {
+	int color;		//DrumNoiseColor
+	float gain;
+	float feedback;
+	float recursive;
+	float peak;		//largest sample
+
+	void setup(int color, float sampleRate) {
+
+		this->color = color;
+		float ratio = DRUM_NOISE_REFERENCE_RATE/sampleRate;
+		float density = sqrtf(1/ratio);
+		switch(color){
+			case DRUM_NOISE_DARK:
+				//y = 0.5*y + 0.5*x at the reference rate has 1/3 of the input power; the same corner
+				//(about 5.3 kHz) and low frequency gain sqrt(3) at any rate
+				feedback = powf(0.5f, ratio);
+				gain = 0.8660254f/0.5f*(1 - feedback)*density;
+				recursive = 1;
+				peak = gain/(1 - feedback)*DRUM_NOISE_WHITE_PEAK;
+				break;
+			case DRUM_NOISE_BRIGHT:
+				//x - x1 at the reference rate has twice the input power; it rises as 2*pi*f/fs, so the
+				//same slope in Hz takes a gain in proportion to the rate
+				gain = 0.70710678f/ratio*density;
+				feedback = -gain;
+				recursive = 0;
+				peak = 2*gain*DRUM_NOISE_WHITE_PEAK;
+				break;
+			default:
+				gain = density;
+				feedback = 0;
+				recursive = 0;
+				peak = gain*DRUM_NOISE_WHITE_PEAK;
+				break;
+		}
+	}
+};
+
+struct DrumNoise {
+	uint32_t state;
+	float z;		//filter state
+
+	void seed(uint32_t n) {
+
+		state = drum_noise_seed(n);
+		z = 0;
+	}
+
+	inline float next(const DrumNoiseFilter &f) {
+
+		state = drum_xorshift(state);
+		float x = drum_noise_sample(state);
+		float y = f.gain*x + f.feedback*z;
+		z = x + f.recursive*(y - x);
+		return y;
+	}
+
+	void fill(const DrumNoiseFilter &f, float *out, int numSamples) {
+
+		uint32_t s = state;
+
+		//white noise skips the filter and its loop-carried dependency
+		if(f.color == DRUM_NOISE_WHITE){
+			for(int i=0; i<numSamples; i++){
+				s = drum_xorshift(s);
+				out[i] = f.gain*drum_noise_sample(s);
+			}
+			state = s;
+			return;
+		}
+
+		float zz = z;
+		for(int i=0; i<numSamples; i++){
+			s = drum_xorshift(s);
+			float x = drum_noise_sample(s);
+			float y = f.gain*x + f.feedback*zz;
+			zz = x + f.recursive*(y - x);
+			out[i] = y;
+		}
+		state = s;
+		z = zz;
+	}
+};
+
+#endif /* DRUM_NOISE_H_ */
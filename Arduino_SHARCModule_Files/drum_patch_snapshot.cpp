@@ -0,0 +1,37 @@
+/*
+ * drum_patch_snapshot.cpp
+ *
+ * Publishing the knob and button targets from the background loop.  See drum_patch_snapshot.h.
+ */
+
+#include "drum_patch_snapshot.h"
+#include "drum_engine.h"
+
+void DrumPatchSnapshots::setup() {
+
+	published = 0;
+	reading = 0;
+	swaps = 0;
+	panicRequests = 0;
+	panicsTaken = 0;
+}
+
+bool DrumPatchSnapshots::publish(const DrumEngine &engine, const DrumControls &c) {
+
+	DrumPatchSnapshot *current = published;
+	if(current != 0 && !current->controls.differs(c)){
+		return true;
+	}
+
+	//the back snapshot may still be in use until the audio callback has picked up the published one
+	if(reading != current){
+		return false;
+	}
+	DrumPatchSnapshot *back = current == &snapshots[0] ? &snapshots[1] : &snapshots[0];
+	engine.workOutTargets(c, *back);
+
+	DRUM_RELEASE_BARRIER();
+	published = back;
+	swaps++;
+	return true;
+}
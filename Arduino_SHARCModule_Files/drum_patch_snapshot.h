@@ -0,0 +1,111 @@
+/*
+ * drum_patch_snapshot.h
+ *
+ * Knob and tone button settings worked out off the audio path, and the panic button.
+ *
+ * A move of a knob or a tone button gives the drums it acts on new targets: phase increments,
+ * the modulation index I_0, which operators run at twice the rate and the poles of the modal
+ * resonators.  The background loop works them out with DrumPatchSnapshots::publish() into the
+ * snapshot the audio callback is not reading and publishes it with a single pointer store.  The
+ * callback picks up the published snapshot at the start of a block with acquire() and hands it to
+ * the engine, which ramps to its targets over the block (drum_engine.h), so the callback never
+ * sees a half-written setting and never works one out.  As with the sample cache
+ * (drum_sample_cache.h), the back snapshot is only rewritten after the callback has acquired the
+ * published one.
+ *
+ * The panic button does not touch the voices from the background loop either: requestPanic()
+ * counts a request, and the callback turns it into a MIDI All Sound Off at the start of its next
+ * block, which the engine applies like any other event.  With the voices split between cores
+ * (drum_dual_core.h) it is forwarded with the others, and core 2 gets the knobs and buttons of
+ * each block with the block and works its own targets out from them.
+ */
+
+#ifndef DRUM_PATCH_SNAPSHOT_H_
+#define DRUM_PATCH_SNAPSHOT_H_
+
+#include <stdint.h>
+#include "drum_atomic.h"
+#include "drum_patches.h"
+#include "drum_fm_stack.h"
+#include "drum_modal.h"
+
+class DrumEngine;
+
+//the knobs (0..1), the tone buttons (0..3) and the DrumOversampling mode
+struct DrumControls {
+	float pot0, pot1, pot2;
+	int type, type2, type3;
+	int oversampling;
+
+	bool differs(const DrumControls &c) const {
+
+		return pot0 != c.pot0 || pot1 != c.pot1 || pot2 != c.pot2
+				|| type != c.type || type2 != c.type2 || type3 != c.type3 || oversampling != c.oversampling;
+	}
+};
+
+//what a drum's knob and button are set to
+struct DrumPatchTargets {
+	float freqShift;
+	float I_0;
+	uint32_t inc[DRUM_STACK_MAX_OPS];		//carrier and modulator, or the stack's operators
+	bool oversample[DRUM_STACK_MAX_OPS];	//the main operator ([0]), or the stack's operators
+	float poleRe[DRUM_MODAL_MAX_MODES];		//the modal resonators of a tom that has them
+	float poleIm[DRUM_MODAL_MAX_MODES];
+};
+
+struct DrumPatchSnapshot {
+	DrumControls controls;
+	DrumPatchTargets drum[DRUM_NUM_TYPES];
+};
+
+class DrumPatchSnapshots {
+
+	public:
+		//snapshots published so far
+		unsigned swaps;
+
+		void setup();
+
+		//background loop: the engine's targets for c into the back snapshot, and publish it, if c
+		//differs from the published controls; false while the callback has not yet picked up the
+		//last one, when it has to be tried again on a later pass
+		bool publish(const DrumEngine &engine, const DrumControls &c);
+
+		//audio callback, once per block: the snapshot to follow, NULL until one has been published
+		inline const DrumPatchSnapshot *acquire() {
+
+			DrumPatchSnapshot *snapshot = published;
+			DRUM_ACQUIRE_BARRIER();
+			reading = snapshot;
+			return snapshot;
+		}
+
+		//background loop: silence every voice at the start of the callback's next block
+		void requestPanic() {
+
+			panicRequests = panicRequests + 1;
+		}
+
+		//audio callback: true once after any number of requestPanic()
+		inline bool takePanic() {
+
+			unsigned requests = panicRequests;
+			if(requests == panicsTaken){
+				return false;
+			}
+			panicsTaken = requests;
+			return true;
+		}
+
+	private:
+		DrumPatchSnapshot snapshots[2];
+
+		DrumPatchSnapshot *volatile published;
+		DrumPatchSnapshot *volatile reading;	//last snapshot the audio callback acquired
+
+		volatile unsigned panicRequests;
+		unsigned panicsTaken;
+};
+
+#endif /* DRUM_PATCH_SNAPSHOT_H_ */
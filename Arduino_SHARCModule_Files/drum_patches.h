@@ -0,0 +1,222 @@
+/*
+ * drum_patches.h
+ *
+ * The drum models as a table of constant patches.
+ *
+ * Each drum is one DrumPatch: its note, amplitude envelope, FM index envelope, carrier and
+ * modulator, the knob and tone button that move them, the percussive sub operator, the noise
+ * term and the weights they are mixed with.  The drums that need more operators than that (floor
+ * tom, ride, crash) name an operator stack of drum_fm_stack.h instead of a carrier and
+ * modulator; their amplitude envelope is then the one of their main carrier, which sets their
+ * length, the tail the admission may reduce and the level it steals by.
+ *
+ * drumPatches[] is constexpr, and the per-voice renderers in drum_engine.cpp and drum_lanes.cpp
+ * are templates on the drum, so for every model
+ * the compiler sees its constants: the mix weights fold into the arithmetic, and the index
+ * envelope, sub operator and noise branches disappear from drums that do not use them.  What
+ * depends on the sample rate (envelope coefficients, phase increments) is computed from the
+ * patch once in DrumEngine::setup(), and what depends on the knobs once per block.
+ *
+ * The toms also name the modal resonators of drum_modal.h, which can ring in place of their
+ * operators.
+ *
+ * Adding a drum is a DrumType, a note and an entry here, in DrumType order (and a stack patch
+ * for a stack drum).
+ */
+
+#ifndef DRUM_PATCHES_H_
+#define DRUM_PATCHES_H_
+
+#include "drum_lanes.h"
+#include "drum_noise.h"
+#include "drum_fm_stack.h"
+#include "drum_modal.h"
+
+//MIDI notes that trigger each drum
+#define DRUM_NOTE_KICK		60
+#define DRUM_NOTE_SNARE		61
+#define DRUM_NOTE_MIDTOM	62
+#define DRUM_NOTE_HIGHTOM	63
+#define DRUM_NOTE_HIHAT		64
+#define DRUM_NOTE_FLOORTOM	65
+#define DRUM_NOTE_RIDE		66
+#define DRUM_NOTE_CRASH		67
+
+enum DrumType {
+	DRUM_KICK = 0,
+	DRUM_SNARE,
+	DRUM_MIDTOM,
+	DRUM_HIGHTOM,
+	DRUM_HIHAT,
+	DRUM_FLOORTOM,
+	DRUM_RIDE,
+	DRUM_CRASH,
+	DRUM_NUM_TYPES
+};
+
+//DrumEngine::pot0..pot2, which scale a drum's frequencies by (1 + knob)
+enum DrumKnob {
+	DRUM_KNOB_NONE = -1,
+	DRUM_KNOB_POT0,
+	DRUM_KNOB_POT1,
+	DRUM_KNOB_POT2
+};
+
+//DrumEngine::type, type2, type3, which step a drum's modulation index
+enum DrumButton {
+	DRUM_BUTTON_NONE = -1,
+	DRUM_BUTTON_TYPE,
+	DRUM_BUTTON_TYPE2,
+	DRUM_BUTTON_TYPE3
+};
+
+struct DrumPatch {
+	int note;
+	const char *name;
+
+	//A_t: attack ramp slope*t up to timePeak, then A*exp(-(t-timePeak)/tau) until r, the end
+	//of the drum
+	float slope;
+	float timePeak;
+	float A;
+	float tau;
+	float r;
+
+	//I_t (DrumLaneIndex): 1; exp(-t/indexTau); or
+	//gammaC*(t+gammaT0)^2*exp(-indexTau*(t+gammaT0))
+	int indexKind;
+	float indexTau;
+	float gammaC;
+	float gammaT0;
+
+	//carrier and modulator, times (1 + knob) for the drums on a knob
+	float fc;
+	float fm;
+	int knob;		//DrumKnob
+
+	//I_0 = index0 + indexStep*button
+	float index0;
+	float indexStep;
+	int button;		//DrumButton
+
+	//percussive sub operator: a ramp from 1 down to 0 over subR, at fixed frequencies, with
+	//index subIndex0*subA_t
+	bool hasSub;
+	float subFc;
+	float subFm;
+	float subIndex0;
+	float subR;
+
+	//noise term
+	bool hasNoise;
+	int noiseColor;	//DrumNoiseColor
+
+	//mix: synthGain*A_t*fm + subGain*subA_t*subfm + noiseGain*A_t*noise; for a stack drum
+	//synthGain*(operator mix) + noiseGain*(noise operator level)*noise
+	float synthGain;
+	float subGain;
+	float noiseGain;
+
+	//operator stack (DrumStackType) instead of the carrier and modulator, -1 for none
+	int stack;
+
+	//modal resonators (DrumModalType) that DrumEngine::modal can ring instead, -1 for none
+	int modal;
+};
+
+//the attack slopes are the original callback's, about A/timePeak
+static constexpr DrumPatch drumPatches[] = {
+	//Kick: fundamental with a constant index, percussive sub operator
+	{ DRUM_NOTE_KICK, "kick",
+		199.826f, 0.005f, 0.999f, 0.065f, 0.3f,
+		DRUM_LANE_INDEX_CONST, 0, 0, 0,
+		70, 30, DRUM_KNOB_POT0,
+		1.15f, 2, DRUM_BUTTON_TYPE3,
+		true, 200, 350, 5, 0.03f,
+		false, DRUM_NOISE_WHITE,
+		2, 2*0.001f, 0,
+		-1, -1 },
+
+	//Snare: decaying index, white noise
+	{ DRUM_NOTE_SNARE, "snare",
+		657.237f, 0.00152f, 0.999f, 0.04f, 0.25f,
+		DRUM_LANE_INDEX_EXP, 0.03f, 0, 0,
+		80, 85, DRUM_KNOB_POT1,
+		1, 2, DRUM_BUTTON_TYPE2,
+		false, 0, 0, 0, 0,
+		true, DRUM_SNARE_NOISE_COLOR,
+		2, 0, 2*0.035f,
+		-1, -1 },
+
+	//Midtom: gamma shaped index, percussive sub operator
+	{ DRUM_NOTE_MIDTOM, "midtom",
+		155.607f, 0.00642f, 0.999f, 0.1f, 0.4f,
+		DRUM_LANE_INDEX_GAMMA, 70, 18500, 0.01f,
+		110, 113, DRUM_KNOB_POT2,
+		1.5f, 2, DRUM_BUTTON_TYPE,
+		true, 200, 350, 5, 0.03f,
+		false, DRUM_NOISE_WHITE,
+		1, 0.005f, 0,
+		-1, DRUM_MODAL_MIDTOM },
+
+	//Hightom
+	{ DRUM_NOTE_HIGHTOM, "hightom",
+		69.375f, 0.0144f, 0.999f, 0.1f, 0.4f,
+		DRUM_LANE_INDEX_GAMMA, 100, 18500, 0.01f,
+		200, 400, DRUM_KNOB_POT2,
+		1.5f, 2, DRUM_BUTTON_TYPE,
+		true, 200, 350, 5, 0.03f,
+		false, DRUM_NOISE_WHITE,
+		1, 0.005f, 0,
+		-1, DRUM_MODAL_HIGHTOM },
+
+	//Hihat: fixed tone, decaying index, white noise
+	{ DRUM_NOTE_HIHAT, "hihat",
+		819.672f, 0.00122f, 1, 0.045f, 0.3f,
+		DRUM_LANE_INDEX_EXP, 0.2f, 0, 0,
+		350, 700, DRUM_KNOB_NONE,
+		20, 0, DRUM_BUTTON_NONE,
+		false, 0, 0, 0, 0,
+		true, DRUM_HIHAT_NOISE_COLOR,
+		0.15f, 0, 0.2f,
+		-1, -1 },
+
+	//Floor tom: operator stack on the tom knob, amplitude of its 90 Hz ring (A_t of
+	//DrumMachine_FloorTom.m, peak at the recording's first peak)
+	{ DRUM_NOTE_FLOORTOM, "floortom",
+		0.6f/0.00469f, 0.00469f, 0.6f, 0.15f, 0.55f,
+		DRUM_LANE_INDEX_CONST, 0, 0, 0,
+		0, 0, DRUM_KNOB_POT2,
+		0, 0, DRUM_BUTTON_NONE,
+		false, 0, 0, 0, 0,
+		false, DRUM_NOISE_WHITE,
+		1, 0, 0,
+		DRUM_STACK_FLOORTOM, DRUM_MODAL_FLOORTOM },
+
+	//Ride: operator stack over noise, 11 s long; DrumMachine_Ride.m's 0.3*0.025*randn noise and
+	//0.1 tone, both times 1.5, with the noise's 0.5 RMS made up
+	{ DRUM_NOTE_RIDE, "ride",
+		1/0.0224f, 0.0224f, 1, 0.65f, 11,
+		DRUM_LANE_INDEX_CONST, 0, 0, 0,
+		0, 0, DRUM_KNOB_NONE,
+		0, 0, DRUM_BUTTON_NONE,
+		false, 0, 0, 0, 0,
+		true, DRUM_NOISE_WHITE,
+		0.15f, 0, 2*0.3f*0.025f*1.5f,
+		DRUM_STACK_RIDE, -1 },
+
+	//Crash: derived from the ride, 5 s long
+	{ DRUM_NOTE_CRASH, "crash",
+		1/0.002f, 0.002f, 1, 0.8f, 5,
+		DRUM_LANE_INDEX_CONST, 0, 0, 0,
+		0, 0, DRUM_KNOB_NONE,
+		0, 0, DRUM_BUTTON_NONE,
+		false, 0, 0, 0, 0,
+		true, DRUM_NOISE_BRIGHT,
+		0.12f, 0, 0.05f,
+		DRUM_STACK_CRASH, -1 }
+};
+
+static_assert(sizeof(drumPatches)/sizeof(drumPatches[0]) == DRUM_NUM_TYPES, "one patch per DrumType");
+
+#endif /* DRUM_PATCHES_H_ */
@@ -0,0 +1,299 @@
+/*
+ * drum_profile.h
+ *
+ * Cycle accounting for the audio callback.
+ *
+ * A DrumProfiler is owned by the core that runs the callback.  The callback brackets its work
+ * with beginCallback() / endCallback(), and the engine (when its `profiler` is set) adds the
+ * cycles it spends on each drum and each voice in between.  endCallback() folds the block into
+ * a DrumProfileStats: the last and worst callback, an average, overruns of the block budget, a
+ * histogram of callback times in 1/DRUM_PROFILE_BINS_PER_BUDGET steps of the budget, and per
+ * drum and per voice costs.
+ *
+ * The statistics are published with a sequence count (a seqlock): the callback makes it odd
+ * while it writes and even again when it is done, and drum_profile_read() copies them until it
+ * sees the same even count before and after.  The callback never waits on a reader, so the
+ * background loop, the other SHARC core or the ARM can read them at any time.  Every field is
+ * 32 bits wide so the layout is the same for all of them.
+ *
+ * Cycles come from emuclk() on the SHARC and from rdtsc (clock_gettime() nanoseconds where
+ * there is none) on the host.
+ */
+
+#ifndef DRUM_PROFILE_H_
+#define DRUM_PROFILE_H_
+
+#include <stdint.h>
+#include "drum_atomic.h"
+#include "drum_engine.h"
+
+#if defined(__ADSP21000__)
+#include <builtins.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+//histogram resolution: bins per block budget; the histogram covers twice the budget and its
+//last bin also counts everything longer
+#define DRUM_PROFILE_BINS_PER_BUDGET	32
+#define DRUM_PROFILE_BINS				(2*DRUM_PROFILE_BINS_PER_BUDGET)
+
+//the averages follow roughly the last 1/DRUM_PROFILE_AVERAGE callbacks; they start from the
+//first value, and take no callback for more than twice the budget, so that one callback held up
+//by something else (a debugger, a long interrupt) does not swamp them
+#define DRUM_PROFILE_AVERAGE			(1.0f/256)
+
+//a free running cycle count; differences are good for one wrap of 32 bits
+static inline uint32_t drum_profile_clock(void) {
+
+#if defined(__ADSP21000__)
+	return emuclk();
+#elif defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec*1000000000ull + ts.tv_nsec);
+#endif
+}
+
+struct DrumProfileStats {
+	//odd while the callback is writing
+	volatile uint32_t sequence;
+
+	uint32_t budget;		//cycles a callback may take
+	uint32_t callbacks;
+	uint32_t overruns;		//callbacks that took longer than the budget
+	uint32_t last;			//cycles of the last callback
+	uint32_t worst;
+	float average;
+	uint32_t histogram[DRUM_PROFILE_BINS];
+
+	//cycles outside the drums: events, block parameters, output copies
+	float otherAverage;
+
+	//per drum: cycles of the last callback, the worst callback, and the average cost of one
+	//voice for one sample
+	uint32_t drumLast[DRUM_NUM_TYPES];
+	uint32_t drumWorst[DRUM_NUM_TYPES];
+	float drumVoiceSample[DRUM_NUM_TYPES];
+
+	//per voice of the pool: cycles in the last callback, and the drum it played (-1 if none)
+	uint32_t voiceLast[DRUM_MAX_VOICES];
+	int32_t voiceDrum[DRUM_MAX_VOICES];
+
+	//written outside the sequence: processaudio_mips_overflow() calls, the sample clock and the
+	//number of sounding voices at the last one
+	volatile uint32_t mipsOverflows;
+	volatile uint32_t overflowWindow;
+	volatile uint32_t overflowVoices;
+
+	//a reader bumps this to have the callback clear the statistics at its next block
+	volatile uint32_t resetRequests;
+};
+
+class DrumProfiler {
+
+	public:
+		DrumProfileStats *stats;
+
+		//publish into stats, which may sit in memory shared with other cores
+		void setup(DrumProfileStats *stats, uint32_t budgetCycles) {
+
+			this->stats = stats;
+			stats->sequence = 0;
+			stats->mipsOverflows = 0;
+			stats->overflowWindow = 0;
+			stats->overflowVoices = 0;
+			stats->resetRequests = 0;
+			resetsSeen = 0;
+			budget = budgetCycles;
+			clearStats();
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				drumCycles[d] = 0;
+				drumVoiceSamples[d] = 0;
+			}
+			for(int v=0; v<DRUM_MAX_VOICES; v++){
+				voiceCycles[v] = 0;
+				voiceDrum[v] = -1;
+			}
+		}
+
+		inline uint32_t now() {
+
+			return drum_profile_clock();
+		}
+
+		inline void beginCallback() {
+
+			start = drum_profile_clock();
+		}
+
+		//cycles spent on voiceSamples samples of a drum's voices (samples times voices)
+		inline void addDrum(int drum, uint32_t cycles, int voiceSamples) {
+
+			drumCycles[drum] += cycles;
+			drumVoiceSamples[drum] += voiceSamples;
+		}
+
+		//cycles spent on one voice of the pool
+		inline void addVoice(int slot, int drum, uint32_t cycles) {
+
+			voiceCycles[slot] += cycles;
+			voiceDrum[slot] = drum;
+		}
+
+		//fold the block into the statistics; returns the cycles the callback took
+		uint32_t endCallback() {
+
+			uint32_t total = drum_profile_clock() - start;
+			DrumProfileStats &s = *stats;
+
+			s.sequence = s.sequence + 1;
+			DRUM_RELEASE_BARRIER();
+
+			if(s.resetRequests != resetsSeen){
+				resetsSeen = s.resetRequests;
+				clearStats();
+			}
+
+			s.callbacks++;
+			s.last = total;
+			if(total > s.worst){
+				s.worst = total;
+			}
+			if(total > budget){
+				s.overruns++;
+			}
+			uint32_t bin = (uint32_t)((uint64_t)total*DRUM_PROFILE_BINS_PER_BUDGET/budget);
+			s.histogram[bin < DRUM_PROFILE_BINS ? bin : DRUM_PROFILE_BINS - 1]++;
+			bool outlier = total > 2*budget;
+			if(!outlier){
+				average(s.average, (float)total, s.callbacks == 1);
+			}
+
+			uint32_t drums = 0;
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				uint32_t c = drumCycles[d];
+				drums += c;
+				s.drumLast[d] = c;
+				if(c > s.drumWorst[d]){
+					s.drumWorst[d] = c;
+				}
+				if(drumVoiceSamples[d] != 0 && !outlier){
+					average(s.drumVoiceSample[d], (float)c/drumVoiceSamples[d], s.drumVoiceSample[d] == 0);
+				}
+				drumCycles[d] = 0;
+				drumVoiceSamples[d] = 0;
+			}
+			if(!outlier){
+				average(s.otherAverage, total > drums ? (float)(total - drums) : 0.0f, s.callbacks == 1);
+			}
+
+			for(int v=0; v<DRUM_MAX_VOICES; v++){
+				s.voiceLast[v] = voiceCycles[v];
+				s.voiceDrum[v] = voiceDrum[v];
+				voiceCycles[v] = 0;
+				voiceDrum[v] = -1;
+			}
+
+			DRUM_RELEASE_BARRIER();
+			s.sequence = s.sequence + 1;
+			return total;
+		}
+
+		//from processaudio_mips_overflow(): the callback missed its deadline
+		void mipsOverflow(uint32_t window, int numVoices) {
+
+			stats->mipsOverflows = stats->mipsOverflows + 1;
+			stats->overflowWindow = window;
+			stats->overflowVoices = numVoices;
+		}
+
+	private:
+		uint32_t budget;
+		uint32_t start;
+		uint32_t resetsSeen;
+
+		//this callback so far
+		uint32_t drumCycles[DRUM_NUM_TYPES];
+		int drumVoiceSamples[DRUM_NUM_TYPES];
+		uint32_t voiceCycles[DRUM_MAX_VOICES];
+		int32_t voiceDrum[DRUM_MAX_VOICES];
+
+		static inline void average(float &avg, float x, bool first) {
+
+			avg = first ? x : avg + (x - avg)*DRUM_PROFILE_AVERAGE;
+		}
+
+		//everything but the sequence, the overflow record and the reset requests
+		void clearStats() {
+
+			DrumProfileStats &s = *stats;
+			s.budget = budget;
+			s.callbacks = 0;
+			s.overruns = 0;
+			s.last = 0;
+			s.worst = 0;
+			s.average = 0;
+			for(int b=0; b<DRUM_PROFILE_BINS; b++){
+				s.histogram[b] = 0;
+			}
+			s.otherAverage = 0;
+			for(int d=0; d<DRUM_NUM_TYPES; d++){
+				s.drumLast[d] = 0;
+				s.drumWorst[d] = 0;
+				s.drumVoiceSample[d] = 0;
+			}
+			for(int v=0; v<DRUM_MAX_VOICES; v++){
+				s.voiceLast[v] = 0;
+				s.voiceDrum[v] = -1;
+			}
+		}
+};
+
+//reader side: a consistent copy of the statistics; false if the callback kept writing over
+//maxTries attempts
+static inline bool drum_profile_read(const DrumProfileStats *stats, DrumProfileStats &copy, int maxTries = 16) {
+
+	for(int t=0; t<maxTries; t++){
+		uint32_t before = stats->sequence;
+		if(before & 1){
+			continue;
+		}
+		DRUM_ACQUIRE_BARRIER();
+		const uint32_t *from = (const uint32_t *)stats;
+		uint32_t *to = (uint32_t *)&copy;
+		for(unsigned w=0; w<sizeof(DrumProfileStats)/sizeof(uint32_t); w++){
+			to[w] = ((const volatile uint32_t *)from)[w];
+		}
+		DRUM_ACQUIRE_BARRIER();
+		if(stats->sequence == before){
+			return true;
+		}
+	}
+	return false;
+}
+
+//callback cycles that p (0..1) of the callbacks in the histogram stayed within, to the bin;
+//at least twice the budget if the percentile falls in the last bin
+static inline uint32_t drum_profile_percentile(const DrumProfileStats &stats, float p) {
+
+	uint32_t count = 0;
+	for(int b=0; b<DRUM_PROFILE_BINS; b++){
+		count += stats.histogram[b];
+	}
+	uint32_t target = (uint32_t)(p*count + 0.5f);
+	uint32_t sum = 0;
+	for(int b=0; b<DRUM_PROFILE_BINS; b++){
+		sum += stats.histogram[b];
+		if(sum >= target && sum != 0){
+			return (uint32_t)((uint64_t)stats.budget*(b + 1)/DRUM_PROFILE_BINS_PER_BUDGET);
+		}
+	}
+	return 0;
+}
+
+#endif /* DRUM_PROFILE_H_ */
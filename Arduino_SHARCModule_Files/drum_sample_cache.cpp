@@ -0,0 +1,142 @@
+/*
+ * drum_sample_cache.cpp
+ *
+ * Background re-render and publishing of the drum one-shots.  See drum_sample_cache.h.
+ */
+
+#include <math.h>
+#include "drum_sample_cache.h"
+
+//the first drum from d on that the cache holds, DRUM_NUM_TYPES if none
+static int next_cached_drum(int d) {
+
+	while(d < DRUM_NUM_TYPES && drumPatches[d].stack >= 0){
+		d++;
+	}
+	return d;
+}
+
+bool DrumCacheControls::differs(const DrumCacheControls &c) const {
+
+	return fabsf(pot0 - c.pot0) >= DRUM_CACHE_POT_HYSTERESIS
+			|| fabsf(pot1 - c.pot1) >= DRUM_CACHE_POT_HYSTERESIS
+			|| fabsf(pot2 - c.pot2) >= DRUM_CACHE_POT_HYSTERESIS
+			|| type != c.type || type2 != c.type2 || type3 != c.type3;
+}
+
+void DrumSampleCache::setup(float sampleRate) {
+
+	renderer.setup(sampleRate);
+
+	published = 0;
+	reading = 0;
+	target = 0;
+	swaps = 0;
+	setControls(0, 0, 0, 0, 0, 0);
+
+	//lay both sets out in their storage: all tones, then the noise weights
+	int total = 0;
+	for(int s=0; s<2; s++){
+		total = 0;
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			sets[s].length[d] = renderer.drumLength[d];
+			sets[s].tone[d] = 0;
+			if(drumPatches[d].stack < 0){
+				sets[s].tone[d] = &storage[s][total];
+				total += renderer.drumLength[d];
+			}
+		}
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			sets[s].noise[d] = 0;
+			if(drumPatches[d].hasNoise && drumPatches[d].stack < 0){
+				sets[s].noise[d] = &storage[s][total];
+				total += renderer.drumLength[d];
+			}
+		}
+	}
+	enabled = total <= DRUM_CACHE_SET_SAMPLES;
+}
+
+void DrumSampleCache::setControls(float pot0, float pot1, float pot2, int type, int type2, int type3) {
+
+	wanted.pot0 = pot0;
+	wanted.pot1 = pot1;
+	wanted.pot2 = pot2;
+	wanted.type = type;
+	wanted.type2 = type2;
+	wanted.type3 = type3;
+}
+
+void DrumSampleCache::startRender(DrumOneShots *set) {
+
+	target = set;
+	target->controls = wanted;
+
+	renderer.pot0 = wanted.pot0;
+	renderer.pot1 = wanted.pot1;
+	renderer.pot2 = wanted.pot2;
+	renderer.type = wanted.type;
+	renderer.type2 = wanted.type2;
+	renderer.type3 = wanted.type3;
+
+	renderDrum = next_cached_drum(0);
+	renderPos = 0;
+	renderer.startOneShot(renderVoice, renderDrum);
+}
+
+bool DrumSampleCache::renderStep(int maxSamples) {
+
+	if(!enabled){
+		return false;
+	}
+
+	if(target == 0){
+		DrumOneShots *current = published;
+		if(current != 0 && !current->controls.differs(wanted)){
+			return false;
+		}
+
+		//the back set may still be in use until the audio callback has picked up the published one
+		if(reading != current){
+			return true;
+		}
+		startRender(current == &sets[0] ? &sets[1] : &sets[0]);
+	}
+
+	while(maxSamples > 0){
+		int d = renderDrum;
+		int n = target->length[d] - renderPos;
+		if(n > maxSamples){
+			n = maxSamples;
+		}
+
+		renderer.renderOneShot(renderVoice, &target->tone[d][renderPos],
+				target->noise[d] != 0 ? &target->noise[d][renderPos] : 0, n);
+		renderPos += n;
+		maxSamples -= n;
+
+		if(renderPos == target->length[d]){
+			renderDrum = next_cached_drum(renderDrum + 1);
+			if(renderDrum == DRUM_NUM_TYPES){
+				//the whole set is written: publish it with one pointer store
+				DRUM_RELEASE_BARRIER();
+				published = target;
+				target = 0;
+				swaps++;
+				return false;
+			}
+			renderPos = 0;
+			renderer.startOneShot(renderVoice, renderDrum);
+		}
+	}
+	return true;
+}
+
+void DrumSampleCache::renderAll() {
+
+	while(renderStep(DRUM_CACHE_STEP)){
+	}
+
+	//nothing is playing yet, so the audio callback counts as having seen the new set
+	reading = published;
+}
@@ -0,0 +1,118 @@
+/*
+ * drum_sample_cache.h
+ *
+ * Pre-rendered one-shots of every drum, re-rendered in the background when a knob or a tone
+ * button changes.
+ *
+ * Apart from their noise term the drums are deterministic: a hit always produces the same
+ * samples for the same pot0..2 and type/type2/type3.  The cache renders each drum's full
+ * one-shot once into memory and the audio callback then only mixes cached samples, so a
+ * voice costs a load and an add instead of the FM synthesis.  The noise of the snare and hihat
+ * is kept random per hit: the cache stores the noise weight (A_t times the noise level) next to
+ * the tone, and the callback multiplies it with fresh noise.  The stack drums (floor tom, ride,
+ * crash) are not cached: the ride alone would need twice the memory of all the others, so they
+ * are synthesized in the callback as without a cache.
+ *
+ * There are two sets of one-shots.  The audio callback reads the published set; when the
+ * controls move, processaudio_background_loop() renders the other set a slice at a time with
+ * renderStep() and publishes it with a single pointer store.  The back set is only written
+ * after the audio callback has acquired the published one, so a set is never rewritten while
+ * a block is still reading it.
+ */
+
+#ifndef DRUM_SAMPLE_CACHE_H_
+#define DRUM_SAMPLE_CACHE_H_
+
+#include "drum_engine.h"
+#include "drum_atomic.h"
+
+//highest sample rate the cache has room for; at higher rates it disables itself
+#ifndef DRUM_CACHE_MAX_RATE
+#define DRUM_CACHE_MAX_RATE		48000
+#endif
+
+//floats per set of one-shots: every drum's tone plus the snare and hihat noise weights, 2.2 s
+//of samples at the rate (105607 at 48 kHz) and some to spare
+#define DRUM_CACHE_SET_SAMPLES	((int)(2.3*DRUM_CACHE_MAX_RATE))
+
+//samples renderStep() renders per background loop pass
+#ifndef DRUM_CACHE_STEP
+#define DRUM_CACHE_STEP			4096
+#endif
+
+//knob moves smaller than this do not trigger a re-render (ADC noise)
+#define DRUM_CACHE_POT_HYSTERESIS	(1.0f/256)
+
+//the controls a set of one-shots was rendered for
+struct DrumCacheControls {
+	float pot0, pot1, pot2;
+	int type, type2, type3;
+
+	bool differs(const DrumCacheControls &c) const;
+};
+
+struct DrumOneShots {
+	DrumCacheControls controls;
+	int length[DRUM_NUM_TYPES];
+	float *tone[DRUM_NUM_TYPES];	//NULL for the drums that are not cached
+	float *noise[DRUM_NUM_TYPES];	//noise weight per sample, NULL for drums without noise
+};
+
+class DrumSampleCache {
+
+	public:
+		//false when the one-shots do not fit in DRUM_CACHE_SET_SAMPLES at this sample rate
+		bool enabled;
+
+		//sets published so far
+		unsigned swaps;
+
+		void setup(float sampleRate);
+
+		//background loop: the controls the cache should follow
+		void setControls(float pot0, float pot1, float pot2, int type, int type2, int type3);
+
+		//background loop: render up to maxSamples of a pending set and publish it when it is
+		//complete; returns true while a re-render is still in progress
+		bool renderStep(int maxSamples);
+
+		//render and publish a complete set for the current controls; before the audio starts
+		void renderAll();
+
+		//audio callback, once per block: the set to mix from, NULL until one has been published
+		inline const DrumOneShots *acquire() {
+
+			DrumOneShots *shots = published;
+			DRUM_ACQUIRE_BARRIER();
+			reading = shots;
+			return shots;
+		}
+
+		//the set the audio callback acquired last, NULL if none
+		inline const DrumOneShots *acquired() const {
+
+			return reading;
+		}
+
+	private:
+		DrumOneShots sets[2];
+		float storage[2][DRUM_CACHE_SET_SAMPLES];
+
+		DrumOneShots *volatile published;
+		DrumOneShots *volatile reading;	//last set the audio callback acquired
+
+		DrumCacheControls wanted;
+
+		//re-render in progress: set, drum and sample being rendered
+		DrumOneShots *target;
+		int renderDrum;
+		int renderPos;
+
+		//a private engine and voice that synthesize the one-shots
+		DrumEngine renderer;
+		DrumVoice renderVoice;
+
+		void startRender(DrumOneShots *set);
+};
+
+#endif /* DRUM_SAMPLE_CACHE_H_ */
@@ -0,0 +1,14 @@
+/*
+ * drum_shared_data.cpp
+ *
+ * The drum state both cores share.  See drum_shared_data.h.
+ */
+
+#include "drum_shared_data.h"
+
+//not zeroed at startup, so neither core's startup wipes what the other has written; each core
+//sets up its own parts (DrumProfiler::setup())
+#if defined(__ADSP21000__)
+#pragma section("seg_drum_shared", NO_INIT)
+#endif
+DrumSharedData drumSharedData;
@@ -0,0 +1,34 @@
+/*
+ * drum_shared_data.h
+ *
+ * Drum state in the memory the SHARC cores and the ARM share.
+ *
+ * The framework's MULTICORE_DATA (common/multicore_shared_memory.h) is not part of this tree and
+ * cannot grow fields from here, so DrumSharedData has a block of L2 of its own: the section
+ * seg_drum_shared, which drum_shared_data.ldf reserves at the same address in the .ldf of both
+ * cores.  Both core projects compile drum_shared_data.cpp, so their two drumSharedData are the
+ * same memory, and find it with DRUM_SHARED_DATA.
+ */
+
+#ifndef DRUM_SHARED_DATA_H_
+#define DRUM_SHARED_DATA_H_
+
+#include <stdint.h>
+#include "drum_profile.h"
+
+//bytes drum_shared_data.ldf reserves for seg_drum_shared
+#define DRUM_SHARED_DATA_BYTES		8192
+
+struct DrumSharedData {
+	//cycle statistics of the audio callbacks on core 1 and core 2
+	DrumProfileStats profile[2];
+};
+
+static_assert(sizeof(DrumSharedData) <= DRUM_SHARED_DATA_BYTES,
+		"DrumSharedData outgrew seg_drum_shared: raise DRUM_SHARED_DATA_BYTES and drum_shared_data.ldf");
+
+extern DrumSharedData drumSharedData;
+
+#define DRUM_SHARED_DATA	(&drumSharedData)
+
+#endif /* DRUM_SHARED_DATA_H_ */
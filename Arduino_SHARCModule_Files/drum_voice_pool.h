@@ -0,0 +1,124 @@
+/*
+ * drum_voice_pool.h
+ *
+ * Fixed-capacity pool of drum voices.
+ *
+ * Every hit gets its own voice with its own counter, envelopes and FM operator phases, so
+ * retriggering a drum (flams, rolls) starts a second voice instead of sharing state with the
+ * first one.  Free voices sit on a stack and sounding voices in a dense active list, so
+ * allocate() and release() are O(1); each voice remembers its position in the active list so
+ * it can be swapped out without a search.
+ *
+ * A voice holds only what changes while it plays.  Everything it shares with the other voices of
+ * its drum (envelope stage tables, index envelope coefficients, the patch itself) stays in the
+ * drum's DrumModel and in drumPatches[], and a voice is either a two operator drum, a stack drum
+ * or a tom on modal resonators, so the three kinds of state share their memory.  The fields the
+ * renderers advance every sample come first and a voice starts on a cache line, so a two operator
+ * voice renders out of its first two lines; `drum_render --footprint` lists the sizes.
+ */
+
+#ifndef DRUM_VOICE_POOL_H_
+#define DRUM_VOICE_POOL_H_
+
+#include "drum_envelope.h"
+#include "drum_fm.h"
+#include "drum_noise.h"
+#include "drum_fm_stack.h"
+#include "drum_modal.h"
+
+//number of voices that can sound at once; override on the compiler command line
+#ifndef DRUM_MAX_VOICES
+#define DRUM_MAX_VOICES		32
+#endif
+
+//voices start on a cache line on the host; the SHARC reads its L1 SRAM without a cache
+#if defined(__GNUC__) && !defined(__ADSP21000__)
+#define DRUM_VOICE_ALIGN	__attribute__((aligned(64)))
+#else
+#define DRUM_VOICE_ALIGN
+#endif
+
+//the carrier and modulator of a two operator drum, in the order the renderers read them; the
+//coefficients are the DrumModel's
+struct DrumFmVoice {
+	EnvelopeState amp;		//A_t
+	FmOperator op;
+	EnvelopeState index;	//I_t of the snare and hihat
+	GammaState gammaIndex;	//I_t of the toms
+
+	//percussive sub operator of the kick and toms
+	EnvelopeState subAmp;
+	FmOperator subOp;
+
+	//op at twice the rate (drum_fm.h)
+	DrumHalfband halfband;
+};
+
+struct DrumVoice {
+	//read or advanced by the renderers
+	int drum;			//DrumType
+	int counter;		//samples since the hit
+	int delay;			//samples of the next render before the hit starts (DrumEngine::renderQueued())
+	bool held;			//key still down: the drum loops when it reaches its end
+	bool reduced;		//tail at reduced quality (drum_admission.h): coarse sine, no sub operator
+	bool oversampled;	//fm.op at twice the rate, through fm.halfband
+	bool modal;			//rings on the modal resonators in bank (DrumEngine::modal)
+	DrumNoise noise;	//noise of the snare, hihat, ride and crash, seeded from the serial
+	union {
+		DrumFmVoice fm;			//two operator drums
+		DrumStackVoice stack;	//stack drums (drum_fm_stack.h)
+		DrumModalVoice bank;	//modal toms (drum_modal.h)
+	};
+
+	//read on note events only
+	int note;			//MIDI note that started it
+	unsigned serial;	//trigger order; the oldest voice is the furthest behind the next serial, which wraps
+	int activePos;		//position in DrumVoicePool::active
+} DRUM_VOICE_ALIGN;
+
+class DrumVoicePool {
+
+	public:
+		DrumVoice voices[DRUM_MAX_VOICES];
+
+		//indices into voices[] of the sounding voices, in no particular order
+		int active[DRUM_MAX_VOICES];
+		int numActive;
+
+		void reset() {
+
+			numActive = 0;
+			numFree = DRUM_MAX_VOICES;
+			for(int v=0; v<DRUM_MAX_VOICES; v++){
+				freeList[v] = DRUM_MAX_VOICES - 1 - v;
+			}
+		}
+
+		//take a voice off the free stack and add it to the active list, NULL if all are sounding
+		inline DrumVoice *allocate() {
+
+			if(numFree == 0){
+				return 0;
+			}
+			int v = freeList[--numFree];
+			voices[v].activePos = numActive;
+			active[numActive++] = v;
+			return &voices[v];
+		}
+
+		//remove a voice from the active list by swapping the last active voice into its place
+		inline void release(DrumVoice &voice) {
+
+			int pos = voice.activePos;
+			int last = active[--numActive];
+			active[pos] = last;
+			voices[last].activePos = pos;
+			freeList[numFree++] = (int)(&voice - voices);
+		}
+
+	private:
+		int freeList[DRUM_MAX_VOICES];
+		int numFree;
+};
+
+#endif /* DRUM_VOICE_POOL_H_ */
@@ -0,0 +1,115 @@
+/*
+ * midi_parser.h
+ *
+ * MIDI byte-stream state machine for the UART receive interrupt.
+ *
+ * Bytes go in one at a time with feed(), which returns true whenever they complete a channel
+ * message.  It follows the MIDI 1.0 stream rules drum kits rely on:
+ *  - running status: data bytes without a new status byte repeat the last channel status
+ *  - all 16 channels; the channel stays in the low nibble of the status
+ *  - a note on with velocity 0 is returned as a note off
+ *  - realtime bytes (0xF8-0xFF) may appear anywhere, even inside a message, and are skipped
+ *  - system exclusive (0xF0 ... 0xF7) and system common messages are skipped; they cancel
+ *    running status
+ *  - data bytes with no status to belong to are dropped
+ *
+ * The parser has no dependency on the UART driver, so the host tools feed it recorded byte
+ * streams and MIDI files directly.
+ */
+
+#ifndef MIDI_PARSER_H_
+#define MIDI_PARSER_H_
+
+#include <stdint.h>
+#include "drum_midi_queue.h"
+
+class MidiParser {
+
+	public:
+		//bytes seen, and bytes that were not part of a channel message
+		uint32_t bytes;
+		uint32_t skipped;
+
+		void reset() {
+
+			runningStatus = 0;
+			numData = 0;
+			commonRemaining = 0;
+			inSysex = false;
+			bytes = 0;
+			skipped = 0;
+		}
+
+		//feed one byte; true when it completes a channel message, which is left in `event`
+		//(status, data1, data2; the caller stamps the time)
+		inline bool feed(uint8_t byte, DrumMidiEvent &event) {
+
+			bytes++;
+
+			//realtime: clock, start/stop, active sensing... never interrupt anything
+			if(byte >= 0xf8){
+				skipped++;
+				return false;
+			}
+
+			if(byte & 0x80){
+				//any status but realtime also ends a sysex, even one missing its 0xF7
+				inSysex = byte == 0xf0;
+				commonRemaining = 0;
+				numData = 0;
+
+				if(byte < 0xf0){
+					runningStatus = byte;
+					return false;
+				}
+
+				//system exclusive or common: skip it and its data, and forget the running status
+				skipped++;
+				runningStatus = 0;
+				commonRemaining = byte == 0xf2 ? 2 : (byte == 0xf1 || byte == 0xf3) ? 1 : 0;
+				return false;
+			}
+
+			if(inSysex || commonRemaining > 0 || runningStatus == 0){
+				if(commonRemaining > 0){
+					commonRemaining--;
+				}
+				skipped++;
+				return false;
+			}
+
+			data[numData++] = byte;
+
+			//program change and channel pressure have one data byte, the others two
+			int type = runningStatus & 0xf0;
+			int length = (type == 0xc0 || type == 0xd0) ? 1 : 2;
+			if(numData < length){
+				return false;
+			}
+			numData = 0;
+
+			event.status = runningStatus;
+			event.data1 = data[0];
+			event.data2 = length == 2 ? data[1] : 0;
+			if(type == MIDI_NOTE_ON && event.data2 == 0){
+				event.status = MIDI_NOTE_OFF | (runningStatus & 0x0f);
+			}
+			return true;
+		}
+
+	private:
+		uint8_t runningStatus;		//0 when there is none
+		uint8_t data[2];
+		int numData;
+		int commonRemaining;		//data bytes of a system common message still to skip
+		bool inSysex;
+};
+
+//note on/off, the only messages the drum engine acts on
+static inline bool midi_is_note(const DrumMidiEvent &event) {
+
+	int type = event.status & 0xf0;
+	return type == MIDI_NOTE_ON || type == MIDI_NOTE_OFF;
+}
+
+#endif /* MIDI_PARSER_H_ */
@@ -0,0 +1,142 @@
+/*
+ * activity_bench.cpp
+ *
+ * drum_render --activity: the engine's cost following what actually sounds.
+ *
+ * Checks, for every drum, that all of it past silentLength stays below DRUM_SILENT_LEVEL (tone
+ * plus the loudest the noise can get, from a full one-shot render), and that an unheld voice is
+ * off the active list by the first block boundary after silentLength.  Then times the engine
+ * with no voice at all (the zero-filled fast path) and with more and more held voices, and one
+ * ride hit, which goes quiet well before its end, against a held one that plays it all.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//loudest |tone| + |noise weight|*(noise peak) of the drum past its silentLength
+static double tail_peak(DrumEngine &engine, int drum) {
+
+	int length = engine.drumLength[drum];
+	std::vector<float> tone(length), noiseWeight(length);
+	DrumVoice v;
+	engine.startOneShot(v, drum);
+	engine.renderOneShot(v, tone.data(), noiseWeight.data(), length);
+
+	double peak = 0;
+	for(int i=engine.silentLength[drum]; i<length; i++){
+		double y = fabs(tone[i]) + fabs(noiseWeight[i])*engine.noiseFilter[drum].peak;
+		if(y > peak){
+			peak = y;
+		}
+	}
+	return peak;
+}
+
+//end of the block after which the drum's unheld voice is off the active list
+static long voice_end(int drum, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.noteOn(drumPatches[drum].note);
+	engine.noteOff(drumPatches[drum].note);
+
+	std::vector<float> block(blockSize);
+	long pos = 0;
+	while(engine.pool.numActive > 0){
+		engine.render(block.data(), blockSize);
+		pos += blockSize;
+	}
+	return pos;
+}
+
+//cycles/sample of numVoices held voices, going round the drums
+static double time_voices(int numVoices, double seconds, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	for(int v=0; v<numVoices; v++){
+		engine.noteOn(drumPatches[v % DRUM_NUM_TYPES].note);
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+//cycles of one ride hit over the ride's whole length, held or released straight away
+static double time_ride(bool held, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.noteOn(DRUM_NOTE_RIDE);
+	if(!held){
+		engine.noteOff(DRUM_NOTE_RIDE);
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = engine.drumLength[DRUM_RIDE]/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (double)(c1 - c0);
+}
+
+int run_activity_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 1;
+	}
+
+	printf("rate %d Hz, block %d, silent below %g\n\n", sampleRate, blockSize, DRUM_SILENT_LEVEL);
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+
+	bool ok = true;
+	printf("%-10s %10s %10s %16s %14s\n", "drum", "length s", "silent s", "peak past silent", "voice ends s");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		double peak = tail_peak(engine, d);
+		long end = voice_end(d, sampleRate, blockSize);
+		int silent = engine.silentLength[d];
+		bool drumOk = peak <= DRUM_SILENT_LEVEL && end >= silent && end < silent + blockSize;
+		printf("%-10s %10.3f %10.3f %16.3g %14.3f   %s\n", drumPatches[d].name, (double)engine.drumLength[d]/sampleRate,
+				(double)silent/sampleRate, peak, (double)end/sampleRate, drumOk ? "ok" : "FAIL");
+		ok = ok && drumOk;
+	}
+
+	float checksum = 0;
+	printf("\ncycles/sample by held voices:\n");
+	const int counts[] = { 0, 1, 2, 4, 8, 16, 32 };
+	double idle = 0;
+	for(int c=0; c<(int)(sizeof(counts)/sizeof(counts[0])); c++){
+		double cycles = time_voices(counts[c], seconds, sampleRate, blockSize, checksum);
+		if(c == 0){
+			idle = cycles;
+		}
+		printf("%4d voices %12.1f\n", counts[c], cycles);
+	}
+
+	double held = time_ride(true, sampleRate, blockSize, checksum);
+	double released = time_ride(false, sampleRate, blockSize, checksum);
+	printf("\none ride hit over %.1f s: %.3g cycles held to its end, %.3g released (%.0f%%)\n",
+			(double)engine.drumLength[DRUM_RIDE]/sampleRate, held, released, 100*released/held);
+	printf("(checksum %g)\n", checksum);
+
+	//an empty engine only zero-fills its block
+	bool idleOk = idle < 5;
+	printf("\nidle engine %.1f cycles/sample   %s\n", idle, idleOk ? "ok" : "FAIL");
+	return ok && idleOk ? 0 : 1;
+}
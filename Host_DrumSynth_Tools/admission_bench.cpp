@@ -0,0 +1,422 @@
+/*
+ * admission_bench.cpp
+ *
+ * drum_render --admission: CPU budget aware voice admission (drum_admission.h) under heavy rolls.
+ *
+ * Measures what a reduced quality tail costs and how far it is from the full one, then plays a
+ * groove with dense rolls on top through the profiled callback path, with a budget the rolls
+ * go well over, once admitting every hit and once through a DrumAdmission fed by the profiler.
+ * Reports overruns and callback percentiles for both, what the admission had to do, and how
+ * far its output is from the unconstrained one.  The check is on the predicted load (the
+ * profiler's costs over the voices left sounding after each block), since host timings on a
+ * shared machine swing too much from run to run to pass or fail on; on the SHARC the two agree.
+ * Counts the libm calls of the admitted run, which has to make none.  Finally checks that two engines splitting the
+ * voices (drum_dual_core.h) make the same admission decisions, and that stealing picks the older of
+ * two equally quiet voices when the serial has wrapped between them.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "drum_engine.h"
+#include "drum_profile.h"
+#include "drum_admission.h"
+#include "bench_timer.h"
+#include "libm_counter.h"
+#include "host_tools.h"
+
+static const int *drumNotes = drum_notes();
+
+static uint32_t rngState;
+
+static uint32_t rng_next(void) {
+
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static void add_hit(std::vector<DrumMidiEvent> &events, long time, int note) {
+
+	DrumMidiEvent event;
+	event.time = (uint32_t)time;
+	event.status = MIDI_NOTE_ON;
+	event.data1 = (uint8_t)note;
+	event.data2 = 100;
+	events.push_back(event);
+	event.status = MIDI_NOTE_OFF;
+	event.data2 = 0;
+	events.push_back(event);
+}
+
+static bool event_before(const DrumMidiEvent &a, const DrumMidiEvent &b) {
+
+	return a.time < b.time;
+}
+
+//kick and snare on the beats, hihat eighths, and every other bar a roll of 64th notes over
+//snare and toms
+static std::vector<DrumMidiEvent> make_rolls(long numSamples, int sampleRate) {
+
+	std::vector<DrumMidiEvent> events;
+	long beat = sampleRate/2;
+	long bar = 4*beat;
+	for(long b=0; b*bar<numSamples; b++){
+		long start = b*bar;
+		for(int q=0; q<4; q++){
+			add_hit(events, start + q*beat, q % 2 ? DRUM_NOTE_SNARE : DRUM_NOTE_KICK);
+			add_hit(events, start + q*beat + beat/2, DRUM_NOTE_HIHAT);
+			add_hit(events, start + q*beat, DRUM_NOTE_HIHAT);
+		}
+		if(b % 2 == 1){
+			for(long t=0; t<bar; t+=beat/16){
+				add_hit(events, start + t + rng_next() % 64, drumNotes[1 + rng_next() % 3]);
+			}
+		}
+	}
+	std::stable_sort(events.begin(), events.end(), event_before);
+	return events;
+}
+
+struct RollRun {
+	DrumProfileStats stats;
+	uint32_t reduced, stolen, refused;
+	uint32_t predictedOverruns;		//blocks whose voices the costs put over the budget
+	unsigned long libmCalls;		//exp/pow/sin calls in the callbacks, admission included
+};
+
+//the performance through the callback path; admission on if budget > 0
+static void render_rolls(const std::vector<DrumMidiEvent> &events, float *out, long numBlocks, int sampleRate,
+		int blockSize, uint32_t budget, bool admit, RollRun &run) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	queue->reset();
+	DrumProfileStats *stats = new DrumProfileStats;
+	DrumProfiler profiler;
+	profiler.setup(stats, budget);
+	engine->profiler = &profiler;
+	DrumAdmission admission;
+	admission.setup((float)budget, blockSize, (float)sampleRate);
+	if(admit){
+		engine->admission = &admission;
+	}
+
+	run.predictedOverruns = 0;
+	libm_counter_reset();
+	size_t next = 0;
+	for(long b=0; b<numBlocks; b++){
+		uint32_t window = (uint32_t)(b*blockSize);
+		while(next < events.size() && events[next].time < window + blockSize){
+			queue->push(events[next]);
+			next++;
+		}
+		profiler.beginCallback();
+		admission.measure(*stats, *engine);
+		engine->renderQueued(*queue, window, &out[b*blockSize], blockSize);
+		profiler.endCallback();
+
+		float load = admission.overhead;
+		for(int a=0; a<engine->pool.numActive; a++){
+			const DrumVoice &v = engine->pool.voices[engine->pool.active[a]];
+			load += admission.cost(v.drum, v.reduced);
+		}
+		run.predictedOverruns += load > budget;
+	}
+	run.libmCalls = 0;
+	for(int f=0; f<LIBM_NUM_FUNCTIONS; f++){
+		run.libmCalls += libm_calls[f];
+	}
+
+	run.stats = *stats;
+	run.reduced = admission.reduced;
+	run.stolen = admission.stolen;
+	run.refused = admission.refused;
+	delete stats;
+	delete queue;
+	delete engine;
+}
+
+//host cycles per sample of numVoices unheld voices from their tail to their end, at full or
+//reduced quality; the output goes to out[] if it is not NULL
+static double time_tails(int numVoices, bool reduced, int sampleRate, int blockSize, int repeats, float *out,
+		long outLength) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	std::vector<float> block(blockSize);
+	uint64_t cycles = 0;
+	long samples = 0;
+	for(int r=0; r<repeats; r++){
+		engine.reset();
+		for(int v=0; v<numVoices; v++){
+			int note = drumNotes[v % DRUM_NUM_TYPES];
+			engine.noteOn(note);
+			engine.noteOff(note);
+		}
+		//up to the latest tail start
+		long pos = 0;
+		int tail = 0;
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			tail = std::max(tail, engine.tailStart[d]);
+		}
+		for(; pos < tail; pos += blockSize){
+			engine.render(block.data(), blockSize);
+			if(out != 0 && pos + blockSize <= outLength){
+				std::copy(block.begin(), block.end(), &out[pos]);
+			}
+		}
+		for(int a=0; a<engine.pool.numActive; a++){
+			engine.pool.voices[engine.pool.active[a]].reduced = reduced;
+		}
+		uint64_t c0 = bench_cycles();
+		while(engine.pool.numActive > 0){
+			engine.render(block.data(), blockSize);
+			if(out != 0 && pos + blockSize <= outLength){
+				std::copy(block.begin(), block.end(), &out[pos]);
+			}
+			pos += blockSize;
+			samples += blockSize;
+		}
+		cycles += bench_cycles() - c0;
+	}
+	return (double)cycles/samples;
+}
+
+//fixed cycles per sample of a voice of the drum in check_parts_agree()
+static inline float parts_voice_cost(int drum) {
+
+	return 100.0f + 20*drum;
+}
+
+//the most the voices of one part cost per block at parts_voice_cost() with every hit admitted
+static float busiest_part(const std::vector<DrumMidiEvent> &events, long numBlocks, int sampleRate, int blockSize) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	queue->reset();
+
+	std::vector<float> block(blockSize);
+	size_t next = 0;
+	float busiest = 0;
+	for(long b=0; b<numBlocks; b++){
+		uint32_t window = (uint32_t)(b*blockSize);
+		while(next < events.size() && events[next].time < window + blockSize){
+			queue->push(events[next++]);
+		}
+		engine->renderQueued(*queue, window, block.data(), blockSize);
+		float load[2] = { 0, 0 };
+		for(int a=0; a<engine->pool.numActive; a++){
+			const DrumVoice &v = engine->pool.voices[engine->pool.active[a]];
+			load[v.serial % 2] += parts_voice_cost(v.drum)*blockSize;
+		}
+		busiest = std::max(busiest, std::max(load[0], load[1]));
+	}
+	delete queue;
+	delete engine;
+	return busiest;
+}
+
+//two engines splitting the voices, with the same fixed costs and a budget that lets the voices of
+//a part take half of what they take at their busiest (so the admission always has to decide),
+//must keep the same pool
+static bool check_parts_agree(const std::vector<DrumMidiEvent> &events, long numBlocks, int sampleRate, int blockSize,
+		uint32_t &decisions) {
+
+	float budget = busiest_part(events, numBlocks, sampleRate, blockSize)/2/(1 - DRUM_ADMISSION_HEADROOM);
+	DrumEngine *engines = new DrumEngine[2];
+	DrumAdmission admission[2];
+	DrumMidiQueue *queues = new DrumMidiQueue[2];
+	for(int p=0; p<2; p++){
+		engines[p].setup((float)sampleRate);
+		engines[p].numParts = 2;
+		engines[p].part = p;
+		admission[p].setup(budget, blockSize, (float)sampleRate);
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			admission[p].voiceCost[d] = parts_voice_cost(d);
+		}
+		engines[p].admission = &admission[p];
+		queues[p].reset();
+	}
+
+	std::vector<float> block(blockSize);
+	size_t next = 0;
+	bool agree = true;
+	for(long b=0; b<numBlocks && agree; b++){
+		uint32_t window = (uint32_t)(b*blockSize);
+		while(next < events.size() && events[next].time < window + blockSize){
+			queues[0].push(events[next]);
+			queues[1].push(events[next]);
+			next++;
+		}
+		for(int p=0; p<2; p++){
+			engines[p].renderQueued(queues[p], window, block.data(), blockSize);
+		}
+		//same voices, by serial, at the same quality
+		const DrumVoicePool &a = engines[0].pool, &c = engines[1].pool;
+		agree = a.numActive == c.numActive;
+		for(int i=0; i<a.numActive && agree; i++){
+			const DrumVoice &v = a.voices[a.active[i]];
+			bool found = false;
+			for(int j=0; j<c.numActive; j++){
+				const DrumVoice &w = c.voices[c.active[j]];
+				if(w.serial == v.serial){
+					found = w.reduced == v.reduced && w.drum == v.drum;
+				}
+			}
+			agree = found;
+		}
+	}
+	decisions = admission[0].reduced + admission[0].stolen + admission[0].refused;
+	agree = agree && admission[0].reduced == admission[1].reduced && admission[0].stolen == admission[1].stolen &&
+			admission[0].refused == admission[1].refused;
+	delete[] queues;
+	delete[] engines;
+	return agree;
+}
+
+//two equally loud kicks, the first started just before the serial wraps: making room for a third
+//has to steal the older one, although its serial is the larger
+static bool check_steal_across_wrap(int sampleRate, int blockSize) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	DrumAdmission admission;
+	//room for two full voices, not for three even with both tails reduced
+	float cost = parts_voice_cost(0);
+	admission.setup(2.2f*cost*blockSize/(1 - DRUM_ADMISSION_HEADROOM), blockSize, (float)sampleRate);
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		admission.voiceCost[d] = cost;
+	}
+	engine->admission = &admission;
+
+	engine->setNextVoiceSerial(~0u);
+	for(int v=0; v<2; v++){
+		engine->noteOn(DRUM_NOTE_KICK);
+		engine->noteOff(DRUM_NOTE_KICK);
+	}
+	std::vector<float> block(blockSize);
+	for(int pos=0; pos<=admission.minAge; pos+=blockSize){
+		engine->render(block.data(), blockSize);
+	}
+	engine->noteOn(DRUM_NOTE_KICK);
+	engine->noteOff(DRUM_NOTE_KICK);
+
+	bool olderLeft = false, newerLeft = false;
+	for(int a=0; a<engine->pool.numActive; a++){
+		unsigned serial = engine->pool.voices[engine->pool.active[a]].serial;
+		olderLeft = olderLeft || serial == ~0u;
+		newerLeft = newerLeft || serial == 0;
+	}
+	bool ok = admission.stolen == 1 && !olderLeft && newerLeft;
+	delete engine;
+	return ok;
+}
+
+static void print_run(const char *name, const RollRun &run) {
+
+	const DrumProfileStats &s = run.stats;
+	printf("%-16s %9u %8.2f%% %10u %10u %10u %10u %8u %8u %8u\n", name, s.overruns, 100.0*s.overruns/s.callbacks,
+			drum_profile_percentile(s, 0.5f), drum_profile_percentile(s, 0.99f), drum_profile_percentile(s, 0.999f),
+			s.worst, run.reduced, run.stolen, run.refused);
+}
+
+int run_admission_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 8;
+	}
+	int failures = 0;
+
+	//reduced quality tails: cost and distance from the full ones
+	long tailLength = sampleRate/2;
+	std::vector<float> full(tailLength, 0.0f), coarse(tailLength, 0.0f);
+	time_tails(DRUM_NUM_TYPES, false, sampleRate, blockSize, 1, full.data(), tailLength);
+	time_tails(DRUM_NUM_TYPES, true, sampleRate, blockSize, 1, coarse.data(), tailLength);
+	double peak = 0, err = 0;
+	for(long i=0; i<tailLength; i++){
+		peak = fmax(peak, fabs(full[i]));
+		err = fmax(err, fabs(coarse[i] - full[i]));
+	}
+	printf("reduced quality tails: max |difference| %.3g, %.1f dB below the peak of the hits\n", err,
+			20*log10(peak/err));
+	printf("  %8s %14s %14s %10s\n", "voices", "full", "reduced", "ratio");
+	double worstRatio = 0;
+	for(int n=5; n<=DRUM_MAX_VOICES; n*=2){
+		int repeats = std::max(2, (int)(seconds*4/n));
+		double f = time_tails(n, false, sampleRate, blockSize, repeats, 0, 0);
+		double r = time_tails(n, true, sampleRate, blockSize, repeats, 0, 0);
+		worstRatio = std::max(worstRatio, r/f);
+		printf("  %8d %14.1f %14.1f %10.2f\n", n, f, r, r/f);
+	}
+	printf("  (host cycles/sample; drum_admission.h assumes %.2f)\n\n", DRUM_ADMISSION_REDUCED_COST);
+
+	//rolls against a budget they go well over
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	long numSamples = numBlocks*blockSize;
+	rngState = 0xfeedbeefu;
+	std::vector<DrumMidiEvent> events = make_rolls(numSamples, sampleRate);
+	std::vector<float> free(numSamples), admitted(numSamples);
+
+	//calibrate: what the voices cost on this host, and a budget with room for about 8 of them
+	RollRun run;
+	render_rolls(events, free.data(), numBlocks, sampleRate, blockSize, 1000000, false, run);
+	double voiceCost = 0;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		voiceCost += run.stats.drumVoiceSample[d]/DRUM_NUM_TYPES;
+	}
+	uint32_t budget = (uint32_t)(run.stats.otherAverage + 8*voiceCost*blockSize);
+
+	printf("groove with 64th note rolls every other bar, %.1f s, %zu events\n", seconds, events.size());
+	printf("budget %u host cycles per callback: about 8 voices at %.1f cycles/sample each\n\n", budget, voiceCost);
+	printf("%-16s %9s %9s %10s %10s %10s %10s %8s %8s %8s\n", "", "overruns", "", "p50", "p99", "p99.9", "worst",
+			"reduced", "stolen", "refused");
+
+	RollRun unlimited, limited;
+	render_rolls(events, free.data(), numBlocks, sampleRate, blockSize, budget, false, unlimited);
+	print_run("every hit", unlimited);
+	render_rolls(events, admitted.data(), numBlocks, sampleRate, blockSize, budget, true, limited);
+	print_run("admission", limited);
+
+	double signal = 0, noise = 0;
+	for(long i=0; i<numSamples; i++){
+		signal += (double)free[i]*free[i];
+		noise += (double)(admitted[i] - free[i])*(admitted[i] - free[i]);
+	}
+	printf("\nadmission output against every hit: %.1f dB SNR\n", 10*log10(signal/noise));
+
+	//by its own costs the admission has to keep every block within the budget, bar the few right
+	//after the costs move.  A run too short to reach the rolls hardly goes over the budget, and has
+	//nothing to check
+	bool overloaded = unlimited.predictedOverruns > limited.stats.callbacks/20;
+	bool rollsOk = !overloaded || limited.predictedOverruns < limited.stats.callbacks/50;
+	failures += !rollsOk;
+	printf("predicted overruns down from %u to %u   %s\n", unlimited.predictedOverruns, limited.predictedOverruns,
+			!overloaded ? "skipped, the run hardly goes over the budget" : rollsOk ? "ok" : "FAILED");
+	printf("(timed overruns down from %u to %u)\n", unlimited.stats.overruns, limited.stats.overruns);
+
+	//the admission runs in noteOn() inside the callback, so it must not call libm either
+	bool libmOk = limited.libmCalls == 0;
+	failures += !libmOk;
+	printf("exp/pow/sin calls in the callbacks with admission: %lu   %s\n", limited.libmCalls,
+			libmOk ? "ok" : "FAILED");
+
+	uint32_t decisions;
+	bool partsOk = check_parts_agree(events, numBlocks, sampleRate, blockSize, decisions) && decisions > 0;
+	failures += !partsOk;
+	printf("two engines splitting the voices make the same %u decisions   %s\n", decisions, partsOk ? "ok" : "FAILED");
+
+	bool wrapOk = check_steal_across_wrap(sampleRate, blockSize);
+	failures += !wrapOk;
+	printf("of two equally quiet voices the older is stolen across the serial wrap   %s\n", wrapOk ? "ok" : "FAILED");
+
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
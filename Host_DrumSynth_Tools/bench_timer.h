@@ -0,0 +1,46 @@
+/*
+ * bench_timer.h
+ *
+ * Wall-clock and cycle counters for the host benchmarks.
+ *
+ * On x86 the cycle count comes from rdtsc (constant-rate TSC ticks, which track core cycles
+ * closely when frequency scaling is off).  On other hosts it falls back to clock_gettime()
+ * nanoseconds so the numbers are still comparable run to run.
+ */
+
+#ifndef BENCH_TIMER_H_
+#define BENCH_TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_RDTSC 1
+#else
+#define BENCH_HAVE_RDTSC 0
+#endif
+
+//SHARC budget from the header of callback_audio_processing.cpp: 450MHz, 48kHz, 32 sample blocks
+#define SHARC_CORE_CLOCK_HZ			450000000.0
+#define SHARC_CYCLES_PER_SAMPLE		9375.0
+
+static inline double bench_seconds(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static inline uint64_t bench_cycles(void) {
+
+#if BENCH_HAVE_RDTSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
+#endif /* BENCH_TIMER_H_ */
@@ -0,0 +1,144 @@
+/*
+ * cache_bench.cpp
+ *
+ * drum_render --cache: the pre-rendered one-shot cache (drum_sample_cache.h).  Checks that
+ * cached drums match the synthesized ones, times a full background re-render, compares the
+ * cost of cached and synthesized voices, and follows a knob change from the background loop to
+ * the audio path.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_sample_cache.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//hits of every drum, released straight away, synthesized or mixed from the cache
+static void render_hits(DrumSampleCache *cache, float *out, long numSamples, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.cache = cache;
+
+	static const int notes[] = { DRUM_NOTE_KICK, DRUM_NOTE_SNARE, DRUM_NOTE_MIDTOM, DRUM_NOTE_HIHAT, DRUM_NOTE_KICK,
+			DRUM_NOTE_HIGHTOM };
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		long b = pos/blockSize;
+		if(b % 50 == 0){
+			int note = notes[(b/50) % 6];
+			engine.noteOn(note);
+			engine.noteOff(note);
+		}
+		engine.render(&out[pos], blockSize);
+	}
+}
+
+//cycles per sample with numVoices held hits of the given drums
+static double time_voices(DrumSampleCache *cache, const int *notes, int numNotes, int numVoices, double seconds,
+		int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.cache = cache;
+
+	std::vector<float> block(blockSize);
+	for(int v=0; v<numVoices; v++){
+		engine.noteOn(notes[v % numNotes]);
+		engine.render(block.data(), blockSize);
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+int run_cache_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 3;
+	}
+
+	//two sets of one-shots are large, keep them off the stack
+	DrumSampleCache *cache = new DrumSampleCache;
+	cache->setup((float)sampleRate);
+	if(!cache->enabled){
+		printf("one-shots do not fit in DRUM_CACHE_SET_SAMPLES (%d) at %d Hz\n", DRUM_CACHE_SET_SAMPLES, sampleRate);
+		delete cache;
+		return 1;
+	}
+
+	printf("rate %d Hz, block %d, %d floats per set, %.0f KB for both sets\n\n", sampleRate, blockSize,
+			DRUM_CACHE_SET_SAMPLES, 2.0*DRUM_CACHE_SET_SAMPLES*sizeof(float)/1024);
+
+	//full render of a set, the way the background loop does it
+	int steps = 0;
+	uint64_t c0 = bench_cycles();
+	double t0 = bench_seconds();
+	while(cache->renderStep(DRUM_CACHE_STEP)){
+		steps++;
+	}
+	double t1 = bench_seconds();
+	uint64_t c1 = bench_cycles();
+	cache->renderAll();
+	printf("re-render: %d steps of %d samples, %.2f ms, %.1f M host cycles\n\n", steps + 1, DRUM_CACHE_STEP,
+			(t1 - t0)*1e3, (c1 - c0)/1e6);
+
+	//cached and synthesized drums must agree
+	long numSamples = 2*(long)sampleRate;
+	numSamples -= numSamples % blockSize;
+	std::vector<float> synth(numSamples), cached(numSamples);
+	render_hits(0, synth.data(), numSamples, sampleRate, blockSize);
+	render_hits(cache, cached.data(), numSamples, sampleRate, blockSize);
+	double maxErr = 0, peak = 0;
+	for(long i=0; i<numSamples; i++){
+		maxErr = fmax(maxErr, fabs(synth[i] - cached[i]));
+		peak = fmax(peak, fabs(synth[i]));
+	}
+	printf("cached vs synthesized: max |difference| %g (%.1f dB below peak)\n\n", maxErr,
+			maxErr > 0 ? 20*log10(peak/maxErr) : INFINITY);
+
+	//the snare and hihat still generate their noise, so also time the tonal drums on their own
+	static const int allNotes[] = { DRUM_NOTE_KICK, DRUM_NOTE_SNARE, DRUM_NOTE_MIDTOM, DRUM_NOTE_HIGHTOM, DRUM_NOTE_HIHAT };
+	static const int tonalNotes[] = { DRUM_NOTE_KICK, DRUM_NOTE_MIDTOM, DRUM_NOTE_HIGHTOM };
+	printf("%-8s %6s %14s %14s %14s %10s\n", "drums", "voices", "synthesized", "cached", "cached/voice", "speedup");
+	for(int set=0; set<2; set++){
+		const int *notes = set == 0 ? allNotes : tonalNotes;
+		int numNotes = set == 0 ? 5 : 3;
+		for(int n=8; n<=DRUM_MAX_VOICES; n*=2){
+			float checksum = 0;
+			double s = time_voices(0, notes, numNotes, n, seconds, sampleRate, blockSize, checksum);
+			double c = time_voices(cache, notes, numNotes, n, seconds, sampleRate, blockSize, checksum);
+			printf("%-8s %6d %14.1f %14.1f %14.2f %9.2fx   (checksum %g)\n", set == 0 ? "all" : "kick/tom",
+					n, s, c, c/n, s/c, checksum);
+		}
+	}
+
+	//turn a knob: the background loop gets one renderStep() per block, like processaudio_background_loop()
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.cache = cache;
+	std::vector<float> block(blockSize);
+	unsigned swapsBefore = cache->swaps;
+	int blocks = 0;
+	cache->setControls(0.5f, 0, 0, 0, 0, 0);
+	do{
+		engine.noteOn(DRUM_NOTE_KICK);
+		engine.noteOff(DRUM_NOTE_KICK);
+		engine.render(block.data(), blockSize);
+		cache->renderStep(DRUM_CACHE_STEP);
+		blocks++;
+	}while(cache->swaps == swapsBefore && blocks < 100000);
+	engine.render(block.data(), blockSize);
+	printf("\nknob change published after %d blocks (%.1f ms of audio at one step per block)\n", blocks,
+			1e3*blocks*blockSize/sampleRate);
+
+	delete cache;
+	return 0;
+}
@@ -0,0 +1,592 @@
+/*
+ * capture_bench.cpp
+ *
+ * drum_render --capture: the capture of drum_capture.h on a performance through the firmware's
+ * MIDI input and audio callback, the way processaudio_callback() and the background loop use it.
+ *
+ * The performance (-m, or --play's built-in one) reaches the real midi_rx_callback_sharc1()
+ * through the mock UART, which adds every event to the capture; the simulated callback renders
+ * into its claimed record with the profiler, the admission, the knob snapshots and the sample
+ * cache attached, and the background loop turns a knob, presses buttons and the panic, and
+ * drains the capture after every block, except for a stall longer than the ring.  The dump
+ * (saved with -o) is then replayed through a fresh engine, which has to match every block it
+ * replays bit for bit and replay as many as the run says it can: the records from the first
+ * block with nothing sounding on, less the ones lost in the stall and the ones after it until a
+ * panic silences the voices again.  The same performance without admission must come out the
+ * same with the capture as without it.  Finally it times what the capture adds per event to the
+ * interrupt, per block to the callback and per record and event to the background loop.
+ *
+ * drum_render --replay: the same replay of a dump saved from the SHARC (-m), with the dump's own
+ * cycle counts; -o writes the audio the dump holds.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <builtins.h>
+#include "drivers/bm_uart_driver/bm_uart.h"
+#include "callback_midi_message.h"
+#include "drum_engine.h"
+#include "drum_capture.h"
+#include "drum_profile.h"
+#include "drum_admission.h"
+#include "drum_patch_snapshot.h"
+#include "midi_file.h"
+#include "capture_replay.h"
+#include "bench_timer.h"
+#include "wav_file.h"
+#include "host_tools.h"
+
+//the firmware's queue, clock, capture and UART, defined in midi_parser_bench.cpp and
+//callback_midi_message.cpp
+extern DrumMidiQueue midiQueue;
+extern DrumMidiClock midiClock;
+extern DrumCapture drumCapture;
+extern uint32_t mock_emuclk_cycles;
+extern BM_UART midi_uart_sharc1;
+
+//longest the voices may ring on after the last byte
+#define CAPTURE_MAX_TAIL_SECONDS	12.0
+
+//the background loop stalls this many blocks longer than the ring holds
+#define CAPTURE_STALL_EXTRA			8
+
+//what the background loop does when, as a share of the performance
+#define CAPTURE_SWEEP_FROM			0.55
+#define CAPTURE_SWEEP_TO			0.7
+#define CAPTURE_BUTTON_AT			0.6
+#define CAPTURE_STALL_AT			0.75
+
+//panics; the last one after the performance, where it ends the run
+#define CAPTURE_PANICS				3
+static const double panicAt[CAPTURE_PANICS] = { 0.5, 0.95, 1.1 };
+
+//repetitions of the cost measurements; each is its least
+#define CAPTURE_TIMING_PASSES		5
+
+//runs with and without the capture; each block's cost is its least
+#define CAPTURE_PASSES				3
+
+//the firmware's globals the simulation stands in for
+struct CaptureFirmware {
+	DrumEngine engine;
+	DrumPatchSnapshots snapshots;
+	DrumProfileStats stats;
+	DrumProfiler profiler;
+	DrumAdmission admission;
+	DrumSampleCache cache;
+	DrumCaptureDump dump;
+};
+
+struct CaptureRun {
+	long numBlocks;
+	long numEvents;
+	std::vector<double> captureCycles;		//per block, what the capture added to the callback
+	std::vector<double> callbackCycles;
+	uint32_t checksum;
+	double stallAt;
+
+	//per block, with the capture: whether it got a record, and whether no voice was sounding when
+	//its events started (DRUM_CAPTURE_IDLE)
+	std::vector<bool> kept;
+	std::vector<bool> idle;
+};
+
+static uint32_t cycles_at(double seconds) {
+
+	return (uint32_t)(uint64_t)(seconds*SHARC_CORE_CLOCK_HZ);
+}
+
+static uint32_t checksum_add(uint32_t h, const float *x, int n) {
+
+	for(int i=0; i<n; i++){
+		uint32_t bits;
+		memcpy(&bits, &x[i], 4);
+		for(int k=0; k<4; k++){
+			h = (h ^ ((bits >> (8*k)) & 0xff))*16777619u;
+		}
+	}
+	return h;
+}
+
+//the knobs and buttons at a share of the performance
+static DrumControls controls_at(double f, int oversampling) {
+
+	double sweep = (f - CAPTURE_SWEEP_FROM)/(CAPTURE_SWEEP_TO - CAPTURE_SWEEP_FROM);
+	sweep = sweep < 0 ? 0 : sweep > 1 ? 1 : sweep;
+	DrumControls c = { (float)(0.2 + 0.5*sweep), 0.3f, 0.6f, f >= CAPTURE_BUTTON_AT ? 1 : 0, 0,
+			f >= CAPTURE_BUTTON_AT ? 2 : 0, oversampling };
+	return c;
+}
+
+//bench_cycles() back to back
+static double timer_overhead(void) {
+
+	double least = 1e30;
+	for(int k=0; k<1000; k++){
+		uint64_t c0 = bench_cycles();
+		uint64_t c1 = bench_cycles();
+		least = fmin(least, (double)(c1 - c0));
+	}
+	return least;
+}
+
+//the performance through the firmware: processaudio_setup(), then for every block the receive
+//interrupts, processaudio_callback() and a pass of processaudio_background_loop()
+static void capture_run(const std::vector<MidiWireByte> &bytes, bool capture, bool admission, double seconds,
+		int sampleRate, int blockSize, CaptureFirmware &fw, CaptureRun &run) {
+
+	double overhead = timer_overhead();
+
+	midi_setup_sharc1();
+	midiQueue.reset();
+	midiClock.setup((float)sampleRate);
+	drumCapture.reset();
+	mock_emuclk_cycles = 0;
+
+	DrumEngine &engine = fw.engine;
+	engine.setup((float)sampleRate);
+	fw.snapshots.setup();
+	double length = seconds > 0 ? seconds : bytes.empty() ? 1 : bytes.back().time;
+	fw.snapshots.publish(engine, controls_at(0, engine.oversampling));
+	uint32_t budget = (uint32_t)(SHARC_CYCLES_PER_SAMPLE*blockSize);
+	fw.profiler.setup(&fw.stats, budget);
+	engine.profiler = &fw.profiler;
+	if(admission){
+		fw.admission.setup((float)budget, blockSize, (float)sampleRate);
+		engine.admission = &fw.admission;
+	}
+	DrumControls c = controls_at(0, engine.oversampling);
+	fw.cache.setup((float)sampleRate);
+	fw.cache.setControls(c.pot0, c.pot1, c.pot2, c.type, c.type2, c.type3);
+	fw.cache.renderAll();
+	if(fw.cache.enabled){
+		engine.cache = &fw.cache;
+	}
+	drum_capture_dump_setup(fw.dump, engine, blockSize);
+
+	long maxBlocks = (long)((seconds > 0 ? seconds : length + CAPTURE_MAX_TAIL_SECONDS)*sampleRate)/blockSize;
+	long stallBlocks = DRUM_CAPTURE_RING_BLOCKS + CAPTURE_STALL_EXTRA;
+	long stallStart = -1;
+	int panics = 0;
+	std::vector<float> out(blockSize);
+	run.numBlocks = 0;
+	run.numEvents = 0;
+	run.captureCycles.clear();
+	run.callbackCycles.clear();
+	run.kept.clear();
+	run.idle.clear();
+	run.checksum = 2166136261u;
+	size_t next = 0;
+
+	for(long b=0; b<maxBlocks; b++){
+		double callbackTime = (double)(b + 1)*blockSize/sampleRate;
+		double f = callbackTime/length;
+
+		while(next < bytes.size() && bytes[next].time < callbackTime){
+			mock_emuclk_cycles = cycles_at(bytes[next].time);
+			mock_uart_receive(&midi_uart_sharc1, &bytes[next].byte, 1);
+			next++;
+		}
+
+		//processaudio_callback(); the capture's share is timed on its own
+		mock_emuclk_cycles = cycles_at(callbackTime);
+		uint64_t t0 = bench_cycles();
+		fw.profiler.beginCallback();
+		if(admission){
+			fw.admission.measure(fw.stats, engine);
+		}
+		uint64_t c0 = bench_cycles();
+		DrumCaptureBlock *record = capture ? drumCapture.claimBlock() : 0;
+		uint64_t c1 = bench_cycles();
+		engine.snapshot = fw.snapshots.acquire();
+		uint32_t window = midiClock.periodStart();
+		midiClock.startPeriod(window + blockSize, emuclk());
+		bool panic = fw.snapshots.takePanic();
+		if(panic){
+			DrumMidiEvent panicEvent = { window, MIDI_CONTROL_CHANGE, MIDI_ALL_SOUND_OFF, 0 };
+			engine.applyEvent(panicEvent);
+		}
+		uint64_t c2 = bench_cycles();
+		if(record != 0){
+			drum_capture_block_begin(*record, engine, panic);
+		}
+		if(capture){
+			run.kept.push_back(record != 0);
+			run.idle.push_back(engine.pool.numActive == 0);
+		}
+		uint64_t c3 = bench_cycles();
+		uint32_t queued = midiQueue.depth();
+		float *drumOut = record != 0 ? record->audio : out.data();
+		engine.renderQueued(midiQueue, window, drumOut, blockSize);
+		run.numEvents += queued - midiQueue.depth();
+		uint64_t c4 = bench_cycles();
+		if(record != 0){
+			drum_capture_block_end(*record, engine, window);
+		}
+		uint64_t c5 = bench_cycles();
+		if(record != 0){
+			memcpy(out.data(), drumOut, blockSize*sizeof(float));
+		}
+		uint32_t cycles = fw.profiler.endCallback();
+		uint64_t c6 = bench_cycles();
+		if(record != 0){
+			record->cycles = cycles;
+			drumCapture.commitBlock();
+		}
+		uint64_t t1 = bench_cycles();
+		if(capture){
+			run.captureCycles.push_back((double)((c1 - c0) + (c3 - c2) + (c5 - c4) + (t1 - c6)) - 4*overhead);
+		}
+		run.callbackCycles.push_back((double)(t1 - t0));
+		run.checksum = checksum_add(run.checksum, out.data(), blockSize);
+		run.numBlocks++;
+
+		//processaudio_background_loop(), unless it is stalled
+		if(stallStart < 0 && f >= CAPTURE_STALL_AT){
+			stallStart = b;
+			run.stallAt = callbackTime;
+		}
+		if(stallStart >= 0 && b >= stallStart && b < stallStart + stallBlocks){
+			continue;
+		}
+		if(panics < CAPTURE_PANICS && f >= panicAt[panics]){
+			panics++;
+			fw.snapshots.requestPanic();
+		}
+		c = controls_at(f, engine.oversampling);
+		fw.snapshots.publish(engine, c);
+		fw.cache.setControls(c.pot0, c.pot1, c.pot2, c.type, c.type2, c.type3);
+		fw.cache.renderStep(DRUM_CACHE_STEP);
+		drumCapture.drain(fw.dump);
+
+		if(seconds <= 0 && next == bytes.size() && f > 1 && engine.pool.numActive == 0 && midiQueue.depth() == 0){
+			break;
+		}
+	}
+	drumCapture.drain(fw.dump);
+}
+
+//what the capture costs the interrupt per event, and the background loop per record and event
+static void time_capture(int blockSize, double &perEvent, double &perMessage, double &perRecord,
+		double &perDrainEvent, CaptureFirmware &fw) {
+
+	DrumMidiEvent event = { 0, 0x99, 38, 100 };
+	perEvent = 1e30;
+	perMessage = 1e30;
+	perRecord = 1e30;
+	perDrainEvent = 1e30;
+	for(int p=0; p<CAPTURE_TIMING_PASSES; p++){
+		//addEvent() into a ring with room
+		drumCapture.reset();
+		uint64_t c0 = bench_cycles();
+		for(int k=0; k<DRUM_MIDI_QUEUE_SIZE; k++){
+			event.time = k;
+			drumCapture.addEvent(event);
+		}
+		uint64_t c1 = bench_cycles();
+		perEvent = fmin(perEvent, (double)(c1 - c0)/DRUM_MIDI_QUEUE_SIZE);
+
+		//and draining them
+		c0 = bench_cycles();
+		drumCapture.drain(fw.dump);
+		c1 = bench_cycles();
+		perDrainEvent = fmin(perDrainEvent, (double)(c1 - c0)/DRUM_MIDI_QUEUE_SIZE);
+
+		//a whole note on through the interrupt, for scale
+		midiQueue.reset();
+		drumCapture.reset();
+		const int messages = DRUM_MIDI_QUEUE_SIZE;
+		c0 = bench_cycles();
+		for(int k=0; k<messages; k++){
+			uint8_t bytes[3] = { 0x99, (uint8_t)(36 + k%8), 100 };
+			mock_uart_receive(&midi_uart_sharc1, bytes, 3);
+		}
+		c1 = bench_cycles();
+		perMessage = fmin(perMessage, (double)(c1 - c0)/messages);
+
+		//a full ring of records into the dump
+		drumCapture.reset();
+		for(int k=0; k<DRUM_CAPTURE_RING_BLOCKS; k++){
+			DrumCaptureBlock *record = drumCapture.claimBlock();
+			memset(record->audio, 0, blockSize*sizeof(float));
+			drumCapture.commitBlock();
+		}
+		c0 = bench_cycles();
+		drumCapture.drain(fw.dump);
+		c1 = bench_cycles();
+		perRecord = fmin(perRecord, (double)(c1 - c0)/DRUM_CAPTURE_RING_BLOCKS);
+	}
+	midiQueue.reset();
+	drumCapture.reset();
+}
+
+static double percentile(std::vector<double> x, double p) {
+
+	if(x.empty()){
+		return 0;
+	}
+	std::sort(x.begin(), x.end());
+	return x[(size_t)(p*(x.size() - 1))];
+}
+
+static double mean(const std::vector<double> &x) {
+
+	double sum = 0;
+	for(size_t k=0; k<x.size(); k++){
+		sum += x[k];
+	}
+	return x.empty() ? 0 : sum/x.size();
+}
+
+//records of the dump from `from` up to `to` that no segment replayed, if any
+static void print_skipped(const CaptureDump &dump, long from, long to) {
+
+	if(to <= from){
+		return;
+	}
+	const DrumCaptureHeader &h = dump.header;
+	printf("  from %.3f s, %ld records skipped: %s\n", (double)dump.blocks[from].controls.window/h.sampleRate,
+			to - from, from == 0 ? "voices sound from the start of the dump to the first record that starts with none"
+			: "voices sound from the break to the next record that starts with none");
+}
+
+static void print_replay(const CaptureDump &dump, const CaptureReplay &replay) {
+
+	const DrumCaptureHeader &h = dump.header;
+	printf("replay: %ld of %d records in %d segment%s, %ld bit for bit, largest difference %.3g\n", replay.blocks,
+			(int)dump.blocks.size(), replay.segments, replay.segments == 1 ? "" : "s", replay.exact, replay.maxError);
+	for(int s=0; s<replay.segments; s++){
+		print_skipped(dump, s > 0 ? replay.last[s - 1] : 0, replay.first[s]);
+		const DrumCaptureBlock &first = dump.blocks[replay.first[s]];
+		printf("  from %.3f s (%s) for %ld blocks, %s\n", (double)first.controls.window/h.sampleRate,
+				(first.flags & DRUM_CAPTURE_PANIC) ? "panic" : "nothing sounding", replay.last[s] - replay.first[s],
+				replay.stop[s] != 0 ? replay.stop[s] : "to the end");
+	}
+	print_skipped(dump, replay.segments > 0 ? replay.last[replay.segments - 1] : 0, (long)dump.blocks.size());
+	if(replay.firstMismatch >= 0){
+		printf("  first difference at %.3f s\n",
+				(double)dump.blocks[replay.firstMismatch].controls.window/h.sampleRate);
+	}
+}
+
+//records capture_replay() should replay from a run's dump, from what the run knows: the dump keeps
+//the last DRUM_CAPTURE_DUMP_BLOCKS records, and a segment starts at a block with nothing sounding
+//whose block before is in the dump, and runs to the next block that got no record
+static long expected_replay(const CaptureRun &run) {
+
+	long numKept = 0;
+	for(size_t b=0; b<run.kept.size(); b++){
+		numKept += run.kept[b];
+	}
+	long skip = numKept > DRUM_CAPTURE_DUMP_BLOCKS ? numKept - DRUM_CAPTURE_DUMP_BLOCKS : 0;
+	size_t dumpStart = 0;
+	while(dumpStart < run.kept.size() && (!run.kept[dumpStart] || skip-- > 0)){
+		dumpStart++;
+	}
+
+	long replayed = 0;
+	bool replaying = false;
+	for(size_t b=dumpStart+1; b<run.kept.size(); b++){
+		if(!run.kept[b]){
+			replaying = false;
+			continue;
+		}
+		replaying = replaying || (run.idle[b] && run.kept[b - 1]);
+		replayed += replaying;
+	}
+	return replayed;
+}
+
+static bool write_dump(const char *path, const DrumCaptureDump &dump) {
+
+	FILE *f = fopen(path, "wb");
+	if(f == 0){
+		return false;
+	}
+	bool ok = fwrite(&dump, sizeof(dump), 1, f) == 1;
+	return fclose(f) == 0 && ok;
+}
+
+int run_capture_bench(const char *path, const char *outPath, double seconds, int sampleRate, int blockSize) {
+
+	if(blockSize > DRUM_CAPTURE_BLOCK_SIZE){
+		fprintf(stderr, "a capture record holds %d samples, build with -DDRUM_CAPTURE_BLOCK_SIZE=%d\n",
+				DRUM_CAPTURE_BLOCK_SIZE, blockSize);
+		return 1;
+	}
+	std::vector<MidiWireByte> bytes;
+	if(path != 0){
+		if(!midi_file_read(path, bytes)){
+			fprintf(stderr, "could not read %s\n", path);
+			return 1;
+		}
+	}
+	else{
+		play_builtin_performance(bytes);
+	}
+
+	drum_fm_init();
+
+	printf("%s: %d bytes over %.2f s, rate %d Hz, block %d\n", path != 0 ? path : "built-in performance",
+			(int)bytes.size(), bytes.empty() ? 0 : bytes.back().time, sampleRate, blockSize);
+	printf("ring %d records and %d events, dump %d blocks (%.1f s) and %d events, %.2f MB\n",
+			DRUM_CAPTURE_RING_BLOCKS, DRUM_MIDI_QUEUE_SIZE, DRUM_CAPTURE_DUMP_BLOCKS,
+			(double)DRUM_CAPTURE_DUMP_BLOCKS*blockSize/sampleRate, DRUM_CAPTURE_DUMP_EVENTS,
+			sizeof(DrumCaptureDump)/1048576.0);
+
+	CaptureFirmware *fw = new CaptureFirmware;
+	CaptureRun run;
+	bool ok = true;
+
+	//the full firmware path, admission included: its decisions follow the cycles measured on the
+	//host, so only the dump can reproduce them
+	capture_run(bytes, true, true, seconds, sampleRate, blockSize, *fw, run);
+	const DrumCaptureHeader &h = fw->dump.header;
+	//the ring fills up during the stall, and the callback after it still finds it full
+	long expectLost = CAPTURE_STALL_EXTRA + 1;
+	printf("\n%ld blocks, %ld events; background stalled for %d blocks at %.3f s: %u records lost (%ld expected), "
+			"%u events lost\n", run.numBlocks, run.numEvents, DRUM_CAPTURE_RING_BLOCKS + CAPTURE_STALL_EXTRA, run.stallAt,
+			(unsigned)h.blocksLost, expectLost, (unsigned)h.eventsLost);
+	ok = ok && (long)h.blocksLost == expectLost && h.eventsLost == 0;
+
+	CaptureDump dump;
+	std::string error;
+	if(!capture_dump_load((const uint8_t *)&fw->dump, sizeof(DrumCaptureDump), dump, error)){
+		fprintf(stderr, "%s\n", error.c_str());
+		delete fw;
+		return 1;
+	}
+	if(outPath != 0){
+		if(!write_dump(outPath, fw->dump) || !capture_dump_read(outPath, dump, error)){
+			fprintf(stderr, "could not write and read back %s %s\n", outPath, error.c_str());
+			delete fw;
+			return 1;
+		}
+		printf("wrote %s\n", outPath);
+	}
+	CaptureReplay replay;
+	capture_replay(dump, replay);
+	printf("dump holds %d records from %.3f s on, and %d events\n", (int)dump.blocks.size(),
+			dump.blocks.empty() ? 0 : (double)dump.blocks[0].controls.window/sampleRate, (int)dump.events.size());
+	print_replay(dump, replay);
+	long expectReplayed = expected_replay(run);
+	bool replayOk = replay.blocks == expectReplayed && replay.exact == replay.blocks;
+	printf("  %ld records replayable (%ld expected), all bit for bit: %s\n", replay.blocks, expectReplayed,
+			replayOk ? "ok" : "FAILED");
+	ok = ok && replayOk;
+
+	//without admission the output does not depend on the host's timing: the same with and without
+	//the capture, every pass
+	CaptureRun with, without, pass;
+	bool same = true;
+	for(int p=0; p<CAPTURE_PASSES; p++){
+		for(int k=0; k<2; k++){
+			capture_run(bytes, k == 1, false, seconds, sampleRate, blockSize, *fw, pass);
+			CaptureRun &least = k == 1 ? with : without;
+			if(p == 0){
+				least = pass;
+				continue;
+			}
+			same = same && pass.checksum == least.checksum && pass.numBlocks == least.numBlocks;
+			for(size_t b=0; b<least.callbackCycles.size() && b<pass.callbackCycles.size(); b++){
+				least.callbackCycles[b] = fmin(least.callbackCycles[b], pass.callbackCycles[b]);
+			}
+			for(size_t b=0; b<least.captureCycles.size() && b<pass.captureCycles.size(); b++){
+				least.captureCycles[b] = fmin(least.captureCycles[b], pass.captureCycles[b]);
+			}
+		}
+	}
+	same = same && with.checksum == without.checksum && with.numBlocks == without.numBlocks;
+	printf("\noutput with the capture %08x, without %08x: %s\n", with.checksum, without.checksum,
+			same ? "the same every pass" : "DIFFERENT");
+	ok = ok && same;
+
+	double budget = SHARC_CYCLES_PER_SAMPLE*blockSize;
+	printf("\ncapture in the callback, cycles per block (budget %.0f), least of %d passes:\n", budget,
+			CAPTURE_PASSES);
+	printf("  mean   %10.1f  %7.3f%%\n", mean(with.captureCycles), 100*mean(with.captureCycles)/budget);
+	printf("  p99    %10.1f  %7.3f%%\n", percentile(with.captureCycles, 0.99),
+			100*percentile(with.captureCycles, 0.99)/budget);
+	printf("  worst  %10.1f  %7.3f%%\n", percentile(with.captureCycles, 1),
+			100*percentile(with.captureCycles, 1)/budget);
+	printf("  whole callback, mean %.0f with the capture, %.0f without\n", mean(with.callbackCycles),
+			mean(without.callbackCycles));
+
+	double perEvent, perMessage, perRecord, perDrainEvent;
+	time_capture(blockSize, perEvent, perMessage, perRecord, perDrainEvent, *fw);
+	printf("\ncapture in the MIDI interrupt: %.1f cycles per event, of %.1f per note on through the interrupt\n",
+			perEvent, perMessage);
+	printf("drain in the background loop: %.1f cycles per record (%d bytes), %.1f per event\n", perRecord,
+			(int)sizeof(DrumCaptureBlock), perDrainEvent);
+
+	delete fw;
+	printf("\ncycles are host cycles; the budget is %.0f SHARC cycles/sample.\n", SHARC_CYCLES_PER_SAMPLE);
+	return ok ? 0 : 1;
+}
+
+int run_capture_replay(const char *path, const char *outPath) {
+
+	if(path == 0){
+		fprintf(stderr, "--replay needs a dump: -m dump.bin\n");
+		return 1;
+	}
+	drum_fm_init();
+
+	CaptureDump dump;
+	std::string error;
+	if(!capture_dump_read(path, dump, error)){
+		fprintf(stderr, "%s: %s\n", path, error.c_str());
+		return 1;
+	}
+	const DrumCaptureHeader &h = dump.header;
+	printf("%s: rate %.0f Hz, block %u, %d records and %d events kept of %u and %u, %u records and %u events lost\n",
+			path, h.sampleRate, (unsigned)h.blockSize, (int)dump.blocks.size(), (int)dump.events.size(),
+			(unsigned)h.blocks, (unsigned)h.events, (unsigned)h.blocksLost, (unsigned)h.eventsLost);
+	printf("engine: loop order %d, %s controls, oversampling %d, part %d of %d, modal drums %#x, admission %s\n",
+			(int)h.loopOrder, h.smoothControls ? "ramped" : "stepped", (int)h.oversampling, (int)h.part,
+			(int)h.numParts, (unsigned)h.modal, h.admissionBudget > 0 ? "on" : "off");
+
+	if(!dump.blocks.empty()){
+		std::vector<double> cycles;
+		long over = 0;
+		for(size_t k=0; k<dump.blocks.size(); k++){
+			cycles.push_back(dump.blocks[k].cycles);
+			over += h.admissionBudget > 0 && dump.blocks[k].cycles > h.admissionBudget;
+		}
+		printf("cycles per callback: mean %.0f, p99 %.0f, worst %.0f", mean(cycles), percentile(cycles, 0.99),
+				percentile(cycles, 1));
+		if(h.admissionBudget > 0){
+			printf(" of %.0f, %ld over", h.admissionBudget, over);
+		}
+		printf("\n");
+	}
+
+	CaptureReplay replay;
+	capture_replay(dump, replay);
+	print_replay(dump, replay);
+	bool exact = replay.blocks > 0 && replay.exact == replay.blocks;
+	if(!exact && replay.blocks > 0){
+		printf("  (a dump from another build of the engine, e.g. the SHARC's, differs by its rounding)\n");
+	}
+
+	if(outPath != 0){
+		//what the callback rendered, silence for the records that were lost
+		std::vector<float> audio;
+		for(size_t k=0; k<dump.blocks.size(); k++){
+			if(k > 0){
+				uint32_t missing = dump.blocks[k].sequence - dump.blocks[k - 1].sequence - 1;
+				audio.insert(audio.end(), (size_t)missing*h.blockSize, 0.0f);
+			}
+			audio.insert(audio.end(), dump.blocks[k].audio, dump.blocks[k].audio + h.blockSize);
+		}
+		if(!wav_write_float(outPath, audio.data(), (int)audio.size(), (int)h.sampleRate)){
+			fprintf(stderr, "could not write %s\n", outPath);
+			return 1;
+		}
+		printf("wrote %s\n", outPath);
+	}
+	return exact ? 0 : 1;
+}
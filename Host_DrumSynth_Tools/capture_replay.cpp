@@ -0,0 +1,226 @@
+/*
+ * capture_replay.cpp
+ *
+ * Reading and replaying capture dumps.  See capture_replay.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "drum_admission.h"
+#include "capture_replay.h"
+
+//bytes of a record before its audio
+#define CAPTURE_HEAD_BYTES	offsetof(DrumCaptureBlock, audio)
+
+bool capture_dump_load(const uint8_t *data, size_t size, CaptureDump &dump, std::string &error) {
+
+	char text[160];
+	DrumCaptureHeader &h = dump.header;
+	if(size < sizeof(DrumCaptureHeader)){
+		error = "too short for a capture dump";
+		return false;
+	}
+	memcpy((void *)&h, data, sizeof(DrumCaptureHeader));
+	if(h.magic != DRUM_CAPTURE_MAGIC){
+		error = "not a capture dump";
+		return false;
+	}
+	if(h.version != DRUM_CAPTURE_VERSION){
+		snprintf(text, sizeof(text), "capture dump version %u, this build reads %u", (unsigned)h.version,
+				DRUM_CAPTURE_VERSION);
+		error = text;
+		return false;
+	}
+	if(h.headerBytes != sizeof(DrumCaptureHeader) || h.eventBytes != sizeof(DrumCaptureEvent)
+			|| h.blockBytes < CAPTURE_HEAD_BYTES + 4*h.blockSize || (h.blockBytes - CAPTURE_HEAD_BYTES) % 4 != 0){
+		error = "laid out differently from this build's drum_capture.h";
+		return false;
+	}
+	if(h.blockSize == 0 || h.blockSize > DRUM_CAPTURE_BLOCK_SIZE){
+		snprintf(text, sizeof(text), "blocks of %u samples, build with -DDRUM_CAPTURE_BLOCK_SIZE=%u",
+				(unsigned)h.blockSize, (unsigned)h.blockSize);
+		error = text;
+		return false;
+	}
+	if(size < h.headerBytes + (size_t)h.maxBlocks*h.blockBytes + (size_t)h.maxEvents*h.eventBytes){
+		error = "capture dump cut short";
+		return false;
+	}
+
+	//the history, oldest first
+	uint32_t numBlocks = h.blocks < h.maxBlocks ? h.blocks : h.maxBlocks;
+	dump.blocks.assign(numBlocks, DrumCaptureBlock());
+	for(uint32_t k=0; k<numBlocks; k++){
+		uint32_t n = h.blocks - numBlocks + k;
+		memcpy(&dump.blocks[k], data + h.headerBytes + (size_t)(n % h.maxBlocks)*h.blockBytes,
+				CAPTURE_HEAD_BYTES + 4*h.blockSize);
+	}
+	const uint8_t *events = data + h.headerBytes + (size_t)h.maxBlocks*h.blockBytes;
+	uint32_t numEvents = h.events < h.maxEvents ? h.events : h.maxEvents;
+	dump.events.resize(numEvents);
+	for(uint32_t k=0; k<numEvents; k++){
+		uint32_t n = h.events - numEvents + k;
+		memcpy(&dump.events[k], events + (size_t)(n % h.maxEvents)*h.eventBytes, sizeof(DrumCaptureEvent));
+	}
+	return true;
+}
+
+bool capture_dump_read(const char *path, CaptureDump &dump, std::string &error) {
+
+	FILE *f = fopen(path, "rb");
+	if(f == 0){
+		error = std::string("could not open ") + path;
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[65536];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+		data.insert(data.end(), buffer, buffer + n);
+	}
+	fclose(f);
+	return capture_dump_load(data.data(), data.size(), dump, error);
+}
+
+//an engine set up like the one the dump was captured from
+static void replay_setup(const DrumCaptureHeader &h, DrumEngine &engine, DrumAdmission &admission) {
+
+	engine.setup(h.sampleRate);
+	engine.loopOrder = h.loopOrder;
+	engine.smoothControls = h.smoothControls != 0;
+	engine.oversampling = h.oversampling;
+	engine.numParts = h.numParts;
+	engine.part = h.part;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		engine.modal[d] = (h.modal >> d) & 1;
+	}
+	if(h.admissionBudget > 0){
+		admission.setup(h.admissionBudget, h.blockSize, h.sampleRate);
+		engine.admission = &admission;
+	}
+}
+
+static bool same_controls(const DrumCacheControls &a, const DrumCacheControls &b) {
+
+	return a.pot0 == b.pot0 && a.pot1 == b.pot1 && a.pot2 == b.pot2 && a.type == b.type && a.type2 == b.type2
+			&& a.type3 == b.type3;
+}
+
+void capture_replay(const CaptureDump &dump, CaptureReplay &replay) {
+
+	const DrumCaptureHeader &h = dump.header;
+	int n = h.blockSize;
+	long numRecords = (long)dump.blocks.size();
+
+	replay.segments = 0;
+	replay.blocks = 0;
+	replay.exact = 0;
+	replay.firstMismatch = -1;
+	replay.maxError = 0;
+	replay.first.clear();
+	replay.last.clear();
+	replay.stop.clear();
+
+	//once the event history has wrapped, only the blocks after its oldest event have all of theirs
+	bool eventsWrapped = h.events > dump.events.size();
+	uint32_t oldestEvent = dump.events.empty() ? 0 : dump.events[0].time;
+
+	DrumEngine *engine = new DrumEngine;
+	DrumAdmission admission;
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	DrumSampleCache *cache = 0;
+	DrumCacheControls cacheFor = { 0, 0, 0, 0, 0, 0 };
+	std::vector<float> out(n);
+
+	long b = 1;
+	while(b < numRecords){
+		//a start: no voice sounding, and the record before it for the controls the models stand at
+		const DrumCaptureBlock &start = dump.blocks[b];
+		const DrumCaptureBlock &before = dump.blocks[b - 1];
+		if(!(start.flags & DRUM_CAPTURE_IDLE) || start.sequence != before.sequence + 1
+				|| (eventsWrapped && (int32_t)(start.controls.window - oldestEvent) <= 0)){
+			b++;
+			continue;
+		}
+
+		replay_setup(h, *engine, admission);
+		queue->reset();
+		drum_core_block_controls(*engine, before.controls);
+		engine->render(out.data(), n);
+		engine->setNextVoiceSerial(start.nextSerial);
+
+		//the events played from the start on
+		size_t next = 0;
+		while(next < dump.events.size() && (int32_t)(dump.events[next].time - start.controls.window) < 0){
+			next++;
+		}
+
+		long first = b;
+		const char *stop = 0;
+		for(; b<numRecords; b++){
+			const DrumCaptureBlock &r = dump.blocks[b];
+			if(b > first && r.sequence != dump.blocks[b - 1].sequence + 1){
+				stop = "a record lost to a full ring";
+				break;
+			}
+			//an event of this block is lost by the next block's record at the latest
+			uint32_t lost = b + 1 < numRecords ? dump.blocks[b + 1].eventsLost : h.eventsLost;
+			if(lost != before.eventsLost){
+				stop = "events lost to a full ring";
+				break;
+			}
+
+			drum_core_block_controls(*engine, r.controls);
+			engine->cache = 0;
+			if(r.flags & DRUM_CAPTURE_CACHED){
+				if(cache == 0 || !same_controls(cacheFor, r.cache)){
+					if(cache == 0){
+						cache = new DrumSampleCache;
+					}
+					cache->setup(h.sampleRate);
+					cache->setControls(r.cache.pot0, r.cache.pot1, r.cache.pot2, r.cache.type, r.cache.type2,
+							r.cache.type3);
+					cache->renderAll();
+					cacheFor = r.cache;
+				}
+				engine->cache = cache;
+			}
+			uint32_t window = r.controls.window;
+			if(r.flags & DRUM_CAPTURE_PANIC){
+				DrumMidiEvent panic = { window, MIDI_CONTROL_CHANGE, MIDI_ALL_SOUND_OFF, 0 };
+				engine->applyEvent(panic);
+			}
+			while(next < dump.events.size() && (int32_t)(dump.events[next].time - (window + n)) < 0){
+				const DrumCaptureEvent &e = dump.events[next++];
+				DrumMidiEvent event = { e.time, (uint8_t)e.message, (uint8_t)(e.message >> 8),
+						(uint8_t)(e.message >> 16) };
+				queue->push(event);
+			}
+			engine->renderQueued(*queue, window, out.data(), n);
+
+			bool exact = memcmp(out.data(), r.audio, n*sizeof(float)) == 0;
+			for(int i=0; i<n; i++){
+				replay.maxError = fmax(replay.maxError, fabs(out[i] - r.audio[i]));
+			}
+			replay.blocks++;
+			replay.exact += exact;
+			if(!exact && replay.firstMismatch < 0){
+				replay.firstMismatch = b;
+			}
+		}
+		if(b == first){
+			//events lost right at the start: try the next one
+			b++;
+			continue;
+		}
+		replay.segments++;
+		replay.first.push_back(first);
+		replay.last.push_back(b);
+		replay.stop.push_back(stop);
+	}
+
+	delete engine;
+	delete queue;
+	delete cache;
+}
@@ -0,0 +1,56 @@
+/*
+ * capture_replay.h
+ *
+ * Capture dumps (drum_capture.h) on the host: read one as the firmware left it in memory, and
+ * replay it through the engine block by block against what the callback rendered.
+ *
+ * A replay starts at a record that began with no voice sounding and that follows another
+ * record: a fresh engine set up as the header says renders one silent block with the knobs and
+ * buttons of the record before, so its models stand where the callback's did, and takes the
+ * serial of the next voice from the record.  Then every block gets its record's knobs, buttons
+ * and admission costs, the one-shots its record mixed, its panic, and the events that arrived
+ * during the block before, and renders like renderQueued() did in the callback.  It stops at a
+ * lost record or lost events, and starts again at the next record it can.
+ */
+
+#ifndef CAPTURE_REPLAY_H_
+#define CAPTURE_REPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "drum_capture.h"
+
+struct CaptureDump {
+	DrumCaptureHeader header;
+
+	//the records and events still in the history, oldest first; a record's audio holds
+	//header.blockSize samples
+	std::vector<DrumCaptureBlock> blocks;
+	std::vector<DrumCaptureEvent> events;
+};
+
+//the dump from the memory the firmware wrote it to; false, with the reason in error, if it is not
+//a dump this build can read
+bool capture_dump_load(const uint8_t *data, size_t size, CaptureDump &dump, std::string &error);
+
+//the same from a file holding that memory
+bool capture_dump_read(const char *path, CaptureDump &dump, std::string &error);
+
+struct CaptureReplay {
+	int segments;			//runs of records replayed without a break
+	long blocks;			//records replayed
+	long exact;				//of them, bit for bit what the callback rendered
+	long firstMismatch;		//index of the first record that was not, -1 if none
+	double maxError;		//largest difference of a sample
+
+	//per segment: the first record and the record it stopped at (blocks.size() at the end), and
+	//why it stopped, NULL at the end of the dump
+	std::vector<long> first, last;
+	std::vector<const char *> stop;
+};
+
+void capture_replay(const CaptureDump &dump, CaptureReplay &replay);
+
+#endif /* CAPTURE_REPLAY_H_ */
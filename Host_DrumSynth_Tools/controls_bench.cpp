@@ -0,0 +1,196 @@
+/*
+ * controls_bench.cpp
+ *
+ * drum_render --controls: the control-rate knob and button handling of the DrumEngine.
+ *
+ * Each drum on a knob is held while its knob sweeps from 0 to 1, read once per block like
+ * processaudio_callback() reads the pots, and rendered three ways: stepping to each new value at
+ * the block start, ramping to it over the block (the engine's default), and the ideal of the
+ * same ramp worked out every sample (a block size of 1).  The distance of the stepped and ramped renders to the ideal is the zipper
+ * noise; the ramps have to take most of it away.  The ramped render is done again through
+ * renderQueued() with a hit in the middle of every block that splits the render, and has to come
+ * out the same bit for bit: the ramp runs over the block, not over each part of it.  Then the
+ * cost of the engine with the knobs still, where the control rate work is skipped, and with all
+ * of them moving every block.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_admission.h"
+#include "drum_midi_queue.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//least improvement of the ramped renders over the stepped ones, SNR against the ideal
+#define CONTROLS_MIN_GAIN_DB	10.0
+
+enum {
+	CONTROLS_STEPPED = 0,
+	CONTROLS_RAMPED,
+	CONTROLS_IDEAL,
+	CONTROLS_SPLIT
+};
+
+//the drum's knob, going from 0 to 1 over numBlocks blocks
+static float sweep_pot(long block, long numBlocks) {
+
+	return block > 0 ? (float)block/(numBlocks - 1) : 0;
+}
+
+static void set_knob(DrumEngine &engine, int knob, float pot) {
+
+	if(knob == DRUM_KNOB_POT0){
+		engine.pot0 = pot;
+	}
+	else if(knob == DRUM_KNOB_POT1){
+		engine.pot1 = pot;
+	}
+	else{
+		engine.pot2 = pot;
+	}
+}
+
+//one held hit of the drum while its knob sweeps; the ideal render is the ramp of the ramped one,
+//a sample at a time
+static void render_sweep(int drum, int mode, int sampleRate, int blockSize, long numBlocks, float *out) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.smoothControls = mode != CONTROLS_STEPPED;
+	engine.noteOn(drumPatches[drum].note);
+	int knob = drumPatches[drum].knob;
+
+	//split: a voice costs twice the budget, so every hit stops the render at its offset to make
+	//room, and is refused without touching the held voice
+	DrumAdmission admission;
+	DrumMidiQueue queue;
+	queue.reset();
+	if(mode == CONTROLS_SPLIT){
+		admission.setup(1000, blockSize, (float)sampleRate);
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			admission.voiceCost[d] = 2*admission.budget/blockSize;
+		}
+		engine.admission = &admission;
+	}
+
+	for(long b=0; b<numBlocks; b++){
+		float *block = &out[b*blockSize];
+		float pot = sweep_pot(b, numBlocks);
+		if(mode == CONTROLS_SPLIT){
+			set_knob(engine, knob, pot);
+			DrumMidiEvent hit = { (uint32_t)(b*blockSize + blockSize/2 + 1), MIDI_NOTE_ON | 9,
+					(uint8_t)drumPatches[drum].note, 100 };
+			queue.push(hit);
+			engine.renderQueued(queue, (uint32_t)(b*blockSize), block, blockSize);
+			continue;
+		}
+		if(mode != CONTROLS_IDEAL){
+			set_knob(engine, knob, pot);
+			engine.render(block, blockSize);
+			continue;
+		}
+
+		//the block's ramp, landing on the new value on its last sample
+		float from = sweep_pot(b - 1, numBlocks);
+		for(int i=0; i<blockSize; i++){
+			set_knob(engine, knob, from + (float)(i + 1)/blockSize*(pot - from));
+			engine.render(&block[i], 1);
+		}
+	}
+}
+
+static double snr_db(const float *ref, const float *x, long n) {
+
+	double signal = 0, noise = 0;
+	for(long i=0; i<n; i++){
+		double e = (double)x[i] - ref[i];
+		signal += (double)ref[i]*ref[i];
+		noise += e*e;
+	}
+	return 10*log10(signal/(noise + 1e-30));
+}
+
+//cycles/sample of one held voice of every drum, with the knobs still or all sweeping
+static double time_engine(bool sweep, bool smooth, double seconds, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.smoothControls = smooth;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		engine.noteOn(drumPatches[d].note);
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		if(sweep){
+			float pot = (float)(b % 1000)/1000;
+			engine.pot0 = pot;
+			engine.pot1 = 1 - pot;
+			engine.pot2 = pot;
+		}
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+int run_controls_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 1;
+	}
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	long n = numBlocks*blockSize;
+
+	printf("rate %d Hz, block %d, control period %d samples, %.1f s sweeps\n\n", sampleRate, blockSize,
+			DRUM_CONTROL_PERIOD, seconds);
+
+	printf("zipper noise: SNR against the ideal per-sample ramp (at least %.0f dB better ramped)\n",
+			CONTROLS_MIN_GAIN_DB);
+	printf("%-10s %-8s %14s %14s %10s\n", "drum", "pot", "stepped dB", "ramped dB", "gain");
+
+	bool ok = true;
+	std::vector<float> ideal(n), stepped(n), ramped(n), split(n);
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].knob == DRUM_KNOB_NONE){
+			continue;
+		}
+		render_sweep(d, CONTROLS_IDEAL, sampleRate, blockSize, numBlocks, ideal.data());
+		render_sweep(d, CONTROLS_STEPPED, sampleRate, blockSize, numBlocks, stepped.data());
+		render_sweep(d, CONTROLS_RAMPED, sampleRate, blockSize, numBlocks, ramped.data());
+
+		double s = snr_db(ideal.data(), stepped.data(), n);
+		double r = snr_db(ideal.data(), ramped.data(), n);
+		bool caseOk = r - s >= CONTROLS_MIN_GAIN_DB;
+		printf("%-10s %-8d %14.1f %14.1f %9.1f   %s\n", drumPatches[d].name, drumPatches[d].knob, s, r, r - s,
+				caseOk ? "ok" : "FAIL");
+		ok = ok && caseOk;
+
+		render_sweep(d, CONTROLS_SPLIT, sampleRate, blockSize, numBlocks, split.data());
+		long differ = 0;
+		for(long i=0; i<n; i++){
+			differ += split[i] != ramped[i];
+		}
+		printf("%-10s %-8s split by a hit mid-block: %ld samples differ   %s\n", "", "", differ,
+				differ == 0 ? "ok" : "FAILED");
+		ok = ok && differ == 0;
+	}
+
+	float checksum = 0;
+	printf("\ncycles/sample, one held voice of every drum:\n");
+	double still = time_engine(false, true, seconds, sampleRate, blockSize, checksum);
+	double sweepStepped = time_engine(true, false, seconds, sampleRate, blockSize, checksum);
+	double sweepRamped = time_engine(true, true, seconds, sampleRate, blockSize, checksum);
+	printf("  knobs still (control work skipped)   %10.1f\n", still);
+	printf("  knobs moving every block, stepped    %10.1f\n", sweepStepped);
+	printf("  knobs moving every block, ramped     %10.1f\n", sweepRamped);
+	printf("(checksum %g)\n", checksum);
+
+	printf("\n%s\n", ok ? "ramps take the zipper noise away" : "some ramps are not smoother than steps");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+/*
+ * drum_reference.cpp
+ *
+ * Closed-form double precision drums for the host checks.  See drum_reference.h.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include "drum_reference.h"
+#include "spectrum.h"
+#include "wav_file.h"
+
+double drum_reference_stack_level(const DrumStackOp &op, double drumR, double t) {
+
+	double r = op.r > 0 ? op.r : drumR;
+	if(t > r + 1e-9){
+		return 0;
+	}
+	switch(op.shape){
+		case DRUM_STACK_ATTACK_DECAY:
+			if(t <= op.time + 1e-9){
+				return op.level/op.time*t;
+			}
+			return op.level*exp(-(t - op.time)/op.tau);
+		case DRUM_STACK_LINE:
+			return op.level*(1 - t/op.time);
+		default:
+			return op.level*exp(-t/op.tau);
+	}
+}
+
+double drum_reference_stack(const DrumStackPatch &patch, double drumR, double freqShift, double t) {
+
+	double y[DRUM_STACK_MAX_OPS];
+	double mix = 0;
+	for(int k=0; k<patch.numOps; k++){
+		const DrumStackOp &op = patch.op[k];
+		double mod = op.src >= 0 ? y[op.src] : 0;
+		y[k] = drum_reference_stack_level(op, drumR, t)*sin(2*PI*op.freq*freqShift*t + mod);
+		mix += op.gain*y[k];
+	}
+	return mix;
+}
+
+double drum_reference_tone(int drum, double t, double freqShift, double I_0, double &noiseWeight) {
+
+	const DrumPatch &p = drumPatches[drum];
+
+	if(p.stack >= 0){
+		const DrumStackPatch &stack = drumStackPatches[p.stack];
+		noiseWeight = p.noiseGain*drum_reference_stack_level(stack.op[stack.noiseOp], p.r, t);
+		return p.synthGain*drum_reference_stack(stack, p.r, freqShift, t);
+	}
+
+	//A_t: attack ramp, decay, end of the drum
+	double A_t = 0;
+	if(t <= p.timePeak + 1e-9){
+		A_t = p.slope*t;
+	}
+	else if(t <= p.r + 1e-9){
+		A_t = p.A*exp(-(t - p.timePeak)/p.tau);
+	}
+
+	double I_t = 1;
+	if(p.indexKind == DRUM_LANE_INDEX_EXP){
+		I_t = exp(-t/p.indexTau);
+	}
+	else if(p.indexKind == DRUM_LANE_INDEX_GAMMA){
+		I_t = p.gammaC*pow(t + p.gammaT0, 2)*exp(-p.indexTau*(t + p.gammaT0));
+	}
+
+	double y = p.synthGain*A_t*sin(2*PI*p.fc*freqShift*t + I_0*I_t*sin(2*PI*p.fm*freqShift*t));
+
+	//percussive sub operator: A_t = I_t = -(1/r2)*t + 1 for its first subR seconds
+	if(p.hasSub && t <= p.subR + 1e-9){
+		double subA_t = 1 - t/p.subR;
+		y += p.subGain*subA_t*sin(2*PI*p.subFc*t + p.subIndex0*subA_t*sin(2*PI*p.subFm*t));
+	}
+
+	noiseWeight = p.noiseGain*A_t;
+	return y;
+}
+
+const char *drum_reference_recording(int drum) {
+
+	static const char *files[] = { "RD_K_5.wav", "RD_S_1.wav", "RD_T_MT_3.wav", "RD_T_HT_3.wav", "RD_C_HH_3.wav",
+			"RD_T_FT_4.wav", "RD_C_R_4.wav", 0 };
+	static_assert(sizeof(files)/sizeof(files[0]) == DRUM_NUM_TYPES, "one entry per DrumType");
+	return files[drum];
+}
+
+bool drum_reference_load_recording(const char *dir, int drum, std::vector<float> &samples, int &sampleRate) {
+
+	const char *file = drum_reference_recording(drum);
+	if(file == 0){
+		return false;
+	}
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	WavReader wav;
+	if(!wav.open(path)){
+		return false;
+	}
+	sampleRate = wav.sampleRate;
+	samples.resize(wav.numFrames);
+	samples.resize(wav.read(samples.data(), (int)wav.numFrames));
+	wav.close();
+	return true;
+}
+
+void drum_reference_stft_db(const float *x, long numSamples, std::vector<double> &db) {
+
+	spectrum_stft(x, numSamples, DRUM_REFERENCE_STFT_N, DRUM_REFERENCE_STFT_N*DRUM_REFERENCE_STFT_ZP, db);
+	double peak = 0;
+	for(size_t k=0; k<db.size(); k++){
+		if(db[k] > peak){
+			peak = db[k];
+		}
+	}
+	for(size_t k=0; k<db.size(); k++){
+		double d = 20*log10(db[k]/peak + 1e-30);
+		db[k] = d > -DRUM_REFERENCE_SCORE_FLOOR_DB ? d : -DRUM_REFERENCE_SCORE_FLOOR_DB;
+	}
+}
+
+double drum_reference_score(const std::vector<double> &recordingDb, const float *x, long numSamples) {
+
+	std::vector<double> db;
+	drum_reference_stft_db(x, numSamples, db);
+	size_t n = db.size() < recordingDb.size() ? db.size() : recordingDb.size();
+	double sum = 0;
+	for(size_t k=0; k<n; k++){
+		sum += fabs(db[k] - recordingDb[k]);
+	}
+	return n > 0 ? sum/n : 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * drum_reference.h
+ *
+ * The drums in closed form and double precision, the way the original processaudio_callback()
+ * and the DrumMachine_*.m scripts wrote them: exp() envelopes, libm sin() operators, no
+ * recurrences, tables or segments.  This is what the engine approximates, and what the host
+ * checks measure it against.
+ */
+
+#ifndef DRUM_REFERENCE_H_
+#define DRUM_REFERENCE_H_
+
+#include <vector>
+#include "drum_engine.h"
+
+//spectrogram(x, hamming(N), N/2, zp*N) of the DrumMachine_*.m scripts
+#define DRUM_REFERENCE_STFT_N			1024
+#define DRUM_REFERENCE_STFT_ZP			10
+
+//magnitudes further below the peak of their STFT count as this far down in a recording score
+#define DRUM_REFERENCE_SCORE_FLOOR_DB	80.0
+
+//level of a stack operator at t; drumR is the end of its drum
+double drum_reference_stack_level(const DrumStackOp &op, double drumR, double t);
+
+//operator mix of a stack at t: y_k = level_k(t)*sin(2*pi*f_k*freqShift*t + y_src)
+double drum_reference_stack(const DrumStackPatch &patch, double drumR, double freqShift, double t);
+
+//one sample of a drum at t without its noise term, and the weight of the noise; freqShift is
+//(1 + knob) and I_0 the index from the buttons, as in DrumEngine::updateBlockParameters()
+double drum_reference_tone(int drum, double t, double freqShift, double I_0, double &noiseWeight);
+
+//file name of the drum's recording in Matlab_DrumSound_Analysis, NULL if there is none
+const char *drum_reference_recording(int drum);
+
+//the drum's recording from dir, as mono samples at its own rate; false if it has none or it cannot
+//be read
+bool drum_reference_load_recording(const char *dir, int drum, std::vector<float> &samples, int &sampleRate);
+
+//STFT magnitudes of the scripts' spectrogram in dB below their peak, floored at
+//DRUM_REFERENCE_SCORE_FLOOR_DB
+void drum_reference_stft_db(const float *x, long numSamples, std::vector<double> &db);
+
+//mean |dB difference| between a render and a recording's drum_reference_stft_db() over the
+//frames both have: 0 for the same spectrogram
+double drum_reference_score(const std::vector<double> &recordingDb, const float *x, long numSamples);
+
+#endif /* DRUM_REFERENCE_H_ */
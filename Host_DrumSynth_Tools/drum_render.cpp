@@ -0,0 +1,482 @@
+/*
+ * drum_render.cpp
+ *
+ * Host-side offline renderer and benchmark for the FM drum engine.
+ *
+ * Renders a note sequence through the same DrumEngine that runs in processaudio_callback()
+ * and writes it to a WAV file, or (with --bench) times each drum and the full mix and
+ * reports ns/sample and cycles/sample against the SHARC budget of 9,375 cycles per sample.
+ *
+ * Usage:
+ *   drum_render [-o out.wav] [-p pattern] [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --bench [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --envelope [-r rate]
+ *   drum_render --fm [-r rate]
+ *   drum_render --stress [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --loops [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --cache [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --midiq [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --midiparse [-m bytes.raw]
+ *   drum_render --noise [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --dual [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --profile [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --admission [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --stack [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --fit [-d recordings] [-o table.h]
+ *   drum_render --fidelity [-d recordings] [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --controls [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --activity [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --play [-m file.mid|bytes.raw] [-o out.wav] [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --oversample [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --footprint [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --sweep [-t seconds]
+ *   drum_render --snapshot [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --modalfit [-d recordings] [-o table.h]
+ *   drum_render --modal [-d recordings] [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --capture [-m file.mid|bytes.raw] [-o dump.bin] [-t seconds] [-r rate] [-b blocksize]
+ *   drum_render --replay -m dump.bin [-o out.wav]
+ *
+ * A pattern is a comma separated list of note@start[:length] in seconds, e.g.
+ *   60@0:0.1,64@0.25:0.05,61@0.5:0.1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "drum_engine.h"
+#include "bench_timer.h"
+#include "wav_file.h"
+#include "libm_counter.h"
+#include "host_tools.h"
+
+struct NoteEvent {
+	int note;
+	double start;	//seconds
+	double length;	//seconds the key is held
+};
+
+//default pattern: one hit of every drum
+static const char *defaultPattern = "60@0:0.1,64@0.35:0.05,61@0.7:0.1,63@1.05:0.1,62@1.45:0.1,65@1.85:0.1,"
+		"66@2.3:0.05,67@2.8:0.05";
+
+static bool parse_pattern(const char *text, std::vector<NoteEvent> &events) {
+
+	const char *p = text;
+	while(*p){
+		NoteEvent ev;
+		ev.length = 0.05;
+
+		char *end;
+		ev.note = (int)strtol(p, &end, 10);
+		if(end == p || *end != '@'){
+			return false;
+		}
+		p = end + 1;
+
+		ev.start = strtod(p, &end);
+		if(end == p){
+			return false;
+		}
+		p = end;
+
+		if(*p == ':'){
+			ev.length = strtod(p + 1, &end);
+			p = end;
+		}
+
+		events.push_back(ev);
+
+		if(*p == ','){
+			p++;
+		}
+		else if(*p){
+			return false;
+		}
+	}
+	return true;
+}
+
+static int render_pattern(const char *pattern, const char *outPath, double seconds, int sampleRate, int blockSize) {
+
+	std::vector<NoteEvent> events;
+	if(!parse_pattern(pattern, events)){
+		fprintf(stderr, "bad pattern: %s\n", pattern);
+		return 1;
+	}
+
+	//turn note on/off times into sample positions, applied at block boundaries like the firmware
+	std::vector<long> onAt, offAt;
+	double lastEnd = 0;
+	for(size_t e=0; e<events.size(); e++){
+		onAt.push_back((long)(events[e].start*sampleRate));
+		offAt.push_back((long)((events[e].start + events[e].length)*sampleRate));
+		if(events[e].start + events[e].length > lastEnd){
+			lastEnd = events[e].start + events[e].length;
+		}
+	}
+	if(seconds <= 0){
+		seconds = lastEnd + 0.5;
+	}
+
+	long numSamples = (long)(seconds*sampleRate);
+	numSamples -= numSamples % blockSize;
+	std::vector<float> out(numSamples);
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		for(size_t e=0; e<events.size(); e++){
+			if(offAt[e] >= pos && offAt[e] < pos + blockSize){
+				engine.noteOff(events[e].note);
+			}
+			if(onAt[e] >= pos && onAt[e] < pos + blockSize){
+				engine.noteOn(events[e].note);
+			}
+		}
+		engine.render(&out[pos], blockSize);
+	}
+
+	if(!wav_write_float(outPath, out.data(), (int)numSamples, sampleRate)){
+		fprintf(stderr, "could not write %s\n", outPath);
+		return 1;
+	}
+	printf("wrote %ld samples (%.2f s) to %s\n", numSamples, (double)numSamples/sampleRate, outPath);
+	return 0;
+}
+
+struct BenchResult {
+	double nsPerSample;
+	double cyclesPerSample;
+	double libmPerSample[LIBM_NUM_FUNCTIONS];	//exp/pow/sin calls left in the per-sample path
+	float checksum;		//keeps the optimizer from dropping the render
+};
+
+//hold the given notes for the whole run so every sample is synthesized
+static BenchResult bench_notes(const int *notes, int numNotes, double seconds, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	for(int n=0; n<numNotes; n++){
+		engine.noteOn(notes[n]);
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+
+	BenchResult res;
+	res.checksum = 0;
+
+	libm_counter_reset();
+	double t0 = bench_seconds();
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		res.checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	double t1 = bench_seconds();
+
+	double numSamples = (double)numBlocks*blockSize;
+	res.nsPerSample = (t1 - t0)*1e9/numSamples;
+	res.cyclesPerSample = (double)(c1 - c0)/numSamples;
+	for(int f=0; f<LIBM_NUM_FUNCTIONS; f++){
+		res.libmPerSample[f] = libm_calls[f]/numSamples;
+	}
+	return res;
+}
+
+static void print_bench_row(const char *name, const BenchResult &r) {
+
+	printf("%-10s %10.1f %14.1f %12.2f%% %6.2f %6.2f %6.2f   (checksum %g)\n", name, r.nsPerSample,
+			r.cyclesPerSample, 100.0*r.cyclesPerSample/SHARC_CYCLES_PER_SAMPLE, r.libmPerSample[LIBM_EXP],
+			r.libmPerSample[LIBM_POW], r.libmPerSample[LIBM_SIN], r.checksum);
+}
+
+static int run_bench(double seconds, int sampleRate, int blockSize) {
+
+	const int *notes = drum_notes();
+
+	if(seconds <= 0){
+		seconds = 10;
+	}
+
+	printf("rate %d Hz, block %d, %.1f s per case, %s\n", sampleRate, blockSize, seconds,
+			BENCH_HAVE_RDTSC ? "cycles from rdtsc" : "cycles are clock_gettime ns");
+	printf("%-10s %10s %14s %13s %6s %6s %6s  (libm calls/sample)\n", "drum", "ns/sample", "cycles/sample",
+			"of budget", "exp", "pow", "sin");
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		print_bench_row(drumPatches[d].name, bench_notes(&notes[d], 1, seconds, sampleRate, blockSize));
+	}
+	print_bench_row("full mix", bench_notes(notes, DRUM_NUM_TYPES, seconds, sampleRate, blockSize));
+
+	printf("budget: %.0f SHARC cycles/sample (%.0f MHz). Host cycles are not SHARC cycles;\n"
+			"use the budget column to track relative cost between changes.\n",
+			SHARC_CYCLES_PER_SAMPLE, SHARC_CORE_CLOCK_HZ/1e6);
+	return 0;
+}
+
+static void usage(void) {
+
+	fprintf(stderr,
+			"usage: drum_render [-o out.wav] [-p pattern] [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --bench [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --envelope [-r rate]\n"
+			"       drum_render --fm [-r rate]\n"
+			"       drum_render --stress [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --loops [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --cache [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --midiq [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --midiparse [-m bytes.raw]\n"
+			"       drum_render --noise [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --dual [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --profile [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --admission [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --stack [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --fit [-d recordings] [-o table.h]\n"
+			"       drum_render --fidelity [-d recordings] [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --controls [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --activity [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --play [-m file.mid|bytes.raw] [-o out.wav] [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --oversample [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --footprint [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --sweep [-t seconds]\n"
+			"       drum_render --snapshot [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --modalfit [-d recordings] [-o table.h]\n"
+			"       drum_render --modal [-d recordings] [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --capture [-m file.mid|bytes.raw] [-o dump.bin] [-t seconds] [-r rate] [-b blocksize]\n"
+			"       drum_render --replay -m dump.bin [-o out.wav]\n");
+}
+
+int main(int argc, char **argv) {
+
+	const char *outPath = "drums.wav";
+	const char *pattern = defaultPattern;
+	const char *midiPath = 0;
+	const char *recordingDir = "../Matlab_DrumSound_Analysis";
+	bool outGiven = false;
+	double seconds = 0;
+	int sampleRate = 48000;
+	int blockSize = 32;
+	bool bench = false;
+	bool envelope = false;
+	bool fm = false;
+	bool stress = false;
+	bool loops = false;
+	bool cache = false;
+	bool midiq = false;
+	bool midiparse = false;
+	bool noise = false;
+	bool dual = false;
+	bool profile = false;
+	bool admission = false;
+	bool stack = false;
+	bool fit = false;
+	bool fidelity = false;
+	bool controls = false;
+	bool activity = false;
+	bool play = false;
+	bool oversample = false;
+	bool footprint = false;
+	bool sweep = false;
+	bool snapshot = false;
+	bool modalfit = false;
+	bool modal = false;
+	bool capture = false;
+	bool replay = false;
+
+	for(int a=1; a<argc; a++){
+		if(!strcmp(argv[a], "--bench")){
+			bench = true;
+		}
+		else if(!strcmp(argv[a], "--envelope")){
+			envelope = true;
+		}
+		else if(!strcmp(argv[a], "--fm")){
+			fm = true;
+		}
+		else if(!strcmp(argv[a], "--stress")){
+			stress = true;
+		}
+		else if(!strcmp(argv[a], "--loops")){
+			loops = true;
+		}
+		else if(!strcmp(argv[a], "--cache")){
+			cache = true;
+		}
+		else if(!strcmp(argv[a], "--midiq")){
+			midiq = true;
+		}
+		else if(!strcmp(argv[a], "--midiparse")){
+			midiparse = true;
+		}
+		else if(!strcmp(argv[a], "--noise")){
+			noise = true;
+		}
+		else if(!strcmp(argv[a], "--dual")){
+			dual = true;
+		}
+		else if(!strcmp(argv[a], "--profile")){
+			profile = true;
+		}
+		else if(!strcmp(argv[a], "--admission")){
+			admission = true;
+		}
+		else if(!strcmp(argv[a], "--stack")){
+			stack = true;
+		}
+		else if(!strcmp(argv[a], "--fit")){
+			fit = true;
+		}
+		else if(!strcmp(argv[a], "--fidelity")){
+			fidelity = true;
+		}
+		else if(!strcmp(argv[a], "--controls")){
+			controls = true;
+		}
+		else if(!strcmp(argv[a], "--activity")){
+			activity = true;
+		}
+		else if(!strcmp(argv[a], "--play")){
+			play = true;
+		}
+		else if(!strcmp(argv[a], "--oversample")){
+			oversample = true;
+		}
+		else if(!strcmp(argv[a], "--footprint")){
+			footprint = true;
+		}
+		else if(!strcmp(argv[a], "--sweep")){
+			sweep = true;
+		}
+		else if(!strcmp(argv[a], "--snapshot")){
+			snapshot = true;
+		}
+		else if(!strcmp(argv[a], "--modalfit")){
+			modalfit = true;
+		}
+		else if(!strcmp(argv[a], "--modal")){
+			modal = true;
+		}
+		else if(!strcmp(argv[a], "--capture")){
+			capture = true;
+		}
+		else if(!strcmp(argv[a], "--replay")){
+			replay = true;
+		}
+		else if(!strcmp(argv[a], "-o") && a + 1 < argc){
+			outPath = argv[++a];
+			outGiven = true;
+		}
+		else if(!strcmp(argv[a], "-d") && a + 1 < argc){
+			recordingDir = argv[++a];
+		}
+		else if(!strcmp(argv[a], "-m") && a + 1 < argc){
+			midiPath = argv[++a];
+		}
+		else if(!strcmp(argv[a], "-p") && a + 1 < argc){
+			pattern = argv[++a];
+		}
+		else if(!strcmp(argv[a], "-t") && a + 1 < argc){
+			seconds = atof(argv[++a]);
+		}
+		else if(!strcmp(argv[a], "-r") && a + 1 < argc){
+			sampleRate = atoi(argv[++a]);
+		}
+		else if(!strcmp(argv[a], "-b") && a + 1 < argc){
+			blockSize = atoi(argv[++a]);
+		}
+		else{
+			usage();
+			return 1;
+		}
+	}
+
+	if(sampleRate <= 0 || blockSize <= 0){
+		usage();
+		return 1;
+	}
+
+	if(envelope){
+		return run_envelope_check(sampleRate);
+	}
+	if(fm){
+		return run_fm_check(sampleRate);
+	}
+	if(stress){
+		return run_voice_stress(seconds, sampleRate, blockSize);
+	}
+	if(loops){
+		return run_loop_order_bench(seconds, sampleRate, blockSize);
+	}
+	if(cache){
+		return run_cache_bench(seconds, sampleRate, blockSize);
+	}
+	if(midiq){
+		return run_midi_queue_bench(seconds, sampleRate, blockSize);
+	}
+	if(midiparse){
+		return run_midi_parser_bench(midiPath);
+	}
+	if(noise){
+		return run_noise_bench(seconds, sampleRate, blockSize);
+	}
+	if(dual){
+		return run_dual_core_bench(seconds, sampleRate, blockSize);
+	}
+	if(profile){
+		return run_profile_bench(seconds, sampleRate, blockSize);
+	}
+	if(admission){
+		return run_admission_bench(seconds, sampleRate, blockSize);
+	}
+	if(stack){
+		return run_stack_bench(seconds, sampleRate, blockSize);
+	}
+	if(fit){
+		return run_envelope_fit(recordingDir, outGiven ? outPath : 0);
+	}
+	if(fidelity){
+		return run_fidelity_bench(seconds, sampleRate, blockSize, recordingDir);
+	}
+	if(controls){
+		return run_controls_bench(seconds, sampleRate, blockSize);
+	}
+	if(activity){
+		return run_activity_bench(seconds, sampleRate, blockSize);
+	}
+	if(play){
+		return run_play_bench(midiPath, outGiven ? outPath : 0, seconds, sampleRate, blockSize);
+	}
+	if(oversample){
+		return run_oversample_bench(seconds, sampleRate, blockSize);
+	}
+	if(footprint){
+		return run_footprint_bench(seconds, sampleRate, blockSize);
+	}
+	if(sweep){
+		return run_sweep_bench(seconds);
+	}
+	if(snapshot){
+		return run_snapshot_bench(seconds, sampleRate, blockSize);
+	}
+	if(modalfit){
+		return run_modal_fit(recordingDir, outGiven ? outPath : 0);
+	}
+	if(modal){
+		return run_modal_bench(seconds, sampleRate, blockSize, recordingDir);
+	}
+	if(capture){
+		return run_capture_bench(midiPath, outGiven ? outPath : 0, seconds, sampleRate, blockSize);
+	}
+	if(replay){
+		return run_capture_replay(midiPath, outGiven ? outPath : 0);
+	}
+	if(bench){
+		return run_bench(seconds, sampleRate, blockSize);
+	}
+	return render_pattern(pattern, outPath, seconds, sampleRate, blockSize);
+}
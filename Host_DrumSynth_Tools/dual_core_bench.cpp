@@ -0,0 +1,283 @@
+/*
+ * dual_core_bench.cpp
+ *
+ * drum_render --dual: the dual-core voice partition (drum_dual_core.h) modelled with two
+ * threads.
+ *
+ * The "core 1" thread takes the MIDI events, renders its share of the voices, hands each
+ * block's events and controls to the "core 2" thread through a DrumCoreLink and mixes core 2's
+ * stem of the previous block with its own, delayed by a block in a DrumStemDelay.  Core 2
+ * renders into one half of a double buffer while core 1 mixes the other.  The mix must match a
+ * single engine rendering the same events, and must come out bit for bit the same however the
+ * two threads are scheduled.  The cost of each core's share is timed to show the split.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "drum_engine.h"
+#include "drum_dual_core.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+static const int *drumNotes = drum_notes();
+
+static uint32_t rngState;
+
+static uint32_t rng_next(void) {
+
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static DrumMidiEvent make_event(uint32_t time, int status, int note, int velocity) {
+
+	DrumMidiEvent event;
+	event.time = time;
+	event.status = (uint8_t)status;
+	event.data1 = (uint8_t)note;
+	event.data2 = (uint8_t)velocity;
+	return event;
+}
+
+//a busy performance: hits on random samples, a few of them held for a while, in time order
+static std::vector<DrumMidiEvent> make_performance(long numSamples, int hitsPerSecond, int sampleRate) {
+
+	std::vector<DrumMidiEvent> events;
+	long numHits = numSamples*hitsPerSecond/sampleRate;
+	long step = numSamples/(numHits + 1);
+	for(long h=0; h<numHits; h++){
+		uint32_t time = (uint32_t)(h*step + rng_next() % step);
+		int note = drumNotes[rng_next() % DRUM_NUM_TYPES];
+		events.push_back(make_event(time, MIDI_NOTE_ON | 9, note, 100));
+		//most hits are released at once, some are held for up to half a second and loop
+		uint32_t hold = (rng_next() % 4 == 0) ? rng_next() % (sampleRate/2) : 0;
+		events.push_back(make_event(time + hold, MIDI_NOTE_OFF | 9, note, 0));
+	}
+	//insertion sort keeps equal times in order: a note on before its own note off
+	for(size_t i=1; i<events.size(); i++){
+		DrumMidiEvent e = events[i];
+		size_t j = i;
+		while(j > 0 && events[j - 1].time > e.time){
+			events[j] = events[j - 1];
+			j--;
+		}
+		events[j] = e;
+	}
+	return events;
+}
+
+//events arriving during block b, queued the way midi_rx_callback_sharc1() would
+static void queue_block_events(const std::vector<DrumMidiEvent> &events, size_t &next, uint32_t end,
+		DrumMidiQueue &queue) {
+
+	while(next < events.size() && events[next].time < end){
+		queue.push(events[next]);
+		next++;
+	}
+}
+
+//reference: one engine renders every voice
+static double render_single(const std::vector<DrumMidiEvent> &events, float *out, long numBlocks, int sampleRate,
+		int blockSize) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	queue->reset();
+
+	size_t next = 0;
+	uint64_t cycles = 0;
+	for(long b=0; b<numBlocks; b++){
+		uint32_t window = (uint32_t)(b*blockSize);
+		queue_block_events(events, next, window + blockSize, *queue);
+		uint64_t c0 = bench_cycles();
+		engine->renderQueued(*queue, window, &out[b*blockSize], blockSize);
+		cycles += bench_cycles() - c0;
+	}
+	delete queue;
+	delete engine;
+	return (double)cycles/(numBlocks*blockSize);
+}
+
+struct DualModel {
+	DrumEngine core1, core2;
+	DrumMidiQueue midi;
+	DrumCoreLink link;
+	DrumStemDelay delay;
+
+	//core 2's stems, double buffered: core 2 fills one while core 1 mixes the other
+	std::vector<float> stem2[2];
+
+	volatile long core2Done;	//blocks core 2 has rendered
+	volatile long mixed;		//blocks core 1 has mixed
+
+	uint64_t core1Cycles, core2Cycles;
+};
+
+//give the other thread a chance at random points, so every run interleaves differently
+static void maybe_yield(uint32_t &state, int perturb) {
+
+	if(perturb == 0){
+		return;
+	}
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	if(state % perturb == 0){
+		std::this_thread::yield();
+	}
+}
+
+static void core2_thread(DualModel *m, long numBlocks, int blockSize, int perturb) {
+
+	uint32_t state = 0x2545f491u + perturb;
+	DrumCoreBlock block;
+	for(long b=0; b<numBlocks; b++){
+		//wait for core 1's block, and for core 1 to have mixed what was last in this half of the buffer
+		while(!m->link.peekBlock(block) || m->mixed < b - 1){
+			std::this_thread::yield();
+		}
+		DRUM_ACQUIRE_BARRIER();
+		maybe_yield(state, perturb);
+
+		uint64_t c0 = bench_cycles();
+		drum_core2_render(m->core2, m->link, m->stem2[b % 2].data(), blockSize);
+		m->core2Cycles += bench_cycles() - c0;
+
+		DRUM_RELEASE_BARRIER();
+		m->core2Done = b + 1;
+	}
+}
+
+//returns the core 1 and core 2 cycles per sample in core1Cost/core2Cost
+static void render_dual(const std::vector<DrumMidiEvent> &events, float *out, long numBlocks, int sampleRate,
+		int blockSize, int perturb, double &core1Cost, double &core2Cost) {
+
+	DualModel *m = new DualModel;
+	m->core1.setup((float)sampleRate);
+	m->core1.numParts = 2;
+	m->core1.part = 0;
+	m->core2.setup((float)sampleRate);
+	m->core2.numParts = 2;
+	m->core2.part = 1;
+	m->midi.reset();
+	m->link.reset();
+	m->delay.setup(blockSize);
+	m->stem2[0].assign(blockSize, 0);
+	m->stem2[1].assign(blockSize, 0);
+	m->core2Done = 0;
+	m->mixed = 0;
+	m->core1Cycles = 0;
+	m->core2Cycles = 0;
+
+	std::thread core2(core2_thread, m, numBlocks, blockSize, perturb);
+
+	uint32_t state = 0x9e3779b9u + perturb;
+	std::vector<float> stem1(blockSize);
+	size_t next = 0;
+	for(long b=0; b<=numBlocks; b++){
+		if(b < numBlocks){
+			uint32_t window = (uint32_t)(b*blockSize);
+			queue_block_events(events, next, window + blockSize, m->midi);
+
+			uint64_t c0 = bench_cycles();
+			m->core1.renderQueued(m->midi, window, stem1.data(), blockSize, &m->link.events);
+			DrumCoreBlock block = drum_core_block_make(m->core1, window);
+			while(!m->link.pushBlock(block)){
+				std::this_thread::yield();
+			}
+			m->delay.process(stem1.data(), stem1.data(), blockSize);
+			m->core1Cycles += bench_cycles() - c0;
+		}
+		else{
+			//past the end: flush the last block out of the delay
+			std::fill(stem1.begin(), stem1.end(), 0.0f);
+			m->delay.process(stem1.data(), stem1.data(), blockSize);
+		}
+		maybe_yield(state, perturb);
+
+		//output routing: core 2's stem of the previous block plus core 1's, which the delay held back
+		if(b >= 1){
+			while(m->core2Done < b){
+				std::this_thread::yield();
+			}
+			DRUM_ACQUIRE_BARRIER();
+			const float *s2 = m->stem2[(b - 1) % 2].data();
+			float *o = &out[(b - 1)*blockSize];
+			for(int i=0; i<blockSize; i++){
+				o[i] = s2[i] + stem1[i];
+			}
+			DRUM_RELEASE_BARRIER();
+			m->mixed = b;
+		}
+	}
+	core2.join();
+
+	core1Cost = (double)m->core1Cycles/(numBlocks*blockSize);
+	core2Cost = (double)m->core2Cycles/(numBlocks*blockSize);
+	delete m;
+}
+
+int run_dual_core_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 4;
+	}
+	if(blockSize > DRUM_STEM_DELAY_SIZE - 1){
+		printf("block size %d is longer than the stem delay line (%d)\n", blockSize, DRUM_STEM_DELAY_SIZE);
+		return 1;
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	long numSamples = numBlocks*blockSize;
+	std::vector<float> single(numSamples), dual(numSamples), again(numSamples);
+
+	printf("rate %d Hz, block %d, %.1f s per run, %u hardware threads on this host\n\n", sampleRate, blockSize,
+			seconds, std::thread::hardware_concurrency());
+
+	int failures = 0;
+	printf("%10s %14s %12s %12s %12s %12s %10s  %s\n", "hits/s", "max |dual-1|", "1 core", "core 1", "core 2",
+			"busiest", "split", "repeatable");
+	static const int rates[] = { 10, 40, 160 };
+	for(int r=0; r<3; r++){
+		rngState = 0x1234567u + r;
+		std::vector<DrumMidiEvent> events = make_performance(numSamples, rates[r], sampleRate);
+
+		double singleCost = render_single(events, single.data(), numBlocks, sampleRate, blockSize);
+		double core1Cost, core2Cost;
+		render_dual(events, dual.data(), numBlocks, sampleRate, blockSize, 0, core1Cost, core2Cost);
+
+		double maxErr = 0;
+		for(long i=0; i<numSamples; i++){
+			maxErr = fmax(maxErr, fabs(dual[i] - single[i]));
+		}
+
+		//the same performance under different thread interleavings must give the same bits
+		bool repeatable = true;
+		for(int perturb=2; perturb<=8; perturb*=2){
+			double c1, c2;
+			render_dual(events, again.data(), numBlocks, sampleRate, blockSize, perturb, c1, c2);
+			repeatable = repeatable && memcmp(dual.data(), again.data(), numSamples*sizeof(float)) == 0;
+		}
+
+		double busiest = fmax(core1Cost, core2Cost);
+		bool ok = maxErr < 1e-4 && repeatable;
+		failures += !ok;
+		printf("%10d %14g %12.1f %12.1f %12.1f %12.1f %9.2fx  %s%s\n", rates[r], maxErr, singleCost, core1Cost,
+				core2Cost, busiest, singleCost/busiest, repeatable ? "yes" : "NO", ok ? "" : "   FAILED");
+	}
+
+	printf("\ncosts are host cycles per sample inside the render calls; split is 1 core / busiest core,\n"
+			"the speedup two cores get when each has a core of its own.\n");
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * envelope_bench.cpp
+ *
+ * drum_render --envelope: checks every envelope generator in drum_envelope.h against the
+ * closed-form expression it replaces, and times both.  Fails if any is further from its closed
+ * form than the bound drum_envelope.h states.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "drum_envelope.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//largest error the recurrences may have, relative to the peak of the envelope
+#define ENV_CHECK_MAX_REL	3e-4
+
+//closed forms from the original per-sample code, evaluated in double precision
+struct ClosedForm {
+	int kind;
+	double slope, timePeak, A, tau, r;	//attack/decay
+	double C, t0, k;					//gamma
+};
+
+enum { CF_ATTACK_DECAY, CF_EXP_DECAY, CF_RAMP_DOWN, CF_GAMMA };
+
+static double closed_form(const ClosedForm &cf, double t) {
+
+	switch(cf.kind){
+		case CF_ATTACK_DECAY:
+			if(t <= cf.timePeak + 1e-9){
+				return cf.slope*t;
+			}
+			if(t <= cf.r + 1e-9){
+				return cf.A*exp(-(t - cf.timePeak)/cf.tau);
+			}
+			return 0;
+		case CF_EXP_DECAY:
+			return exp(-t/cf.tau);
+		case CF_RAMP_DOWN:
+			return (t <= cf.r + 1e-9) ? -(1/cf.r)*t + 1 : 0;
+		default:
+			return cf.C*pow(t + cf.t0, 2)*exp(-cf.k*(t + cf.t0));
+	}
+}
+
+struct EnvCase {
+	const char *name;
+	ClosedForm cf;
+	int length;		//samples the drum actually plays
+};
+
+//true if the recurrence stays within ENV_CHECK_MAX_REL of the closed form
+template <class Gen>
+static bool check_case(const EnvCase &c, Gen &gen, int sampleRate) {
+
+	const int reps = 50;
+
+	double maxAbs = 0, peak = 0;
+	gen.start();
+	for(int n=0; n<c.length; n++){
+		double ref = closed_form(c.cf, n/(double)sampleRate);
+		double err = fabs(gen.next() - ref);
+		if(err > maxAbs){
+			maxAbs = err;
+		}
+		if(fabs(ref) > peak){
+			peak = fabs(ref);
+		}
+	}
+
+	//cost of the closed form, in float like the firmware, against the recurrence
+	volatile float sink = 0;
+	float acc = 0;
+	double t0 = bench_seconds();
+	for(int rep=0; rep<reps; rep++){
+		for(int n=0; n<c.length; n++){
+			acc += (float)closed_form(c.cf, (float)n/(float)sampleRate);
+		}
+	}
+	double t1 = bench_seconds();
+	for(int rep=0; rep<reps; rep++){
+		gen.start();
+		for(int n=0; n<c.length; n++){
+			acc += gen.next();
+		}
+	}
+	double t2 = bench_seconds();
+	sink = acc;
+	(void)sink;
+
+	double samples = (double)reps*c.length;
+	bool ok = maxAbs <= ENV_CHECK_MAX_REL*peak;
+	printf("%-14s %7d %12.3g %12.3g %11.2f %11.2f   %s\n", c.name, c.length, maxAbs, maxAbs/peak,
+			(t1 - t0)*1e9/samples, (t2 - t1)*1e9/samples, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int run_envelope_check(int sampleRate) {
+
+	//the envelopes set up by DrumEngine::setup(), with the lengths the drums play them for
+	EnvCase amp[] = {
+		{ "kick A_t",    { CF_ATTACK_DECAY, 199.826, 0.005,   0.999, 0.065, 0.3  }, 14401 },
+		{ "snare A_t",   { CF_ATTACK_DECAY, 657.237, 0.00152, 0.999, 0.04,  0.25 }, 12001 },
+		{ "midtom A_t",  { CF_ATTACK_DECAY, 155.607, 0.00642, 0.999, 0.1,   0.4  }, 19201 },
+		{ "hightom A_t", { CF_ATTACK_DECAY, 69.375,  0.0144,  0.999, 0.1,   0.4  }, 19201 },
+		{ "hihat A_t",   { CF_ATTACK_DECAY, 819.672, 0.00122, 1,     0.045, 0.3  }, 14401 },
+	};
+	EnvCase expDecay[] = {
+		{ "snare I_t",   { CF_EXP_DECAY, 0, 0, 0, 0.03 }, 12001 },
+		{ "hihat I_t",   { CF_EXP_DECAY, 0, 0, 0, 0.2  }, 14401 },
+	};
+	EnvCase ramp = { "sub A_t", { CF_RAMP_DOWN, 0, 0, 0, 0, 0.03 }, 1441 };
+	EnvCase gamma[] = {
+		{ "midtom I_t",  { CF_GAMMA, 0, 0, 0, 0, 0, 18500, 0.01, 70  }, 19201 },
+		{ "hightom I_t", { CF_GAMMA, 0, 0, 0, 0, 0, 18500, 0.01, 100 }, 19201 },
+	};
+
+	int failures = 0;
+	printf("envelope recurrences vs closed forms at %d Hz, within %g of the peak\n", sampleRate,
+			ENV_CHECK_MAX_REL);
+	printf("%-14s %7s %12s %12s %11s %11s\n", "envelope", "samples", "max abs err", "rel to peak",
+			"closed ns", "recur ns");
+
+	for(unsigned e=0; e<sizeof(amp)/sizeof(amp[0]); e++){
+		Envelope env;
+		const ClosedForm &cf = amp[e].cf;
+		env.setupAttackDecay(sampleRate, cf.slope, cf.timePeak, cf.A, cf.tau, cf.r);
+		failures += !check_case(amp[e], env, sampleRate);
+	}
+	for(unsigned e=0; e<sizeof(expDecay)/sizeof(expDecay[0]); e++){
+		Envelope env;
+		env.setupExpDecay(sampleRate, expDecay[e].cf.tau);
+		failures += !check_case(expDecay[e], env, sampleRate);
+	}
+	{
+		Envelope env;
+		env.setupRampDown(sampleRate, 1, ramp.cf.r);
+		failures += !check_case(ramp, env, sampleRate);
+	}
+	for(unsigned e=0; e<sizeof(gamma)/sizeof(gamma[0]); e++){
+		GammaEnvelope env;
+		env.setup(sampleRate, gamma[e].cf.C, gamma[e].cf.t0, gamma[e].cf.k);
+		failures += !check_case(gamma[e], env, sampleRate);
+	}
+
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
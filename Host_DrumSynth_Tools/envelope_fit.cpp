@@ -0,0 +1,319 @@
+/*
+ * envelope_fit.cpp
+ *
+ * drum_render --fit: the envelope fitting of the DrumMachine_*.m scripts as a batch job.
+ *
+ * Every reference recording in Matlab_DrumSound_Analysis is streamed a block at a time, on a
+ * thread of its own.  Its peaks are found like findpeaks(x, time, 'MinPeakDistance', 0.025):
+ * all local maxima, then from the highest down each one removes its neighbours closer than
+ * 25 ms.  The scripts put TimePeak on the first of those peaks; the decay
+ * A*exp(-(t-TimePeak)/tau) is fitted through it by least squares on the log of the later peaks
+ * down to DRUM_FIT_FLOOR_DB below it, and the drum is taken to end where the fitted decay
+ * reaches the same floor.
+ *
+ * The result is printed next to the current patches, and the whole drumPatches[] table of
+ * drum_patches.h is emitted with the fitted slope, timePeak, tau and r (to stdout, or to the
+ * file given with -o) so it can replace the one in the firmware as it is.  A stays the patch's:
+ * it is a mix level, the recordings are normalized.  Drums without a recording keep their
+ * patch.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "drum_engine.h"
+#include "wav_file.h"
+#include "bench_timer.h"
+#include "drum_reference.h"
+#include "host_tools.h"
+
+//findpeaks 'MinPeakDistance' of the scripts
+#define DRUM_FIT_PEAK_DISTANCE	0.025
+
+//peaks further below the first one are left out of the decay fit: the recordings' noise floor
+//and the ring of the drum body are not part of A_t
+#define DRUM_FIT_FLOOR_DB		40.0
+
+#define DRUM_FIT_BLOCK			4096
+
+struct FitResult {
+	bool ok;
+	int sampleRate;
+	double seconds;		//length of the recording
+	int numPeaks;
+	int numFitted;		//peaks the decay was fitted to
+	double timePeak;
+	double peak;
+	double tau;
+	double r;
+	double rmsDb;		//RMS error of the fit at the fitted peaks
+};
+
+struct PeakCandidate {
+	long pos;
+	float value;
+};
+
+static bool higher(const PeakCandidate &a, const PeakCandidate &b) {
+
+	return a.value > b.value || (a.value == b.value && a.pos < b.pos);
+}
+
+static void fit_file(const char *path, FitResult *result) {
+
+	FitResult &res = *result;
+	res.ok = false;
+
+	WavReader wav;
+	if(!wav.open(path)){
+		return;
+	}
+	res.sampleRate = wav.sampleRate;
+	res.seconds = (double)wav.numFrames/wav.sampleRate;
+
+	//local maxima, streamed: x[pos-1] is a maximum if it rises from x[pos-2] and does not fall
+	//short of x[pos]
+	std::vector<PeakCandidate> maxima;
+	std::vector<float> block(DRUM_FIT_BLOCK);
+	float x1 = 0, x2 = 0;
+	long pos = 0;
+	int n;
+	while((n = wav.read(block.data(), DRUM_FIT_BLOCK)) > 0){
+		for(int i=0; i<n; i++, pos++){
+			float x = block[i];
+			if(pos >= 2 && x1 > x2 && x1 >= x){
+				PeakCandidate c = { pos - 1, x1 };
+				maxima.push_back(c);
+			}
+			x2 = x1;
+			x1 = x;
+		}
+	}
+	wav.close();
+
+	//MinPeakDistance: from the highest down, each kept peak removes its close neighbours
+	long distance = (long)(DRUM_FIT_PEAK_DISTANCE*res.sampleRate);
+	std::vector<int> order(maxima.size());
+	for(size_t k=0; k<maxima.size(); k++){
+		order[k] = (int)k;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return higher(maxima[a], maxima[b]); });
+	std::vector<bool> removed(maxima.size(), false);
+	for(size_t o=0; o<order.size(); o++){
+		int k = order[o];
+		if(removed[k]){
+			continue;
+		}
+		for(int j=k-1; j>=0 && maxima[k].pos - maxima[j].pos <= distance; j--){
+			removed[j] = true;
+		}
+		for(int j=k+1; j<(int)maxima.size() && maxima[j].pos - maxima[k].pos <= distance; j++){
+			removed[j] = true;
+		}
+	}
+	std::vector<PeakCandidate> peaks;
+	for(size_t k=0; k<maxima.size(); k++){
+		if(!removed[k]){
+			peaks.push_back(maxima[k]);
+		}
+	}
+	res.numPeaks = (int)peaks.size();
+	if(peaks.size() < 2 || peaks[0].value <= 0){
+		return;
+	}
+
+	//decay through the first peak: minimize sum (log(p/peak) + (t - timePeak)/tau)^2
+	res.timePeak = (double)peaks[0].pos/res.sampleRate;
+	res.peak = peaks[0].value;
+	double floorLevel = res.peak*pow(10, -DRUM_FIT_FLOOR_DB/20);
+	double sumTY = 0, sumTT = 0;
+	res.numFitted = 0;
+	for(size_t k=1; k<peaks.size(); k++){
+		if(peaks[k].value > floorLevel){
+			double t = (double)peaks[k].pos/res.sampleRate - res.timePeak;
+			double y = log(peaks[k].value/res.peak);
+			sumTY += t*y;
+			sumTT += t*t;
+			res.numFitted++;
+		}
+	}
+	if(res.numFitted == 0 || sumTY >= 0){
+		return;
+	}
+	res.tau = -sumTT/sumTY;
+	res.r = res.timePeak + res.tau*log(res.peak/floorLevel);
+	if(res.r > res.seconds){
+		res.r = res.seconds;
+	}
+
+	double err = 0;
+	for(size_t k=1; k<peaks.size(); k++){
+		if(peaks[k].value > floorLevel){
+			double t = (double)peaks[k].pos/res.sampleRate - res.timePeak;
+			double e = 20*log10(peaks[k].value/res.peak) + 20*t/res.tau/log(10);
+			err += e*e;
+		}
+	}
+	res.rmsDb = sqrt(err/res.numFitted);
+	res.ok = true;
+}
+
+//a float as a C++ literal, without a suffix when it is a whole number like the table writes them
+static const char *literal(char *buf, float v) {
+
+	sprintf(buf, "%.6g", v);
+	if(strpbrk(buf, ".e") != NULL){
+		strcat(buf, "f");
+	}
+	return buf;
+}
+
+static const char *note_name(int drum) {
+
+	static const char *names[] = { "DRUM_NOTE_KICK", "DRUM_NOTE_SNARE", "DRUM_NOTE_MIDTOM", "DRUM_NOTE_HIGHTOM",
+			"DRUM_NOTE_HIHAT", "DRUM_NOTE_FLOORTOM", "DRUM_NOTE_RIDE", "DRUM_NOTE_CRASH" };
+	static_assert(sizeof(names)/sizeof(names[0]) == DRUM_NUM_TYPES, "one note name per DrumType");
+	return names[drum];
+}
+
+static const char *index_kind_name(int kind) {
+
+	static const char *names[] = { "DRUM_LANE_INDEX_CONST", "DRUM_LANE_INDEX_EXP", "DRUM_LANE_INDEX_GAMMA" };
+	return names[kind];
+}
+
+static const char *knob_name(int knob) {
+
+	static const char *names[] = { "DRUM_KNOB_NONE", "DRUM_KNOB_POT0", "DRUM_KNOB_POT1", "DRUM_KNOB_POT2" };
+	return names[knob + 1];
+}
+
+static const char *button_name(int button) {
+
+	static const char *names[] = { "DRUM_BUTTON_NONE", "DRUM_BUTTON_TYPE", "DRUM_BUTTON_TYPE2", "DRUM_BUTTON_TYPE3" };
+	return names[button + 1];
+}
+
+//the snare and hihat keep their compile-time colour overrides
+static const char *noise_name(int drum, int color) {
+
+	static const char *names[] = { "DRUM_NOISE_WHITE", "DRUM_NOISE_DARK", "DRUM_NOISE_BRIGHT" };
+	if(drum == DRUM_SNARE){
+		return "DRUM_SNARE_NOISE_COLOR";
+	}
+	if(drum == DRUM_HIHAT){
+		return "DRUM_HIHAT_NOISE_COLOR";
+	}
+	return names[color];
+}
+
+static const char *stack_name(int stack) {
+
+	static const char *names[] = { "-1", "DRUM_STACK_FLOORTOM", "DRUM_STACK_RIDE", "DRUM_STACK_CRASH" };
+	return names[stack + 1];
+}
+
+static const char *modal_name(int modal) {
+
+	static const char *names[] = { "-1", "DRUM_MODAL_MIDTOM", "DRUM_MODAL_HIGHTOM", "DRUM_MODAL_FLOORTOM" };
+	return names[modal + 1];
+}
+
+static void write_patch(FILE *f, const DrumPatch &p, int drum, const char *comment) {
+
+	char a[32], b[32], c[32], d[32], e[32];
+
+	fprintf(f, "\t//%s\n", comment);
+	fprintf(f, "\t{ %s, \"%s\",\n", note_name(drum), p.name);
+	fprintf(f, "\t\t%s, %s, %s, %s, %s,\n", literal(a, p.slope), literal(b, p.timePeak), literal(c, p.A),
+			literal(d, p.tau), literal(e, p.r));
+	fprintf(f, "\t\t%s, %s, %s, %s,\n", index_kind_name(p.indexKind), literal(a, p.indexTau), literal(b, p.gammaC),
+			literal(c, p.gammaT0));
+	fprintf(f, "\t\t%s, %s, %s,\n", literal(a, p.fc), literal(b, p.fm), knob_name(p.knob));
+	fprintf(f, "\t\t%s, %s, %s,\n", literal(a, p.index0), literal(b, p.indexStep), button_name(p.button));
+	fprintf(f, "\t\t%s, %s, %s, %s, %s,\n", p.hasSub ? "true" : "false", literal(a, p.subFc), literal(b, p.subFm),
+			literal(c, p.subIndex0), literal(d, p.subR));
+	fprintf(f, "\t\t%s, %s,\n", p.hasNoise ? "true" : "false", noise_name(drum, p.noiseColor));
+	fprintf(f, "\t\t%s, %s, %s,\n", literal(a, p.synthGain), literal(b, p.subGain), literal(c, p.noiseGain));
+	fprintf(f, "\t\t%s, %s }%s\n", stack_name(p.stack), modal_name(p.modal), drum == DRUM_NUM_TYPES - 1 ? "" : ",\n");
+}
+
+int run_envelope_fit(const char *dir, const char *outPath) {
+
+	FitResult results[DRUM_NUM_TYPES];
+	char paths[DRUM_NUM_TYPES][1024];
+
+	//one thread per recording
+	double t0 = bench_seconds();
+	std::vector<std::thread> threads;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drum_reference_recording(d) != 0){
+			snprintf(paths[d], sizeof(paths[d]), "%s/%s", dir, drum_reference_recording(d));
+			threads.push_back(std::thread(fit_file, paths[d], &results[d]));
+		}
+	}
+	for(size_t t=0; t<threads.size(); t++){
+		threads[t].join();
+	}
+	double t1 = bench_seconds();
+
+	printf("%-10s %-14s %7s %6s %6s %21s %21s %21s %8s\n", "drum", "recording", "seconds", "peaks", "fitted",
+			"timePeak fit/patch", "tau fit/patch", "r fit/patch", "rms dB");
+	DrumPatch patches[DRUM_NUM_TYPES];
+	char comments[DRUM_NUM_TYPES][160];
+	int failed = 0;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		patches[d] = drumPatches[d];
+		snprintf(comments[d], sizeof(comments[d]), "%s: no recording, patch kept", drumPatches[d].name);
+	}
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const char *file = drum_reference_recording(d);
+		if(file == 0){
+			continue;
+		}
+		const FitResult &res = results[d];
+		const DrumPatch &patch = drumPatches[d];
+		if(!res.ok){
+			printf("%-10s %-14s could not be fitted\n", patch.name, file);
+			snprintf(comments[d], sizeof(comments[d]), "%s: %s could not be fitted, patch kept", patch.name, file);
+			failed++;
+			continue;
+		}
+		printf("%-10s %-14s %7.2f %6d %6d %10.5f/%-10.5f %10.4f/%-10.4f %10.3f/%-10.3f %8.2f\n", patch.name,
+				file, res.seconds, res.numPeaks, res.numFitted, res.timePeak, patch.timePeak,
+				res.tau, patch.tau, res.r, patch.r, res.rmsDb);
+
+		DrumPatch &p = patches[d];
+		p.timePeak = (float)res.timePeak;
+		p.slope = (float)(p.A/res.timePeak);
+		p.tau = (float)res.tau;
+		p.r = (float)res.r;
+		snprintf(comments[d], sizeof(comments[d]), "%s: fitted from %s, %d peaks, %.2f dB RMS", patch.name,
+				file, res.numFitted, res.rmsDb);
+	}
+	printf("%d recordings on as many threads in %.3f s\n\n", (int)threads.size(), t1 - t0);
+
+	FILE *f = stdout;
+	if(outPath != 0){
+		f = fopen(outPath, "w");
+		if(f == NULL){
+			fprintf(stderr, "could not write %s\n", outPath);
+			return 1;
+		}
+	}
+	fprintf(f, "//drumPatches[] with the envelopes fitted by drum_render --fit; replaces the table in\n"
+			"//drum_patches.h\n");
+	fprintf(f, "static constexpr DrumPatch drumPatches[] = {\n");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		write_patch(f, patches[d], d, comments[d]);
+	}
+	fprintf(f, "};\n");
+	if(f != stdout){
+		fclose(f);
+		printf("wrote the patch table to %s\n", outPath);
+	}
+	return failed == 0 ? 0 : 1;
+}
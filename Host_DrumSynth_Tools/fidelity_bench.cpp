@@ -0,0 +1,240 @@
+/*
+ * fidelity_bench.cpp
+ *
+ * drum_render --fidelity: accuracy against speed of the engine's fast paths.
+ *
+ * Each drum is rendered once with the reference math of drum_reference.h (exp() envelopes and
+ * libm sin() in double precision, as the original callback computed them) and once through
+ * every render path of the engine, one hit with the same noise sequence, and the two are
+ * compared by maximum error, SNR and the distance between their STFT magnitudes.  The STFT is
+ * the one of the Matlab comparisons, spectrogram(x, hamming(1024), 512, 10*1024).  Reference
+ * and engine are also scored against the drum's RD_*.wav recording, at the recording's rate,
+ * by the mean difference of their normalized STFT magnitudes in dB.
+ *
+ * The reference math aliases the way the original callback did, so the paths are compared with
+ * oversampling off (drum_render --oversample measures what it takes away); the cached one-shots
+ * oversample only the drums that need it at the rate, none of them at 48 kHz.
+ *
+ * A path fails when its SNR or STFT distance passes the limits in fidelityPaths[], or when it
+ * scores against the recording worse than the reference by more than its limit, so a speedup
+ * that audibly changes a drum shows up as a failing exit code.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_sample_cache.h"
+#include "drum_reference.h"
+#include "spectrum.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+enum {
+	PATH_SAMPLE_OUTER = 0,
+	PATH_VOICE_OUTER,
+	PATH_CACHED,
+	PATH_REDUCED_TAIL,
+	NUM_PATHS
+};
+
+struct FidelityPath {
+	const char *name;
+	double minSnrDb;		//against the reference
+	double maxStftDb;		//STFT magnitude distance to the reference, dB of its energy
+	double maxScoreLossDb;	//how much worse than the reference it may score against the recording
+};
+
+static const FidelityPath fidelityPaths[NUM_PATHS] = {
+	{ "sample-outer",	60, -50, 0.05 },
+	{ "voice-outer",	60, -50, 0.05 },
+	{ "cached",			60, -50, 0.05 },
+	//the admission's reduced quality tails: coarse sine and no sub operator past the attack
+	{ "reduced tail",	25, -20, 0.5 }
+};
+
+//one hit of the drum through a render path, released straight away
+static void render_path(int path, int drum, int sampleRate, int blockSize, DrumSampleCache *cache, float *out,
+		long numSamples) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.oversampling = DRUM_OVERSAMPLE_OFF;
+	if(path == PATH_SAMPLE_OUTER){
+		engine.loopOrder = DRUM_SAMPLE_OUTER;
+	}
+	if(path == PATH_CACHED){
+		engine.cache = cache;
+	}
+	engine.noteOn(drumPatches[drum].note);
+	engine.noteOff(drumPatches[drum].note);
+	DrumVoice &v = engine.pool.voices[engine.pool.active[0]];
+
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		//the admission reduces a voice at a block boundary once it is past tailStart
+		if(path == PATH_REDUCED_TAIL && v.counter >= engine.tailStart[drum]){
+			v.reduced = true;
+		}
+		int n = numSamples - pos < blockSize ? (int)(numSamples - pos) : blockSize;
+		engine.render(&out[pos], n);
+	}
+}
+
+//the same hit from the closed forms, with the noise sequence the engine draws for it
+static void render_reference(int drum, int sampleRate, double *out, long numSamples) {
+
+	const DrumPatch &patch = drumPatches[drum];
+	DrumNoiseFilter filter;
+	filter.setup(patch.hasNoise ? patch.noiseColor : DRUM_NOISE_WHITE, (float)sampleRate);
+	DrumNoise noise;
+	noise.seed(0);
+
+	for(long i=0; i<numSamples; i++){
+		double noiseWeight;
+		double y = drum_reference_tone(drum, (double)i/sampleRate, 1, patch.index0, noiseWeight);
+		if(patch.hasNoise){
+			y += noiseWeight*noise.next(filter);
+		}
+		out[i] = y;
+	}
+}
+
+//samples of the drum's hit, at most maxSeconds of it
+static long hit_length(int drum, int sampleRate, double maxSeconds) {
+
+	long n = (long)floor(drumPatches[drum].r*sampleRate + 1e-3) + 1;
+	long max = (long)(maxSeconds*sampleRate);
+	return n < max ? n : max;
+}
+
+//distance of the STFT magnitudes of x to those of ref, in dB of ref's energy
+static double stft_distance(const std::vector<double> &refMag, const float *x, long numSamples) {
+
+	std::vector<double> mag;
+	spectrum_stft(x, numSamples, DRUM_REFERENCE_STFT_N, DRUM_REFERENCE_STFT_N*DRUM_REFERENCE_STFT_ZP, mag);
+	double diff = 0, energy = 0;
+	for(size_t k=0; k<mag.size() && k<refMag.size(); k++){
+		diff += (mag[k] - refMag[k])*(mag[k] - refMag[k]);
+		energy += refMag[k]*refMag[k];
+	}
+	return 10*log10(diff/energy + 1e-30);
+}
+
+//a cache of one-shots at the rate, set up again when the rate changes
+static DrumSampleCache *cache_at(DrumSampleCache *cache, int &cacheRate, int sampleRate) {
+
+	if(cacheRate != sampleRate){
+		cache->setup((float)sampleRate);
+		cache->renderAll();
+		cacheRate = sampleRate;
+	}
+	return cache;
+}
+
+int run_fidelity_bench(double seconds, int sampleRate, int blockSize, const char *recordingDir) {
+
+	if(seconds <= 0){
+		seconds = 3;
+	}
+
+	printf("rate %d Hz, block %d, up to %.1f s of each hit; STFT hamming(%d), hop %d, %d point DFT\n\n",
+			sampleRate, blockSize, seconds, DRUM_REFERENCE_STFT_N, DRUM_REFERENCE_STFT_N/2, DRUM_REFERENCE_STFT_N*DRUM_REFERENCE_STFT_ZP);
+
+	//two sets of one-shots are large, keep them off the stack
+	DrumSampleCache *cache = new DrumSampleCache;
+	int cacheRate = 0;
+	int failures = 0;
+
+	printf("%-9s %-13s %10s %8s %12s %9s %10s %24s\n", "drum", "path", "cyc/sample", "speedup", "max abs err",
+			"SNR dB", "STFT dB", "recording dB ref/path");
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		long n = hit_length(d, sampleRate, seconds);
+		std::vector<double> ref(n);
+		std::vector<float> refFloat(n), out(n);
+
+		uint64_t c0 = bench_cycles();
+		render_reference(d, sampleRate, ref.data(), n);
+		uint64_t c1 = bench_cycles();
+		double refCycles = (double)(c1 - c0)/n;
+
+		for(long i=0; i<n; i++){
+			refFloat[i] = (float)ref[i];
+		}
+		std::vector<double> refMag;
+		spectrum_stft(refFloat.data(), n, DRUM_REFERENCE_STFT_N, DRUM_REFERENCE_STFT_N*DRUM_REFERENCE_STFT_ZP, refMag);
+
+		//the same hit at the recording's rate, for the scores
+		std::vector<float> recording;
+		int recordingRate = 0;
+		bool haveRecording = drum_reference_load_recording(recordingDir, d, recording, recordingRate);
+		long rn = 0;
+		std::vector<double> recordingDb;
+		std::vector<float> atRate;
+		double refScore = 0;
+		if(haveRecording){
+			rn = hit_length(d, recordingRate, seconds);
+			if(rn > (long)recording.size()){
+				rn = (long)recording.size();
+			}
+			drum_reference_stft_db(recording.data(), rn, recordingDb);
+			std::vector<double> r(rn);
+			render_reference(d, recordingRate, r.data(), rn);
+			atRate.resize(rn);
+			for(long i=0; i<rn; i++){
+				atRate[i] = (float)r[i];
+			}
+			refScore = drum_reference_score(recordingDb, atRate.data(), rn);
+		}
+
+		printf("%-9s %-13s %10.1f\n", drumPatches[d].name, "reference", refCycles);
+
+		for(int p=0; p<NUM_PATHS; p++){
+			const FidelityPath &path = fidelityPaths[p];
+			DrumSampleCache *c = p == PATH_CACHED ? cache_at(cache, cacheRate, sampleRate) : 0;
+
+			uint64_t t0 = bench_cycles();
+			render_path(p, d, sampleRate, blockSize, c, out.data(), n);
+			uint64_t t1 = bench_cycles();
+			double cycles = (double)(t1 - t0)/n;
+
+			double maxErr = 0, noise = 0, signal = 0;
+			for(long i=0; i<n; i++){
+				double e = fabs(out[i] - ref[i]);
+				if(e > maxErr){
+					maxErr = e;
+				}
+				noise += e*e;
+				signal += ref[i]*ref[i];
+			}
+			double snr = 10*log10(signal/(noise + 1e-30));
+			double stft = stft_distance(refMag, out.data(), n);
+			bool ok = snr >= path.minSnrDb && stft <= path.maxStftDb;
+
+			char score[64] = "-";
+			if(haveRecording){
+				c = p == PATH_CACHED ? cache_at(cache, cacheRate, recordingRate) : 0;
+				render_path(p, d, recordingRate, blockSize, c, atRate.data(), rn);
+				double s = drum_reference_score(recordingDb, atRate.data(), rn);
+				snprintf(score, sizeof(score), "%.3f/%.3f", refScore, s);
+				ok = ok && s - refScore <= path.maxScoreLossDb;
+			}
+
+			printf("%-9s %-13s %10.1f %7.1fx %12.3g %9.1f %10.1f %24s   %s\n", "", path.name, cycles, refCycles/cycles,
+					maxErr, snr, stft, score, ok ? "ok" : "FAIL");
+			if(!ok){
+				failures++;
+			}
+		}
+	}
+	delete cache;
+
+	printf("\nlimits (SNR, STFT distance, recording score loss):");
+	for(int p=0; p<NUM_PATHS; p++){
+		printf("%s %s >= %.0f dB, <= %.0f dB, <= %.2f dB", p ? ";" : "", fidelityPaths[p].name,
+				fidelityPaths[p].minSnrDb, fidelityPaths[p].maxStftDb, fidelityPaths[p].maxScoreLossDb);
+	}
+	printf("\ncycles are host cycles per sample of one hit; speedup is against the reference math\n");
+	printf("%s\n", failures == 0 ? "all paths within limits" : "some paths are past their limits");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/*
+ * fm_bench.cpp
+ *
+ * drum_render --fm: accuracy and cost of the table-based FmOperator against the libm
+ * expression sin(2*PI*fc*t + I*sin(2*PI*fm*t)) it replaced. Fails when the table's
+ * harmonic distortion or an operator's error against libm passes the limits below.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "drum_engine.h"
+#include "drum_fm.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//worst harmonic distortion of a pure table tone; linear interpolation of the table sits near -150 dB
+#define FM_CHECK_MAX_THD_DB	-120
+//largest error of an operator against the libm expression, over the drums' own settings
+#define FM_CHECK_MAX_ERR	1e-3
+
+//power of bin k of x[0..n-1] (Goertzel)
+static double bin_power(const float *x, int n, double k) {
+
+	double w = 2*PI*k/n;
+	double coeff = 2*cos(w);
+	double s1 = 0, s2 = 0;
+	for(int i=0; i<n; i++){
+		double s0 = x[i] + coeff*s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	return s1*s1 + s2*s2 - coeff*s1*s2;
+}
+
+//THD (harmonics 2..10) and THD+N of a pure table tone (index 0) exactly on DFT bin k
+static void table_thd_db(int k, int n, float sampleRate, double *thd, double *thdn) {
+
+	static float x[65536];
+
+	FmOperator op;
+	op.setFrequencies(k*sampleRate/n, 0, sampleRate);
+	op.start();
+	for(int i=0; i<n; i++){
+		x[i] = op.next(0);
+	}
+
+	double fundamental = bin_power(x, n, k);
+	double harmonics = 0;
+	int h;
+	for(h=2; h<=10 && h*k < n/2; h++){
+		harmonics += bin_power(x, n, h*k);
+	}
+	//no harmonic below Nyquist: nothing to measure
+	*thd = (h == 2) ? -INFINITY : 10*log10(harmonics/fundamental);
+
+	//everything that is not the fundamental: the residual against the exact sine
+	double noise = 0, signal = 0;
+	for(int i=0; i<n; i++){
+		double ref = sin(2*PI*(double)k*i/n);
+		noise += (x[i] - ref)*(x[i] - ref);
+		signal += ref*ref;
+	}
+	*thdn = 10*log10(noise/signal);
+}
+
+struct FmCase {
+	const char *name;
+	float fc, fm, index;
+};
+
+int run_fm_check(int sampleRate) {
+
+	drum_fm_init();
+
+	printf("sine table: %d points, linear interpolation\n", DRUM_SINE_TABLE_SIZE);
+
+	//pure tone distortion across the band
+	const int n = 65536;
+	static const int bins[] = { 137, 1367, 6833, 20507 };
+	double worstThd = -400, worstThdn = -400;
+	for(unsigned b=0; b<sizeof(bins)/sizeof(bins[0]); b++){
+		double thd, thdn;
+		table_thd_db(bins[b], n, (float)sampleRate, &thd, &thdn);
+		if(isinf(thd)){
+			printf("  %8.1f Hz: THD     n/a    THD+N %7.1f dB\n", bins[b]*(double)sampleRate/n, thdn);
+		}
+		else{
+			printf("  %8.1f Hz: THD %7.1f dB, THD+N %7.1f dB\n", bins[b]*(double)sampleRate/n, thd, thdn);
+		}
+		if(thd > worstThd){
+			worstThd = thd;
+		}
+		if(thdn > worstThdn){
+			worstThdn = thdn;
+		}
+	}
+	int failures = 0;
+	bool thdOk = worstThd <= FM_CHECK_MAX_THD_DB;
+	if(!thdOk){
+		failures++;
+	}
+	printf("  worst: THD %.1f dB, THD+N %.1f dB   %s\n\n", worstThd, worstThdn, thdOk ? "ok" : "FAILED");
+
+	//operator error against libm and cost per operator sample, with the drums' own settings
+	static const FmCase cases[] = {
+		{ "kick",    70,  30,  7.15 },
+		{ "sub",     200, 350, 5 },
+		{ "snare",   80,  85,  7 },
+		{ "midtom",  110, 113, 7.5 },
+		{ "hightom", 200, 400, 7.5 },
+		{ "hihat",   350, 700, 20 },
+	};
+	const int len = 19200;
+	const int reps = 50;
+
+	printf("%-9s %12s %11s %11s %9s\n", "operator", "max abs err", "libm ns", "table ns", "speedup");
+	for(unsigned c=0; c<sizeof(cases)/sizeof(cases[0]); c++){
+		const FmCase &fc = cases[c];
+		FmOperator op;
+		op.setFrequencies(fc.fc, fc.fm, (float)sampleRate);
+
+		double maxErr = 0;
+		op.start();
+		for(int i=0; i<len; i++){
+			double t = (double)i/sampleRate;
+			double ref = sin(2*PI*fc.fc*t + fc.index*sin(2*PI*fc.fm*t));
+			double err = fabs(op.next(fc.index) - ref);
+			if(err > maxErr){
+				maxErr = err;
+			}
+		}
+
+		//the firmware expression, float t_r and double sin() as on the SHARC
+		volatile float sink;
+		float acc = 0;
+		double t0 = bench_seconds();
+		for(int rep=0; rep<reps; rep++){
+			for(int i=0; i<len; i++){
+				float t_r = i/(float)sampleRate;
+				acc += sin(2*PI*fc.fc*t_r + fc.index*sin(2*PI*fc.fm*t_r));
+			}
+		}
+		double t1 = bench_seconds();
+		for(int rep=0; rep<reps; rep++){
+			op.start();
+			for(int i=0; i<len; i++){
+				acc += op.next(fc.index);
+			}
+		}
+		double t2 = bench_seconds();
+		sink = acc;
+		(void)sink;
+
+		double libmNs = (t1 - t0)*1e9/((double)reps*len);
+		double tableNs = (t2 - t1)*1e9/((double)reps*len);
+		bool ok = maxErr <= FM_CHECK_MAX_ERR;
+		if(!ok){
+			failures++;
+		}
+		printf("%-9s %12.3g %11.2f %11.2f %8.1fx   %s\n", fc.name, maxErr, libmNs, tableNs, libmNs/tableNs,
+				ok ? "ok" : "FAILED");
+	}
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * footprint_bench.cpp
+ *
+ * drum_render --footprint: where the engine's memory goes, and how much of a voice the render
+ * loop touches.
+ *
+ * Lists the constant data (the patch tables), what the engine keeps per drum (the models the
+ * voices read their coefficients from) and per voice, with the part of a voice the renderers
+ * read and the operator state of each kind of drum.  Then, for every drum, plays a voice through
+ * the per-sample renderer and compares a copy of the voice before and after each sample: the
+ * bytes that change are the stores of the inner loop, and the 64-byte lines they fall in are the
+ * lines a sample needs.  Last, the cycles per voice and sample with the pool full of one drum.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+#include "drum_engine.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+#define FOOTPRINT_LINE			64
+
+//samples into the hit before watching the voice (past every attack), and samples watched
+#define FOOTPRINT_SKIP			2000
+#define FOOTPRINT_WATCH			256
+
+static int lines(size_t bytes) {
+
+	return (int)((bytes + FOOTPRINT_LINE - 1)/FOOTPRINT_LINE);
+}
+
+//bytes of the voice a sample of the renderer writes, over FOOTPRINT_WATCH samples, and the lines
+//they are in
+static void watch_voice(DrumEngine &engine, int drum, int &bytes, int &numLines) {
+
+	static DrumVoice voice, before;
+	engine.startOneShot(voice, drum);
+	std::vector<float> tone(FOOTPRINT_SKIP), noise(FOOTPRINT_SKIP);
+	engine.renderOneShot(voice, tone.data(), noise.data(), FOOTPRINT_SKIP);
+
+	std::vector<bool> written(sizeof(DrumVoice), false);
+	for(int i=0; i<FOOTPRINT_WATCH; i++){
+		memcpy(&before, &voice, sizeof(DrumVoice));
+		engine.renderOneShot(voice, tone.data(), noise.data(), 1);
+		const unsigned char *a = (const unsigned char *)&before, *b = (const unsigned char *)&voice;
+		for(size_t k=0; k<sizeof(DrumVoice); k++){
+			if(a[k] != b[k]){
+				written[k] = true;
+			}
+		}
+	}
+
+	bytes = 0;
+	numLines = 0;
+	for(size_t line=0; line<sizeof(DrumVoice); line+=FOOTPRINT_LINE){
+		bool any = false;
+		for(size_t k=line; k<line + FOOTPRINT_LINE && k<sizeof(DrumVoice); k++){
+			bytes += written[k];
+			any = any || written[k];
+		}
+		numLines += any;
+	}
+}
+
+//cycles per voice and sample of a pool full of the drum
+static double time_pool(int drum, double seconds, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	for(int v=0; v<DRUM_MAX_VOICES; v++){
+		engine->noteOn(drumPatches[drum].note);
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine->render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	delete engine;
+	return (c1 - c0)/((double)numBlocks*blockSize*DRUM_MAX_VOICES);
+}
+
+int run_footprint_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 0.5;
+	}
+
+	printf("constant data:\n");
+	printf("  %-36s %7zu bytes, %d x %zu\n", "drumPatches[]", sizeof(drumPatches), DRUM_NUM_TYPES, sizeof(DrumPatch));
+	printf("  %-36s %7zu bytes, %d x %zu\n", "drumStackPatches[]", sizeof(drumStackPatches), DRUM_STACK_NUM_TYPES,
+			sizeof(DrumStackPatch));
+	printf("  %-36s %7zu bytes, %d x %zu\n", "drumModalPatches[]", sizeof(drumModalPatches), DRUM_MODAL_NUM_TYPES,
+			sizeof(DrumModalPatch));
+	printf("  %-36s %7zu bytes (written once, by drum_fm_init())\n", "drum_sine_table[]", sizeof(drum_sine_table));
+
+	printf("\nper drum:\n");
+	printf("  %-36s %7zu bytes, %d x %zu\n", "DrumEngine::model[]", sizeof(DrumModel)*DRUM_NUM_TYPES, DRUM_NUM_TYPES,
+			sizeof(DrumModel));
+	printf("  %-36s %7zu bytes\n", "rest of the engine, besides the pool", sizeof(DrumEngine) - sizeof(DrumVoicePool) -
+			sizeof(DrumModel)*DRUM_NUM_TYPES);
+	printf("    %-34s %7zu bytes\n", "of which the render's lanes", sizeof(DrumLanes));
+
+	printf("\nper voice: %zu bytes, %d lines, aligned to %zu; %d voices, %zu bytes in the pool\n", sizeof(DrumVoice),
+			lines(sizeof(DrumVoice)), alignof(DrumVoice), DRUM_MAX_VOICES, sizeof(DrumVoicePool));
+	printf("  %-36s %7zu bytes\n", "read by the renderers, before fm/stack", offsetof(DrumVoice, fm));
+	printf("  %-36s %7zu bytes\n", "two operator drums (DrumFmVoice)", sizeof(DrumFmVoice));
+	printf("    %-34s %7zu bytes\n", "of which the decimator", sizeof(DrumHalfband));
+	printf("  %-36s %7zu bytes\n", "stack drums (DrumStackVoice)", sizeof(DrumStackVoice));
+	printf("    %-34s %7zu bytes\n", "of which the decimators",
+			sizeof(((DrumStackVoice *)0)->halfbandEven) + sizeof(((DrumStackVoice *)0)->halfbandOdd));
+	printf("  %-36s %7zu bytes\n", "modal toms (DrumModalVoice)", sizeof(DrumModalVoice));
+	printf("  %-36s %7zu bytes\n", "note, serial, active list, padding", sizeof(DrumVoice) - offsetof(DrumVoice, note));
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	float checksum = 0;
+	printf("\nvoice state written per sample by the per-sample renderer, and a pool of %d voices of the drum:\n",
+			DRUM_MAX_VOICES);
+	printf("  %-10s %8s %8s %24s\n", "drum", "bytes", "lines", "cycles/voice/sample");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		int bytes, numLines;
+		watch_voice(*engine, d, bytes, numLines);
+		double cycles = time_pool(d, seconds, sampleRate, blockSize, checksum);
+		printf("  %-10s %8d %8d %24.1f\n", drumPatches[d].name, bytes, numLines, cycles);
+	}
+	printf("(rate %d Hz, block %d, checksum %g)\n", sampleRate, blockSize, checksum);
+	delete engine;
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * host_tools.h
+ *
+ * Entry points of the drum_render tool modes that live in their own files.
+ */
+
+#ifndef HOST_TOOLS_H_
+#define HOST_TOOLS_H_
+
+#include <vector>
+#include "drum_patches.h"
+#include "midi_file.h"
+
+//MIDI note of every drum, in DrumType order
+static inline const int *drum_notes(void) {
+
+	static int notes[DRUM_NUM_TYPES];
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		notes[d] = drumPatches[d].note;
+	}
+	return notes;
+}
+
+//--envelope: error of the envelope recurrences against the closed forms, and their cost
+int run_envelope_check(int sampleRate);
+
+//--fm: THD and error of the table-based FM operator against libm, and its cost
+int run_fm_check(int sampleRate);
+
+//--stress: voice independence and cost with 16..DRUM_MAX_VOICES voices sounding
+int run_voice_stress(double seconds, int sampleRate, int blockSize);
+
+//--loops: sample-outer against voice-outer (SIMD lanes) rendering, agreement and cost
+int run_loop_order_bench(double seconds, int sampleRate, int blockSize);
+
+//--cache: pre-rendered one-shots against synthesis, re-render time and knob change latency
+int run_cache_bench(double seconds, int sampleRate, int blockSize);
+
+//--midiq: sample-accurate hit timing through the MIDI event queue, thread safety and cost
+int run_midi_queue_bench(double seconds, int sampleRate, int blockSize);
+
+//--midiparse: MIDI stream rules and fuzzing of the UART interrupt's parser, and its cost per byte
+//on streamPath (raw MIDI bytes) or a built-in kit stream when it is 0
+int run_midi_parser_bench(const char *streamPath);
+
+//--noise: spectral flatness, level and colour of the snare/hihat noise against rand(), and its cost
+int run_noise_bench(double seconds, int sampleRate, int blockSize);
+
+//--dual: voices split between two cores modelled as threads, against one core; determinism and cost split
+int run_dual_core_bench(double seconds, int sampleRate, int blockSize);
+
+//--profile: the callback cycle accounting on a busy performance: percentiles, per drum costs, overhead
+int run_profile_bench(double seconds, int sampleRate, int blockSize);
+
+//--admission: CPU budget aware voice admission under heavy rolls: overruns, decisions, output error
+int run_admission_bench(double seconds, int sampleRate, int blockSize);
+
+//--stack: the floor tom, ride and crash operator stacks against their formulas, cost per operator
+int run_stack_bench(double seconds, int sampleRate, int blockSize);
+
+//--fit: attack/decay envelopes fitted to the reference recordings in dir, all at once; the patch
+//table goes to outPath, or stdout when it is 0
+int run_envelope_fit(const char *dir, const char *outPath);
+
+//--controls: zipper noise of stepped and ramped knob changes against a per-sample ramp, and the cost
+//of the control rate work
+int run_controls_bench(double seconds, int sampleRate, int blockSize);
+
+//--activity: voices ending once they go quiet, and the cost from an idle engine up to every voice
+int run_activity_bench(double seconds, int sampleRate, int blockSize);
+
+//--fidelity: every render path against the reference math and the recordings in recordingDir:
+//max error, SNR, STFT distance, cost; fails past the limits
+int run_fidelity_bench(double seconds, int sampleRate, int blockSize, const char *recordingDir);
+
+//--oversample: in-band aliasing of every FM operator at the sample rate and oversampled, against the
+//band-limited tone; cost per oversampled voice
+int run_oversample_bench(double seconds, int sampleRate, int blockSize);
+
+//--footprint: memory of the patch tables, the models and the voices, and the voice state the render
+//loop writes per sample
+int run_footprint_bench(double seconds, int sampleRate, int blockSize);
+
+//--sweep: every block size from 8 to 256 at every rate from 44.1 to 96 kHz: drum length and pitch,
+//cycles per sample, per-block overhead, worst-case note on to sound latency
+int run_sweep_bench(double seconds);
+
+//--snapshot: knob and button targets published from a background thread while the callback renders:
+//torn snapshots, bit-exact replay, the panic event, and the control work taken off the callback
+int run_snapshot_bench(double seconds, int sampleRate, int blockSize);
+
+//--modalfit: the modes of the tom recordings in dir, all at once; the drumModalPatches[] table goes to
+//outPath, or stdout when it is 0
+int run_modal_fit(const char *dir, const char *outPath);
+
+//--modal: the modal toms against the closed form of their modes and the recordings in recordingDir,
+//against the FM toms; cost per voice, knob ramps, reduced quality
+int run_modal_bench(double seconds, int sampleRate, int blockSize, const char *recordingDir);
+
+//--play: a MIDI file or raw dump (the built-in performance when path is 0) through the firmware's MIDI
+//input and audio callback as fast as possible: realtime factor, worst block, deadline misses; the
+//output goes to outPath unless it is 0
+int run_play_bench(const char *path, const char *outPath, double seconds, int sampleRate, int blockSize);
+
+//the built-in performance of --play: dense e-kit patterns as the bytes a MIDI input receives
+void play_builtin_performance(std::vector<MidiWireByte> &bytes);
+
+//--capture: a performance (path, or the built-in one) through the firmware with the capture of
+//drum_capture.h: bit-exact replay of the dump (saved to outPath unless it is 0), lost records, and
+//the capture's cost in the interrupt, the callback and the background loop
+int run_capture_bench(const char *path, const char *outPath, double seconds, int sampleRate, int blockSize);
+
+//--replay: a capture dump saved from the firmware through the engine against the audio it holds;
+//the audio goes to outPath unless it is 0
+int run_capture_replay(const char *path, const char *outPath);
+
+#endif /* HOST_TOOLS_H_ */
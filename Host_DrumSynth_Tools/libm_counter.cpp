@@ -0,0 +1,64 @@
+/*
+ * libm_counter.cpp
+ *
+ * Counting wrappers for the libm transcendental functions.  See libm_counter.h.
+ */
+
+#include "libm_counter.h"
+
+unsigned long libm_calls[LIBM_NUM_FUNCTIONS];
+const char *libm_names[LIBM_NUM_FUNCTIONS] = { "exp", "pow", "sin" };
+
+extern "C" {
+
+double __real_exp(double x);
+double __real_pow(double x, double y);
+double __real_sin(double x);
+float __real_expf(float x);
+float __real_powf(float x, float y);
+float __real_sinf(float x);
+
+double __wrap_exp(double x) {
+
+	libm_calls[LIBM_EXP]++;
+	return __real_exp(x);
+}
+
+double __wrap_pow(double x, double y) {
+
+	libm_calls[LIBM_POW]++;
+	return __real_pow(x, y);
+}
+
+double __wrap_sin(double x) {
+
+	libm_calls[LIBM_SIN]++;
+	return __real_sin(x);
+}
+
+float __wrap_expf(float x) {
+
+	libm_calls[LIBM_EXP]++;
+	return __real_expf(x);
+}
+
+float __wrap_powf(float x, float y) {
+
+	libm_calls[LIBM_POW]++;
+	return __real_powf(x, y);
+}
+
+float __wrap_sinf(float x) {
+
+	libm_calls[LIBM_SIN]++;
+	return __real_sinf(x);
+}
+
+}
+
+void libm_counter_reset(void) {
+
+	for(int f=0; f<LIBM_NUM_FUNCTIONS; f++){
+		libm_calls[f] = 0;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * libm_counter.h
+ *
+ * Counts calls to the libm transcendental functions made by the engine.
+ *
+ * The host tools are linked with -Wl,--wrap for exp/pow/sin and expf/powf/sinf (see the
+ * Makefile), so every call the engine makes to one of them goes through a counting wrapper in
+ * libm_counter.cpp; the float versions count with the double ones.
+ * The benchmarks use this to show which transcendental calls are left in the per-sample path.
+ */
+
+#ifndef LIBM_COUNTER_H_
+#define LIBM_COUNTER_H_
+
+enum LibmFunction {
+	LIBM_EXP = 0,
+	LIBM_POW,
+	LIBM_SIN,
+	LIBM_NUM_FUNCTIONS
+};
+
+extern unsigned long libm_calls[LIBM_NUM_FUNCTIONS];
+extern const char *libm_names[LIBM_NUM_FUNCTIONS];
+
+void libm_counter_reset(void);
+
+#endif /* LIBM_COUNTER_H_ */
@@ -0,0 +1,194 @@
+/*
+ * loop_bench.cpp
+ *
+ * drum_render --loops: compares the two loop orders of DrumEngine::render().  Checks that the
+ * voice-outer SIMD lane render produces the same drums as the sample-outer one, then times both
+ * with a single drum, the full mix, and up to DRUM_MAX_VOICES identical or mixed voices. Fails
+ * when the two orders differ by more than LOOP_CHECK_MAX_REL of the peak.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//largest difference between the two orders, relative to the peak; they only round differently
+#define LOOP_CHECK_MAX_REL	1e-4
+
+//every drum and a held kick that loops; each voice's noise comes from its own generator, so both
+//orders must agree up to float rounding
+static void render_check_pattern(int loopOrder, float *out, long numSamples, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.loopOrder = loopOrder;
+
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		long b = pos/blockSize;
+		if(b == 0 || b == 7){
+			engine.noteOn(DRUM_NOTE_KICK);
+			engine.noteOff(DRUM_NOTE_KICK);
+		}
+		if(b == 3 || b == 40 || b == 41){
+			engine.noteOn(DRUM_NOTE_MIDTOM);
+			engine.noteOff(DRUM_NOTE_MIDTOM);
+		}
+		if(b == 20){
+			engine.noteOn(DRUM_NOTE_HIGHTOM);
+			engine.noteOff(DRUM_NOTE_HIGHTOM);
+		}
+		if(b == 10 || b == 30 || b == 31){
+			engine.noteOn(DRUM_NOTE_SNARE);
+			engine.noteOff(DRUM_NOTE_SNARE);
+		}
+		if(b == 12 || b == 25 || b == 50){
+			engine.noteOn(DRUM_NOTE_HIHAT);
+			engine.noteOff(DRUM_NOTE_HIHAT);
+		}
+		if(b == 15 || b == 60){
+			engine.noteOn(DRUM_NOTE_FLOORTOM);
+			engine.noteOff(DRUM_NOTE_FLOORTOM);
+		}
+		if(b == 5){
+			engine.noteOn(DRUM_NOTE_RIDE);
+			engine.noteOff(DRUM_NOTE_RIDE);
+		}
+		if(b == 45){
+			engine.noteOn(DRUM_NOTE_CRASH);
+			engine.noteOff(DRUM_NOTE_CRASH);
+		}
+		if(b == 100){
+			engine.noteOn(DRUM_NOTE_KICK);
+		}
+		if(pos > numSamples/2){
+			engine.noteOff(DRUM_NOTE_KICK);
+		}
+		engine.render(&out[pos], blockSize);
+	}
+}
+
+//max |a - b| and the peak of either (at least the given peak), true if the difference is within
+//LOOP_CHECK_MAX_REL of the peak
+static bool orders_agree(const float *a, const float *b, long n, double *maxErr, double *peak) {
+
+	*maxErr = 0;
+	for(long i=0; i<n; i++){
+		if(fabs(a[i] - b[i]) > *maxErr){
+			*maxErr = fabs(a[i] - b[i]);
+		}
+		if(fabs(a[i]) > *peak){
+			*peak = fabs(a[i]);
+		}
+		if(fabs(b[i]) > *peak){
+			*peak = fabs(b[i]);
+		}
+	}
+	return *maxErr <= LOOP_CHECK_MAX_REL*(*peak);
+}
+
+//cycles per sample with the given notes triggered one block apart and held; the last block is left in
+//lastBlock and the peak of the untimed attack blocks is raised into peak
+static double time_order(int loopOrder, const int *notes, int numNotes, double seconds, int sampleRate,
+		int blockSize, float &checksum, float *lastBlock, double &peak) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.loopOrder = loopOrder;
+
+	std::vector<float> block(blockSize);
+	for(int n=0; n<numNotes; n++){
+		engine.noteOn(notes[n]);
+		engine.render(block.data(), blockSize);
+		for(int i=0; i<blockSize; i++){
+			if(fabs(block[i]) > peak){
+				peak = fabs(block[i]);
+			}
+		}
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+
+	for(int i=0; i<blockSize; i++){
+		lastBlock[i] = block[i];
+	}
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+//time both orders on one case, true if their last blocks agree relative to the attack's peak
+static bool compare(const char *name, const int *notes, int numNotes, double seconds, int sampleRate, int blockSize) {
+
+	float checksum = 0;
+	double peak = 0;
+	std::vector<float> sampleBlock(blockSize), voiceBlock(blockSize);
+	double sampleOuter = time_order(DRUM_SAMPLE_OUTER, notes, numNotes, seconds, sampleRate, blockSize, checksum,
+			sampleBlock.data(), peak);
+	double voiceOuter = time_order(DRUM_VOICE_OUTER, notes, numNotes, seconds, sampleRate, blockSize, checksum,
+			voiceBlock.data(), peak);
+
+	double maxErr;
+	bool ok = orders_agree(sampleBlock.data(), voiceBlock.data(), blockSize, &maxErr, &peak);
+	printf("%-18s %6d %14.1f %14.1f %9.2fx %9.2f%%   %s   (checksum %g)\n", name, numNotes, sampleOuter, voiceOuter,
+			sampleOuter/voiceOuter, 100.0*voiceOuter/SHARC_CYCLES_PER_SAMPLE, ok ? "ok" : "FAILED", checksum);
+	return ok;
+}
+
+int run_loop_order_bench(double seconds, int sampleRate, int blockSize) {
+
+	const int *drumNotes = drum_notes();
+
+	if(seconds <= 0){
+		seconds = 5;
+	}
+
+	printf("rate %d Hz, block %d, %d lanes, %.1f s per case\n\n", sampleRate, blockSize, DRUM_LANES, seconds);
+
+	long numSamples = 2*(long)sampleRate;
+	numSamples -= numSamples % blockSize;
+	std::vector<float> a(numSamples), b(numSamples);
+	render_check_pattern(DRUM_SAMPLE_OUTER, a.data(), numSamples, sampleRate, blockSize);
+	render_check_pattern(DRUM_VOICE_OUTER, b.data(), numSamples, sampleRate, blockSize);
+	int failures = 0;
+	double maxErr, peak = 0;
+	bool patternOk = orders_agree(a.data(), b.data(), numSamples, &maxErr, &peak);
+	failures += !patternOk;
+	printf("voice-outer vs sample-outer: max |difference| %g (%.1f dB below peak)   %s\n\n", maxErr,
+			maxErr > 0 ? 20*log10(peak/maxErr) : INFINITY, patternOk ? "ok" : "FAILED");
+
+	printf("%-18s %6s %14s %14s %10s %10s\n", "case", "voices", "sample-outer", "voice-outer", "speedup", "of budget");
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		failures += !compare(drumPatches[d].name, &drumNotes[d], 1, seconds, sampleRate, blockSize);
+	}
+	failures += !compare("full mix", drumNotes, DRUM_NUM_TYPES, seconds, sampleRate, blockSize);
+
+	int notes[DRUM_MAX_VOICES];
+	for(int n=8; n<=DRUM_MAX_VOICES; n*=2){
+		char name[32];
+		for(int v=0; v<n; v++){
+			notes[v] = DRUM_NOTE_HIGHTOM;
+		}
+		snprintf(name, sizeof(name), "%d hightoms", n);
+		failures += !compare(name, notes, n, seconds, sampleRate, blockSize);
+
+		for(int v=0; v<n; v++){
+			notes[v] = drumNotes[v % DRUM_NUM_TYPES];
+		}
+		snprintf(name, sizeof(name), "%d mixed", n);
+		failures += !compare(name, notes, n, seconds, sampleRate, blockSize);
+	}
+
+	printf("\ncycles/sample are host cycles; speedup is sample-outer/voice-outer.\n");
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * midi_file.cpp
+ *
+ * Standard MIDI File and raw MIDI dump reader.  See midi_file.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "midi_file.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+//an SMF event on the merged timeline: its wire bytes, or a tempo change
+struct SmfEvent {
+	uint32_t tick;
+	int track;
+	int order;			//position in its track, so events on the same tick keep their order
+	uint32_t tempo;		//microseconds per quarter note, 0 if this is not a tempo change
+	Bytes bytes;
+};
+
+static bool smf_event_before(const SmfEvent &a, const SmfEvent &b) {
+
+	if(a.tick != b.tick){
+		return a.tick < b.tick;
+	}
+	if(a.track != b.track){
+		return a.track < b.track;
+	}
+	return a.order < b.order;
+}
+
+static uint32_t read_be(const uint8_t *p, int n) {
+
+	uint32_t v = 0;
+	for(int i=0; i<n; i++){
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+//variable length quantity at pos, moving pos past it; false if it runs off the end
+static bool read_vlq(const Bytes &data, size_t end, size_t &pos, uint32_t &value) {
+
+	value = 0;
+	for(int i=0; i<4; i++){
+		if(pos >= end){
+			return false;
+		}
+		uint8_t b = data[pos++];
+		value = (value << 7) | (b & 0x7f);
+		if(!(b & 0x80)){
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool read_track(const Bytes &data, size_t pos, size_t end, int track, std::vector<SmfEvent> &events) {
+
+	uint32_t tick = 0;
+	uint8_t running = 0;
+	int order = 0;
+
+	while(pos < end){
+		uint32_t delta;
+		if(!read_vlq(data, end, pos, delta) || pos >= end){
+			return false;
+		}
+		tick += delta;
+
+		SmfEvent ev;
+		ev.tick = tick;
+		ev.track = track;
+		ev.order = order++;
+		ev.tempo = 0;
+
+		uint8_t status = data[pos];
+		if(status & 0x80){
+			pos++;
+		}
+		else if(running != 0){
+			status = running;
+		}
+		else{
+			return false;
+		}
+
+		if(status == 0xff){
+			//meta event: only the tempo matters here
+			if(pos >= end){
+				return false;
+			}
+			uint8_t type = data[pos++];
+			uint32_t length;
+			if(!read_vlq(data, end, pos, length) || pos + length > end){
+				return false;
+			}
+			if(type == 0x2f){
+				break;
+			}
+			if(type == 0x51 && length == 3){
+				ev.tempo = read_be(&data[pos], 3);
+				events.push_back(ev);
+			}
+			pos += length;
+			continue;
+		}
+
+		if(status == 0xf0 || status == 0xf7){
+			//system exclusive, or an escape with raw bytes: F0 goes on the wire, F7 only its data
+			uint32_t length;
+			if(!read_vlq(data, end, pos, length) || pos + length > end){
+				return false;
+			}
+			if(status == 0xf0){
+				ev.bytes.push_back(0xf0);
+			}
+			ev.bytes.insert(ev.bytes.end(), data.begin() + pos, data.begin() + pos + length);
+			pos += length;
+			running = 0;
+			events.push_back(ev);
+			continue;
+		}
+
+		if(status >= 0xf0){
+			//system common inside a file is not valid
+			return false;
+		}
+
+		int type = status & 0xf0;
+		int numData = (type == 0xc0 || type == 0xd0) ? 1 : 2;
+		if(pos + numData > end){
+			return false;
+		}
+		running = status;
+		ev.bytes.push_back(status);
+		for(int i=0; i<numData; i++){
+			ev.bytes.push_back(data[pos++] & 0x7f);
+		}
+		events.push_back(ev);
+	}
+	return true;
+}
+
+static bool read_smf(const Bytes &data, std::vector<MidiWireByte> &bytes) {
+
+	if(data.size() < 14 || read_be(&data[4], 4) < 6){
+		return false;
+	}
+	int numTracks = (int)read_be(&data[10], 2);
+	uint16_t division = (uint16_t)read_be(&data[12], 2);
+
+	std::vector<SmfEvent> events;
+	size_t pos = 8 + read_be(&data[4], 4);
+	for(int t=0; t<numTracks && pos + 8 <= data.size(); ){
+		uint32_t length = read_be(&data[pos + 4], 4);
+		size_t start = pos + 8;
+		if(start + length > data.size()){
+			return false;
+		}
+		//unknown chunks are skipped, as the standard asks
+		if(!memcmp(&data[pos], "MTrk", 4)){
+			if(!read_track(data, start, start + length, t, events)){
+				return false;
+			}
+			t++;
+		}
+		pos = start + length;
+	}
+	std::stable_sort(events.begin(), events.end(), smf_event_before);
+
+	//ticks to seconds: SMPTE divisions have a fixed tick length, metrical ones follow the tempo
+	double secondsPerTick;
+	bool smpte = (division & 0x8000) != 0;
+	if(smpte){
+		int fps = -(int8_t)(division >> 8);
+		secondsPerTick = 1.0/(fps*(division & 0xff));
+	}
+	else{
+		secondsPerTick = 0.5/division;	//120 bpm until the first tempo event
+	}
+
+	double time = 0;
+	uint32_t lastTick = 0;
+	for(size_t e=0; e<events.size(); e++){
+		const SmfEvent &ev = events[e];
+		time += (ev.tick - lastTick)*secondsPerTick;
+		lastTick = ev.tick;
+		if(ev.tempo != 0){
+			if(!smpte){
+				secondsPerTick = ev.tempo*1e-6/division;
+			}
+			continue;
+		}
+		for(size_t i=0; i<ev.bytes.size(); i++){
+			MidiWireByte w;
+			w.time = time;
+			w.byte = ev.bytes[i];
+			bytes.push_back(w);
+		}
+	}
+	return true;
+}
+
+void midi_wire_serialize(std::vector<MidiWireByte> &bytes) {
+
+	for(size_t i=1; i<bytes.size(); i++){
+		double earliest = bytes[i - 1].time + MIDI_WIRE_BYTE_SECONDS;
+		if(bytes[i].time < earliest){
+			bytes[i].time = earliest;
+		}
+	}
+}
+
+bool midi_file_read(const char *path, std::vector<MidiWireByte> &bytes) {
+
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		return false;
+	}
+	Bytes data;
+	uint8_t buffer[4096];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), file)) > 0){
+		data.insert(data.end(), buffer, buffer + n);
+	}
+	fclose(file);
+
+	bytes.clear();
+	if(data.size() >= 4 && !memcmp(&data[0], "MThd", 4)){
+		if(!read_smf(data, bytes)){
+			return false;
+		}
+	}
+	else{
+		for(size_t i=0; i<data.size(); i++){
+			MidiWireByte w;
+			w.time = 0;
+			w.byte = data[i];
+			bytes.push_back(w);
+		}
+	}
+	midi_wire_serialize(bytes);
+	return true;
+}
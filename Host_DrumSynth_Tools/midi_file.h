@@ -0,0 +1,35 @@
+/*
+ * midi_file.h
+ *
+ * Standard MIDI Files and raw MIDI byte dumps for the host tools, as the bytes a MIDI input
+ * would receive and the time each one arrives.
+ *
+ * A Standard MIDI File (format 0 or 1, metrical or SMPTE division) has its tracks merged and
+ * its tempo map applied.  Its channel messages go on the wire with their status spelled out,
+ * its system exclusive messages as they are, and its meta events not at all.  A raw dump
+ * (anything that does not start with MThd) carries no timing, so its bytes arrive back to back
+ * at the wire rate, the densest a real input can deliver.  Either way no byte arrives sooner
+ * than one byte time (320 us at 31250 baud) after the one before.
+ */
+
+#ifndef MIDI_FILE_H_
+#define MIDI_FILE_H_
+
+#include <stdint.h>
+#include <vector>
+
+//one start, 8 data and one stop bit at 31250 baud
+#define MIDI_WIRE_BYTE_SECONDS		(10/31250.0)
+
+struct MidiWireByte {
+	double time;	//seconds
+	uint8_t byte;
+};
+
+//the bytes of the file in arrival order; false if it cannot be read or is a broken MIDI file
+bool midi_file_read(const char *path, std::vector<MidiWireByte> &bytes);
+
+//space the bytes out to the wire rate, keeping their order
+void midi_wire_serialize(std::vector<MidiWireByte> &bytes);
+
+#endif /* MIDI_FILE_H_ */
@@ -0,0 +1,403 @@
+/*
+ * midi_parser_bench.cpp
+ *
+ * drum_render --midiparse: the MIDI byte-stream parser (midi_parser.h) inside the real
+ * midi_rx_callback_sharc1(), built against the mock UART driver in mock/.
+ *
+ * Checks the stream rules case by case (running status, velocity 0, channels, realtime, sysex,
+ * system common), then fuzzes: random performances with known notes are encoded with and
+ * without running status, sprinkled with realtime, sysex and controller traffic, and delivered
+ * in interrupts of random size; and random garbage must never produce a malformed event.
+ * Finally it times the interrupt per byte on a recorded byte stream (-m file, raw MIDI bytes)
+ * or on a built-in drum kit stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <builtins.h>
+#include "drivers/bm_uart_driver/bm_uart.h"
+#include "callback_midi_message.h"
+#include "drum_midi_queue.h"
+#include "drum_capture.h"
+#include "midi_parser.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//what callback_midi_message.cpp links against in the firmware
+DrumMidiQueue midiQueue;
+DrumMidiClock midiClock;
+DrumCapture drumCapture;
+uint32_t mock_emuclk_cycles;
+extern BM_UART midi_uart_sharc1;
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<DrumMidiEvent> Events;
+
+static DrumMidiEvent make_note(int status, int note, int velocity) {
+
+	DrumMidiEvent event;
+	event.time = 0;
+	event.status = (uint8_t)status;
+	event.data1 = (uint8_t)note;
+	event.data2 = (uint8_t)velocity;
+	return event;
+}
+
+static bool same_events(const Events &a, const Events &b) {
+
+	if(a.size() != b.size()){
+		return false;
+	}
+	for(size_t i=0; i<a.size(); i++){
+		if(a[i].status != b[i].status || a[i].data1 != b[i].data1 || a[i].data2 != b[i].data2){
+			return false;
+		}
+	}
+	return true;
+}
+
+//small deterministic generator so failures reproduce
+static uint32_t fuzzState;
+
+static uint32_t fuzz_next(void) {
+
+	fuzzState ^= fuzzState << 13;
+	fuzzState ^= fuzzState >> 17;
+	fuzzState ^= fuzzState << 5;
+	return fuzzState;
+}
+
+static int fuzz_range(int n) {
+
+	return (int)(fuzz_next() % (uint32_t)n);
+}
+
+//the stream through midi_rx_callback_sharc1(), chunk bytes per interrupt (0: random sizes)
+static Events run_isr(const Bytes &bytes, int chunk) {
+
+	midi_setup_sharc1();
+	midiQueue.reset();
+	midiClock.setup(48000);
+
+	Events events;
+	size_t pos = 0;
+	while(pos < bytes.size()){
+		int n = chunk > 0 ? chunk : 1 + fuzz_range(64);
+		if(pos + n > bytes.size()){
+			n = (int)(bytes.size() - pos);
+		}
+		mock_emuclk_cycles += 1000;
+		mock_uart_receive(&midi_uart_sharc1, &bytes[pos], n);
+		pos += n;
+
+		DrumMidiEvent event;
+		while(midiQueue.peek(event)){
+			events.push_back(event);
+			midiQueue.pop();
+		}
+	}
+	return events;
+}
+
+struct ParserCase {
+	const char *name;
+	Bytes bytes;
+	Events expected;
+};
+
+static int check_cases(void) {
+
+	std::vector<ParserCase> cases = {
+		{ "note on, note off", { 0x90, 36, 100, 0x80, 36, 64 },
+			{ make_note(0x90, 36, 100), make_note(0x80, 36, 64) } },
+		{ "running status", { 0x99, 36, 100, 38, 80, 36, 0 },
+			{ make_note(0x99, 36, 100), make_note(0x99, 38, 80), make_note(0x89, 36, 0) } },
+		{ "velocity 0 is a note off", { 0x95, 48, 0 },
+			{ make_note(0x85, 48, 0) } },
+		{ "any channel", { 0x90, 36, 100, 0x9f, 37, 101, 0x8a, 36, 0 },
+			{ make_note(0x90, 36, 100), make_note(0x9f, 37, 101), make_note(0x8a, 36, 0) } },
+		{ "realtime inside a message", { 0x99, 0xf8, 36, 0xfe, 100, 0xfa, 38, 0xfc, 90 },
+			{ make_note(0x99, 36, 100), make_note(0x99, 38, 90) } },
+		{ "sysex skipped, cancels running status", { 0x99, 36, 100, 0xf0, 0x7e, 36, 100, 0xf8, 0xf7, 38, 90 },
+			{ make_note(0x99, 36, 100) } },
+		{ "sysex without end", { 0xf0, 0x43, 36, 100, 0x99, 38, 90 },
+			{ make_note(0x99, 38, 90) } },
+		{ "system common skipped", { 0x99, 36, 100, 0xf2, 0x10, 0x20, 38, 90, 0xf3, 5, 0x98, 40, 1 },
+			{ make_note(0x99, 36, 100), make_note(0x98, 40, 1) } },
+		{ "data before any status", { 36, 100, 0x99, 38, 90 },
+			{ make_note(0x99, 38, 90) } },
+		{ "controllers and programs between notes", { 0xc9, 5, 6, 0x99, 36, 100, 0xb9, 4, 127, 4, 0, 0xd9, 3, 0x99, 38, 90 },
+			{ make_note(0x99, 36, 100), make_note(0x99, 38, 90) } },
+		{ "status interrupting a message", { 0x99, 36, 0x89, 38, 0 },
+			{ make_note(0x89, 38, 0) } },
+	};
+
+	printf("stream rules (whole stream in one interrupt / one byte per interrupt):\n");
+	int failures = 0;
+	for(size_t c=0; c<cases.size(); c++){
+		bool whole = same_events(run_isr(cases[c].bytes, (int)cases[c].bytes.size()), cases[c].expected);
+		bool single = same_events(run_isr(cases[c].bytes, 1), cases[c].expected);
+		printf("  %-40s %s / %s\n", cases[c].name, whole ? "ok" : "FAILED", single ? "ok" : "FAILED");
+		failures += !whole + !single;
+	}
+	printf("\n");
+	return failures;
+}
+
+//a random performance: the bytes, and the note events a correct parser must return
+static void make_performance(int numMessages, Bytes &bytes, Events &expected) {
+
+	bytes.clear();
+	expected.clear();
+	int running = 0;
+	for(int m=0; m<numMessages; m++){
+		//realtime bytes can land anywhere, so put them between bytes after the fact below
+		int kind = fuzz_range(16);
+		if(kind < 10){
+			//note on / off / velocity 0 off on any channel
+			int channel = fuzz_range(16);
+			int note = fuzz_range(128);
+			int velocity = kind < 7 ? 1 + fuzz_range(127) : 0;
+			int status = (kind < 9 ? MIDI_NOTE_ON : MIDI_NOTE_OFF) | channel;
+			if(status != running || fuzz_range(2)){
+				bytes.push_back((uint8_t)status);
+			}
+			bytes.push_back((uint8_t)note);
+			bytes.push_back((uint8_t)velocity);
+			running = status;
+			expected.push_back(make_note(velocity == 0 ? (MIDI_NOTE_OFF | channel) : status, note, velocity));
+		}
+		else if(kind < 13){
+			//controller, program change, pressure or pitch bend
+			static const int types[] = { 0xa0, 0xb0, 0xc0, 0xd0, 0xe0 };
+			int status = types[fuzz_range(5)] | fuzz_range(16);
+			if(status != running || fuzz_range(2)){
+				bytes.push_back((uint8_t)status);
+			}
+			bytes.push_back((uint8_t)fuzz_range(128));
+			if((status & 0xf0) != 0xc0 && (status & 0xf0) != 0xd0){
+				bytes.push_back((uint8_t)fuzz_range(128));
+			}
+			running = status;
+		}
+		else if(kind < 15){
+			//sysex of up to 40 data bytes
+			bytes.push_back(0xf0);
+			for(int n=fuzz_range(40); n>0; n--){
+				bytes.push_back((uint8_t)fuzz_range(128));
+			}
+			bytes.push_back(0xf7);
+			running = 0;
+		}
+		else{
+			//system common: MTC quarter frame, song position, song select, tune request
+			static const int common[] = { 0xf1, 0xf2, 0xf3, 0xf6 };
+			static const int length[] = { 1, 2, 1, 0 };
+			int c = fuzz_range(4);
+			bytes.push_back((uint8_t)common[c]);
+			for(int n=0; n<length[c]; n++){
+				bytes.push_back((uint8_t)fuzz_range(128));
+			}
+			running = 0;
+		}
+	}
+
+	//realtime between any two bytes
+	Bytes mixed;
+	for(size_t i=0; i<bytes.size(); i++){
+		if(fuzz_range(8) == 0){
+			static const int realtime[] = { 0xf8, 0xfa, 0xfb, 0xfc, 0xfe, 0xff };
+			mixed.push_back((uint8_t)realtime[fuzz_range(6)]);
+		}
+		mixed.push_back(bytes[i]);
+	}
+	bytes.swap(mixed);
+}
+
+static int fuzz(void) {
+
+	printf("fuzz:\n");
+	int failures = 0;
+
+	//generated performances: exact notes, whatever the interrupt sizes
+	long numBytes = 0, numNotes = 0;
+	int numRuns = 200;
+	for(int run=0; run<numRuns; run++){
+		Bytes bytes;
+		Events expected;
+		make_performance(500, bytes, expected);
+		Events got = run_isr(bytes, run % 4 == 0 ? 1 : 0);
+		if(!same_events(got, expected)){
+			if(failures == 0){
+				printf("  performance %d: %d notes expected, %d parsed\n", run, (int)expected.size(), (int)got.size());
+			}
+			failures++;
+		}
+		numBytes += (long)bytes.size();
+		numNotes += (long)expected.size();
+	}
+	printf("  %d performances, %ld bytes, %ld notes: %s\n", numRuns, numBytes, numNotes,
+			failures == 0 ? "every note parsed exactly" : "FAILED");
+
+	//garbage: no malformed events, and the interrupt sizes make no difference
+	int garbageFailures = 0;
+	long garbageEvents = 0;
+	for(int run=0; run<200; run++){
+		Bytes bytes(2000);
+		for(size_t i=0; i<bytes.size(); i++){
+			//lean on data bytes so some messages complete
+			bytes[i] = (uint8_t)(fuzz_range(4) ? fuzz_range(128) : 0x80 + fuzz_range(128));
+		}
+		Events single = run_isr(bytes, 1);
+		Events chunked = run_isr(bytes, 0);
+		bool ok = same_events(single, chunked);
+		for(size_t e=0; e<single.size(); e++){
+			ok = ok && midi_is_note(single[e]) && single[e].data1 < 0x80 && single[e].data2 < 0x80
+					&& !((single[e].status & 0xf0) == MIDI_NOTE_ON && single[e].data2 == 0);
+		}
+		garbageFailures += !ok;
+		garbageEvents += (long)single.size();
+	}
+	printf("  200 random byte streams, %ld notes found: %s\n\n", garbageEvents,
+			garbageFailures == 0 ? "all well formed, same for any interrupt size" : "FAILED");
+	return failures + garbageFailures;
+}
+
+//two bars of sixteenths on channel 10 as an e-kit sends them: running status, velocity 0
+//note offs, hi-hat pedal controller, MIDI clock and active sensing
+static Bytes kit_stream(void) {
+
+	Bytes bytes;
+	bytes.push_back(0x99);
+	for(int step=0; step<32; step++){
+		for(int t=0; t<6; t++){
+			bytes.push_back(0xf8);		//24 clocks per quarter note, 6 per sixteenth
+		}
+		if(step % 8 == 0){
+			bytes.push_back(0xfe);
+		}
+		bytes.push_back(42);			//closed hat
+		bytes.push_back((uint8_t)(60 + 20*(step % 2)));
+		if(step % 4 == 0){
+			bytes.push_back(36);		//kick
+			bytes.push_back(110);
+		}
+		if(step % 8 == 4){
+			bytes.push_back(38);		//snare
+			bytes.push_back(100);
+		}
+		bytes.push_back(0xb9);			//hi-hat pedal
+		bytes.push_back(4);
+		bytes.push_back((uint8_t)(step*4));
+		bytes.push_back(0x99);
+		bytes.push_back(42);
+		bytes.push_back(0);
+		if(step % 4 == 0){
+			bytes.push_back(36);
+			bytes.push_back(0);
+		}
+		if(step % 8 == 4){
+			bytes.push_back(38);
+			bytes.push_back(0);
+		}
+	}
+	return bytes;
+}
+
+static bool read_bytes(const char *path, Bytes &bytes) {
+
+	FILE *file = fopen(path, "rb");
+	if(!file){
+		return false;
+	}
+	uint8_t buffer[4096];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), file)) > 0){
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	}
+	fclose(file);
+	return true;
+}
+
+//host cycles per byte through midi_rx_callback_sharc1(), chunk bytes per interrupt
+static double time_isr(const Bytes &bytes, int chunk, long minBytes) {
+
+	midi_setup_sharc1();
+	midiClock.setup(48000);
+	long done = 0;
+	uint64_t c0 = bench_cycles();
+	while(done < minBytes){
+		for(size_t pos=0; pos<bytes.size(); pos+=chunk){
+			int n = pos + chunk > bytes.size() ? (int)(bytes.size() - pos) : chunk;
+			mock_uart_receive(&midi_uart_sharc1, &bytes[pos], n);
+			//the audio callback's side, so the queue never fills
+			midiQueue.reset();
+		}
+		done += (long)bytes.size();
+	}
+	uint64_t c1 = bench_cycles();
+	return (double)(c1 - c0)/done;
+}
+
+//host cycles per byte through the parser alone
+static double time_parser(const Bytes &bytes, long minBytes, long &notes) {
+
+	MidiParser parser;
+	parser.reset();
+	DrumMidiEvent event = make_note(0, 0, 0);
+	notes = 0;
+	long done = 0;
+	uint64_t c0 = bench_cycles();
+	while(done < minBytes){
+		for(size_t pos=0; pos<bytes.size(); pos++){
+			if(parser.feed(bytes[pos], event) && midi_is_note(event)){
+				notes++;
+			}
+		}
+		done += (long)bytes.size();
+	}
+	uint64_t c1 = bench_cycles();
+	return (double)(c1 - c0)/done;
+}
+
+int run_midi_parser_bench(const char *streamPath) {
+
+	fuzzState = 0x9e3779b9;
+	int failures = check_cases();
+	failures += fuzz();
+
+	Bytes bytes;
+	if(streamPath){
+		if(!read_bytes(streamPath, bytes) || bytes.empty()){
+			fprintf(stderr, "can't read MIDI bytes from %s\n", streamPath);
+			return 1;
+		}
+		printf("stream %s: %d bytes\n", streamPath, (int)bytes.size());
+	}
+	else{
+		bytes = kit_stream();
+		printf("built-in kit stream: %d bytes\n", (int)bytes.size());
+	}
+
+	long minBytes = 20000000;
+	long notes;
+	double parser = time_parser(bytes, minBytes, notes);
+	printf("  %ld note on/offs per pass\n", notes/((minBytes + (long)bytes.size() - 1)/(long)bytes.size()));
+	printf("  parser alone: %.1f host cycles/byte\n", parser);
+	printf("  %-24s %16s %22s\n", "bytes per interrupt", "cycles/byte", "cycles/s at 3125 B/s");
+	static const int chunks[] = { 1, 4, 16, 64 };
+	for(int c=0; c<4; c++){
+		double cost = time_isr(bytes, chunks[c], minBytes);
+		printf("  %-24d %16.1f %22.0f\n", chunks[c], cost, cost*3125);
+	}
+	printf("MIDI at 31250 baud delivers at most 3125 bytes/s; the SHARC has %.0f M cycles/s.\n",
+			SHARC_CORE_CLOCK_HZ/1e6);
+
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * midi_queue_bench.cpp
+ *
+ * drum_render --midiq: the timestamped MIDI event queue (drum_midi_queue.h).
+ *
+ * Plays hits that arrive at arbitrary cycles inside an audio period through DrumMidiClock and
+ * DrumEngine::renderQueued() the way the firmware does, and checks that every hit starts
+ * exactly one block after it arrived.  Then hammers the queue from a producer thread while a
+ * consumer thread drains it, checking order and the overflow count, and times push/pop and
+ * what starting hits at their offsets costs over starting them at the block start.  Fails when
+ * a hit starts late or early, or the queue loses or reorders an event it did not count.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_midi_queue.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//largest difference between a queued kick and the reference kick shifted by one block; they come
+//out identical, the limit only leaves room for rounding.  A kick one sample off misses it by far
+#define MIDIQ_TIMING_MAX_ERR	1e-5
+
+static DrumMidiEvent make_event(uint32_t time, int status, int note, int velocity) {
+
+	DrumMidiEvent event;
+	event.time = time;
+	event.status = (uint8_t)status;
+	event.data1 = (uint8_t)note;
+	event.data2 = (uint8_t)velocity;
+	return event;
+}
+
+//a kick arriving at sample `arrival`, played through the queue like processaudio_callback()
+static void render_queued_kick(long arrival, float *out, long numSamples, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	DrumMidiQueue queue;
+	queue.reset();
+	DrumMidiClock clock;
+	clock.setup((float)sampleRate);
+
+	double cyclesPerSample = DRUM_CORE_CLOCK_HZ/sampleRate;
+	bool sent = false;
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		uint32_t window = clock.periodStart();
+		clock.startPeriod(window + blockSize, (uint32_t)(pos*cyclesPerSample));
+		engine.renderQueued(queue, window, &out[pos], blockSize);
+
+		//the interrupt fires during this period, on the cycle the note arrives
+		if(!sent && arrival < pos + blockSize){
+			uint32_t cycles = (uint32_t)(arrival*cyclesPerSample);
+			queue.push(make_event(clock.now(cycles), MIDI_NOTE_ON | 9, DRUM_NOTE_KICK, 100));
+			queue.push(make_event(clock.now(cycles), MIDI_NOTE_OFF | 9, DRUM_NOTE_KICK, 0));
+			sent = true;
+		}
+	}
+}
+
+//the same kick started at sample 0
+static void render_reference_kick(float *out, long numSamples, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.noteOn(DRUM_NOTE_KICK);
+	engine.noteOff(DRUM_NOTE_KICK);
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		engine.render(&out[pos], blockSize);
+	}
+}
+
+//true if every kick starts exactly one block after it arrived
+static bool check_timing(int sampleRate, int blockSize) {
+
+	long numSamples = sampleRate/2;
+	numSamples -= numSamples % blockSize;
+	std::vector<float> ref(numSamples), out(numSamples);
+	render_reference_kick(ref.data(), numSamples, sampleRate, blockSize);
+
+	printf("hit timing (kick arriving at sample T must start at T + %d):\n", blockSize);
+	printf("%8s %12s %16s %18s\n", "T", "max |error|", "queued offset", "block boundary at");
+	long arrivals[] = { 0, 1, (long)blockSize/2, (long)blockSize - 1, 3*(long)blockSize + 7, 1000 };
+	bool allOk = true;
+	for(size_t a=0; a<sizeof(arrivals)/sizeof(arrivals[0]); a++){
+		long T = arrivals[a];
+		render_queued_kick(T, out.data(), numSamples, sampleRate, blockSize);
+
+		long start = T + blockSize;
+		double maxErr = 0;
+		for(long i=0; i<start && i<numSamples; i++){
+			maxErr = fmax(maxErr, fabs(out[i]));
+		}
+		for(long i=start; i<numSamples; i++){
+			maxErr = fmax(maxErr, fabs(out[i] - ref[i - start]));
+		}
+
+		//where the hit used to start: the first block boundary after it arrived
+		long boundary = (T/blockSize + 1)*blockSize;
+		bool ok = maxErr <= MIDIQ_TIMING_MAX_ERR;
+		allOk = allOk && ok;
+		printf("%8ld %12g %16ld %18ld   %s\n", T, maxErr, start - T, boundary, ok ? "ok" : "FAILED");
+	}
+	printf("\n");
+	return allOk;
+}
+
+//producer and consumer on two threads.  The producer sends bursts of events, like an interrupt
+//draining the UART, and never waits, so bursts bigger than the queue lose events.  True if every
+//event was either received in order or counted as an overflow
+static bool check_threads(long numEvents, int burst) {
+
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	queue->reset();
+
+	long received = 0;
+	long outOfOrder = 0;
+	std::thread consumer([&]() {
+		uint32_t last = 0;
+		bool first = true;
+		DrumMidiEvent event;
+		long seen = 0;
+		while(seen + (long)queue->overflows < numEvents){
+			if(!queue->peek(event)){
+				continue;
+			}
+			if(!first && event.time <= last){
+				outOfOrder++;
+			}
+			first = false;
+			last = event.time;
+			queue->pop();
+			seen++;
+		}
+		received = seen;
+	});
+
+	for(long e=0; e<numEvents; e++){
+		queue->push(make_event((uint32_t)e, MIDI_NOTE_ON, (int)(e & 0x7f), 100));
+		if(e % burst == burst - 1){
+			//let the consumer catch up between bursts, it sleeps if the consumer has no core of its own
+			while(queue->depth() != 0){
+				std::this_thread::yield();
+			}
+		}
+	}
+	consumer.join();
+
+	bool ok = received + (long)queue->overflows == numEvents && outOfOrder == 0;
+	printf("%10ld %10d %10ld %10u %10u %12ld %s\n", numEvents, burst, received, (unsigned)queue->overflows,
+			(unsigned)queue->maxDepth, outOfOrder, ok ? "ok" : "FAILED");
+	delete queue;
+	return ok;
+}
+
+//blocks between the resets of time_events(), few enough that its hits never fill the pool
+#define MIDIQ_BURST_BLOCKS	4
+
+//runs of time_events(); each block's cost is its least
+#define MIDIQ_PASSES		5
+
+//cycles per sample of renderQueued() with every drum held and eventsPerBlock hits spread over each
+//block, started at their offsets, or all at the block start (`atOffsets` false).  The engine is
+//reset every MIDIQ_BURST_BLOCKS blocks, outside the timing, so no hit has to steal a voice
+static double time_events(int eventsPerBlock, bool atOffsets, double seconds, int sampleRate, int blockSize) {
+
+	const int *notes = drum_notes();
+
+	DrumEngine engine;
+	DrumMidiQueue queue;
+	queue.reset();
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	std::vector<uint64_t> least(numBlocks, ~(uint64_t)0);
+
+	for(int pass=0; pass<MIDIQ_PASSES; pass++){
+		engine.setup((float)sampleRate);
+		for(long b=0; b<numBlocks; b++){
+			if(b % MIDIQ_BURST_BLOCKS == 0){
+				engine.reset();
+				for(int d=0; d<DRUM_NUM_TYPES; d++){
+					engine.noteOn(notes[d]);
+				}
+			}
+			uint32_t window = (uint32_t)(b*blockSize);
+			for(int e=0; e<eventsPerBlock; e++){
+				uint32_t t = atOffsets ? window + (uint32_t)((e*blockSize)/eventsPerBlock + 1) : window;
+				queue.push(make_event(t, MIDI_NOTE_ON, notes[(b*eventsPerBlock + e) % DRUM_NUM_TYPES], 100));
+			}
+			uint64_t c0 = bench_cycles();
+			engine.renderQueued(queue, window, block.data(), blockSize);
+			uint64_t c1 = bench_cycles();
+			if(c1 - c0 < least[b]){
+				least[b] = c1 - c0;
+			}
+		}
+	}
+	double cycles = 0;
+	for(long b=0; b<numBlocks; b++){
+		cycles += least[b];
+	}
+	return cycles/((double)numBlocks*blockSize);
+}
+
+int run_midi_queue_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 2;
+	}
+
+	printf("queue: %d events of %d bytes, rate %d Hz, block %d\n\n", DRUM_MIDI_QUEUE_SIZE,
+			(int)sizeof(DrumMidiEvent), sampleRate, blockSize);
+
+	int failures = 0;
+	failures += !check_timing(sampleRate, blockSize);
+
+	printf("producer/consumer threads:\n");
+	printf("%10s %10s %10s %10s %10s %12s\n", "pushed", "burst", "received", "overflows", "max depth", "out of order");
+	failures += !check_threads(1000000, 64);
+	failures += !check_threads(1000000, DRUM_MIDI_QUEUE_SIZE);
+	failures += !check_threads(1000000, 1000);
+	printf("\n");
+
+	//push/pop pairs on one thread
+	DrumMidiQueue queue;
+	queue.reset();
+	long numOps = 10000000;
+	DrumMidiEvent event = make_event(0, MIDI_NOTE_ON, 60, 100);
+	DrumMidiEvent out = event;
+	uint32_t sum = 0;
+	uint64_t c0 = bench_cycles();
+	for(long i=0; i<numOps; i++){
+		event.time = (uint32_t)i;
+		queue.push(event);
+		queue.peek(out);
+		queue.pop();
+		sum += out.time;
+	}
+	uint64_t c1 = bench_cycles();
+	printf("push + peek + pop: %.1f host cycles   (checksum %u)\n", (double)(c1 - c0)/numOps, (unsigned)sum);
+
+	//hits at their offsets against the same hits at the block start; a hit at an offset renders
+	//that many samples fewer in its first block, and costs nothing else
+	printf("renderQueued with every drum held, cycles/sample:\n");
+	printf("  0 hits/block: %.1f\n", time_events(0, true, seconds, sampleRate, blockSize));
+	for(int e=1; e<=4; e*=2){
+		double atStart = time_events(e, false, seconds, sampleRate, blockSize);
+		double atOffsets = time_events(e, true, seconds, sampleRate, blockSize);
+		printf("  %d hits/block: %.1f at their offsets, %.1f at the block start (%.2fx)\n", e, atOffsets, atStart,
+				atOffsets/atStart);
+	}
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
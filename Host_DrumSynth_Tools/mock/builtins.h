@@ -0,0 +1,20 @@
+/*
+ * builtins.h
+ *
+ * Host stand-in for the CCES compiler builtins the firmware uses.  emuclk() returns
+ * mock_emuclk_cycles, which the host tools set to whatever core cycle they are simulating.
+ */
+
+#ifndef MOCK_BUILTINS_H_
+#define MOCK_BUILTINS_H_
+
+#include <stdint.h>
+
+extern uint32_t mock_emuclk_cycles;
+
+static inline uint32_t emuclk(void) {
+
+	return mock_emuclk_cycles;
+}
+
+#endif /* MOCK_BUILTINS_H_ */
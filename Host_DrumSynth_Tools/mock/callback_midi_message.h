@@ -0,0 +1,13 @@
+/*
+ * callback_midi_message.h
+ *
+ * Host stand-in for the framework header declaring the MIDI hooks in callback_midi_message.cpp.
+ */
+
+#ifndef MOCK_CALLBACK_MIDI_MESSAGE_H_
+#define MOCK_CALLBACK_MIDI_MESSAGE_H_
+
+bool midi_setup_sharc1(void);
+void midi_rx_callback_sharc1(void);
+
+#endif /* MOCK_CALLBACK_MIDI_MESSAGE_H_ */
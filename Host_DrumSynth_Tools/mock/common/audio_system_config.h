@@ -0,0 +1,13 @@
+/*
+ * audio_system_config.h
+ *
+ * Host stand-in for the framework's audio system configuration: only what the firmware sources
+ * built by the host tools refer to.
+ */
+
+#ifndef MOCK_AUDIO_SYSTEM_CONFIG_H_
+#define MOCK_AUDIO_SYSTEM_CONFIG_H_
+
+#define MIDI_UART_MANAGED_BY_SHARC1_CORE	1
+
+#endif /* MOCK_AUDIO_SYSTEM_CONFIG_H_ */
@@ -0,0 +1,10 @@
+/*
+ * bm_event_logging.h
+ *
+ * Host stand-in for the framework's event logging driver; nothing the host tools build logs.
+ */
+
+#ifndef MOCK_BM_EVENT_LOGGING_H_
+#define MOCK_BM_EVENT_LOGGING_H_
+
+#endif /* MOCK_BM_EVENT_LOGGING_H_ */
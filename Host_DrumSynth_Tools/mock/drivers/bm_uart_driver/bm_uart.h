@@ -0,0 +1,91 @@
+/*
+ * bm_uart.h
+ *
+ * Host stand-in for the framework's UART driver, enough to run midi_rx_callback_sharc1().
+ *
+ * Received bytes wait in a software FIFO like the driver's.  mock_uart_receive() plays the
+ * driver's receive interrupt: it adds a run of bytes to the FIFO and calls the rx callback,
+ * which reads them back with uart_available() / uart_read_byte().
+ */
+
+#ifndef MOCK_BM_UART_H_
+#define MOCK_BM_UART_H_
+
+#include <stdint.h>
+
+#define MOCK_UART_FIFO_SIZE		1024
+
+typedef enum {
+	UART_SUCCESS,
+	UART_RX_EMPTY,
+	UART_RX_OVERFLOW
+} BM_UART_RESULT;
+
+typedef enum {
+	UART_BAUD_RATE_MIDI = 31250
+} BM_UART_BAUD_RATE;
+
+typedef enum {
+	UART_SERIAL_8N1
+} BM_UART_CONFIG;
+
+typedef enum {
+	UART_AUDIOPROJ_DEVICE_MIDI
+} BM_UART_PERIPHERAL_NUMBER;
+
+typedef struct {
+	uint8_t fifo[MOCK_UART_FIFO_SIZE];
+	uint32_t head;				//next byte the "hardware" writes
+	uint32_t tail;				//next byte uart_read_byte() returns
+	uint32_t overflows;			//bytes lost because the FIFO was full
+	void (*rx_callback)(void);
+} BM_UART;
+
+static inline BM_UART_RESULT uart_initialize(BM_UART *device, BM_UART_BAUD_RATE baud, BM_UART_CONFIG config,
+		BM_UART_PERIPHERAL_NUMBER device_num) {
+
+	(void)baud;
+	(void)config;
+	(void)device_num;
+	device->head = 0;
+	device->tail = 0;
+	device->overflows = 0;
+	device->rx_callback = 0;
+	return UART_SUCCESS;
+}
+
+static inline void uart_set_rx_callback(BM_UART *device, void (*callback)(void)) {
+
+	device->rx_callback = callback;
+}
+
+static inline uint16_t uart_available(BM_UART *device) {
+
+	return (uint16_t)(device->head - device->tail);
+}
+
+static inline BM_UART_RESULT uart_read_byte(BM_UART *device, uint8_t *val) {
+
+	if(device->head == device->tail){
+		return UART_RX_EMPTY;
+	}
+	*val = device->fifo[device->tail++ % MOCK_UART_FIFO_SIZE];
+	return UART_SUCCESS;
+}
+
+//bytes arrive from the wire, then the receive interrupt runs the callback
+static inline void mock_uart_receive(BM_UART *device, const uint8_t *bytes, int numBytes) {
+
+	for(int i=0; i<numBytes; i++){
+		if(device->head - device->tail >= MOCK_UART_FIFO_SIZE){
+			device->overflows++;
+			continue;
+		}
+		device->fifo[device->head++ % MOCK_UART_FIFO_SIZE] = bytes[i];
+	}
+	if(device->rx_callback){
+		device->rx_callback();
+	}
+}
+
+#endif /* MOCK_BM_UART_H_ */
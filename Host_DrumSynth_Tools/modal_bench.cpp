@@ -0,0 +1,295 @@
+/*
+ * modal_bench.cpp
+ *
+ * drum_render --modal: the toms on the modal resonators of drum_modal.h.  Checks a hit through
+ * every render path against its modes evaluated in double precision, scores the modal and the FM
+ * toms against their recordings, times a held voice of each on the engine against the SHARC
+ * budget, keeps the rings' amplitude through a retune by the knob, and measures what the reduced
+ * quality saves and costs.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_sample_cache.h"
+#include "bench_timer.h"
+#include "drum_reference.h"
+#include "host_tools.h"
+
+//lowest acceptable SNR of a modal tom against its modes
+#define MODAL_MIN_SNR_DB		50.0
+
+//most a retune by the knob may change the energy of a ringing voice, dB
+#define MODAL_MAX_RETUNE_DB		0.1
+
+//what the fitted modal toms measure, with a little room, so that a worse fit or render fails:
+//the most mean |dB| from the recording at full and reduced quality, and the least SNR of the
+//reduced modes from tailStart on, by DrumModalType.  The fits are not close (drum_modal.h), so
+//these are regression limits, not a quality bar
+static const double modalMaxScore[DRUM_MODAL_NUM_TYPES] = { 4.2, 3.1, 2.6 };
+static const double modalMinReducedSnrDb[DRUM_MODAL_NUM_TYPES] = { 30.0, 16.0, 3.5 };
+
+enum {
+	MODAL_PATH_VOICE_OUTER = 0,
+	MODAL_PATH_SAMPLE_OUTER,
+	MODAL_PATH_CACHED,
+	MODAL_NUM_PATHS
+};
+
+static const char *modalPathNames[MODAL_NUM_PATHS] = { "voice outer", "sample outer", "cached" };
+
+//samples of the drum's hit
+static long hit_length(int drum, int sampleRate) {
+
+	return (long)floor(drumPatches[drum].r*sampleRate + 1e-3) + 1;
+}
+
+//the hit from its modes in double precision: the attack ramp times the decaying sinusoids
+static void render_modes(int drum, int sampleRate, int numModes, double *out, long numSamples) {
+
+	const DrumPatch &patch = drumPatches[drum];
+	const DrumModalPatch &mp = drumModalPatches[patch.modal];
+	long rampLength = (long)floor(mp.attack*sampleRate + 1e-3);
+	for(long i=0; i<numSamples; i++){
+		double t = (double)i/sampleRate;
+		double y = 0;
+		for(int k=0; k<numModes && k<mp.numModes; k++){
+			const DrumModalMode &m = mp.mode[k];
+			y += m.amp*exp(-t/m.tau)*sin(2*M_PI*m.freq*t + m.phase);
+		}
+		out[i] = patch.synthGain*y*(i < rampLength ? (double)i/rampLength : 1);
+	}
+}
+
+//a hit through the engine, on the modal resonators or the FM operators, at reduced quality from
+//tailStart on if reducedTail
+static void render_hit(int drum, bool modal, int path, DrumSampleCache *cache, bool reducedTail, int sampleRate,
+		int blockSize, float *out, long numSamples) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.modal[drum] = modal;
+	if(path == MODAL_PATH_SAMPLE_OUTER){
+		engine.loopOrder = DRUM_SAMPLE_OUTER;
+	}
+	if(path == MODAL_PATH_CACHED){
+		engine.cache = cache;
+	}
+	engine.noteOn(drumPatches[drum].note);
+	engine.noteOff(drumPatches[drum].note);
+	DrumVoice &v = engine.pool.voices[engine.pool.active[0]];
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		if(reducedTail && v.counter >= engine.tailStart[drum]){
+			v.reduced = true;
+		}
+		int n = numSamples - pos < blockSize ? (int)(numSamples - pos) : blockSize;
+		engine.render(&out[pos], n);
+	}
+}
+
+static double snr_db(const double *ref, const float *x, long n) {
+
+	double noise = 0, signal = 0;
+	for(long i=0; i<n; i++){
+		noise += (x[i] - ref[i])*(x[i] - ref[i]);
+		signal += ref[i]*ref[i];
+	}
+	return 10*log10(signal/(noise + 1e-30));
+}
+
+//cycles per sample of the engine with the drum's note held, at reduced quality if reduced
+static double time_engine(int drum, bool modal, bool reduced, double seconds, int sampleRate, int blockSize,
+		float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.modal[drum] = modal;
+	engine.noteOn(drumPatches[drum].note);
+
+	std::vector<float> block(blockSize);
+	engine.render(block.data(), blockSize);
+	engine.pool.voices[engine.pool.active[0]].reduced = reduced;
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+//energy of the resonators of the engine's only voice
+static double ring_energy(const DrumEngine &engine) {
+
+	const DrumModalVoice &s = engine.pool.voices[engine.pool.active[0]].bank;
+	double e = 0;
+	for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+		e += (double)s.re[k]*s.re[k] + (double)s.im[k]*s.im[k];
+	}
+	return e;
+}
+
+//energy of a ringing voice the knob retunes to pot, against one it leaves alone, dB
+static double retune_db(int drum, float pot, bool smooth, int sampleRate, int blockSize) {
+
+	DrumEngine still, turned;
+	DrumEngine *engines[2] = { &still, &turned };
+	std::vector<float> block(blockSize);
+	long blocks = (long)(0.1*sampleRate)/blockSize;
+	for(int e=0; e<2; e++){
+		DrumEngine &engine = *engines[e];
+		engine.setup((float)sampleRate);
+		engine.modal[drum] = true;
+		engine.smoothControls = smooth;
+		engine.noteOn(drumPatches[drum].note);
+		for(long b=0; b<blocks; b++){
+			if(e == 1 && b == blocks/2){
+				float *pots[] = { &engine.pot0, &engine.pot1, &engine.pot2 };
+				*pots[drumPatches[drum].knob] = pot;
+			}
+			engine.render(block.data(), blockSize);
+		}
+	}
+	return 10*log10(ring_energy(turned)/ring_energy(still));
+}
+
+int run_modal_bench(double seconds, int sampleRate, int blockSize, const char *recordingDir) {
+
+	if(seconds <= 0){
+		seconds = 2;
+	}
+
+	drum_fm_init();
+
+	printf("rate %d Hz, block %d, %.1f s per timing\n\n", sampleRate, blockSize, seconds);
+
+	DrumSampleCache *cache = new DrumSampleCache;
+	cache->setup((float)sampleRate);
+	cache->renderAll();
+
+	printf("one hit against its modes in double precision (SNR at least %.0f dB):\n", MODAL_MIN_SNR_DB);
+	printf("%-10s %5s %-13s %9s %14s %13s\n", "drum", "modes", "path", "samples", "max abs err", "SNR");
+	bool ok = true;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].modal < 0){
+			continue;
+		}
+		long n = hit_length(d, sampleRate);
+		std::vector<double> ref(n);
+		std::vector<float> out(n);
+		render_modes(d, sampleRate, DRUM_MODAL_MAX_MODES, ref.data(), n);
+		for(int p=0; p<MODAL_NUM_PATHS; p++){
+			render_hit(d, true, p, cache, false, sampleRate, blockSize, out.data(), n);
+			double maxErr = 0;
+			for(long i=0; i<n; i++){
+				maxErr = fmax(maxErr, fabs(out[i] - ref[i]));
+			}
+			double snr = snr_db(ref.data(), out.data(), n);
+			bool pathOk = snr >= MODAL_MIN_SNR_DB;
+			printf("%-10s %5d %-13s %9ld %14.3g %10.1f dB   %s\n", drumPatches[d].name,
+					drumModalPatches[drumPatches[d].modal].numModes, modalPathNames[p], n, maxErr, snr,
+					pathOk ? "ok" : "FAIL");
+			ok = ok && pathOk;
+		}
+	}
+
+	printf("\nagainst the recordings (mean |dB| between spectrograms, lower is closer; the modal toms closer than\n"
+			"the FM ones, and within their limit):\n");
+	printf("%-10s %-14s %10s %10s %10s %10s\n", "drum", "recording", "FM", "reduced", "modal", "reduced");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		std::vector<float> recording;
+		int recordingRate = 0;
+		if(drumPatches[d].modal < 0){
+			continue;
+		}
+		if(!drum_reference_load_recording(recordingDir, d, recording, recordingRate)){
+			printf("%-10s %-14s %10s %10s %10s %10s\n", drumPatches[d].name, "(not found)", "-", "-", "-", "-");
+			continue;
+		}
+		long n = hit_length(d, recordingRate);
+		if(n > (long)recording.size()){
+			n = (long)recording.size();
+		}
+		std::vector<double> recordingDb;
+		drum_reference_stft_db(recording.data(), n, recordingDb);
+		printf("%-10s %-14s", drumPatches[d].name, drum_reference_recording(d));
+		std::vector<float> out(n);
+		double score[4];
+		for(int c=0; c<4; c++){
+			render_hit(d, c >= 2, MODAL_PATH_VOICE_OUTER, 0, c%2 == 1, recordingRate, blockSize, out.data(), n);
+			score[c] = drum_reference_score(recordingDb, out.data(), n);
+			printf(" %10.3f", score[c]);
+		}
+		double limit = modalMaxScore[drumPatches[d].modal];
+		bool scoreOk = score[2] < score[0] && score[3] < score[1] && score[2] <= limit && score[3] <= limit;
+		printf("   %s\n", scoreOk ? "ok" : "FAILED");
+		ok = ok && scoreOk;
+	}
+
+	float checksum = 0;
+	printf("\none held voice through the engine, cycles/sample:\n");
+	printf("%-10s %10s %10s %10s %10s %10s\n", "drum", "FM", "reduced", "modal", "reduced", "of budget");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].modal < 0){
+			continue;
+		}
+		double f = time_engine(d, false, false, seconds, sampleRate, blockSize, checksum);
+		double fr = time_engine(d, false, true, seconds, sampleRate, blockSize, checksum);
+		double m = time_engine(d, true, false, seconds, sampleRate, blockSize, checksum);
+		double mr = time_engine(d, true, true, seconds, sampleRate, blockSize, checksum);
+		printf("%-10s %10.1f %10.1f %10.1f %10.1f %9.2f%%\n", drumPatches[d].name, f, fr, m, mr,
+				100*m/SHARC_CYCLES_PER_SAMPLE);
+	}
+	printf("(checksum %g)\n", checksum);
+
+	printf("\nreduced quality: the strongest %d modes against all of them, from where the admission reduces a\n"
+			"voice (tailStart) on:\n", DRUM_MODAL_REDUCED_MODES);
+	printf("%-10s %10s %13s %13s\n", "drum", "tailStart", "SNR", "least");
+	DrumEngine tails;
+	tails.setup((float)sampleRate);
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].modal < 0){
+			continue;
+		}
+		long n = hit_length(d, sampleRate);
+		std::vector<double> full(n), reduced(n);
+		std::vector<float> reducedFloat(n);
+		render_modes(d, sampleRate, DRUM_MODAL_MAX_MODES, full.data(), n);
+		render_modes(d, sampleRate, DRUM_MODAL_REDUCED_MODES, reduced.data(), n);
+		for(long i=0; i<n; i++){
+			reducedFloat[i] = (float)reduced[i];
+		}
+		long tail = tails.tailStart[d] < n ? tails.tailStart[d] : n - 1;
+		double snr = snr_db(&full[tail], &reducedFloat[tail], n - tail);
+		double least = modalMinReducedSnrDb[drumPatches[d].modal];
+		printf("%-10s %10ld %10.1f dB %10.1f dB   %s\n", drumPatches[d].name, tail, snr, least,
+				snr >= least ? "ok" : "FAILED");
+		ok = ok && snr >= least;
+	}
+
+	printf("\nenergy of a ringing voice after the knob retunes it, against one left alone (within %.1f dB):\n",
+			MODAL_MAX_RETUNE_DB);
+	printf("%-10s %6s %14s %14s\n", "drum", "pot", "stepped dB", "ramped dB");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].modal < 0 || drumPatches[d].knob == DRUM_KNOB_NONE){
+			continue;
+		}
+		const float pots[] = { 0.5f, 1 };
+		for(int p=0; p<2; p++){
+			double stepped = retune_db(d, pots[p], false, sampleRate, blockSize);
+			double ramped = retune_db(d, pots[p], true, sampleRate, blockSize);
+			bool retuneOk = fabs(stepped) <= MODAL_MAX_RETUNE_DB && fabs(ramped) <= MODAL_MAX_RETUNE_DB;
+			printf("%-10s %6.2f %14.4f %14.4f   %s\n", drumPatches[d].name, pots[p], stepped, ramped,
+					retuneOk ? "ok" : "FAIL");
+			ok = ok && retuneOk;
+		}
+	}
+
+	delete cache;
+
+	printf("\ncycles/sample are host cycles; the budget is %.0f SHARC cycles/sample.\n", SHARC_CYCLES_PER_SAMPLE);
+	return ok ? 0 : 1;
+}
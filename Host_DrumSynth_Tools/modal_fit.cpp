@@ -0,0 +1,474 @@
+/*
+ * modal_fit.cpp
+ *
+ * drum_render --modalfit: the modes of the toms' recordings, for the modal resonators of
+ * drum_modal.h.
+ *
+ * The ring of a recording from its peak to the end of the drum (the patch's r) is fitted as a
+ * sum of exponentially decaying sinusoids,
+ *   x(t) = sum_k exp(-s_k*t)*(a_k*sin(w_k*t) + b_k*cos(w_k*t)):
+ *   1. candidate frequencies are the highest peaks of its Hann windowed, zero padded spectrum
+ *      between MODAL_FIT_LOW_HZ and MODAL_FIT_HIGH_HZ, at least MODAL_FIT_SPACING_HZ apart;
+ *   2. their decays come from the slope of the log magnitude of the ring heterodyned down by each
+ *      of them, in frames of MODAL_FIT_FRAME seconds;
+ *   3. a and b follow by linear least squares, then all frequencies, decays, a and b are refined
+ *      together by Levenberg-Marquardt;
+ *   4. the DRUM_MODAL_MAX_MODES with the most energy are kept and refined again.
+ * Amplitude and phase are then moved back to t = 0 of the recording, where the voice starts, and
+ * scaled so the recording's peak comes out at the patch's A, the level of the FM tom.
+ *
+ * Every recording is fitted on a thread of its own.  The modes are printed with the SNR of the
+ * fit against the ring, and the drumModalPatches[] table of drum_modal.h is emitted (to stdout,
+ * or to the file given with -o) so it can replace the one in the firmware as it is.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <complex>
+#include <thread>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_reference.h"
+#include "spectrum.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//band the candidate modes are looked for in, and how close two may be
+#define MODAL_FIT_LOW_HZ		30.0
+#define MODAL_FIT_HIGH_HZ		8000.0
+#define MODAL_FIT_SPACING_HZ	5.0
+
+//modes fitted before the strongest DRUM_MODAL_MAX_MODES are kept
+#define MODAL_FIT_CANDIDATES	(2*DRUM_MODAL_MAX_MODES)
+
+//heterodyne frames for the first guess at each decay, and the frames that count: down to this
+//far below the loudest one
+#define MODAL_FIT_FRAME			0.04
+#define MODAL_FIT_FRAME_DB		40.0
+
+//Levenberg-Marquardt iterations per fit
+#define MODAL_FIT_ITERATIONS	60
+
+//decays a mode may have, 1/s
+#define MODAL_FIT_MIN_DECAY		0.5
+#define MODAL_FIT_MAX_DECAY		100.0
+
+//SNR of the fits of the recordings the table in drum_modal.h came from, by DrumModalType, less
+//0.5 dB: a change to the fit that does worse on them fails
+static const double modalFitMinSnrDb[DRUM_MODAL_NUM_TYPES] = { 9.8, 12.7, 9.0 };
+
+//a, b, w (rad/s), s (1/s) of one mode, over t from the peak
+struct FitMode {
+	double a, b, w, s;
+};
+
+struct ModalFitResult {
+	bool ok;
+	int sampleRate;
+	double timePeak;
+	double peak;
+	double seconds;		//length of the ring fitted
+	double snrDb;
+	int numCandidates;
+	std::vector<FitMode> modes;
+};
+
+//the model and its error against x[], and if J is not NULL the normal equations J'J and J'r
+static double evaluate(const std::vector<FitMode> &modes, const float *x, int n, int sampleRate,
+		std::vector<double> *JtJ, std::vector<double> *Jtr) {
+
+	int numParams = 4*(int)modes.size();
+	if(JtJ != 0){
+		JtJ->assign(numParams*numParams, 0);
+		Jtr->assign(numParams, 0);
+	}
+	std::vector<double> J(numParams);
+	double cost = 0;
+	for(int i=0; i<n; i++){
+		double t = (double)i/sampleRate;
+		double y = 0;
+		for(size_t k=0; k<modes.size(); k++){
+			const FitMode &m = modes[k];
+			double e = exp(-m.s*t), sn = sin(m.w*t), cs = cos(m.w*t);
+			double v = e*(m.a*sn + m.b*cs);
+			y += v;
+			J[4*k] = e*sn;
+			J[4*k + 1] = e*cs;
+			J[4*k + 2] = e*t*(m.a*cs - m.b*sn);
+			J[4*k + 3] = -t*v;
+		}
+		double r = x[i] - y;
+		cost += r*r;
+		if(JtJ != 0){
+			for(int p=0; p<numParams; p++){
+				(*Jtr)[p] += J[p]*r;
+				double *row = &(*JtJ)[p*numParams];
+				for(int q=0; q<=p; q++){
+					row[q] += J[p]*J[q];
+				}
+			}
+		}
+	}
+	if(JtJ != 0){
+		for(int p=0; p<numParams; p++){
+			for(int q=0; q<p; q++){
+				(*JtJ)[q*numParams + p] = (*JtJ)[p*numParams + q];
+			}
+		}
+	}
+	return cost;
+}
+
+//solve A x = b in place by Gaussian elimination with partial pivoting; false if A is singular
+static bool solve(std::vector<double> A, std::vector<double> &b) {
+
+	int n = (int)b.size();
+	for(int c=0; c<n; c++){
+		int pivot = c;
+		for(int r=c+1; r<n; r++){
+			if(fabs(A[r*n + c]) > fabs(A[pivot*n + c])){
+				pivot = r;
+			}
+		}
+		if(A[pivot*n + c] == 0){
+			return false;
+		}
+		if(pivot != c){
+			for(int k=0; k<n; k++){
+				std::swap(A[c*n + k], A[pivot*n + k]);
+			}
+			std::swap(b[c], b[pivot]);
+		}
+		for(int r=c+1; r<n; r++){
+			double f = A[r*n + c]/A[c*n + c];
+			for(int k=c; k<n; k++){
+				A[r*n + k] -= f*A[c*n + k];
+			}
+			b[r] -= f*b[c];
+		}
+	}
+	for(int c=n-1; c>=0; c--){
+		for(int k=c+1; k<n; k++){
+			b[c] -= A[c*n + k]*b[k];
+		}
+		b[c] /= A[c*n + c];
+	}
+	return true;
+}
+
+//a and b of every mode by linear least squares, the frequencies and decays as they are
+static void solve_amplitudes(std::vector<FitMode> &modes, const float *x, int n, int sampleRate) {
+
+	int numParams = 4*(int)modes.size(), numModes = (int)modes.size();
+	std::vector<double> JtJ, Jtr;
+	for(int k=0; k<numModes; k++){
+		modes[k].a = modes[k].b = 0;
+	}
+	evaluate(modes, x, n, sampleRate, &JtJ, &Jtr);
+	std::vector<double> A(4*numModes*numModes), b(2*numModes);
+	for(int p=0; p<2*numModes; p++){
+		int pp = 4*(p/2) + p%2;
+		b[p] = Jtr[pp];
+		for(int q=0; q<2*numModes; q++){
+			A[p*2*numModes + q] = JtJ[pp*numParams + 4*(q/2) + q%2];
+		}
+	}
+	if(solve(A, b)){
+		for(int k=0; k<numModes; k++){
+			modes[k].a = b[2*k];
+			modes[k].b = b[2*k + 1];
+		}
+	}
+}
+
+//Levenberg-Marquardt on every parameter of every mode; returns the final error
+static double refine(std::vector<FitMode> &modes, const float *x, int n, int sampleRate) {
+
+	int numParams = 4*(int)modes.size();
+	std::vector<double> JtJ, Jtr;
+	double cost = evaluate(modes, x, n, sampleRate, &JtJ, &Jtr);
+	double lambda = 1e-3;
+	for(int it=0; it<MODAL_FIT_ITERATIONS; it++){
+		bool better = false;
+		while(lambda < 1e12){
+			std::vector<double> A = JtJ, step = Jtr;
+			for(int p=0; p<numParams; p++){
+				A[p*numParams + p] *= 1 + lambda;
+			}
+			if(!solve(A, step)){
+				lambda *= 10;
+				continue;
+			}
+			std::vector<FitMode> trial = modes;
+			for(size_t k=0; k<trial.size(); k++){
+				trial[k].a += step[4*k];
+				trial[k].b += step[4*k + 1];
+				trial[k].w += step[4*k + 2];
+				trial[k].s += step[4*k + 3];
+				trial[k].s = std::min(std::max(trial[k].s, MODAL_FIT_MIN_DECAY), MODAL_FIT_MAX_DECAY);
+				trial[k].w = std::min(std::max(trial[k].w, 2*M_PI*MODAL_FIT_LOW_HZ), 2*M_PI*MODAL_FIT_HIGH_HZ);
+			}
+			double c = evaluate(trial, x, n, sampleRate, 0, 0);
+			if(c < cost){
+				bool converged = cost - c < 1e-10*cost;
+				modes = trial;
+				cost = evaluate(modes, x, n, sampleRate, &JtJ, &Jtr);
+				lambda = std::max(lambda/10, 1e-9);
+				better = !converged;
+				break;
+			}
+			lambda *= 10;
+		}
+		if(!better){
+			break;
+		}
+	}
+	return cost;
+}
+
+//energy of a mode over the ring
+static double mode_energy(const FitMode &m, double seconds) {
+
+	return (m.a*m.a + m.b*m.b)*(1 - exp(-2*m.s*seconds))/(4*m.s);
+}
+
+static void fit_recording(const char *dir, int drum, ModalFitResult *result) {
+
+	ModalFitResult &res = *result;
+	res.ok = false;
+
+	std::vector<float> samples;
+	if(!drum_reference_load_recording(dir, drum, samples, res.sampleRate) || samples.empty()){
+		return;
+	}
+	int fs = res.sampleRate;
+
+	//the ring: from the loudest sample to the end of the drum
+	long peakPos = 0;
+	for(long i=0; i<(long)samples.size(); i++){
+		if(fabsf(samples[i]) > fabsf(samples[peakPos])){
+			peakPos = i;
+		}
+	}
+	res.timePeak = (double)peakPos/fs;
+	res.peak = fabsf(samples[peakPos]);
+	long end = (long)(drumPatches[drum].r*fs);
+	if(end > (long)samples.size()){
+		end = (long)samples.size();
+	}
+	int n = (int)(end - peakPos);
+	if(n < fs/20){
+		return;
+	}
+	const float *x = &samples[peakPos];
+	res.seconds = (double)n/fs;
+
+	//1. spectral peaks of the ring
+	int fftSize = 1;
+	while(fftSize < 8*n){
+		fftSize <<= 1;
+	}
+	std::vector<std::complex<double> > spectrum(fftSize);
+	for(int i=0; i<n; i++){
+		spectrum[i] = x[i]*(0.5 - 0.5*cos(2*M_PI*i/n));
+	}
+	spectrum_fft(spectrum.data(), fftSize);
+	std::vector<double> mag(fftSize/2);
+	for(int k=0; k<fftSize/2; k++){
+		mag[k] = std::abs(spectrum[k]);
+	}
+	double binHz = (double)fs/fftSize;
+	int lo = (int)(MODAL_FIT_LOW_HZ/binHz), hi = (int)(std::min(MODAL_FIT_HIGH_HZ, 0.45*fs)/binHz);
+	std::vector<int> bins;
+	for(int k=lo; k<hi; k++){
+		if(mag[k] > mag[k - 1] && mag[k] >= mag[k + 1]){
+			bins.push_back(k);
+		}
+	}
+	std::sort(bins.begin(), bins.end(), [&](int a, int b) { return mag[a] > mag[b]; });
+	std::vector<double> freqs;
+	for(size_t c=0; c<bins.size() && (int)freqs.size()<MODAL_FIT_CANDIDATES; c++){
+		//parabolic interpolation on the log magnitude
+		int k = bins[c];
+		double l = log(mag[k - 1]), m = log(mag[k]), r = log(mag[k + 1]);
+		double offset = 0.5*(l - r)/(l - 2*m + r);
+		double f = (k + offset)*binHz;
+		bool apart = true;
+		for(size_t j=0; j<freqs.size(); j++){
+			apart = apart && fabs(freqs[j] - f) >= MODAL_FIT_SPACING_HZ;
+		}
+		if(apart){
+			freqs.push_back(f);
+		}
+	}
+	res.numCandidates = (int)freqs.size();
+	if(freqs.empty()){
+		return;
+	}
+
+	//2. decays: the log magnitude of the heterodyned ring falls by s per second
+	int frame = (int)(MODAL_FIT_FRAME*fs);
+	std::vector<FitMode> modes;
+	for(size_t c=0; c<freqs.size(); c++){
+		double w = 2*M_PI*freqs[c];
+		std::vector<double> times, levels;
+		for(int start=0; start+frame<=n; start+=frame/2){
+			std::complex<double> sum = 0;
+			for(int i=0; i<frame; i++){
+				double t = (double)(start + i)/fs;
+				sum += (double)x[start + i]*(0.5 - 0.5*cos(2*M_PI*i/frame))*std::complex<double>(cos(w*t), -sin(w*t));
+			}
+			times.push_back((start + frame/2.0)/fs);
+			levels.push_back(log(std::abs(sum) + 1e-30));
+		}
+		double top = *std::max_element(levels.begin(), levels.end());
+		double st = 0, sl = 0, stt = 0, stl = 0, count = 0;
+		for(size_t f=0; f<levels.size(); f++){
+			if(levels[f] < top - MODAL_FIT_FRAME_DB/20*log(10)){
+				break;
+			}
+			st += times[f];
+			sl += levels[f];
+			stt += times[f]*times[f];
+			stl += times[f]*levels[f];
+			count++;
+		}
+		double s = 10;
+		if(count >= 2 && count*stt - st*st > 0){
+			s = -(count*stl - st*sl)/(count*stt - st*st);
+		}
+		FitMode mode = { 0, 0, w, std::min(std::max(s, MODAL_FIT_MIN_DECAY), MODAL_FIT_MAX_DECAY) };
+		modes.push_back(mode);
+	}
+
+	//3. the amplitudes for those, then every parameter together
+	solve_amplitudes(modes, x, n, fs);
+	refine(modes, x, n, fs);
+
+	//4. the strongest modes, again
+	std::sort(modes.begin(), modes.end(), [&](const FitMode &a, const FitMode &b) {
+		return mode_energy(a, res.seconds) > mode_energy(b, res.seconds);
+	});
+	if((int)modes.size() > DRUM_MODAL_MAX_MODES){
+		modes.resize(DRUM_MODAL_MAX_MODES);
+	}
+	double cost = refine(modes, x, n, fs);
+	std::sort(modes.begin(), modes.end(), [&](const FitMode &a, const FitMode &b) {
+		return mode_energy(a, res.seconds) > mode_energy(b, res.seconds);
+	});
+
+	double energy = 0;
+	for(int i=0; i<n; i++){
+		energy += (double)x[i]*x[i];
+	}
+	res.snrDb = 10*log10(energy/(cost + 1e-30));
+	res.modes = modes;
+	res.ok = true;
+}
+
+//a mode of the fit as the patch has it: from t = 0 of the recording, at the patch's level
+static DrumModalMode patch_mode(const FitMode &m, const ModalFitResult &res, float A) {
+
+	double scale = A/res.peak;
+	double amp = sqrt(m.a*m.a + m.b*m.b)*exp(m.s*res.timePeak)*scale;
+	double phase = remainder(atan2(m.b, m.a) - m.w*res.timePeak, 2*M_PI);
+	DrumModalMode mode = { (float)(m.w/(2*M_PI)), (float)(1/m.s), (float)amp, (float)phase };
+	return mode;
+}
+
+int run_modal_fit(const char *dir, const char *outPath) {
+
+	ModalFitResult results[DRUM_NUM_TYPES];
+	int drumOf[DRUM_MODAL_NUM_TYPES];
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].modal >= 0){
+			drumOf[drumPatches[d].modal] = d;
+		}
+	}
+
+	//one thread per recording
+	double t0 = bench_seconds();
+	std::vector<std::thread> threads;
+	for(int p=0; p<DRUM_MODAL_NUM_TYPES; p++){
+		threads.push_back(std::thread(fit_recording, dir, drumOf[p], &results[drumOf[p]]));
+	}
+	for(size_t t=0; t<threads.size(); t++){
+		threads[t].join();
+	}
+	double t1 = bench_seconds();
+
+	DrumModalPatch patches[DRUM_MODAL_NUM_TYPES];
+	char comments[DRUM_MODAL_NUM_TYPES][160];
+	int failed = 0;
+	for(int p=0; p<DRUM_MODAL_NUM_TYPES; p++){
+		int d = drumOf[p];
+		const DrumPatch &patch = drumPatches[d];
+		const char *file = drum_reference_recording(d);
+		const ModalFitResult &res = results[d];
+		patches[p] = drumModalPatches[p];
+		if(!res.ok){
+			printf("%-10s %-14s could not be fitted\n", patch.name, file);
+			snprintf(comments[p], sizeof(comments[p]), "%s: %s could not be fitted, patch kept", patch.name, file);
+			failed++;
+			continue;
+		}
+
+		printf("%s, %s: peak at %.5f s, %.3f s of ring at %d Hz, %d candidates, %d modes, %.1f dB SNR\n",
+				patch.name, file, res.timePeak, res.seconds, res.sampleRate, res.numCandidates,
+				(int)res.modes.size(), res.snrDb);
+		printf("  %10s %10s %10s %10s %12s\n", "freq Hz", "tau s", "amp", "phase", "energy dB");
+		DrumModalPatch &mp = patches[p];
+		mp.attack = (float)res.timePeak;
+		mp.numModes = (int)res.modes.size();
+		double strongest = mode_energy(res.modes[0], res.seconds);
+		for(int k=0; k<DRUM_MODAL_MAX_MODES; k++){
+			DrumModalMode none = { 0, 1, 0, 0 };
+			mp.mode[k] = k < mp.numModes ? patch_mode(res.modes[k], res, patch.A) : none;
+			if(k < mp.numModes){
+				printf("  %10.2f %10.4f %10.4f %10.3f %12.1f\n", mp.mode[k].freq, mp.mode[k].tau, mp.mode[k].amp,
+						mp.mode[k].phase, 10*log10(mode_energy(res.modes[k], res.seconds)/strongest));
+			}
+		}
+		snprintf(comments[p], sizeof(comments[p]), "%s: fitted from %s, %d modes, %.1f dB SNR over %.2f s of ring",
+				patch.name, file, mp.numModes, res.snrDb, res.seconds);
+		if(res.snrDb < modalFitMinSnrDb[p]){
+			printf("  FAILED: below the %.1f dB the table in drum_modal.h was fitted at\n", modalFitMinSnrDb[p]);
+			failed++;
+		}
+	}
+	printf("%d recordings on as many threads in %.3f s\n\n", (int)threads.size(), t1 - t0);
+
+	FILE *f = stdout;
+	if(outPath != 0){
+		f = fopen(outPath, "w");
+		if(f == NULL){
+			fprintf(stderr, "could not write %s\n", outPath);
+			return 1;
+		}
+	}
+	fprintf(f, "//drumModalPatches[] fitted by drum_render --modalfit; replaces the table in drum_modal.h\n");
+	fprintf(f, "static constexpr DrumModalPatch drumModalPatches[] = {\n");
+	for(int p=0; p<DRUM_MODAL_NUM_TYPES; p++){
+		const DrumModalPatch &mp = patches[p];
+		fprintf(f, "\t//%s\n", comments[p]);
+		fprintf(f, "\t{ %.6gf, %d, {\n", mp.attack, mp.numModes);
+		fprintf(f, "\t\t//freq       tau         amp          phase\n");
+		for(int k=0; k<mp.numModes; k++){
+			char freq[24], tau[24], amp[24];
+			snprintf(freq, sizeof(freq), "%.7gf,", mp.mode[k].freq);
+			snprintf(tau, sizeof(tau), "%.6gf,", mp.mode[k].tau);
+			snprintf(amp, sizeof(amp), "%.6gf,", mp.mode[k].amp);
+			fprintf(f, "\t\t{ %-11s %-11s %-12s %.6gf }%s\n", freq, tau, amp, mp.mode[k].phase,
+					k == mp.numModes - 1 ? "" : ",");
+		}
+		fprintf(f, "\t} }%s\n", p == DRUM_MODAL_NUM_TYPES - 1 ? "" : ",\n");
+	}
+	fprintf(f, "};\n");
+	if(f != stdout){
+		fclose(f);
+		printf("wrote the modal patch table to %s\n", outPath);
+	}
+	return failed == 0 ? 0 : 1;
+}
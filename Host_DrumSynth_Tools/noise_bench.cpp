@@ -0,0 +1,227 @@
+/*
+ * noise_bench.cpp
+ *
+ * drum_render --noise: the snare and hihat noise (drum_noise.h) against the rand()%2-1 it
+ * replaced.  Measures DC, level, spectral flatness, lag-1 correlation and the tilt of each
+ * colour, checks that voices seeded from neighbouring serials are uncorrelated, and times the
+ * generators and noisy voices in the engine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_noise.h"
+#include "spectrum.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+#define NOISE_CHECK_SAMPLES		(1 << 20)
+#define NOISE_FRAME				1024
+
+//noise source: a DrumNoiseColor, or the old rand()%2-1
+#define NOISE_RAND				-1
+
+static void make_noise(int source, uint32_t seed, float *out, long numSamples) {
+
+	if(source == NOISE_RAND){
+		srand(seed);
+		for(long i=0; i<numSamples; i++){
+			out[i] = (float)(rand()%2-1);
+		}
+		return;
+	}
+	DrumNoiseFilter filter;
+	filter.setup(source, DRUM_NOISE_REFERENCE_RATE);
+	DrumNoise noise;
+	noise.seed(seed);
+	noise.fill(filter, out, (int)numSamples);
+}
+
+//returns the number of failed checks
+static int check_quality(const char *name, int source, std::vector<float> &x, std::vector<double> &power) {
+
+	long n = (long)x.size();
+	make_noise(source, 1, x.data(), n);
+
+	double mean = 0, square = 0, lag1 = 0;
+	for(long i=0; i<n; i++){
+		mean += x[i];
+		square += (double)x[i]*x[i];
+		if(i > 0){
+			lag1 += (double)x[i]*x[i - 1];
+		}
+	}
+	mean /= n;
+	double rms = sqrt(square/n - mean*mean);
+	double correlation = (lag1/(n - 1) - mean*mean)/(rms*rms);
+
+	spectrum_welch(x.data(), n, NOISE_FRAME, power.data());
+	double flatness = spectrum_flatness(power.data(), 0, NOISE_FRAME/2);
+
+	//lowest and highest eighth of the band
+	double low = 0, high = 0;
+	for(int k=1; k<=NOISE_FRAME/16; k++){
+		low += power[k];
+		high += power[NOISE_FRAME/2 - k];
+	}
+	double tilt = 10*log10(low/high);
+
+	//the requirements for the new generators; rand() is only reported
+	bool ok = true;
+	if(source != NOISE_RAND){
+		ok = fabs(mean) < 0.005 && fabs(rms - 0.5) < 0.005;
+		if(source == DRUM_NOISE_WHITE){
+			ok = ok && flatness > 0.95 && fabs(correlation) < 0.005 && fabs(tilt) < 0.5;
+		}
+		else if(source == DRUM_NOISE_DARK){
+			ok = ok && tilt > 6;
+		}
+		else{
+			ok = ok && tilt < -6;
+		}
+	}
+
+	printf("%-20s %9.4f %8.4f %10.4f %10.4f %10.1f   %s\n", name, mean, rms, flatness, correlation, tilt,
+			source == NOISE_RAND ? "" : ok ? "ok" : "FAILED");
+	return !ok;
+}
+
+//largest correlation between voices seeded from serials 0..numVoices-1
+static double max_cross_correlation(int numVoices, long numSamples) {
+
+	std::vector<std::vector<float> > voices(numVoices, std::vector<float>(numSamples));
+	for(int v=0; v<numVoices; v++){
+		make_noise(DRUM_NOISE_WHITE, (uint32_t)v, voices[v].data(), numSamples);
+	}
+	double worst = 0;
+	for(int a=0; a<numVoices; a++){
+		for(int b=a+1; b<numVoices; b++){
+			double sum = 0;
+			for(long i=0; i<numSamples; i++){
+				sum += (double)voices[a][i]*voices[b][i];
+			}
+			worst = fmax(worst, fabs(sum/numSamples/0.25));
+		}
+	}
+	return worst;
+}
+
+//host cycles per sample of a noise source filling blocks of blockSize
+static double time_source(int source, int blockSize, long numSamples, float &checksum) {
+
+	std::vector<float> block(blockSize);
+	DrumNoiseFilter filter;
+	filter.setup(source == NOISE_RAND ? DRUM_NOISE_WHITE : source, DRUM_NOISE_REFERENCE_RATE);
+	DrumNoise noise;
+	noise.seed(1);
+
+	long numBlocks = numSamples/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		if(source == NOISE_RAND){
+			for(int i=0; i<blockSize; i++){
+				block[i] = (float)(rand()%2-1);
+			}
+		}
+		else{
+			noise.fill(filter, block.data(), blockSize);
+		}
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (double)(c1 - c0)/(numBlocks*blockSize);
+}
+
+//host cycles per sample of one generator called a sample at a time, as DrumEngine::renderVoice() does
+static double time_next(long numSamples, float &checksum) {
+
+	DrumNoiseFilter filter;
+	filter.setup(DRUM_NOISE_WHITE, DRUM_NOISE_REFERENCE_RATE);
+	DrumNoise noise;
+	noise.seed(1);
+	float sum = 0;
+	uint64_t c0 = bench_cycles();
+	for(long i=0; i<numSamples; i++){
+		sum += noise.next(filter);
+	}
+	uint64_t c1 = bench_cycles();
+	checksum += sum;
+	return (double)(c1 - c0)/numSamples;
+}
+
+//cycles per sample of the engine with numVoices held snares and hihats
+static double time_voices(int loopOrder, int numVoices, double seconds, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.loopOrder = loopOrder;
+	std::vector<float> block(blockSize);
+	for(int v=0; v<numVoices; v++){
+		engine.noteOn(v % 2 ? DRUM_NOTE_HIHAT : DRUM_NOTE_SNARE);
+		engine.render(block.data(), blockSize);
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+int run_noise_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 2;
+	}
+
+	std::vector<float> x(NOISE_CHECK_SAMPLES);
+	std::vector<double> power(NOISE_FRAME/2 + 1);
+
+	printf("%ld samples, Welch spectrum of %d point Hann frames; tilt is the lowest over the highest\n"
+			"eighth of the band\n\n", (long)NOISE_CHECK_SAMPLES, NOISE_FRAME);
+	printf("%-20s %9s %8s %10s %10s %10s\n", "source", "mean", "rms", "flatness", "lag-1 corr", "tilt dB");
+	int failures = 0;
+	failures += check_quality("rand()%2-1", NOISE_RAND, x, power);
+	failures += check_quality("xorshift white", DRUM_NOISE_WHITE, x, power);
+	failures += check_quality("xorshift dark", DRUM_NOISE_DARK, x, power);
+	failures += check_quality("xorshift bright", DRUM_NOISE_BRIGHT, x, power);
+
+	double cross = max_cross_correlation(DRUM_MAX_VOICES, 1 << 16);
+	bool crossOk = cross < 0.03;
+	failures += !crossOk;
+	printf("\nlargest correlation between %d voices seeded from serials 0..%d: %.4f   %s\n\n", DRUM_MAX_VOICES,
+			DRUM_MAX_VOICES - 1, cross, crossOk ? "ok" : "FAILED");
+
+	long numSamples = (long)(seconds*sampleRate);
+	float checksum = 0;
+	printf("host cycles/sample, blocks of %d:\n", blockSize);
+	double randCost = time_source(NOISE_RAND, blockSize, numSamples, checksum);
+	printf("  %-28s %8.2f\n", "rand()%2-1", randCost);
+	double nextCost = time_next(numSamples, checksum);
+	printf("  %-28s %8.2f %8.1fx\n", "DrumNoise::next() white", nextCost, randCost/nextCost);
+	static const char *colorNames[] = { "DrumNoise::fill() white", "DrumNoise::fill() dark", "DrumNoise::fill() bright" };
+	for(int c=DRUM_NOISE_WHITE; c<=DRUM_NOISE_BRIGHT; c++){
+		double cost = time_source(c, blockSize, numSamples, checksum);
+		printf("  %-28s %8.2f %8.1fx\n", colorNames[c], cost, randCost/cost);
+	}
+
+	printf("\nheld snares and hihats, engine cycles/sample:\n");
+	printf("  %6s %14s %14s\n", "voices", "sample-outer", "voice-outer");
+	for(int n=2; n<=DRUM_MAX_VOICES; n*=2){
+		double s = time_voices(DRUM_SAMPLE_OUTER, n, seconds/4, sampleRate, blockSize, checksum);
+		double v = time_voices(DRUM_VOICE_OUTER, n, seconds/4, sampleRate, blockSize, checksum);
+		printf("  %6d %14.1f %14.1f\n", n, s, v);
+	}
+	printf("(checksum %g)\n", checksum);
+
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * oversample_bench.cpp
+ *
+ * drum_render --oversample: what running FM operators at twice the rate takes away, and what it
+ * costs.
+ *
+ * Every operator pair of the kit (the main operator of each two operator drum, each modulated
+ * carrier of the stack drums) is played as a steady tone at the knob and tone button settings
+ * that push its sidebands furthest, once at the sample rate and once oversampled through the
+ * half-band decimator of drum_fm.h.  Both are compared with the exact band-limited tone, the
+ * sum of its Bessel sidebands J_n(I)*sin(2*pi*(fc + n*fm)*t) below a third of the rate, over
+ * that band (the decimator's passband): what is left is the aliasing folded back into it.  The
+ * frequencies are rounded to FFT bins so a whole FFT of the tone is periodic.  Every operator the
+ * engine oversamples at those settings has to come out of the decimator clean and cleaner than at
+ * the sample rate, and every one it leaves at the sample rate has to be clean without it, which
+ * checks drum_fm_folded() and DRUM_OVERSAMPLE_MIN_FOLDED against the decimator.
+ *
+ * Then the engine's cost per voice of each drum with nothing oversampled and with every operator
+ * that can be, and of a held voice of every drum as the engine picks them.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <complex>
+#include <vector>
+#include "drum_engine.h"
+#include "spectrum.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+#define OVERSAMPLE_FFT_BITS		16
+#define OVERSAMPLE_FFT_SIZE		(1 << OVERSAMPLE_FFT_BITS)
+
+//in-band aliasing, dB below the in-band tone, that counts as clean: what the engine lets an
+//operator fold back before it oversamples it
+#define OVERSAMPLE_CLEAN_DB		(10*log10(DRUM_OVERSAMPLE_MIN_FOLDED))
+
+//voices per drum in the cost measurement
+#define OVERSAMPLE_VOICES		8
+
+struct OversampleCase {
+	const char *drum;
+	int drumType;
+	int op;				//stack operator, -1 for the main operator
+	double fc, fm, index;
+	double folded;		//drum_fm_folded()
+	bool oversampled;	//by the engine at these settings
+};
+
+//J_n(x) for any n
+static double bessel(int n, double x) {
+
+	return n >= 0 ? jn(n, x) : ((-n) & 1 ? -jn(-n, x) : jn(-n, x));
+}
+
+//frequency rounded to a bin of the FFT at the rate, and its phase increment
+static double bin_frequency(double freq, int sampleRate, uint32_t &inc) {
+
+	long bin = lround(freq*OVERSAMPLE_FFT_SIZE/sampleRate);
+	inc = (uint32_t)(bin << (32 - OVERSAMPLE_FFT_BITS));
+	return (double)bin*sampleRate/OVERSAMPLE_FFT_SIZE;
+}
+
+//power below a third of the rate of x - ref, dB of ref's there
+static double inband_error_db(const std::vector<double> &x, const std::vector<double> &ref) {
+
+	int n = OVERSAMPLE_FFT_SIZE;
+	std::vector<std::complex<double> > X(n), R(n);
+	for(int i=0; i<n; i++){
+		X[i] = x[i];
+		R[i] = ref[i];
+	}
+	spectrum_fft(X.data(), n);
+	spectrum_fft(R.data(), n);
+
+	double error = 0, signal = 0;
+	for(int k=1; k<n/3; k++){
+		error += std::norm(X[k] - R[k]);
+		signal += std::norm(R[k]);
+	}
+	return 10*log10(error/(signal + 1e-300) + 1e-30);
+}
+
+//the operator's tone at the sample rate and oversampled, against the band-limited tone
+static void measure(OversampleCase &c, int sampleRate, double &plainDb, double &oversampledDb) {
+
+	int n = OVERSAMPLE_FFT_SIZE;
+	FmOperator op;
+	double fc = bin_frequency(c.fc, sampleRate, op.carrierInc);
+	double fm = bin_frequency(c.fm, sampleRate, op.modInc);
+	float index = (float)c.index;
+
+	std::vector<double> plain(n), oversampled(n), ref(n, 0.0);
+	op.start();
+	for(int i=0; i<n; i++){
+		plain[i] = op.next(index);
+	}
+	DrumHalfband h;
+	op.start();
+	op.startOversampling(index, h);
+	for(int i=0; i<n; i++){
+		oversampled[i] = op.nextOversampled(index, h);
+	}
+
+	int maxOrder = (int)c.index + 60;
+	for(int k=-maxOrder; k<=maxOrder; k++){
+		double f = fc + k*fm;
+		double a = bessel(k, c.index);
+		if(fabs(f) >= sampleRate/3.0 || fabs(a) < 1e-12){
+			continue;
+		}
+		for(int i=0; i<n; i++){
+			ref[i] += a*sin(2*M_PI*fmod(f*i/sampleRate, 1.0));
+		}
+	}
+
+	plainDb = inband_error_db(plain, ref);
+	oversampledDb = inband_error_db(oversampled, ref);
+}
+
+//every modulated operator of the kit at the knob and buttons all the way up
+static void kit_cases(DrumEngine &engine, std::vector<OversampleCase> &cases) {
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const DrumPatch &patch = drumPatches[d];
+		const DrumModel &m = engine.model[d];
+		if(patch.stack < 0){
+			OversampleCase c = { patch.name, d, -1, patch.fc*m.freqShift, patch.fm*m.freqShift, m.I_0To*m.indexPeak,
+					0, m.oversample };
+			c.folded = drum_fm_folded((float)c.fc, (float)c.fm, (float)c.index, engine.sampleRate);
+			cases.push_back(c);
+			continue;
+		}
+
+		//the chains of the stacks are one modulator deep
+		const DrumStackPatch &stack = drumStackPatches[patch.stack];
+		for(int k=0; k<stack.numOps; k++){
+			int src = stack.op[k].src;
+			if(src < 0 || stack.op[src].src >= 0){
+				continue;
+			}
+			OversampleCase c = { patch.name, d, k, stack.op[k].freq*m.freqShift, stack.op[src].freq*m.freqShift,
+					stack.op[src].level, 0, m.stack.oversample[k] };
+			c.folded = drum_fm_folded((float)c.fc, (float)c.fm, (float)c.index, engine.sampleRate);
+			cases.push_back(c);
+		}
+	}
+}
+
+//cycles/sample of the voices held, with oversampling in the mode
+static double time_voices(const int *drums, int numDrums, int voicesEach, int mode, double seconds,
+		int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.oversampling = mode;
+	engine.pot0 = engine.pot1 = engine.pot2 = 1;
+	engine.type = engine.type2 = engine.type3 = 3;
+	for(int d=0; d<numDrums; d++){
+		for(int v=0; v<voicesEach; v++){
+			engine.noteOn(drumPatches[drums[d]].note);
+		}
+	}
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+int run_oversample_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 1;
+	}
+
+	//the settings that push the sidebands furthest, worked out by the engine
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.pot0 = engine.pot1 = engine.pot2 = 1;
+	engine.type = engine.type2 = engine.type3 = 3;
+	float scratch[1];
+	engine.render(scratch, 1);
+
+	std::vector<OversampleCase> cases;
+	kit_cases(engine, cases);
+
+	printf("rate %d Hz, block %d, knobs at 1 and buttons at 3; decimator %d taps, flat to %.0f Hz\n\n",
+			sampleRate, blockSize, 4*DRUM_HALFBAND_TAPS - 1, sampleRate/3.0);
+	printf("aliasing below %.0f Hz, dB of the band-limited tone (clean below %.0f dB):\n", sampleRate/3.0,
+			OVERSAMPLE_CLEAN_DB);
+	printf("the operators the engine oversamples have to be cleaner at 2x than plain; folded is the power\n"
+			"drum_fm_folded() works out folds back below %.0f Hz, which picks them\n", sampleRate/3.0);
+	printf("%-10s %-4s %8s %8s %7s %10s %-12s %10s %12s\n", "drum", "op", "fc", "fm", "index", "folded dB",
+			"engine", "plain dB", "2x dB");
+
+	bool ok = true;
+	for(size_t i=0; i<cases.size(); i++){
+		OversampleCase &c = cases[i];
+		double plainDb, oversampledDb;
+		measure(c, sampleRate, plainDb, oversampledDb);
+
+		//what the engine runs has to be clean, and oversampling has to pay for itself
+		bool caseOk = c.oversampled ? oversampledDb <= OVERSAMPLE_CLEAN_DB && oversampledDb < plainDb
+				: plainDb <= OVERSAMPLE_CLEAN_DB;
+		char op[16];
+		snprintf(op, sizeof(op), c.op >= 0 ? "%d" : "main", c.op);
+		printf("%-10s %-4s %8.0f %8.0f %7.2f %10.1f %-12s %10.1f %12.1f   %s\n", c.drum, op, c.fc, c.fm, c.index,
+				10*log10(c.folded + 1e-30), c.oversampled ? "oversampled" : "plain", plainDb, oversampledDb,
+				caseOk ? "ok" : "FAILED");
+		ok = ok && caseOk;
+	}
+
+	float checksum = 0;
+	printf("\ncycles/sample of %d held voices, knobs and buttons as above:\n", OVERSAMPLE_VOICES);
+	printf("%-10s %12s %12s %16s\n", "drum", "plain", "all 2x", "extra per voice");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		double plain = time_voices(&d, 1, OVERSAMPLE_VOICES, DRUM_OVERSAMPLE_OFF, seconds, sampleRate, blockSize, checksum);
+		double all = time_voices(&d, 1, OVERSAMPLE_VOICES, DRUM_OVERSAMPLE_ALL, seconds, sampleRate, blockSize, checksum);
+		printf("%-10s %12.1f %12.1f %12.1f %+4.0f%%\n", drumPatches[d].name, plain, all, (all - plain)/OVERSAMPLE_VOICES,
+				100*(all - plain)/plain);
+	}
+
+	int kit[DRUM_NUM_TYPES];
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		kit[d] = d;
+	}
+	double kitOff = time_voices(kit, DRUM_NUM_TYPES, 1, DRUM_OVERSAMPLE_OFF, seconds, sampleRate, blockSize, checksum);
+	double kitAuto = time_voices(kit, DRUM_NUM_TYPES, 1, DRUM_OVERSAMPLE_AUTO, seconds, sampleRate, blockSize, checksum);
+	double kitAll = time_voices(kit, DRUM_NUM_TYPES, 1, DRUM_OVERSAMPLE_ALL, seconds, sampleRate, blockSize, checksum);
+	printf("\none voice of every drum: %.1f plain, %.1f as the engine picks (%+.0f%%), %.1f all 2x (%+.0f%%)\n",
+			kitOff, kitAuto, 100*(kitAuto - kitOff)/kitOff, kitAll, 100*(kitAll - kitOff)/kitOff);
+	printf("(checksum %g)\n", checksum);
+
+	printf("\n%s\n", ok ? "every operator the engine runs is clean" : "some operators alias past the limit");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+/*
+ * play_bench.cpp
+ *
+ * drum_render --play: a MIDI performance through the firmware's MIDI input and audio callback,
+ * as fast as the host can go, for repeatable load tests.
+ *
+ * The performance is a Standard MIDI File or a raw MIDI byte dump (-m, see midi_file.h), or a
+ * built-in dense pattern.  Its bytes reach the real midi_rx_callback_sharc1() through the mock
+ * UART at the times they would arrive on the wire, with the mock cycle counter set to match,
+ * and the audio side does what processaudio_callback() does every block: start a new period of
+ * the sample clock and renderQueued() the events of the one before.  Nothing waits for real
+ * time: the report gives the realtime factor, the cost of every block against the SHARC budget
+ * (host cycles against SHARC cycles, like the other benchmarks), the worst block and the blocks
+ * that would have missed the deadline, and a checksum of the output, the same on every run of
+ * the same performance.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <builtins.h>
+#include "drivers/bm_uart_driver/bm_uart.h"
+#include "callback_midi_message.h"
+#include "drum_engine.h"
+#include "drum_midi_queue.h"
+#include "midi_file.h"
+#include "bench_timer.h"
+#include "wav_file.h"
+#include "host_tools.h"
+
+//the firmware's queue, clock and UART, defined in midi_parser_bench.cpp and callback_midi_message.cpp
+extern DrumMidiQueue midiQueue;
+extern DrumMidiClock midiClock;
+extern uint32_t mock_emuclk_cycles;
+extern BM_UART midi_uart_sharc1;
+
+//longest the voices may ring on after the last byte
+#define PLAY_MAX_TAIL_SECONDS	12.0
+
+//times the performance is played; each block's cost is its least
+#define PLAY_PASSES		3
+
+//how long the built-in performance lasts
+#define PLAY_BUILTIN_SECONDS	8.0
+
+//the SHARC cycle counter at a time in seconds
+static uint32_t cycles_at(double seconds) {
+
+	return (uint32_t)(uint64_t)(seconds*SHARC_CORE_CLOCK_HZ);
+}
+
+//a dense e-kit performance: 32nd notes at 180 bpm, two or three drums a step, flams, running
+//status, short note offs as velocity 0 note ons, and MIDI clock
+void play_builtin_performance(std::vector<MidiWireByte> &bytes) {
+
+	double step = 60.0/180/8;
+	uint32_t state = 12345;
+
+	std::vector<MidiWireByte> timeline;
+	for(int s=0; s*step<PLAY_BUILTIN_SECONDS; s++){
+		double t = s*step;
+		MidiWireByte w;
+		w.time = t;
+		if(s % 3 == 0){
+			w.byte = 0xf8;
+			timeline.push_back(w);
+		}
+		w.byte = 0x99;
+		timeline.push_back(w);
+
+		int numHits = 2 + (s % 4 == 0);
+		for(int h=0; h<numHits; h++){
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			int note = drumPatches[state % DRUM_NUM_TYPES].note;
+			//a flam on every beat: the grace note just ahead of the main hit
+			double at = t + (s % 8 == 0 && h == 0 ? 0 : 0.015*h);
+			MidiWireByte on[2] = { { at, (uint8_t)note }, { at, (uint8_t)(60 + (state >> 8) % 60) } };
+			MidiWireByte off[2] = { { at + step/2, (uint8_t)note }, { at + step/2, 0 } };
+			timeline.insert(timeline.end(), on, on + 2);
+			timeline.insert(timeline.end(), off, off + 2);
+		}
+	}
+
+	//in time order, keeping each message's bytes together; running status holds throughout
+	std::stable_sort(timeline.begin(), timeline.end(),
+			[](const MidiWireByte &a, const MidiWireByte &b) { return a.time < b.time; });
+	bytes = timeline;
+	midi_wire_serialize(bytes);
+}
+
+static uint32_t checksum_add(uint32_t h, const float *x, int n) {
+
+	//FNV-1a over the sample bits
+	for(int i=0; i<n; i++){
+		uint32_t bits;
+		memcpy(&bits, &x[i], 4);
+		for(int k=0; k<4; k++){
+			h = (h ^ ((bits >> (8*k)) & 0xff))*16777619u;
+		}
+	}
+	return h;
+}
+
+//what one pass over the performance gives
+struct PlayPass {
+	std::vector<double> blockCycles;
+	std::vector<float> out;
+	uint32_t checksum;
+	long numEvents;
+	uint32_t queueOverflows;
+	uint32_t maxQueued;
+	uint32_t uartOverflows;
+	double wallSeconds;
+};
+
+static void play_pass(const std::vector<MidiWireByte> &bytes, bool keepOutput, double seconds, int sampleRate,
+		int blockSize, PlayPass &pass) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	midi_setup_sharc1();
+	midiQueue.reset();
+	midiClock.setup((float)sampleRate);
+	mock_emuclk_cycles = 0;
+
+	//until the last voice ends after the last byte, or -t seconds
+	double lastByte = bytes.empty() ? 0 : bytes.back().time;
+	long maxBlocks = (long)((seconds > 0 ? seconds : lastByte + PLAY_MAX_TAIL_SECONDS)*sampleRate)/blockSize;
+	std::vector<float> block(blockSize);
+	pass.blockCycles.clear();
+	pass.out.clear();
+	pass.checksum = 2166136261u;
+	pass.numEvents = 0;
+	size_t next = 0;
+
+	double wall0 = bench_seconds();
+	for(long b=0; b<maxBlocks; b++){
+		//the callback of block b runs when the block's period of audio has been captured
+		double callbackTime = (double)(b + 1)*blockSize/sampleRate;
+
+		//every byte that arrives before then, each in its own receive interrupt
+		uint32_t waiting = midiQueue.depth();
+		while(next < bytes.size() && bytes[next].time < callbackTime){
+			mock_emuclk_cycles = cycles_at(bytes[next].time);
+			mock_uart_receive(&midi_uart_sharc1, &bytes[next].byte, 1);
+			next++;
+		}
+		pass.numEvents += midiQueue.depth() - waiting;
+
+		//processaudio_callback(): a new period of the sample clock, the last one's events
+		mock_emuclk_cycles = cycles_at(callbackTime);
+		uint64_t c0 = bench_cycles();
+		uint32_t window = midiClock.periodStart();
+		midiClock.startPeriod(window + blockSize, emuclk());
+		engine.renderQueued(midiQueue, window, block.data(), blockSize);
+		uint64_t c1 = bench_cycles();
+
+		pass.blockCycles.push_back((double)(c1 - c0));
+		pass.checksum = checksum_add(pass.checksum, block.data(), blockSize);
+		if(keepOutput){
+			pass.out.insert(pass.out.end(), block.begin(), block.end());
+		}
+		if(seconds <= 0 && next == bytes.size() && engine.pool.numActive == 0 && midiQueue.depth() == 0){
+			break;
+		}
+	}
+	pass.wallSeconds = bench_seconds() - wall0;
+	pass.queueOverflows = midiQueue.overflows;
+	pass.maxQueued = midiQueue.maxDepth;
+	pass.uartOverflows = midi_uart_sharc1.overflows;
+}
+
+int run_play_bench(const char *path, const char *outPath, double seconds, int sampleRate, int blockSize) {
+
+	std::vector<MidiWireByte> bytes;
+	if(path != 0){
+		if(!midi_file_read(path, bytes)){
+			fprintf(stderr, "could not read %s\n", path);
+			return 1;
+		}
+	}
+	else{
+		play_builtin_performance(bytes);
+	}
+
+	printf("%s: %d bytes over %.2f s, rate %d Hz, block %d, best of %d passes\n",
+			path != 0 ? path : "built-in performance", (int)bytes.size(), bytes.empty() ? 0 : bytes.back().time,
+			sampleRate, blockSize, PLAY_PASSES);
+
+	//the performance plays the same every pass, so each block's least cost over the passes is its
+	//cost without the host's interruptions
+	PlayPass first, pass;
+	play_pass(bytes, outPath != 0, seconds, sampleRate, blockSize, first);
+	std::vector<double> blockCycles = first.blockCycles;
+	double wall = first.wallSeconds;
+	bool repeatable = true;
+	for(int p=1; p<PLAY_PASSES; p++){
+		play_pass(bytes, false, seconds, sampleRate, blockSize, pass);
+		repeatable = repeatable && pass.checksum == first.checksum && pass.blockCycles.size() == blockCycles.size();
+		for(size_t b=0; b<blockCycles.size() && b<pass.blockCycles.size(); b++){
+			if(pass.blockCycles[b] < blockCycles[b]){
+				blockCycles[b] = pass.blockCycles[b];
+			}
+		}
+		if(pass.wallSeconds < wall){
+			wall = pass.wallSeconds;
+		}
+	}
+
+	long numBlocks = (long)blockCycles.size();
+	double audioSeconds = (double)numBlocks*blockSize/sampleRate;
+	double budget = SHARC_CYCLES_PER_SAMPLE*blockSize;
+	std::vector<double> sorted = blockCycles;
+	std::sort(sorted.begin(), sorted.end());
+	double p99 = sorted[(size_t)(0.99*(numBlocks - 1))];
+	double total = 0;
+	int misses = 0;
+	long worstBlock = 0;
+	for(long b=0; b<numBlocks; b++){
+		total += blockCycles[b];
+		if(blockCycles[b] > budget){
+			misses++;
+		}
+		if(blockCycles[b] > blockCycles[worstBlock]){
+			worstBlock = b;
+		}
+	}
+
+	printf("\n%ld note events, %u lost to a full queue, %u bytes to a full UART FIFO, most queued %u\n",
+			first.numEvents, (unsigned)first.queueOverflows, (unsigned)first.uartOverflows, (unsigned)first.maxQueued);
+	printf("%.2f s of audio in %.3f s: %.1fx realtime\n", audioSeconds, wall, audioSeconds/wall);
+	printf("\ncycles per block (budget %.0f):\n", budget);
+	printf("  mean   %10.0f  %6.2f%%\n", total/numBlocks, 100*total/numBlocks/budget);
+	printf("  p99    %10.0f  %6.2f%%\n", p99, 100*p99/budget);
+	printf("  worst  %10.0f  %6.2f%%  (block %ld, at %.3f s)\n", sorted.back(), 100*sorted.back()/budget, worstBlock,
+			(double)worstBlock*blockSize/sampleRate);
+	printf("  %d of %ld blocks over the deadline\n", misses, numBlocks);
+	printf("\noutput checksum %08x, %s\n", first.checksum, repeatable ? "the same every pass" : "NOT the same every pass");
+
+	if(outPath != 0){
+		if(!wav_write_float(outPath, first.out.data(), (int)first.out.size(), sampleRate)){
+			fprintf(stderr, "could not write %s\n", outPath);
+			return 1;
+		}
+		printf("wrote %s\n", outPath);
+	}
+	printf("cycles are host cycles; the budget is %.0f SHARC cycles/sample.\n", SHARC_CYCLES_PER_SAMPLE);
+	return misses == 0 && repeatable ? 0 : 1;
+}
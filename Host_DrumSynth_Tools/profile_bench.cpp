@@ -0,0 +1,339 @@
+/*
+ * profile_bench.cpp
+ *
+ * drum_render --profile: the callback cycle accounting (drum_profile.h) on a busy performance.
+ *
+ * Renders the performance a block at a time the way processaudio_callback() does, with a
+ * DrumProfiler on the host cycle counter, and prints what the firmware would publish: callback
+ * percentiles, overruns, and the cost per drum and per voice, for the synthesized and the
+ * cached render.  Checks that the histogram percentiles bracket the exact ones, that a reader
+ * thread only ever sees consistent statistics while the callback keeps publishing, that
+ * overruns, processaudio_mips_overflow() and reset requests are recorded, and measures what
+ * the accounting costs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "drum_engine.h"
+#include "drum_profile.h"
+#include "drum_sample_cache.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+static const int *drumNotes = drum_notes();
+
+static uint32_t rngState;
+
+static uint32_t rng_next(void) {
+
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static DrumMidiEvent make_event(uint32_t time, int status, int note) {
+
+	DrumMidiEvent event;
+	event.time = time;
+	event.status = (uint8_t)status;
+	event.data1 = (uint8_t)note;
+	event.data2 = status == MIDI_NOTE_ON ? 100 : 0;
+	return event;
+}
+
+//bursts of hits that fill the pool, between quieter stretches, so the callback times spread out
+static std::vector<DrumMidiEvent> make_performance(long numSamples, int sampleRate) {
+
+	std::vector<DrumMidiEvent> events;
+	long time = 0;
+	while(time < numSamples){
+		bool burst = rng_next() % 4 == 0;
+		int gap = burst ? 1 + rng_next() % (sampleRate/200) : sampleRate/20 + rng_next() % (sampleRate/10);
+		time += gap;
+		int note = drumNotes[rng_next() % DRUM_NUM_TYPES];
+		events.push_back(make_event((uint32_t)time, MIDI_NOTE_ON, note));
+		events.push_back(make_event((uint32_t)time, MIDI_NOTE_OFF, note));
+	}
+	return events;
+}
+
+struct ProfileRun {
+	double cyclesPerSample;		//host cycles per sample around the whole block loop
+	std::vector<uint32_t> totals;	//every callback's cycles, from endCallback()
+	DrumProfileStats stats;
+	float checksum;
+};
+
+struct ReaderCheck {
+	volatile bool stop;
+	long reads, gaveUp, inconsistent;
+	DrumProfileStats *stats;
+};
+
+//what a consistent copy has to satisfy
+static bool consistent(const DrumProfileStats &s, uint32_t lastCallbacks) {
+
+	uint32_t count = 0;
+	for(int b=0; b<DRUM_PROFILE_BINS; b++){
+		count += s.histogram[b];
+	}
+	return (s.sequence & 1) == 0 && count == s.callbacks && s.last <= s.worst && s.callbacks >= lastCallbacks;
+}
+
+static void reader_thread(ReaderCheck *r) {
+
+	DrumProfileStats copy;
+	uint32_t lastCallbacks = 0;
+	while(!r->stop){
+		if(!drum_profile_read(r->stats, copy)){
+			r->gaveUp++;
+		}
+		else{
+			r->reads++;
+			if(!consistent(copy, lastCallbacks)){
+				r->inconsistent++;
+			}
+			lastCallbacks = copy.callbacks;
+		}
+		std::this_thread::yield();
+	}
+}
+
+static void render_performance(const std::vector<DrumMidiEvent> &events, long numBlocks, int sampleRate,
+		int blockSize, DrumSampleCache *cache, bool profile, uint32_t budget, ReaderCheck *reader, ProfileRun &run) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	engine->cache = cache;
+	DrumMidiQueue *queue = new DrumMidiQueue;
+	queue->reset();
+	DrumProfiler *profiler = new DrumProfiler;
+	DrumProfileStats *stats = new DrumProfileStats;
+	profiler->setup(stats, budget);
+	if(profile){
+		engine->profiler = profiler;
+	}
+
+	std::thread thread;
+	if(reader != 0){
+		reader->stop = false;
+		reader->reads = 0;
+		reader->gaveUp = 0;
+		reader->inconsistent = 0;
+		reader->stats = stats;
+		thread = std::thread(reader_thread, reader);
+	}
+
+	std::vector<float> block(blockSize);
+	run.totals.clear();
+	run.checksum = 0;
+	size_t next = 0;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		uint32_t window = (uint32_t)(b*blockSize);
+		while(next < events.size() && events[next].time < window + blockSize){
+			queue->push(events[next]);
+			next++;
+		}
+		if(profile){
+			profiler->beginCallback();
+		}
+		engine->renderQueued(*queue, window, block.data(), blockSize);
+		if(profile){
+			run.totals.push_back(profiler->endCallback());
+		}
+		run.checksum += block[0];
+
+		//let the reader in between callbacks now and then; on a single CPU it also gets in mid-callback
+		if(reader != 0 && b % 64 == 0){
+			std::this_thread::yield();
+		}
+	}
+	uint64_t c1 = bench_cycles();
+	run.cyclesPerSample = (double)(c1 - c0)/(numBlocks*blockSize);
+
+	if(reader != 0){
+		reader->stop = true;
+		thread.join();
+	}
+	drum_profile_read(stats, run.stats);
+
+	delete stats;
+	delete profiler;
+	delete queue;
+	delete engine;
+}
+
+//the histogram percentile has to be the upper edge of the bin the exact percentile falls in (the
+//edge is rounded down, so it may equal the exact value), or twice the budget for the last bin
+static int check_percentiles(const ProfileRun &run, const char *name) {
+
+	std::vector<uint32_t> sorted = run.totals;
+	std::sort(sorted.begin(), sorted.end());
+	static const float ps[] = { 0.5f, 0.9f, 0.99f, 0.999f };
+	uint32_t binWidth = run.stats.budget/DRUM_PROFILE_BINS_PER_BUDGET;
+	int failures = 0;
+	for(int i=0; i<4; i++){
+		uint32_t target = (uint32_t)(ps[i]*sorted.size() + 0.5f);
+		uint32_t exact = sorted[target > 0 ? target - 1 : 0];
+		uint32_t binned = drum_profile_percentile(run.stats, ps[i]);
+		bool ok;
+		if(exact >= 2*run.stats.budget){
+			ok = binned == 2*run.stats.budget;
+		}
+		else{
+			ok = binned >= exact && binned - exact <= binWidth + 1;
+		}
+		if(!ok){
+			printf("%s: p%g exact %u, histogram %u   FAILED\n", name, ps[i]*100, exact, binned);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static void print_stats(const ProfileRun &run, int blockSize) {
+
+	const DrumProfileStats &s = run.stats;
+	printf("%u callbacks, %u over budget (%.2f%%)\n", s.callbacks, s.overruns, 100.0*s.overruns/s.callbacks);
+	printf("  callback cycles   avg %8.0f   p50 %8u   p90 %8u   p99 %8u   p99.9 %8u   worst %8u\n", s.average,
+			drum_profile_percentile(s, 0.5f), drum_profile_percentile(s, 0.9f), drum_profile_percentile(s, 0.99f),
+			drum_profile_percentile(s, 0.999f), s.worst);
+	printf("  outside the drums avg %8.0f (%.1f cycles/sample)\n", s.otherAverage, s.otherAverage/blockSize);
+	printf("  %-10s %22s %22s\n", "drum", "cycles/voice/sample", "worst callback");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		printf("  %-10s %22.1f %22u\n", drumPatches[d].name, s.drumVoiceSample[d], s.drumWorst[d]);
+	}
+	printf("  voices in the last callback:");
+	int numVoices = 0;
+	for(int v=0; v<DRUM_MAX_VOICES; v++){
+		if(s.voiceDrum[v] >= 0){
+			printf(" %d:%s %u", v, drumPatches[s.voiceDrum[v]].name, s.voiceLast[v]);
+			numVoices++;
+		}
+	}
+	printf("%s\n", numVoices ? "" : " none");
+}
+
+int run_profile_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 10;
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	rngState = 0x5eed1234u;
+	std::vector<DrumMidiEvent> events = make_performance(numBlocks*blockSize, sampleRate);
+
+	DrumSampleCache *cache = new DrumSampleCache;
+	cache->setup((float)sampleRate);
+	cache->renderAll();
+	if(!cache->enabled){
+		delete cache;
+		cache = 0;
+	}
+
+	printf("rate %d Hz, block %d, %.1f s, %zu events, %s\n", sampleRate, blockSize, seconds, events.size(),
+			BENCH_HAVE_RDTSC ? "cycles from rdtsc" : "cycles are clock_gettime ns");
+	printf("the host is far faster than the SHARC, so each path gets a budget of twice its own average\n"
+			"callback to spread the histogram out\n\n");
+
+	int failures = 0;
+	ProfileRun run;
+	static const char *pathNames[2] = { "synthesized", "cached" };
+	for(int path=0; path<2; path++){
+		DrumSampleCache *c = path == 1 ? cache : 0;
+		if(path == 1 && c == 0){
+			printf("cached: one-shots do not fit at %d Hz, skipped\n\n", sampleRate);
+			continue;
+		}
+
+		//the accounting's own cost: best of three runs each way, and how far the runs without it
+		//spread, the least difference the host can time
+		double without = 1e30, with = 1e30, spread = 0;
+		for(int r=0; r<3; r++){
+			render_performance(events, numBlocks, sampleRate, blockSize, c, false, 1, 0, run);
+			spread = std::max(spread, run.cyclesPerSample);
+			without = std::min(without, run.cyclesPerSample);
+			render_performance(events, numBlocks, sampleRate, blockSize, c, true, 1, 0, run);
+			with = std::min(with, run.cyclesPerSample);
+		}
+		spread -= without;
+
+		uint32_t budget = (uint32_t)(2*without*blockSize);
+		render_performance(events, numBlocks, sampleRate, blockSize, c, true, budget, 0, run);
+		printf("%s, budget %u: ", pathNames[path], budget);
+		print_stats(run, blockSize);
+		failures += check_percentiles(run, pathNames[path]);
+		//a run with the accounting can come out faster than one without; the cost is then lost in
+		//the noise, not negative
+		printf("  accounting cost: %.1f -> %.1f cycles/sample, ", without, with);
+		if(with < without){
+			printf("below the host's timing noise (runs spread %.1f cycles/sample)\n\n", spread);
+		}else{
+			printf("%.0f cycles per callback\n\n", (with - without)*blockSize);
+		}
+	}
+
+	//a reader polling the statistics while the callback publishes them, like the background loop
+	//between callbacks or another core at any time
+	ReaderCheck reader;
+	render_performance(events, numBlocks, sampleRate, blockSize, 0, true, SHARC_CYCLES_PER_SAMPLE*blockSize,
+			&reader, run);
+	bool readerOk = reader.inconsistent == 0 && reader.reads > 0;
+	failures += !readerOk;
+	printf("reader thread: %ld consistent copies, %ld inconsistent, %ld gave up   %s\n", reader.reads,
+			reader.inconsistent, reader.gaveUp, readerOk ? "ok" : "FAILED");
+
+	//a budget of one cycle: every callback overruns and lands in the last bin.  Every drum is hit
+	//at the start of every block, so each callback renders voices and takes well over one host
+	//tick; a callback with nothing to do can come in under the timer's resolution
+	std::vector<DrumMidiEvent> hits;
+	for(int b=0; b<100; b++){
+		for(int d=0; d<DRUM_NUM_TYPES; d++){
+			hits.push_back(make_event((uint32_t)(b*blockSize), MIDI_NOTE_ON, drumNotes[d]));
+			hits.push_back(make_event((uint32_t)(b*blockSize), MIDI_NOTE_OFF, drumNotes[d]));
+		}
+	}
+	render_performance(hits, 100, sampleRate, blockSize, 0, true, 1, 0, run);
+	bool overrunOk = run.stats.overruns == 100 && run.stats.histogram[DRUM_PROFILE_BINS - 1] == 100;
+	failures += !overrunOk;
+	printf("overruns with a 1 cycle budget: %u of %u, %u in the last bin   %s\n", run.stats.overruns,
+			run.stats.callbacks, run.stats.histogram[DRUM_PROFILE_BINS - 1], overrunOk ? "ok" : "FAILED");
+
+	//processaudio_mips_overflow(), a reader's reset request, and a reader arriving mid-write
+	DrumProfileStats stats, copy;
+	DrumProfiler profiler;
+	profiler.setup(&stats, 1000);
+	for(int b=0; b<10; b++){
+		profiler.beginCallback();
+		profiler.endCallback();
+	}
+	profiler.mipsOverflow(12345, 7);
+	profiler.mipsOverflow(23456, 9);
+	stats.resetRequests = stats.resetRequests + 1;
+	profiler.beginCallback();
+	profiler.endCallback();
+	bool recordOk = stats.mipsOverflows == 2 && stats.overflowWindow == 23456 && stats.overflowVoices == 9 &&
+			stats.callbacks == 1;
+	stats.sequence = stats.sequence + 1;
+	bool midWriteOk = !drum_profile_read(&stats, copy);
+	stats.sequence = stats.sequence + 1;
+	midWriteOk = midWriteOk && drum_profile_read(&stats, copy) && copy.callbacks == 1;
+	failures += !recordOk + !midWriteOk;
+	printf("mips overflow record and reset request: %u overflows, last at %u with %u voices, %u callbacks after "
+			"reset   %s\n", stats.mipsOverflows, stats.overflowWindow, stats.overflowVoices, stats.callbacks,
+			recordOk ? "ok" : "FAILED");
+	printf("read during a write gives up, and succeeds after it   %s\n", midWriteOk ? "ok" : "FAILED");
+
+	delete cache;
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
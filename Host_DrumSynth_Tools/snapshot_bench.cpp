@@ -0,0 +1,289 @@
+/*
+ * snapshot_bench.cpp
+ *
+ * drum_render --snapshot: knob and button targets published from the background loop while the
+ * callback renders, and the panic button as an event (drum_patch_snapshot.h).
+ *
+ *   - races: a "background loop" thread moves the knobs and buttons at random, publishes their
+ *     targets and presses the panic button, while the "callback" thread renders a busy
+ *     performance with the snapshots it acquires.  Every snapshot the callback acquires must
+ *     hold the targets of its own controls (none torn), and the render must match, bit for bit,
+ *     a single threaded replay that sets the same controls and panics on the same blocks without
+ *     snapshots;
+ *   - panic: a block that starts with the panic is silent, with every voice gone;
+ *   - cost: the cycles of a block in which a knob moved, with the targets worked out in the
+ *     callback against taken from a snapshot, and the cycles the background loop spends on a
+ *     snapshot.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include "drum_engine.h"
+#include "drum_patch_snapshot.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//times the cost is measured; the least counts
+#define SNAPSHOT_PASSES		5
+
+//voices held for the cost measurement
+#define SNAPSHOT_VOICES		8
+
+static const DrumMidiEvent allSoundOff = { 0, MIDI_CONTROL_CHANGE, MIDI_ALL_SOUND_OFF, 0 };
+
+//a hit on every other block, on a drum that follows from the block number
+static void perform(DrumEngine &engine, long b) {
+
+	if(b % 2 == 0){
+		uint32_t n = drum_noise_seed((uint32_t)b);
+		engine.noteOn(drumPatches[n % DRUM_NUM_TYPES].note);
+		engine.noteOff(drumPatches[n % DRUM_NUM_TYPES].note);
+	}
+}
+
+static bool same_targets(const DrumPatchSnapshot &a, const DrumPatchSnapshot &b, const DrumEngine &engine) {
+
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		const DrumPatchTargets &x = a.drum[d], &y = b.drum[d];
+		bool stack = drumPatches[d].stack >= 0;
+		int numIncs = stack ? engine.model[d].stack.numOps : 2;
+		int numFlags = stack ? numIncs : 1;
+		bool same = x.freqShift == y.freqShift && x.I_0 == y.I_0;
+		for(int k=0; k<numIncs; k++){
+			same = same && x.inc[k] == y.inc[k];
+		}
+		for(int k=0; k<numFlags; k++){
+			same = same && x.oversample[k] == y.oversample[k];
+		}
+		for(int k=0; k<DRUM_MODAL_MAX_MODES && drumPatches[d].modal >= 0; k++){
+			same = same && x.poleRe[k] == y.poleRe[k] && x.poleIm[k] == y.poleIm[k];
+		}
+		if(!same){
+			return false;
+		}
+	}
+	return true;
+}
+
+//what the callback got on each block
+struct SnapshotBlock {
+	DrumControls controls;
+	bool panic;
+};
+
+struct SnapshotModel {
+	DrumEngine engine;
+	DrumEngine checker;
+	DrumPatchSnapshots snapshots;
+	volatile bool done;
+	long panics;
+};
+
+static void background_thread(SnapshotModel *m, uint32_t seed) {
+
+	uint32_t state = seed;
+	DrumControls c = { 0, 0, 0, 0, 0, 0, DRUM_OVERSAMPLE_AUTO };
+	while(!m->done){
+		state = drum_xorshift(state);
+		switch(state % 8){
+			case 0: c.pot0 = (float)(state >> 8 & 0xff)/255; break;
+			case 1: c.pot1 = (float)(state >> 8 & 0xff)/255; break;
+			case 2: c.pot2 = (float)(state >> 8 & 0xff)/255; break;
+			case 3: c.type = (c.type + 1) % 4; break;
+			case 4: c.type2 = (c.type2 + 1) % 4; break;
+			case 5: c.type3 = (c.type3 + 1) % 4; break;
+			case 6:
+				if((state >> 8) % 4 == 0){
+					m->snapshots.requestPanic();
+					m->panics++;
+				}
+				break;
+			default: std::this_thread::yield(); break;
+		}
+		//a pass of the background loop publishes until the callback lets it
+		while(!m->done && !m->snapshots.publish(m->engine, c)){
+			std::this_thread::yield();
+		}
+	}
+}
+
+//the threaded run: returns the number of torn snapshots
+static long render_threaded(SnapshotModel *m, std::vector<float> &out, std::vector<SnapshotBlock> &blocks,
+		int sampleRate, int blockSize, uint32_t seed) {
+
+	m->engine.setup((float)sampleRate);
+	m->checker.setup((float)sampleRate);
+	m->snapshots.setup();
+	DrumControls start = { 0, 0, 0, 0, 0, 0, DRUM_OVERSAMPLE_AUTO };
+	m->snapshots.publish(m->engine, start);
+	m->done = false;
+	m->panics = 0;
+
+	std::thread background(background_thread, m, seed);
+
+	long torn = 0;
+	DrumPatchSnapshot check;
+	long numBlocks = (long)blocks.size();
+	for(long b=0; b<numBlocks; b++){
+		const DrumPatchSnapshot *s = m->snapshots.acquire();
+		m->checker.workOutTargets(s->controls, check);
+		if(!same_targets(*s, check, m->checker)){
+			torn++;
+		}
+		blocks[b].controls = s->controls;
+		blocks[b].panic = m->snapshots.takePanic();
+
+		m->engine.snapshot = s;
+		if(blocks[b].panic){
+			m->engine.applyEvent(allSoundOff);
+		}
+		perform(m->engine, b);
+		m->engine.render(&out[b*blockSize], blockSize);
+
+		//the rest of the period is the background loop's
+		std::this_thread::yield();
+	}
+	m->done = true;
+	background.join();
+	return torn;
+}
+
+//the same blocks without snapshots or threads
+static void render_replay(const std::vector<SnapshotBlock> &blocks, std::vector<float> &out, int sampleRate,
+		int blockSize) {
+
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	for(long b=0; b<(long)blocks.size(); b++){
+		const DrumControls &c = blocks[b].controls;
+		engine->pot0 = c.pot0;
+		engine->pot1 = c.pot1;
+		engine->pot2 = c.pot2;
+		engine->type = c.type;
+		engine->type2 = c.type2;
+		engine->type3 = c.type3;
+		if(blocks[b].panic){
+			engine->applyEvent(allSoundOff);
+		}
+		perform(*engine, b);
+		engine->render(&out[b*blockSize], blockSize);
+	}
+	delete engine;
+}
+
+//cycles per block with pot0 moving every block, the targets from snapshots or worked out in render()
+static double knob_block_cycles(bool useSnapshots, int sampleRate, int blockSize) {
+
+	DrumEngine *engine = new DrumEngine;
+	DrumPatchSnapshot *snapshots = new DrumPatchSnapshot[2];
+	std::vector<float> out(blockSize);
+	double least = 0;
+	for(int p=0; p<SNAPSHOT_PASSES; p++){
+		engine->setup((float)sampleRate);
+		for(int k=0; k<2; k++){
+			DrumControls c = { 0.25f + 0.5f*k, 0, 0, 1, 2, 3, DRUM_OVERSAMPLE_AUTO };
+			engine->workOutTargets(c, snapshots[k]);
+		}
+		for(int v=0; v<SNAPSHOT_VOICES; v++){
+			engine->noteOn(drumPatches[v % DRUM_NUM_TYPES].note);
+		}
+		uint64_t cycles = 0;
+		int numBlocks = 200;
+		for(int b=0; b<numBlocks; b++){
+			if(useSnapshots){
+				engine->snapshot = &snapshots[b % 2];
+			}
+			else{
+				engine->pot0 = 0.25f + 0.5f*(b % 2);
+				engine->type = 1;
+				engine->type2 = 2;
+				engine->type3 = 3;
+			}
+			uint64_t c0 = bench_cycles();
+			engine->render(out.data(), blockSize);
+			cycles += bench_cycles() - c0;
+		}
+		double perBlock = (double)cycles/numBlocks;
+		if(p == 0 || perBlock < least){
+			least = perBlock;
+		}
+	}
+	delete[] snapshots;
+	delete engine;
+	return least;
+}
+
+int run_snapshot_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 4;
+	}
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	printf("rate %d Hz, block %d, %.1f s per run\n\n", sampleRate, blockSize, seconds);
+	bool ok = true;
+
+	//races: the threaded render against its single threaded replay
+	printf("background thread publishing while the callback renders:\n");
+	SnapshotModel *m = new SnapshotModel;
+	std::vector<float> threaded(numBlocks*blockSize), replay(numBlocks*blockSize);
+	std::vector<SnapshotBlock> blocks(numBlocks);
+	for(int run=0; run<3; run++){
+		long torn = render_threaded(m, threaded, blocks, sampleRate, blockSize, 0x1234567u + run);
+		render_replay(blocks, replay, sampleRate, blockSize);
+		long changes = 0, panics = 0;
+		for(long b=0; b<numBlocks; b++){
+			changes += b > 0 && blocks[b].controls.differs(blocks[b - 1].controls);
+			panics += blocks[b].panic;
+		}
+		bool same = memcmp(threaded.data(), replay.data(), threaded.size()*sizeof(float)) == 0;
+		printf("  run %d: %u published, %ld blocks with new controls, %ld panics requested and %ld taken, "
+				"%ld torn, replay %s   %s\n", run, m->snapshots.swaps, changes, m->panics, panics, torn,
+				same ? "bit-identical" : "DIFFERS", torn == 0 && same ? "ok" : "FAILED");
+		ok = ok && torn == 0 && same;
+	}
+	delete m;
+
+	//panic: a block that starts with it is silent
+	DrumEngine *engine = new DrumEngine;
+	engine->setup((float)sampleRate);
+	std::vector<float> out(blockSize);
+	for(int v=0; v<DRUM_MAX_VOICES; v++){
+		engine->noteOn(drumPatches[v % DRUM_NUM_TYPES].note);
+	}
+	engine->render(out.data(), blockSize);
+	int before = engine->pool.numActive;
+	engine->applyEvent(allSoundOff);
+	engine->render(out.data(), blockSize);
+	bool silent = engine->pool.numActive == 0;
+	for(int i=0; i<blockSize; i++){
+		silent = silent && out[i] == 0;
+	}
+	printf("\npanic: %d voices, then %d and a silent block   %s\n", before, engine->pool.numActive,
+			silent ? "ok" : "FAILED");
+	ok = ok && silent;
+
+	//cost: the targets worked out in the callback or the background loop
+	DrumPatchSnapshot snapshot;
+	DrumControls c = { 0.5f, 0.5f, 0.5f, 1, 2, 3, DRUM_OVERSAMPLE_AUTO };
+	uint64_t least = 0;
+	for(int p=0; p<SNAPSHOT_PASSES*20; p++){
+		c.pot0 = (float)p/(SNAPSHOT_PASSES*20);
+		uint64_t c0 = bench_cycles();
+		engine->workOutTargets(c, snapshot);
+		uint64_t cycles = bench_cycles() - c0;
+		if(p == 0 || cycles < least){
+			least = cycles;
+		}
+	}
+	delete engine;
+	double own = knob_block_cycles(false, sampleRate, blockSize);
+	double taken = knob_block_cycles(true, sampleRate, blockSize);
+	printf("\na block with a knob moving, %d voices: %.0f cycles working the targets out in the callback, "
+			"%.0f from a snapshot\n", SNAPSHOT_VOICES, own, taken);
+	printf("working out a snapshot in the background loop: %llu cycles\n", (unsigned long long)least);
+
+	printf("cycles are host cycles; the budget is %.0f SHARC cycles/sample.\n", SHARC_CYCLES_PER_SAMPLE);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*
+ * spectrum.cpp
+ *
+ * FFT and averaged power spectra for the host checks.  See spectrum.h.
+ */
+
+#include <math.h>
+#include <vector>
+#include "spectrum.h"
+
+void spectrum_fft(std::complex<double> *x, int n) {
+
+	//bit reversal
+	for(int i=1, j=0; i<n; i++){
+		int bit = n >> 1;
+		for(; j & bit; bit >>= 1){
+			j ^= bit;
+		}
+		j ^= bit;
+		if(i < j){
+			std::swap(x[i], x[j]);
+		}
+	}
+
+	for(int len=2; len<=n; len<<=1){
+		double angle = -2*M_PI/len;
+		std::complex<double> step(cos(angle), sin(angle));
+		for(int start=0; start<n; start+=len){
+			std::complex<double> w(1, 0);
+			for(int k=0; k<len/2; k++){
+				std::complex<double> a = x[start + k];
+				std::complex<double> b = x[start + k + len/2]*w;
+				x[start + k] = a + b;
+				x[start + k + len/2] = a - b;
+				w *= step;
+			}
+		}
+	}
+}
+
+void spectrum_dft(std::complex<double> *x, int n) {
+
+	if((n & (n - 1)) == 0){
+		spectrum_fft(x, n);
+		return;
+	}
+
+	int p = 3;
+	while(n % p != 0 && p*p <= n){
+		p += 2;
+	}
+	if(n % p != 0){
+		//prime: direct sum
+		std::vector<std::complex<double> > y(n);
+		for(int k=0; k<n; k++){
+			std::complex<double> sum = 0;
+			for(int i=0; i<n; i++){
+				sum += x[i]*std::polar(1.0, -2*M_PI*(double)((long)i*k % n)/n);
+			}
+			y[k] = sum;
+		}
+		std::copy(y.begin(), y.end(), x);
+		return;
+	}
+
+	//decimation in time: p interleaved DFTs of n/p, then one radix-p butterfly per output
+	int m = n/p;
+	std::vector<std::complex<double> > sub(n), w(n);
+	for(int k=0; k<n; k++){
+		w[k] = std::polar(1.0, -2*M_PI*k/n);
+	}
+	for(int r=0; r<p; r++){
+		for(int i=0; i<m; i++){
+			sub[r*m + i] = x[i*p + r];
+		}
+		spectrum_dft(&sub[r*m], m);
+	}
+	for(int k=0; k<n; k++){
+		std::complex<double> sum = 0;
+		for(int r=0; r<p; r++){
+			sum += sub[r*m + k % m]*w[(long)r*k % n];
+		}
+		x[k] = sum;
+	}
+}
+
+int spectrum_stft(const float *x, long numSamples, int frameSize, int fftSize, std::vector<double> &mag) {
+
+	std::vector<double> window(frameSize);
+	for(int i=0; i<frameSize; i++){
+		window[i] = 0.54 - 0.46*cos(2*M_PI*i/(frameSize - 1));
+	}
+
+	std::vector<std::complex<double> > frame(fftSize);
+	int numFrames = 0;
+	mag.clear();
+	for(long start=0; start + frameSize <= numSamples; start+=frameSize/2){
+		for(int i=0; i<fftSize; i++){
+			frame[i] = i < frameSize ? x[start + i]*window[i] : 0;
+		}
+		spectrum_dft(frame.data(), fftSize);
+		for(int k=0; k<=fftSize/2; k++){
+			mag.push_back(std::abs(frame[k]));
+		}
+		numFrames++;
+	}
+	return numFrames;
+}
+
+int spectrum_welch(const float *x, long numSamples, int frameSize, double *power) {
+
+	std::vector<double> window(frameSize);
+	for(int i=0; i<frameSize; i++){
+		window[i] = 0.5 - 0.5*cos(2*M_PI*i/frameSize);
+	}
+	for(int k=0; k<=frameSize/2; k++){
+		power[k] = 0;
+	}
+
+	std::vector<std::complex<double> > frame(frameSize);
+	int numFrames = 0;
+	for(long start=0; start + frameSize <= numSamples; start+=frameSize/2){
+		for(int i=0; i<frameSize; i++){
+			frame[i] = x[start + i]*window[i];
+		}
+		spectrum_fft(frame.data(), frameSize);
+		for(int k=0; k<=frameSize/2; k++){
+			power[k] += std::norm(frame[k]);
+		}
+		numFrames++;
+	}
+	for(int k=0; k<=frameSize/2 && numFrames > 0; k++){
+		power[k] /= numFrames;
+	}
+	return numFrames;
+}
+
+double spectrum_flatness(const double *power, int first, int last) {
+
+	double logSum = 0, sum = 0;
+	for(int k=first; k<=last; k++){
+		logSum += log(power[k] + 1e-300);
+		sum += power[k];
+	}
+	int n = last - first + 1;
+	return exp(logSum/n)/(sum/n);
+}
@@ -0,0 +1,31 @@
+/*
+ * spectrum.h
+ *
+ * FFT and averaged power spectra for the host checks.
+ */
+
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <complex>
+#include <vector>
+
+//in-place radix-2 FFT; n must be a power of two
+void spectrum_fft(std::complex<double> *x, int n);
+
+//DFT of any size in place: radix-2 for powers of two, otherwise split by the smallest factor
+void spectrum_dft(std::complex<double> *x, int n);
+
+//STFT magnitudes like Matlab's spectrogram(x, hamming(frameSize), frameSize/2, fftSize): frames of
+//frameSize under a symmetric Hamming window, frameSize/2 apart, zero-padded to fftSize.  mag
+//gets fftSize/2 + 1 magnitudes per frame; returns the number of frames
+int spectrum_stft(const float *x, long numSamples, int frameSize, int fftSize, std::vector<double> &mag);
+
+//Welch power spectrum of x[0..numSamples-1]: Hann windowed frames of frameSize (a power of two)
+//overlapping by half, averaged into power[0..frameSize/2].  Returns the number of frames.
+int spectrum_welch(const float *x, long numSamples, int frameSize, double *power);
+
+//geometric over arithmetic mean of power[first..last]: 1 for a flat spectrum, towards 0 for a tonal one
+double spectrum_flatness(const double *power, int first, int last);
+
+#endif /* SPECTRUM_H_ */
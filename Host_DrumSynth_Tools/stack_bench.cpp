@@ -0,0 +1,183 @@
+/*
+ * stack_bench.cpp
+ *
+ * drum_render --stack: the N-operator FM voices of drum_fm_stack.h.  Checks the floor tom, ride
+ * and crash stacks against their operator formulas evaluated in double precision, and times a
+ * voice per number of operators and per stack drum against the SHARC budget.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "drum_fm_stack.h"
+#include "bench_timer.h"
+#include "drum_reference.h"
+#include "host_tools.h"
+
+//lowest acceptable SNR of a stack against its formulas
+#define STACK_MIN_SNR_DB	50.0
+
+//render a whole voice of the stack into out[], in segments like the engine
+static void render_voice(const DrumStackModel &m, bool coarse, float *out, int numSamples) {
+
+	DrumStackVoice s;
+	s.start(m, false);
+	for(int i=0; i<numSamples; i++){
+		out[i] = 0;
+	}
+	int pos = 0;
+	while(pos < numSamples){
+		int n = numSamples - pos < DRUM_LANE_CHUNK ? numSamples - pos : DRUM_LANE_CHUNK;
+		n = s.segment(m, n);
+		drum_stack_render(m, s, coarse, 1, 0, 0, &out[pos], n);
+		s.advance(m, n);
+		pos += n;
+	}
+}
+
+static bool check_drum(int drum, int sampleRate) {
+
+	const DrumPatch &patch = drumPatches[drum];
+	const DrumStackPatch &stack = drumStackPatches[patch.stack];
+	DrumStackModel m;
+	m.setup(stack, (float)sampleRate, patch.r);
+	m.setFrequencies(stack, 1, (float)sampleRate);
+
+	int length = (int)floor(patch.r*sampleRate + 1e-3) + 1;
+	std::vector<float> out(length);
+	render_voice(m, false, out.data(), length);
+
+	double maxErr = 0, noise = 0, signal = 0;
+	for(int i=0; i<length; i++){
+		double ref = drum_reference_stack(stack, patch.r, 1, i/(double)sampleRate);
+		double err = fabs(out[i] - ref);
+		if(err > maxErr){
+			maxErr = err;
+		}
+		noise += err*err;
+		signal += ref*ref;
+	}
+	double snr = 10*log10(signal/noise);
+	bool ok = snr >= STACK_MIN_SNR_DB;
+	printf("%-10s %4d %4d %9d %14.3g %10.1f dB   %s\n", patch.name, stack.numOps, m.numLayers, length,
+			maxErr, snr, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+//cycles per sample of one voice of the stack, rendered a block at a time
+static double time_stack(const DrumStackModel &m, bool coarse, double seconds, int sampleRate, int blockSize,
+		float &checksum) {
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	DrumStackVoice s;
+	s.start(m, false);
+
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		for(int i=0; i<blockSize; i++){
+			block[i] = 0;
+		}
+		int pos = 0;
+		while(pos < blockSize){
+			int n = s.segment(m, blockSize - pos);
+			drum_stack_render(m, s, coarse, 1, 0, 0, &block[pos], n);
+			s.advance(m, n);
+			pos += n;
+		}
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+//numOps operators: modulator and carrier pairs, or numOps carriers side by side
+static DrumStackPatch synthetic_stack(int numOps, bool pairs) {
+
+	DrumStackPatch p;
+	p.numOps = numOps;
+	p.noiseOp = 0;
+	int numMods = pairs ? numOps/2 : 0;
+	for(int k=0; k<numOps; k++){
+		DrumStackOp &op = p.op[k];
+		bool mod = k < numMods;
+		op.src = !mod && k - numMods < numMods ? k - numMods : -1;
+		op.freq = 100.0f + 37*k;
+		op.gain = mod ? 0 : 1;
+		op.shape = DRUM_STACK_EXP;
+		op.level = mod ? 5 : 1;
+		op.time = 0;
+		op.tau = 1000;
+		op.r = 0;
+	}
+	return p;
+}
+
+//cycles per sample of the engine with the drum's note held
+static double time_engine(int drum, double seconds, int sampleRate, int blockSize, float &checksum) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+	engine.noteOn(drumPatches[drum].note);
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+	}
+	uint64_t c1 = bench_cycles();
+	return (c1 - c0)/((double)numBlocks*blockSize);
+}
+
+int run_stack_bench(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 2;
+	}
+
+	drum_fm_init();
+
+	printf("rate %d Hz, block %d, %.1f s per case\n\n", sampleRate, blockSize, seconds);
+
+	printf("against the operator formulas in double precision (SNR at least %.0f dB):\n", STACK_MIN_SNR_DB);
+	printf("%-10s %4s %4s %9s %14s %13s\n", "drum", "ops", "lay", "samples", "max abs err", "SNR");
+	bool ok = true;
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		if(drumPatches[d].stack >= 0){
+			ok = check_drum(d, sampleRate) && ok;
+		}
+	}
+
+	float checksum = 0;
+	printf("\ncycles/sample of one voice by number of operators:\n");
+	printf("%4s %14s %10s %14s %10s %14s\n", "ops", "carriers", "per op", "mod+carrier", "per op", "coarse pairs");
+	for(int n=1; n<=DRUM_STACK_MAX_OPS; n++){
+		DrumStackPatch parallel = synthetic_stack(n, false);
+		DrumStackPatch pairs = synthetic_stack(n, true);
+		DrumStackModel pm, qm;
+		pm.setup(parallel, (float)sampleRate, 1000);
+		pm.setFrequencies(parallel, 1, (float)sampleRate);
+		qm.setup(pairs, (float)sampleRate, 1000);
+		qm.setFrequencies(pairs, 1, (float)sampleRate);
+
+		double p = time_stack(pm, false, seconds, sampleRate, blockSize, checksum);
+		double q = time_stack(qm, false, seconds, sampleRate, blockSize, checksum);
+		double c = time_stack(qm, true, seconds, sampleRate, blockSize, checksum);
+		printf("%4d %14.1f %10.1f %14.1f %10.1f %14.1f\n", n, p, p/n, q, q/n, c);
+	}
+
+	printf("\none held voice through the engine, cycles/sample:\n");
+	printf("%-10s %4s %14s %10s\n", "drum", "ops", "cycles/sample", "of budget");
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		int ops = drumPatches[d].stack >= 0 ? drumStackPatches[drumPatches[d].stack].numOps : 2;
+		double c = time_engine(d, seconds, sampleRate, blockSize, checksum);
+		printf("%-10s %4d %14.1f %9.2f%%\n", drumPatches[d].name, ops, c, 100*c/SHARC_CYCLES_PER_SAMPLE);
+	}
+	printf("(checksum %g)\n", checksum);
+
+	printf("\ncycles/sample are host cycles; the budget is %.0f SHARC cycles/sample.\n", SHARC_CYCLES_PER_SAMPLE);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+/*
+ * sweep_bench.cpp
+ *
+ * drum_render --sweep: block size against sample rate, what each costs and how late a hit
+ * sounds.
+ *
+ * Every rate from 44.1 to 96 kHz with every block size from 8 to 256 samples, all through the
+ * firmware's MIDI input and the callback's renderQueued() as in --play:
+ *
+ *   - the drums: the length and pitch of every drum at each rate against 48 kHz, which must
+ *     agree to within a sample and a hundredth of a Hz;
+ *   - throughput: a steady groove played through each configuration, its cycles per sample
+ *     against the SHARC budget at that rate, and the cycles per block of an idle engine.  A
+ *     straight line a + b*blockSize through the groove's cycles per block at each rate gives the
+ *     per-block overhead a and the cost of a sample b;
+ *   - latency: single hits at arrival times spread over two blocks, from the start of the note
+ *     on's first byte to the first sample of the hit leaving the codec: the wire time of the
+ *     message, the one block the queue holds it for, and the block the output DMA holds it for
+ *     (AUDIO_OUTPUT_BLOCKS).  The queue's part must be the same for every arrival time, one
+ *     block: no jitter.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <builtins.h>
+#include "drivers/bm_uart_driver/bm_uart.h"
+#include "callback_midi_message.h"
+#include "drum_engine.h"
+#include "drum_midi_queue.h"
+#include "midi_file.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//the firmware's queue, clock and UART, defined in midi_parser_bench.cpp and callback_midi_message.cpp
+extern DrumMidiQueue midiQueue;
+extern DrumMidiClock midiClock;
+extern uint32_t mock_emuclk_cycles;
+extern BM_UART midi_uart_sharc1;
+
+static const int sweepRates[] = { 44100, 48000, 88200, 96000 };
+static const int sweepBlocks[] = { 8, 16, 32, 64, 128, 256 };
+#define SWEEP_NUM_RATES		(int)(sizeof(sweepRates)/sizeof(sweepRates[0]))
+#define SWEEP_NUM_BLOCKS	(int)(sizeof(sweepBlocks)/sizeof(sweepBlocks[0]))
+
+//how long the groove lasts when -t is not given, and the times it is played (the least counts)
+#define SWEEP_SECONDS		4.0
+#define SWEEP_PASSES		5
+
+//blocks the output DMA holds a rendered block for before the codec plays it
+#define AUDIO_OUTPUT_BLOCKS	1
+
+//arrival times tried per block for the latency
+#define SWEEP_PHASES		16
+
+//the SHARC cycle counter at a time in seconds
+static uint32_t cycles_at(double seconds) {
+
+	return (uint32_t)(uint64_t)(seconds*SHARC_CORE_CLOCK_HZ);
+}
+
+//a groove at 120 bpm: kick and hihat on the 8ths, snare on 2 and 4, a tom fill and a crash
+//every other bar, the ride on the 16ths of every other bar
+static void groove(double seconds, std::vector<MidiWireByte> &bytes) {
+
+	double step = 60.0/120/4;
+	std::vector<MidiWireByte> timeline;
+	for(int s=0; s*step<seconds; s++){
+		double t = s*step;
+		int beatStep = s % 16;
+		int bar = s/16;
+		int hits[4];
+		int numHits = 0;
+		if(beatStep % 2 == 0){
+			hits[numHits++] = beatStep % 8 == 4 ? DRUM_SNARE : DRUM_KICK;
+			hits[numHits++] = DRUM_HIHAT;
+		}
+		if(bar % 2 == 1){
+			hits[numHits++] = beatStep >= 12 ? (beatStep % 2 ? DRUM_MIDTOM : DRUM_HIGHTOM) : DRUM_RIDE;
+		}
+		if(bar % 2 == 0 && beatStep == 0){
+			hits[numHits++] = bar % 4 == 0 ? DRUM_CRASH : DRUM_FLOORTOM;
+		}
+		for(int h=0; h<numHits; h++){
+			MidiWireByte on[3] = { { t, 0x99 }, { t, (uint8_t)drumPatches[hits[h]].note }, { t, 100 } };
+			MidiWireByte off[3] = { { t + step/2, 0x89 }, { t + step/2, (uint8_t)drumPatches[hits[h]].note },
+					{ t + step/2, 0 } };
+			timeline.insert(timeline.end(), on, on + 3);
+			timeline.insert(timeline.end(), off, off + 3);
+		}
+	}
+	std::stable_sort(timeline.begin(), timeline.end(),
+			[](const MidiWireByte &a, const MidiWireByte &b) { return a.time < b.time; });
+	bytes = timeline;
+	midi_wire_serialize(bytes);
+}
+
+//the engine, queue, clock and UART back at the start
+static void start_firmware(DrumEngine &engine, int sampleRate) {
+
+	engine.setup((float)sampleRate);
+	midi_setup_sharc1();
+	midiQueue.reset();
+	midiClock.setup((float)sampleRate);
+	mock_emuclk_cycles = 0;
+}
+
+//processaudio_callback() for block b: the bytes that arrived by then, a new period, the last
+//period's events; returns the cycles of the render
+static double callback(DrumEngine &engine, const std::vector<MidiWireByte> &bytes, size_t &next, long b,
+		int sampleRate, int blockSize, float *out) {
+
+	double callbackTime = (double)(b + 1)*blockSize/sampleRate;
+	while(next < bytes.size() && bytes[next].time < callbackTime){
+		mock_emuclk_cycles = cycles_at(bytes[next].time);
+		mock_uart_receive(&midi_uart_sharc1, &bytes[next].byte, 1);
+		next++;
+	}
+	mock_emuclk_cycles = cycles_at(callbackTime);
+	uint64_t c0 = bench_cycles();
+	uint32_t window = midiClock.periodStart();
+	midiClock.startPeriod(window + blockSize, emuclk());
+	engine.renderQueued(midiQueue, window, out, blockSize);
+	return (double)(bench_cycles() - c0);
+}
+
+//mean cycles per block of a performance; the performance plays the same every pass, so each
+//block's least cost over the passes is its cost without the host's interruptions
+static double mean_block_cycles(const std::vector<MidiWireByte> &bytes, long numBlocks, int sampleRate,
+		int blockSize) {
+
+	static DrumEngine engine;
+	std::vector<float> block(blockSize);
+	std::vector<double> least(numBlocks);
+	for(int p=0; p<SWEEP_PASSES; p++){
+		size_t next = 0;
+		start_firmware(engine, sampleRate);
+		for(long b=0; b<numBlocks; b++){
+			double c = callback(engine, bytes, next, b, sampleRate, blockSize, block.data());
+			if(p == 0 || c < least[b]){
+				least[b] = c;
+			}
+		}
+	}
+	double total = 0;
+	for(long b=0; b<numBlocks; b++){
+		total += least[b];
+	}
+	return total/numBlocks;
+}
+
+//cycles per block of the groove and of an idle engine
+static void throughput(const std::vector<MidiWireByte> &bytes, double seconds, int sampleRate, int blockSize,
+		double &grooveCycles, double &idleCycles) {
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	if(numBlocks < 1){
+		numBlocks = 1;
+	}
+	std::vector<MidiWireByte> none;
+	grooveCycles = mean_block_cycles(bytes, numBlocks, sampleRate, blockSize);
+	idleCycles = mean_block_cycles(none, numBlocks, sampleRate, blockSize);
+}
+
+//samples from a hit's arrival (the last byte of its note on) until its first nonzero sample is
+//rendered, for arrivals spread over two blocks: least and most
+static void queue_delay(int sampleRate, int blockSize, double &least, double &most) {
+
+	static DrumEngine engine;
+	std::vector<float> block(blockSize);
+	least = 1e30;
+	most = 0;
+
+	//the message starts after the first block, whatever the block size
+	int startBlock = (int)(3*MIDI_WIRE_BYTE_SECONDS*sampleRate/blockSize) + 1;
+	for(int k=0; k<2*SWEEP_PHASES; k++){
+		//a note on whose last byte lands k/SWEEP_PHASES of a block into startBlock
+		double arrival = (startBlock + (double)k/SWEEP_PHASES)*blockSize/sampleRate;
+		uint8_t message[3] = { 0x99, (uint8_t)drumPatches[DRUM_SNARE].note, 127 };
+		std::vector<MidiWireByte> bytes;
+		for(int i=0; i<3; i++){
+			MidiWireByte w = { arrival - (2 - i)*MIDI_WIRE_BYTE_SECONDS, message[i] };
+			bytes.push_back(w);
+		}
+
+		start_firmware(engine, sampleRate);
+		size_t next = 0;
+		long first = -1;
+		for(long b=0; first<0 && b<startBlock+4; b++){
+			callback(engine, bytes, next, b, sampleRate, blockSize, block.data());
+			for(int i=0; i<blockSize; i++){
+				if(block[i] != 0){
+					first = b*blockSize + i;
+					break;
+				}
+			}
+		}
+		//the callback renders block b at the end of sample period b, so sample n is rendered when
+		//the sample clock is at n + blockSize
+		double delay = first < 0 ? 1e30 : first + blockSize - arrival*sampleRate;
+		least = delay < least ? delay : least;
+		most = delay > most ? delay : most;
+	}
+}
+
+int run_sweep_bench(double seconds) {
+
+	if(seconds <= 0){
+		seconds = SWEEP_SECONDS;
+	}
+	bool ok = true;
+
+	//the drums: the same length and pitch at every rate
+	printf("drum length (ms) and pitch (Hz) at each rate\n");
+	printf("%-10s", "drum");
+	for(int r=0; r<SWEEP_NUM_RATES; r++){
+		printf("  %18d", sweepRates[r]);
+	}
+	printf("\n");
+	static DrumEngine engines[SWEEP_NUM_RATES];
+	int reference = 1;		//48 kHz
+	for(int r=0; r<SWEEP_NUM_RATES; r++){
+		engines[r].setup((float)sweepRates[r]);
+	}
+	for(int d=0; d<DRUM_NUM_TYPES; d++){
+		double refLength = (double)engines[reference].drumLength[d]/sweepRates[reference];
+		double refPitch = 0;
+		bool same = true;
+		printf("%-10s", drumPatches[d].name);
+		for(int r=0; r<SWEEP_NUM_RATES; r++){
+			const DrumModel &m = engines[r].model[d];
+			uint32_t inc = drumPatches[d].stack < 0 ? m.op.carrierInc : m.stack.inc[0];
+			double length = (double)engines[r].drumLength[d]/sweepRates[r];
+			double pitch = inc*(double)sweepRates[r]/4294967296.0;
+			if(r == reference){
+				refPitch = pitch;
+			}
+			printf("  %8.2f %9.2f", 1000*length, pitch);
+			same = same && fabs(length - refLength) <= 1.0/sweepRates[r] + 1.0/sweepRates[reference];
+		}
+		for(int r=0; r<SWEEP_NUM_RATES; r++){
+			const DrumModel &m = engines[r].model[d];
+			uint32_t inc = drumPatches[d].stack < 0 ? m.op.carrierInc : m.stack.inc[0];
+			same = same && fabs(inc*(double)sweepRates[r]/4294967296.0 - refPitch) <= 0.01;
+		}
+		printf("   %s\n", same ? "ok" : "CHANGES");
+		ok = ok && same;
+	}
+
+	//throughput, and the per-block overhead from a line through each rate's cycles per block
+	std::vector<MidiWireByte> bytes;
+	groove(seconds, bytes);
+	printf("\n%.1f s groove (%d bytes), best of %d passes; cycles per sample, %% of the SHARC budget, idle\n"
+			"cycles per block\n", seconds, (int)bytes.size(), SWEEP_PASSES);
+	printf("%-6s", "block");
+	for(int r=0; r<SWEEP_NUM_RATES; r++){
+		printf("  %24d", sweepRates[r]);
+	}
+	printf("\n");
+	double grooveCycles[SWEEP_NUM_RATES][SWEEP_NUM_BLOCKS];
+	double idleCycles[SWEEP_NUM_RATES][SWEEP_NUM_BLOCKS];
+	for(int bs=0; bs<SWEEP_NUM_BLOCKS; bs++){
+		int blockSize = sweepBlocks[bs];
+		printf("%-6d", blockSize);
+		for(int r=0; r<SWEEP_NUM_RATES; r++){
+			throughput(bytes, seconds, sweepRates[r], blockSize, grooveCycles[r][bs], idleCycles[r][bs]);
+			double perSample = grooveCycles[r][bs]/blockSize;
+			printf("  %8.0f %6.2f%% %7.0f", perSample, 100*perSample/(SHARC_CORE_CLOCK_HZ/sweepRates[r]),
+					idleCycles[r][bs]);
+		}
+		printf("\n");
+	}
+	printf("%-6s", "fit");
+	bool forced = false;
+	for(int r=0; r<SWEEP_NUM_RATES; r++){
+		//least squares a + b*blockSize, with a >= 0: a negative overhead only means it is lost in the
+		//host's noise, and the line then goes through 0
+		double sx = 0, sy = 0, sxx = 0, sxy = 0;
+		for(int bs=0; bs<SWEEP_NUM_BLOCKS; bs++){
+			double x = sweepBlocks[bs], y = grooveCycles[r][bs];
+			sx += x;
+			sy += y;
+			sxx += x*x;
+			sxy += x*y;
+		}
+		double n = SWEEP_NUM_BLOCKS;
+		double b = (n*sxy - sx*sy)/(n*sxx - sx*sx);
+		double a = (sy - b*sx)/n;
+		bool negative = a < 0;
+		if(negative){
+			a = 0;
+			b = sxy/sxx;
+			forced = true;
+		}
+		printf("  %7.0f/block%c%5.0f/sample", a, negative ? '*' : ' ', b);
+	}
+	printf("\n");
+	if(forced){
+		printf("* the overhead came out below 0, lost in the host's noise; the line is fitted through 0\n");
+	}
+
+	//latency: wire, queue, output buffer
+	double wireMs = 3000*MIDI_WIRE_BYTE_SECONDS;
+	printf("\nnote on to sound, worst case in ms (wire %.2f + queue + output); queue delay in samples\n", wireMs);
+	printf("%-6s", "block");
+	for(int r=0; r<SWEEP_NUM_RATES; r++){
+		printf("  %18d", sweepRates[r]);
+	}
+	printf("\n");
+	for(int bs=0; bs<SWEEP_NUM_BLOCKS; bs++){
+		int blockSize = sweepBlocks[bs];
+		printf("%-6d", blockSize);
+		bool steady = true;
+		for(int r=0; r<SWEEP_NUM_RATES; r++){
+			double least, most;
+			queue_delay(sweepRates[r], blockSize, least, most);
+			double worst = wireMs + 1000.0*(most + AUDIO_OUTPUT_BLOCKS*blockSize)/sweepRates[r];
+			printf("  %7.2f %5.1f..%-5.1f", worst, least, most);
+			//one block, give or take the rounding of the timestamp to a sample, plus the first sample
+			//of the snare's attack, which is 0
+			steady = steady && most - least <= 1 + 1e-6 && least >= blockSize + 0.5 - 1e-6 &&
+					most <= blockSize + 1.5 + 1e-6;
+		}
+		printf("   %s\n", steady ? "ok" : "JITTER");
+		ok = ok && steady;
+	}
+
+	printf("\nper-block overhead and cycles per sample are host cycles; the budget is %.0f SHARC cycles/s\n",
+			SHARC_CORE_CLOCK_HZ);
+	printf("%s\n", ok ? "every rate and block size plays the same drums on time" : "FAILED");
+	return ok ? 0 : 1;
+}
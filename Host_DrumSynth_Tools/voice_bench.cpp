@@ -0,0 +1,179 @@
+/*
+ * voice_bench.cpp
+ *
+ * drum_render --stress: checks that voices from the DrumVoicePool are independent (a flam
+ * sounds exactly like two single hits added together) and measures the engine with 16 to
+ * DRUM_MAX_VOICES voices sounding at once. Fails when voices are not independent.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "drum_engine.h"
+#include "bench_timer.h"
+#include "host_tools.h"
+
+//largest |together - sum of singles|; the two only differ by the order the voices are summed in
+#define VOICE_CHECK_MAX_ERR	1e-5
+
+//render one hit of each note at its start sample (block aligned), released straight away
+static void render_hits(const int *notes, const long *starts, int numHits, float *out, long numSamples,
+		int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+
+	for(long pos=0; pos<numSamples; pos+=blockSize){
+		for(int h=0; h<numHits; h++){
+			if(starts[h] == pos){
+				engine.noteOn(notes[h]);
+				engine.noteOff(notes[h]);
+			}
+		}
+		engine.render(&out[pos], blockSize);
+	}
+}
+
+//largest difference between rendering hits together and summing them rendered one at a time
+static double independence_error(const int *notes, const long *starts, int numHits, int sampleRate, int blockSize) {
+
+	long numSamples = sampleRate - sampleRate % blockSize;
+	std::vector<float> together(numSamples), single(numSamples), sum(numSamples, 0.0f);
+
+	render_hits(notes, starts, numHits, together.data(), numSamples, sampleRate, blockSize);
+	for(int h=0; h<numHits; h++){
+		render_hits(&notes[h], &starts[h], 1, single.data(), numSamples, sampleRate, blockSize);
+		for(long i=0; i<numSamples; i++){
+			sum[i] += single[i];
+		}
+	}
+
+	double maxErr = 0;
+	for(long i=0; i<numSamples; i++){
+		double err = fabs(together[i] - sum[i]);
+		if(err > maxErr){
+			maxErr = err;
+		}
+	}
+	return maxErr;
+}
+
+//print one independence row, true if it is within VOICE_CHECK_MAX_ERR
+static bool check_independence(const char *name, const int *notes, const long *starts, int numHits,
+		int sampleRate, int blockSize) {
+
+	double err = independence_error(notes, starts, numHits, sampleRate, blockSize);
+	bool ok = err <= VOICE_CHECK_MAX_ERR;
+	printf("  %-17s %-12g %s\n", name, err, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+//hold numVoices voices (drums in turn, one new hit per block) and time the steady state
+static void stress(int numVoices, double seconds, int sampleRate, int blockSize) {
+
+	const int *notes = drum_notes();
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+
+	std::vector<float> block(blockSize);
+	for(int v=0; v<numVoices; v++){
+		engine.noteOn(notes[v % DRUM_NUM_TYPES]);
+		engine.render(block.data(), blockSize);
+	}
+
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	long minActive = numVoices, maxActive = 0;
+	float checksum = 0;
+
+	uint64_t c0 = bench_cycles();
+	double t0 = bench_seconds();
+	for(long b=0; b<numBlocks; b++){
+		engine.render(block.data(), blockSize);
+		checksum += block[0];
+		if(engine.pool.numActive < minActive){
+			minActive = engine.pool.numActive;
+		}
+		if(engine.pool.numActive > maxActive){
+			maxActive = engine.pool.numActive;
+		}
+	}
+	double t1 = bench_seconds();
+	uint64_t c1 = bench_cycles();
+
+	double samples = (double)numBlocks*blockSize;
+	double cyclesPerSample = (c1 - c0)/samples;
+	printf("%6d %7ld-%-3ld %10.1f %14.1f %15.1f %9.2f%%   (checksum %g)\n", numVoices, minActive, maxActive,
+			(t1 - t0)*1e9/samples, cyclesPerSample, cyclesPerSample/numVoices,
+			100.0*cyclesPerSample/SHARC_CYCLES_PER_SAMPLE, checksum);
+}
+
+//snare and hihat rolls: a new hit on each every `interval` samples, released straight away
+static void roll(int interval, double seconds, int sampleRate, int blockSize) {
+
+	DrumEngine engine;
+	engine.setup((float)sampleRate);
+
+	std::vector<float> block(blockSize);
+	long numBlocks = (long)(seconds*sampleRate)/blockSize;
+	double activeSum = 0;
+	long hits = 0;
+
+	uint64_t c0 = bench_cycles();
+	for(long b=0; b<numBlocks; b++){
+		long pos = b*blockSize;
+		if(pos % interval < blockSize){
+			engine.noteOn(DRUM_NOTE_SNARE);
+			engine.noteOff(DRUM_NOTE_SNARE);
+			engine.noteOn(DRUM_NOTE_HIHAT);
+			engine.noteOff(DRUM_NOTE_HIHAT);
+			hits += 2;
+		}
+		engine.render(block.data(), blockSize);
+		activeSum += engine.pool.numActive;
+	}
+	uint64_t c1 = bench_cycles();
+
+	double samples = (double)numBlocks*blockSize;
+	printf("roll every %.1f ms: %ld hits, %.1f voices on average, %.1f cycles/sample\n",
+			interval*1000.0/sampleRate, hits, activeSum/numBlocks, (c1 - c0)/samples);
+}
+
+int run_voice_stress(double seconds, int sampleRate, int blockSize) {
+
+	if(seconds <= 0){
+		seconds = 5;
+	}
+
+	printf("voice pool: %d voices\n\n", DRUM_MAX_VOICES);
+
+	//flams: the same drum retriggered a few blocks later must not disturb the first hit
+	long flamStart[] = { 0, 5*(long)blockSize };
+	int kicks[] = { DRUM_NOTE_KICK, DRUM_NOTE_KICK };
+	int toms[] = { DRUM_NOTE_MIDTOM, DRUM_NOTE_HIGHTOM };
+	long rollStart[8];
+	int rollNotes[8];
+	for(int h=0; h<8; h++){
+		rollStart[h] = 2*h*(long)blockSize;
+		rollNotes[h] = DRUM_NOTE_HIGHTOM;
+	}
+	printf("independence (max |together - sum of singles|):\n");
+	int failures = 0;
+	failures += !check_independence("kick flam:", kicks, flamStart, 2, sampleRate, blockSize);
+	failures += !check_independence("midtom + hightom:", toms, flamStart, 2, sampleRate, blockSize);
+	failures += !check_independence("8 hit tom roll:", rollNotes, rollStart, 8, sampleRate, blockSize);
+	printf("\n");
+
+	printf("%6s %11s %10s %14s %15s %10s\n", "voices", "active", "ns/sample", "cycles/sample", "cycles/voice", "of budget");
+	for(int n=16; n<=DRUM_MAX_VOICES; n+=8){
+		stress(n, seconds, sampleRate, blockSize);
+	}
+	printf("\n");
+	roll(sampleRate/50, seconds, sampleRate, blockSize);
+	roll(sampleRate/100, seconds, sampleRate, blockSize);
+	if(failures){
+		printf("\n%d checks FAILED\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * wav_file.cpp
+ *
+ * Minimal RIFF/WAVE writer and reader for the host tools.  See wav_file.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "wav_file.h"
+
+static void put_u32(FILE *f, uint32_t v) {
+
+	uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	fwrite(b, 1, 4, f);
+}
+
+static void put_u16(FILE *f, uint16_t v) {
+
+	uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+	fwrite(b, 1, 2, f);
+}
+
+bool wav_write_float(const char *path, const float *samples, int numSamples, int sampleRate) {
+
+	FILE *f = fopen(path, "wb");
+	if(f == NULL){
+		return false;
+	}
+
+	uint32_t dataBytes = (uint32_t)numSamples*4;
+
+	fwrite("RIFF", 1, 4, f);
+	put_u32(f, 36 + dataBytes);
+	fwrite("WAVE", 1, 4, f);
+
+	fwrite("fmt ", 1, 4, f);
+	put_u32(f, 16);
+	put_u16(f, 3);				//IEEE float
+	put_u16(f, 1);				//mono
+	put_u32(f, sampleRate);
+	put_u32(f, sampleRate*4);	//byte rate
+	put_u16(f, 4);				//block align
+	put_u16(f, 32);				//bits per sample
+
+	fwrite("data", 1, 4, f);
+	put_u32(f, dataBytes);
+
+	//samples are written little endian, as on every host we build for
+	bool ok = fwrite(samples, 4, numSamples, f) == (size_t)numSamples;
+
+	return (fclose(f) == 0) && ok;
+}
+
+static uint32_t get_u32(const uint8_t *b) {
+
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *b) {
+
+	return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+bool WavReader::open(const char *path) {
+
+	file = fopen(path, "rb");
+	if(file == NULL){
+		return false;
+	}
+
+	uint8_t header[12];
+	if(fread(header, 1, 12, file) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0){
+		close();
+		return false;
+	}
+
+	//walk the chunks up to the samples; fmt comes first
+	bool haveFormat = false;
+	for(;;){
+		uint8_t chunk[8];
+		if(fread(chunk, 1, 8, file) != 8){
+			close();
+			return false;
+		}
+		uint32_t size = get_u32(chunk + 4);
+
+		if(memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && size <= 64){
+			uint8_t fmt[64];
+			if(fread(fmt, 1, size, file) != size){
+				close();
+				return false;
+			}
+			int tag = get_u16(fmt);
+			if(tag == 0xfffe && size >= 26){
+				tag = get_u16(fmt + 24);	//WAVE_FORMAT_EXTENSIBLE: the subformat GUID starts with the tag
+			}
+			channels = get_u16(fmt + 2);
+			sampleRate = (int)get_u32(fmt + 4);
+			bytesPerSample = get_u16(fmt + 14)/8;
+			isFloat = tag == 3;
+			haveFormat = (tag == 1 && bytesPerSample >= 2 && bytesPerSample <= 4)
+					|| (tag == 3 && bytesPerSample == 4);
+			if(!haveFormat || channels < 1){
+				close();
+				return false;
+			}
+			if(size & 1){
+				fseek(file, 1, SEEK_CUR);
+			}
+		}
+		else if(memcmp(chunk, "data", 4) == 0 && haveFormat){
+			numFrames = size/(channels*bytesPerSample);
+			framesLeft = numFrames;
+			return true;
+		}
+		else if(fseek(file, size + (size & 1), SEEK_CUR) != 0){
+			close();
+			return false;
+		}
+	}
+}
+
+int WavReader::read(float *out, int maxFrames) {
+
+	uint8_t buffer[4096];
+	int frameBytes = channels*bytesPerSample;
+	int maxPerRead = (int)sizeof(buffer)/frameBytes;
+
+	int done = 0;
+	while(done < maxFrames && framesLeft > 0){
+		int n = maxFrames - done;
+		if(n > maxPerRead){
+			n = maxPerRead;
+		}
+		if(n > framesLeft){
+			n = (int)framesLeft;
+		}
+		n = (int)fread(buffer, frameBytes, n, file);
+		if(n <= 0){
+			framesLeft = 0;
+			break;
+		}
+
+		for(int f=0; f<n; f++){
+			const uint8_t *b = &buffer[f*frameBytes];
+			float sum = 0;
+			for(int c=0; c<channels; c++, b+=bytesPerSample){
+				if(isFloat){
+					uint32_t u = get_u32(b);
+					float x;
+					memcpy(&x, &u, 4);
+					sum += x;
+				}
+				else if(bytesPerSample == 2){
+					sum += (int16_t)get_u16(b)*(1.0f/32768);
+				}
+				else if(bytesPerSample == 3){
+					sum += (int32_t)((b[0] << 8) | (b[1] << 16) | ((uint32_t)b[2] << 24))*(1.0f/2147483648.0f);
+				}
+				else{
+					sum += (int32_t)get_u32(b)*(1.0f/2147483648.0f);
+				}
+			}
+			out[done + f] = sum/channels;
+		}
+		done += n;
+		framesLeft -= n;
+	}
+	return done;
+}
+
+void WavReader::close() {
+
+	if(file != NULL){
+		fclose(file);
+		file = NULL;
+	}
+}
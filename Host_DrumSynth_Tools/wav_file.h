@@ -0,0 +1,37 @@
+/*
+ * wav_file.h
+ *
+ * Minimal RIFF/WAVE writer and reader for the host tools.  Output is 32-bit float mono, the
+ * same sample format as the reference recordings in Matlab_DrumSound_Analysis.  The reader
+ * streams a recording a block at a time, so even the 10 s ride is never held in memory whole.
+ */
+
+#ifndef WAV_FILE_H_
+#define WAV_FILE_H_
+
+#include <stdio.h>
+
+//write numSamples mono float samples; returns false if the file could not be written
+bool wav_write_float(const char *path, const float *samples, int numSamples, int sampleRate);
+
+//16/24/32 bit PCM or 32 bit float, any number of channels, read as mono: the channels are
+//averaged like the Matlab scripts do with 0.5*(x(:,1) + x(:,2))
+struct WavReader {
+	FILE *file;
+	int sampleRate;
+	int channels;
+	int bytesPerSample;
+	bool isFloat;
+	long numFrames;
+	long framesLeft;
+
+	//false if the file is missing or not a WAV the reader understands
+	bool open(const char *path);
+
+	//up to maxFrames mono samples into out[]; returns the number read, 0 at the end
+	int read(float *out, int maxFrames);
+
+	void close();
+};
+
+#endif /* WAV_FILE_H_ */